@@ -0,0 +1,392 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+// Microbenchmarks of VM subsystems, run outside of any image code. Each
+// benchmark is repeated and the fastest repetition is reported, one JSON
+// object per line, so results can be diffed and tracked across revisions.
+
+#include "vm/globals.h"
+#if !defined(OS_EMSCRIPTEN)
+
+#include <string.h>
+
+#include "vm/heap.h"
+#include "vm/interpreter.h"
+#include "vm/isolate.h"
+#include "vm/lockers.h"
+#include "vm/lookup_cache.h"
+#include "vm/message_loop.h"
+#include "vm/object.h"
+#include "vm/os.h"
+#include "vm/port.h"
+#include "vm/primordial_soup.h"
+#include "vm/snapshot.h"
+#include "vm/thread.h"
+#include "vm/virtual_memory.h"
+
+namespace psoup {
+
+static const intptr_t kRepetitions = 5;
+
+struct Benchmark {
+  const char* name;
+  intptr_t iterations;
+  // Answers the nanoseconds spent in the measured part of 'iterations' runs.
+  int64_t (*run)(Isolate* isolate, intptr_t iterations);
+};
+
+static void* snapshot_ = NULL;
+static size_t snapshot_length_ = 0;
+
+// Results are folded into here so the measured loops are not elided.
+static volatile uword sink_ = 0;
+
+
+static int64_t AllocateArrays(Isolate* isolate, intptr_t iterations) {
+  Heap* H = isolate->heap();
+  int64_t start = OS::CurrentMonotonicNanos();
+  for (intptr_t i = 0; i < iterations; i++) {
+    Array array = H->AllocateArray(4);
+    for (intptr_t j = 0; j < 4; j++) {
+      array->set_element(j, SmallInteger::New(j), kNoBarrier);
+    }
+  }
+  return OS::CurrentMonotonicNanos() - start;
+}
+
+
+static int64_t AllocateByteArrays(Isolate* isolate, intptr_t iterations) {
+  Heap* H = isolate->heap();
+  int64_t start = OS::CurrentMonotonicNanos();
+  for (intptr_t i = 0; i < iterations; i++) {
+    H->AllocateByteArray(64);
+  }
+  return OS::CurrentMonotonicNanos() - start;
+}
+
+
+// A list of two-slot Arrays, built in new space or pretenured.
+static Object BuildList(Heap* H, intptr_t length, Heap::Allocator allocator) {
+  Object list = H->interpreter()->nil_obj();
+  HandleScope h1(H, &list);
+  for (intptr_t i = 0; i < length; i++) {
+    Array node = H->AllocateArray(2, allocator);  // SAFEPOINT
+    node->set_element(0, list);
+    node->set_element(1, SmallInteger::New(i));
+    list = node;
+  }
+  return list;
+}
+
+
+static const intptr_t kYoungListLength = 10000;
+
+static int64_t ScavengeYoungList(Isolate* isolate, intptr_t iterations) {
+  Heap* H = isolate->heap();
+  int64_t elapsed = 0;
+  for (intptr_t i = 0; i < iterations; i++) {
+    H->CollectNew(Heap::kPrimitive);
+    Object list = BuildList(H, kYoungListLength, Heap::kNormal);
+    HandleScope h1(H, &list);
+    int64_t start = OS::CurrentMonotonicNanos();
+    H->CollectNew(Heap::kPrimitive);
+    elapsed += OS::CurrentMonotonicNanos() - start;
+  }
+  return elapsed;
+}
+
+
+static const intptr_t kOldListLength = 100000;
+
+static int64_t MarkSweepOldList(Isolate* isolate, intptr_t iterations) {
+  Heap* H = isolate->heap();
+  Object list = BuildList(H, kOldListLength, Heap::kPretenured);
+  HandleScope h1(H, &list);
+  H->CollectAll(Heap::kPrimitive);
+  int64_t start = OS::CurrentMonotonicNanos();
+  for (intptr_t i = 0; i < iterations; i++) {
+    H->CollectAll(Heap::kPrimitive);
+  }
+  return OS::CurrentMonotonicNanos() - start;
+}
+
+
+// Probes a cache filled with every pairing of some receiver classes and
+// selectors, as a megamorphic send site would.
+static int64_t LookupCacheProbe(Isolate* isolate, intptr_t iterations) {
+  static const intptr_t kClasses = 16;
+  static const intptr_t kSelectors = 16;
+  Heap* H = isolate->heap();
+  Array strings = H->AllocateArray(kSelectors);
+  for (intptr_t i = 0; i < kSelectors; i++) {
+    strings->set_element(i, SmallInteger::New(0), kNoBarrier);
+  }
+  HandleScope h1(H, reinterpret_cast<Object*>(&strings));
+  for (intptr_t i = 0; i < kSelectors; i++) {
+    String string = H->AllocateString(8);  // SAFEPOINT
+    memset(string->element_addr(0), 'a' + i, 8);
+    strings->set_element(i, string);
+  }
+  // Nothing below allocates, so the selectors stay put.
+  String selectors[kSelectors];
+  for (intptr_t i = 0; i < kSelectors; i++) {
+    selectors[i] = static_cast<String>(strings->element(i));
+  }
+  Method target = static_cast<Method>(H->interpreter()->nil_obj());
+  LookupCache* cache = new LookupCache();
+  for (intptr_t cid = 0; cid < kClasses; cid++) {
+    for (intptr_t i = 0; i < kSelectors; i++) {
+      cache->InsertOrdinary(kFirstRegularObjectCid + cid, selectors[i],
+                            target);
+    }
+  }
+
+  uword found = 0;
+  int64_t start = OS::CurrentMonotonicNanos();
+  for (intptr_t i = 0; i < iterations; i++) {
+    intptr_t cid = kFirstRegularObjectCid + (i % kClasses);
+    Method result = target;
+    cache->LookupOrdinary(cid, selectors[(i / kClasses) % kSelectors],
+                          &result);
+    found += static_cast<uword>(result) + i;
+  }
+  int64_t elapsed = OS::CurrentMonotonicNanos() - start;
+  sink_ = sink_ + found;
+  delete cache;
+  return elapsed;
+}
+
+
+static int64_t DeserializeSnapshot(Isolate* isolate, intptr_t iterations) {
+  int64_t elapsed = 0;
+  for (intptr_t i = 0; i < iterations; i++) {
+    int64_t start = OS::CurrentMonotonicNanos();
+    Heap* heap = new Heap();
+    Interpreter* interpreter = new Interpreter(heap, isolate);
+    {
+      Deserializer deserializer(heap, snapshot_, snapshot_length_);
+      deserializer.Deserialize();
+    }
+    elapsed += OS::CurrentMonotonicNanos() - start;
+    delete interpreter;
+    delete heap;
+  }
+  return elapsed;
+}
+
+
+static LargeInteger NewLargeInteger(Heap* H, intptr_t digits) {
+  LargeInteger result = H->AllocateLargeInteger(digits);
+  result->set_negative(false);
+  result->set_size(digits);
+  uint32_t x = 0x9E3779B9;
+  for (intptr_t i = 0; i < digits; i++) {
+    x = x * 1103515245 + 12345;
+    result->set_digit(i, static_cast<digit_t>(x | 1));
+  }
+  return result;
+}
+
+
+enum LargeIntegerOp { kAdd, kMultiply, kDivide };
+
+static int64_t LargeIntegerBenchmark(Isolate* isolate, intptr_t iterations,
+                                     LargeIntegerOp op, intptr_t digits) {
+  Heap* H = isolate->heap();
+  LargeInteger left = NewLargeInteger(H, 2 * digits);
+  HandleScope h1(H, reinterpret_cast<Object*>(&left));
+  LargeInteger right = NewLargeInteger(H, digits);
+  HandleScope h2(H, reinterpret_cast<Object*>(&right));
+  int64_t start = OS::CurrentMonotonicNanos();
+  for (intptr_t i = 0; i < iterations; i++) {
+    switch (op) {
+      case kAdd:
+        LargeInteger::Add(left, right, H);
+        break;
+      case kMultiply:
+        LargeInteger::Multiply(left, right, H);
+        break;
+      case kDivide:
+        LargeInteger::Divide(LargeInteger::kTruncated,
+                             LargeInteger::kQuoitent, left, right, H);
+        break;
+    }
+  }
+  return OS::CurrentMonotonicNanos() - start;
+}
+
+#define LARGE_INTEGER_BENCHMARK(op, digits)                                    \
+  static int64_t LargeInteger##op##digits(Isolate* isolate,                    \
+                                          intptr_t iterations) {               \
+    return LargeIntegerBenchmark(isolate, iterations, k##op, digits);          \
+  }
+
+LARGE_INTEGER_BENCHMARK(Add, 4)
+LARGE_INTEGER_BENCHMARK(Add, 64)
+LARGE_INTEGER_BENCHMARK(Add, 1024)
+LARGE_INTEGER_BENCHMARK(Multiply, 4)
+LARGE_INTEGER_BENCHMARK(Multiply, 64)
+LARGE_INTEGER_BENCHMARK(Multiply, 1024)
+LARGE_INTEGER_BENCHMARK(Divide, 4)
+LARGE_INTEGER_BENCHMARK(Divide, 64)
+LARGE_INTEGER_BENCHMARK(Divide, 1024)
+
+
+// Stands in for an isolate's loop, discarding what is posted to it.
+class DiscardingLoop : public MessageLoop {
+ public:
+  DiscardingLoop() : MessageLoop(NULL) {}
+
+  void PostMessage(IsolateMessage* message) { delete message; }
+  intptr_t AwaitSignal(intptr_t handle, intptr_t signals) { return 0; }
+  void CancelSignalWait(intptr_t wait_id) {}
+  void MessageEpilogue(int64_t new_wakeup) {}
+  void Exit(intptr_t exit_code) {}
+  intptr_t Run() { return 0; }
+  void Interrupt() {}
+};
+
+
+static int64_t PortMapPost(Isolate* isolate, intptr_t iterations) {
+  static const intptr_t kPorts = 64;
+  DiscardingLoop* loop = new DiscardingLoop();
+  Port ports[kPorts];
+  for (intptr_t i = 0; i < kPorts; i++) {
+    ports[i] = PortMap::CreatePort(loop);
+  }
+  int64_t start = OS::CurrentMonotonicNanos();
+  for (intptr_t i = 0; i < iterations; i++) {
+    uint8_t* data = NULL;
+    PortMap::PostMessage(new IsolateMessage(ports[i % kPorts], data, 0));
+  }
+  int64_t elapsed = OS::CurrentMonotonicNanos() - start;
+  PortMap::CloseAllPorts(loop);
+  delete loop;
+  return elapsed;
+}
+
+
+// Two embedder ports bounce a message between the VM's threads.
+struct PingPong {
+  Monitor monitor;
+  PrimordialSoup_Port ports[2];
+  intptr_t remaining;
+};
+
+static void PingPongHandler(PrimordialSoup_Port port,
+                            const uint8_t* data,
+                            size_t length,
+                            void* context) {
+  PingPong* state = reinterpret_cast<PingPong*>(context);
+  MonitorLocker ml(&state->monitor);
+  if (--state->remaining == 0) {
+    ml.Notify();
+    return;
+  }
+  PrimordialSoup_Port other =
+      state->ports[0] == port ? state->ports[1] : state->ports[0];
+  PrimordialSoup_PostMessage(other, data, length);
+}
+
+
+static int64_t PortRoundTrip(Isolate* isolate, intptr_t iterations) {
+  PingPong* state = new PingPong();
+  state->ports[0] = PrimordialSoup_OpenPort(PingPongHandler, state);
+  state->ports[1] = PrimordialSoup_OpenPort(PingPongHandler, state);
+  state->remaining = 2 * iterations;
+  uint8_t data[16] = { 0 };
+  int64_t start = OS::CurrentMonotonicNanos();
+  {
+    MonitorLocker ml(&state->monitor);
+    PrimordialSoup_PostMessage(state->ports[0], data, sizeof(data));
+    while (state->remaining != 0) {
+      ml.Wait();
+    }
+  }
+  int64_t elapsed = OS::CurrentMonotonicNanos() - start;
+  PrimordialSoup_ClosePort(state->ports[0]);
+  PrimordialSoup_ClosePort(state->ports[1]);
+  delete state;
+  return elapsed;
+}
+
+
+static const Benchmark kBenchmarks[] = {
+  { "heap.allocate_array_4", 10000000, AllocateArrays },
+  { "heap.allocate_bytes_64", 10000000, AllocateByteArrays },
+  { "heap.scavenge_list_10k", 200, ScavengeYoungList },
+  { "heap.mark_sweep_list_100k", 20, MarkSweepOldList },
+  { "lookup_cache.probe_16x16", 100000000, LookupCacheProbe },
+  { "snapshot.deserialize", 20, DeserializeSnapshot },
+  { "large_integer.add_4", 1000000, LargeIntegerAdd4 },
+  { "large_integer.add_64", 1000000, LargeIntegerAdd64 },
+  { "large_integer.add_1024", 100000, LargeIntegerAdd1024 },
+  { "large_integer.multiply_4", 1000000, LargeIntegerMultiply4 },
+  { "large_integer.multiply_64", 100000, LargeIntegerMultiply64 },
+  { "large_integer.multiply_1024", 200, LargeIntegerMultiply1024 },
+  { "large_integer.divide_4", 1000000, LargeIntegerDivide4 },
+  { "large_integer.divide_64", 100000, LargeIntegerDivide64 },
+  { "large_integer.divide_1024", 200, LargeIntegerDivide1024 },
+  { "port_map.post", 10000000, PortMapPost },
+  { "port.round_trip", 20000, PortRoundTrip },
+};
+
+
+static void RunBenchmark(const Benchmark& benchmark, bool first) {
+  // Isolates are bound to the thread that made them, so each benchmark gets a
+  // fresh one on the main thread.
+  Isolate* isolate = new Isolate(snapshot_, snapshot_length_,
+                                 OS::CurrentMonotonicNanos());
+  benchmark.run(isolate, benchmark.iterations / 10 + 1);  // Warm up.
+  int64_t best = kMaxInt64;
+  for (intptr_t i = 0; i < kRepetitions; i++) {
+    int64_t elapsed = benchmark.run(isolate, benchmark.iterations);
+    if (elapsed < best) {
+      best = elapsed;
+    }
+  }
+  delete isolate;
+
+  double ns_per_iteration = static_cast<double>(best) / benchmark.iterations;
+  OS::Print("%s{\"name\": \"%s\", \"iterations\": %" Pd ", "
+            "\"ns_per_iteration\": %.3f}",
+            first ? "" : ",\n", benchmark.name, benchmark.iterations,
+            ns_per_iteration);
+}
+
+}  // namespace psoup
+
+
+int main(int argc, const char** argv) {
+  if (argc < 2) {
+    psoup::OS::PrintErr("Usage: %s <snapshot.vfuel> [name-prefix]\n",
+                        argv[0]);
+    return -1;
+  }
+  const char* filter = argc > 2 ? argv[2] : "";
+
+  psoup::VirtualMemory snapshot = psoup::VirtualMemory::MapReadOnly(argv[1]);
+  psoup::snapshot_ = reinterpret_cast<void*>(snapshot.base());
+  psoup::snapshot_length_ = snapshot.size();
+  PrimordialSoup_Startup();
+
+  psoup::OS::Print("{\"benchmarks\": [\n");
+  bool first = true;
+  for (const psoup::Benchmark& benchmark : psoup::kBenchmarks) {
+    if (strncmp(benchmark.name, filter, strlen(filter)) != 0) {
+      continue;
+    }
+    psoup::RunBenchmark(benchmark, first);
+    first = false;
+  }
+  psoup::OS::Print("\n]}\n");
+
+  PrimordialSoup_Shutdown();
+#if !defined(OS_WINDOWS)
+  snapshot.Free();
+#endif
+  return 0;
+}
+
+#endif  // !defined(OS_EMSCRIPTEN)
@@ -0,0 +1,458 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/bytecode_profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm/heap.h"
+#include "vm/lockers.h"
+#include "vm/os.h"
+#include "vm/thread.h"
+
+namespace psoup {
+
+static Mutex* total_mutex_ = NULL;
+static BytecodeProfile* total_ = NULL;
+
+static const intptr_t kPairsSize = 257 * 256;
+
+BytecodeProfile::BytecodeProfile() :
+    pairs_(reinterpret_cast<uint64_t*>(calloc(kPairsSize, sizeof(uint64_t)))),
+    previous_(256),
+    getters_(0),
+    setters_(0),
+    sites_(NULL),
+    sites_capacity_(0),
+    sites_size_(0) {
+  memset(bytecodes_, 0, sizeof(bytecodes_));
+  memset(primitive_calls_, 0, sizeof(primitive_calls_));
+  memset(primitive_failures_, 0, sizeof(primitive_failures_));
+  GrowSites();
+}
+
+
+BytecodeProfile::~BytecodeProfile() {
+  for (intptr_t i = 0; i < sites_capacity_; i++) {
+    SendSite* site = &sites_[i];
+    if (site->key == 0) continue;
+    free(site->method);
+    free(site->selector);
+    for (intptr_t j = 0; j < kMaxReceiverClasses; j++) {
+      free(site->receiver_classes[j]);
+    }
+  }
+  free(sites_);
+  free(pairs_);
+}
+
+
+void BytecodeProfile::Startup() {
+  total_mutex_ = new Mutex();
+  total_ = new BytecodeProfile();
+  // Written at exit rather than at shutdown so that the counts survive
+  // isolates that end the process with OS::Exit.
+  atexit(&WriteAtExit);
+}
+
+
+void BytecodeProfile::Merge(const BytecodeProfile* profile) {
+  MutexLocker ml(total_mutex_);
+  total_->MergeFrom(profile);
+}
+
+
+void BytecodeProfile::WriteAtExit() {
+  const char* path = getenv("PSOUP_BYTECODE_PROFILE");
+  if (path == NULL) {
+    path = "bytecode_profile.json";
+  }
+  MutexLocker ml(total_mutex_);
+  total_->WriteTo(path);
+}
+
+
+static char* CopyName(Object name) {
+  if (!name->IsString()) {
+    return strdup("?");
+  }
+  String string = static_cast<String>(name);
+  return OS::PrintStr("%.*s", static_cast<int>(string->Size()),
+                      reinterpret_cast<const char*>(string->element_addr(0)));
+}
+
+
+static char* MixinName(AbstractMixin mixin) {
+  Object name = mixin->name();
+  if (name->IsString()) {
+    return CopyName(name);
+  }
+  // The mixin of a metaclass is named by the instance side's mixin.
+  char* instance_name = CopyName(static_cast<AbstractMixin>(name)->name());
+  char* result = OS::PrintStr("%s class", instance_name);
+  free(instance_name);
+  return result;
+}
+
+
+static char* MethodName(Method method) {
+  char* mixin_name = MixinName(method->mixin());
+  char* selector = CopyName(method->selector());
+  char* result = OS::PrintStr("%s>>%s", mixin_name, selector);
+  free(mixin_name);
+  free(selector);
+  return result;
+}
+
+
+static char* ClassName(Heap* heap, Object receiver) {
+  Behavior cls = receiver->Klass(heap);
+  Behavior the_metaclass = heap->ClassAt(kSmiCid)->Klass(heap)->Klass(heap);
+  if (cls->Klass(heap) == the_metaclass) {
+    char* instance_name =
+        CopyName(static_cast<Metaclass>(cls)->this_class()->name());
+    char* result = OS::PrintStr("%s class", instance_name);
+    free(instance_name);
+    return result;
+  }
+  return CopyName(static_cast<Class>(cls)->name());
+}
+
+
+// Site keys put the bci in the low bits, so spread them before masking.
+static intptr_t SiteIndex(uword key, intptr_t mask) {
+  return static_cast<intptr_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+
+static uword HashCString(const char* s) {
+  uword hash = 0;
+  while (*s != 0) {
+    hash = hash * 31 + static_cast<uint8_t>(*s++);
+  }
+  return hash;
+}
+
+
+BytecodeProfile::SendSite* BytecodeProfile::LookupSite(
+    uword key, intptr_t selector_hash) {
+  intptr_t mask = sites_capacity_ - 1;
+  intptr_t index = SiteIndex(key, mask);
+  for (;;) {
+    SendSite* site = &sites_[index];
+    if (site->key == 0) {
+      return NULL;
+    }
+    if ((site->key == key) && (site->selector_hash == selector_hash)) {
+      return site;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+
+BytecodeProfile::SendSite* BytecodeProfile::InsertSite(uword key) {
+  if (2 * (sites_size_ + 1) > sites_capacity_) {
+    GrowSites();
+  }
+  intptr_t mask = sites_capacity_ - 1;
+  intptr_t index = SiteIndex(key, mask);
+  while (sites_[index].key != 0) {
+    index = (index + 1) & mask;
+  }
+  sites_size_++;
+  SendSite* site = &sites_[index];
+  site->key = key;
+  return site;
+}
+
+
+void BytecodeProfile::GrowSites() {
+  SendSite* old_sites = sites_;
+  intptr_t old_capacity = sites_capacity_;
+  sites_capacity_ = old_capacity == 0 ? 1024 : old_capacity * 2;
+  sites_ = reinterpret_cast<SendSite*>(
+      calloc(sites_capacity_, sizeof(SendSite)));
+  intptr_t mask = sites_capacity_ - 1;
+  for (intptr_t i = 0; i < old_capacity; i++) {
+    if (old_sites[i].key == 0) continue;
+    intptr_t index = SiteIndex(old_sites[i].key, mask);
+    while (sites_[index].key != 0) {
+      index = (index + 1) & mask;
+    }
+    sites_[index] = old_sites[i];
+  }
+  free(old_sites);
+}
+
+
+void BytecodeProfile::CountSend(uword site_key,
+                                intptr_t selector_hash,
+                                SendKind kind,
+                                Heap* heap,
+                                Method method,
+                                intptr_t bci,
+                                String selector,
+                                Object receiver,
+                                bool cache_hit) {
+  SendSite* site = LookupSite(site_key, selector_hash);
+  if (site == NULL) {
+    site = InsertSite(site_key);
+    site->selector_hash = selector_hash;
+    site->kind = kind;
+    site->bci = bci;
+    site->method = MethodName(method);
+    site->selector = CopyName(selector);
+  }
+  site->count++;
+  if (cache_hit) {
+    site->hits++;
+  }
+
+  intptr_t cid = receiver->ClassId();
+  intptr_t num_classes = site->num_receiver_classes;
+  if (num_classes > kMaxReceiverClasses) {
+    return;
+  }
+  for (intptr_t i = 0; i < num_classes; i++) {
+    if (site->receiver_cids[i] == cid) {
+      return;
+    }
+  }
+  if (num_classes < kMaxReceiverClasses) {
+    site->receiver_cids[num_classes] = cid;
+    site->receiver_classes[num_classes] = ClassName(heap, receiver);
+  }
+  site->num_receiver_classes = num_classes + 1;
+}
+
+
+BytecodeProfile::SendSite* BytecodeProfile::LookupMergedSite(
+    const SendSite* other) {
+  // Method identity hashes differ between isolates, so merged sites are
+  // matched by name.
+  uword key = HashCString(other->method) ^
+      (HashCString(other->selector) * 7) ^
+      (static_cast<uword>(other->bci) << 8) ^
+      static_cast<uword>(other->kind);
+  if (key == 0) {
+    key = 1;
+  }
+  intptr_t mask = sites_capacity_ - 1;
+  intptr_t index = SiteIndex(key, mask);
+  for (;;) {
+    SendSite* site = &sites_[index];
+    if (site->key == 0) {
+      break;
+    }
+    if ((site->key == key) &&
+        (site->kind == other->kind) &&
+        (site->bci == other->bci) &&
+        (strcmp(site->method, other->method) == 0) &&
+        (strcmp(site->selector, other->selector) == 0)) {
+      return site;
+    }
+    index = (index + 1) & mask;
+  }
+
+  SendSite* site = InsertSite(key);
+  site->kind = other->kind;
+  site->bci = other->bci;
+  site->method = strdup(other->method);
+  site->selector = strdup(other->selector);
+  return site;
+}
+
+
+void BytecodeProfile::MergeFrom(const BytecodeProfile* other) {
+  for (intptr_t i = 0; i < 256; i++) {
+    bytecodes_[i] += other->bytecodes_[i];
+  }
+  for (intptr_t i = 0; i < kPairsSize; i++) {
+    pairs_[i] += other->pairs_[i];
+  }
+  getters_ += other->getters_;
+  setters_ += other->setters_;
+  for (intptr_t i = 0; i < kNumPrimitives; i++) {
+    primitive_calls_[i] += other->primitive_calls_[i];
+    primitive_failures_[i] += other->primitive_failures_[i];
+  }
+
+  for (intptr_t i = 0; i < other->sites_capacity_; i++) {
+    const SendSite* other_site = &other->sites_[i];
+    if (other_site->key == 0) continue;
+    SendSite* site = LookupMergedSite(other_site);
+    site->count += other_site->count;
+    site->hits += other_site->hits;
+
+    // Class ids are not comparable across isolates, so receiver classes are
+    // matched by name.
+    intptr_t other_classes = other_site->num_receiver_classes;
+    if (other_classes > kMaxReceiverClasses) {
+      other_classes = kMaxReceiverClasses;
+    }
+    for (intptr_t j = 0; j < other_classes; j++) {
+      const char* name = other_site->receiver_classes[j];
+      intptr_t num_classes = site->num_receiver_classes;
+      if (num_classes > kMaxReceiverClasses) break;
+      bool found = false;
+      for (intptr_t k = 0; k < num_classes; k++) {
+        if (strcmp(site->receiver_classes[k], name) == 0) {
+          found = true;
+          break;
+        }
+      }
+      if (found) continue;
+      if (num_classes < kMaxReceiverClasses) {
+        site->receiver_classes[num_classes] = strdup(name);
+      }
+      site->num_receiver_classes = num_classes + 1;
+    }
+    if (other_site->num_receiver_classes > kMaxReceiverClasses) {
+      site->num_receiver_classes = kMaxReceiverClasses + 1;
+    }
+  }
+}
+
+
+static void WriteString(FILE* file, const char* s) {
+  fputc('"', file);
+  for (; *s != 0; s++) {
+    uint8_t c = *s;
+    if ((c == '"') || (c == '\\')) {
+      fprintf(file, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+
+static const char* SendKindName(intptr_t kind) {
+  switch (kind) {
+    case BytecodeProfile::kOrdinarySend: return "ordinary";
+    case BytecodeProfile::kSelfSend: return "self";
+    case BytecodeProfile::kSuperSend: return "super";
+    case BytecodeProfile::kImplicitReceiverSend: return "implicitReceiver";
+    case BytecodeProfile::kOuterSend: return "outer";
+  }
+  UNREACHABLE();
+  return NULL;
+}
+
+
+struct PairCount {
+  intptr_t pair;
+  uint64_t count;
+};
+
+
+static int ComparePairCounts(const void* a, const void* b) {
+  uint64_t count_a = reinterpret_cast<const PairCount*>(a)->count;
+  uint64_t count_b = reinterpret_cast<const PairCount*>(b)->count;
+  if (count_a != count_b) {
+    return count_a > count_b ? -1 : 1;
+  }
+  return 0;
+}
+
+
+void BytecodeProfile::WriteTo(const char* path) const {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    OS::PrintErr("Cannot write bytecode profile to %s\n", path);
+    return;
+  }
+
+  fprintf(file, "{\n\"bytecodes\": [");
+  const char* separator = "\n";
+  for (intptr_t i = 0; i < 256; i++) {
+    if (bytecodes_[i] == 0) continue;
+    fprintf(file, "%s{\"bytecode\": %" Pd ", \"count\": %" Pu64 "}",
+            separator, i, bytecodes_[i]);
+    separator = ",\n";
+  }
+
+  // Pairs are sorted by count; the row without a predecessor is left out.
+  PairCount* pairs = reinterpret_cast<PairCount*>(
+      malloc(256 * 256 * sizeof(PairCount)));
+  intptr_t num_pairs = 0;
+  for (intptr_t i = 0; i < 256 * 256; i++) {
+    if (pairs_[i] == 0) continue;
+    pairs[num_pairs].pair = i;
+    pairs[num_pairs].count = pairs_[i];
+    num_pairs++;
+  }
+  qsort(pairs, num_pairs, sizeof(PairCount), &ComparePairCounts);
+  fprintf(file, "],\n\"pairs\": [");
+  separator = "\n";
+  for (intptr_t i = 0; i < num_pairs; i++) {
+    fprintf(file, "%s{\"first\": %" Pd ", \"second\": %" Pd ", "
+            "\"count\": %" Pu64 "}",
+            separator, pairs[i].pair >> 8, pairs[i].pair & 255,
+            pairs[i].count);
+    separator = ",\n";
+  }
+  free(pairs);
+
+  fprintf(file, "],\n\"accessors\": {\"getter\": %" Pu64 ", "
+          "\"setter\": %" Pu64 "},\n\"primitives\": [", getters_, setters_);
+  separator = "\n";
+  for (intptr_t i = 0; i < kNumPrimitives; i++) {
+    if (primitive_calls_[i] == 0) continue;
+    fprintf(file, "%s{\"primitive\": %" Pd ", \"success\": %" Pu64 ", "
+            "\"failure\": %" Pu64 "}",
+            separator, i, primitive_calls_[i] - primitive_failures_[i],
+            primitive_failures_[i]);
+    separator = ",\n";
+  }
+
+  // Sites are sorted by count, using PairCount to hold the table index.
+  PairCount* order = reinterpret_cast<PairCount*>(
+      malloc(sites_size_ * sizeof(PairCount)));
+  intptr_t num_sites = 0;
+  for (intptr_t i = 0; i < sites_capacity_; i++) {
+    if (sites_[i].key == 0) continue;
+    order[num_sites].pair = i;
+    order[num_sites].count = sites_[i].count;
+    num_sites++;
+  }
+  qsort(order, num_sites, sizeof(PairCount), &ComparePairCounts);
+  fprintf(file, "],\n\"sends\": [");
+  separator = "\n";
+  for (intptr_t i = 0; i < num_sites; i++) {
+    const SendSite* site = &sites_[order[i].pair];
+    fprintf(file, "%s{\"method\": ", separator);
+    WriteString(file, site->method);
+    fprintf(file, ", \"bci\": %" Pd ", \"kind\": \"%s\", \"selector\": ",
+            site->bci, SendKindName(site->kind));
+    WriteString(file, site->selector);
+    fprintf(file, ", \"count\": %" Pu64 ", \"hits\": %" Pu64 ", "
+            "\"misses\": %" Pu64 ", \"megamorphic\": %s, \"receivers\": [",
+            site->count, site->hits, site->count - site->hits,
+            site->num_receiver_classes > kMaxReceiverClasses ?
+                "true" : "false");
+    intptr_t num_classes = site->num_receiver_classes;
+    if (num_classes > kMaxReceiverClasses) {
+      num_classes = kMaxReceiverClasses;
+    }
+    for (intptr_t j = 0; j < num_classes; j++) {
+      if (j != 0) fprintf(file, ", ");
+      WriteString(file, site->receiver_classes[j]);
+    }
+    fprintf(file, "]}");
+    separator = ",\n";
+  }
+  free(order);
+
+  fprintf(file, "]\n}\n");
+  fclose(file);
+}
+
+}  // namespace psoup
@@ -0,0 +1,111 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_BYTECODE_PROFILE_H_
+#define VM_BYTECODE_PROFILE_H_
+
+#include "vm/globals.h"
+#include "vm/object.h"
+
+namespace psoup {
+
+class Heap;
+
+// Exact execution counts gathered by the interpreter when PROFILE_BYTECODES
+// is set: bytecodes, adjacent bytecode pairs, primitive successes and
+// failures, and for each send site its lookup cache hits and the receiver
+// classes seen. Each interpreter counts into its own profile, which is folded
+// into a process-wide total when the interpreter is destroyed. The total is
+// written as JSON at exit to $PSOUP_BYTECODE_PROFILE, or bytecode_profile.json
+// if that is unset.
+class BytecodeProfile {
+ public:
+  enum SendKind {
+    kOrdinarySend,
+    kSelfSend,
+    kSuperSend,
+    kImplicitReceiverSend,
+    kOuterSend,
+  };
+
+  BytecodeProfile();
+  ~BytecodeProfile();
+
+  static void Startup();
+
+  // Adds profile to the process-wide total.
+  static void Merge(const BytecodeProfile* profile);
+
+  void CountBytecode(uint8_t bytecode) {
+    bytecodes_[bytecode]++;
+    pairs_[(previous_ << 8) | bytecode]++;
+    previous_ = bytecode;
+  }
+
+  void CountGetter() { getters_++; }
+  void CountSetter() { setters_++; }
+  void CountPrimitive(intptr_t prim) { primitive_calls_[prim]++; }
+  void CountPrimitiveFailure(intptr_t prim) { primitive_failures_[prim]++; }
+
+  // site_key identifies the method and bci of the send; selector_hash
+  // separates the sends made by #perform: from the send of #perform: itself.
+  void CountSend(uword site_key,
+                 intptr_t selector_hash,
+                 SendKind kind,
+                 Heap* heap,
+                 Method method,
+                 intptr_t bci,
+                 String selector,
+                 Object receiver,
+                 bool cache_hit);
+
+ private:
+  static const intptr_t kNumPrimitives = 256;
+  static const intptr_t kMaxReceiverClasses = 4;
+
+  struct SendSite {
+    uword key;
+    intptr_t selector_hash;
+    SendKind kind;
+    intptr_t bci;
+    char* method;
+    char* selector;
+    uint64_t count;
+    uint64_t hits;
+    // Past kMaxReceiverClasses the site is megamorphic and only the first
+    // classes seen are kept.
+    intptr_t num_receiver_classes;
+    intptr_t receiver_cids[kMaxReceiverClasses];
+    char* receiver_classes[kMaxReceiverClasses];
+  };
+
+  SendSite* LookupSite(uword key, intptr_t selector_hash);
+  SendSite* LookupMergedSite(const SendSite* site);
+  SendSite* InsertSite(uword key);
+  void GrowSites();
+  void MergeFrom(const BytecodeProfile* other);
+  void WriteTo(const char* path) const;
+
+  static void WriteAtExit();
+
+  uint64_t bytecodes_[256];
+  // Indexed by (previous << 8) | next. The extra row holds the first bytecode
+  // of the interpreter, which has no predecessor.
+  uint64_t* pairs_;
+  intptr_t previous_;
+  uint64_t getters_;
+  uint64_t setters_;
+  uint64_t primitive_calls_[kNumPrimitives];
+  uint64_t primitive_failures_[kNumPrimitives];
+
+  SendSite* sites_;
+  intptr_t sites_capacity_;
+  intptr_t sites_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(BytecodeProfile);
+};
+
+}  // namespace psoup
+
+#endif  // VM_BYTECODE_PROFILE_H_
@@ -0,0 +1,158 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+// An example host using the embedding API of primordial_soup.h. It starts an
+// isolate from a snapshot of EchoApp, passing it the id of a host port. The
+// isolate answers with a port of its own, the host sends integers there and
+// checks that their successors come back, and finally reads the isolate's
+// stats before destroying it.
+
+#include "vm/globals.h"
+#if !defined(OS_EMSCRIPTEN)
+
+#include <stdio.h>
+#include <string.h>
+
+#include "vm/lockers.h"
+#include "vm/os.h"
+#include "vm/primordial_soup.h"
+#include "vm/thread.h"
+#include "vm/virtual_memory.h"
+
+namespace psoup {
+
+static const intptr_t kRoundTrips = 1000;
+
+// Integers travel between the host and EchoApp as 8 little-endian bytes.
+static const size_t kIntegerMessageLength = 8;
+
+static void EncodeInteger(int64_t value, uint8_t* message) {
+  for (size_t i = 0; i < kIntegerMessageLength; i++) {
+    message[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+static bool DecodeInteger(const uint8_t* message, size_t length,
+                          int64_t* value) {
+  if (length != kIntegerMessageLength) {
+    return false;
+  }
+  uint64_t result = 0;
+  for (size_t i = kIntegerMessageLength; i > 0; i--) {
+    result = (result << 8) | message[i - 1];
+  }
+  *value = static_cast<int64_t>(result);
+  return true;
+}
+
+// Replies from the isolate, handed from the VM thread running the host port's
+// handler to the main thread.
+class Replies {
+ public:
+  Replies() : monitor_(), value_(0), valid_(false), pending_(false) {}
+
+  static void Handle(PrimordialSoup_Port port, const uint8_t* data,
+                     size_t length, void* context) {
+    Replies* replies = reinterpret_cast<Replies*>(context);
+    MonitorLocker locker(&replies->monitor_);
+    replies->valid_ = DecodeInteger(data, length, &replies->value_);
+    replies->pending_ = true;
+    locker.Notify();
+  }
+
+  bool Take(int64_t* value) {
+    MonitorLocker locker(&monitor_);
+    while (!pending_) {
+      locker.Wait();
+    }
+    pending_ = false;
+    *value = value_;
+    return valid_;
+  }
+
+ private:
+  Monitor monitor_;
+  int64_t value_;
+  bool valid_;
+  bool pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(Replies);
+};
+
+static int Run(void* snapshot, size_t snapshot_length) {
+  Replies replies;
+  PrimordialSoup_Port host_port =
+      PrimordialSoup_OpenPort(Replies::Handle, &replies);
+
+  char host_port_id[32];
+  snprintf(host_port_id, sizeof(host_port_id), "%" Pd64, host_port);
+  const char* args[] = { host_port_id };
+  PrimordialSoup_Isolate isolate =
+      PrimordialSoup_CreateIsolate(snapshot, snapshot_length, 1, args);
+
+  int64_t isolate_port;
+  if (!replies.Take(&isolate_port)) {
+    OS::PrintErr("Expected the isolate's port\n");
+    return -1;
+  }
+
+  uint8_t message[kIntegerMessageLength];
+  int64_t value = 0;
+  int64_t start = OS::CurrentMonotonicNanos();
+  for (intptr_t i = 0; i < kRoundTrips; i++) {
+    EncodeInteger(value, message);
+    if (!PrimordialSoup_PostMessage(isolate_port, message, sizeof(message))) {
+      OS::PrintErr("Isolate port closed\n");
+      return -1;
+    }
+    int64_t reply;
+    if (!replies.Take(&reply) || (reply != value + 1)) {
+      OS::PrintErr("Expected %" Pd64 " in reply\n", value + 1);
+      return -1;
+    }
+    value = reply;
+  }
+  int64_t stop = OS::CurrentMonotonicNanos();
+  OS::Print("%" Pd " round trips in %" Pd64 " us\n", kRoundTrips,
+            (stop - start) / kNanosecondsPerMicrosecond);
+
+  PrimordialSoup_IsolateStats stats;
+  if (!PrimordialSoup_GetIsolateStats(isolate, &stats)) {
+    OS::PrintErr("Isolate exited early\n");
+    return -1;
+  }
+  OS::Print("Isolate heap %" Pd "kB, %" Pd64 " messages, %" Pd64 " turns\n",
+            stats.heap_size / KB, stats.messages, stats.turns);
+
+  PrimordialSoup_DestroyIsolate(isolate);
+  PrimordialSoup_ClosePort(host_port);
+  return 0;
+}
+
+}  // namespace psoup
+
+int main(int argc, const char** argv) {
+  if (argc < 2) {
+    psoup::OS::PrintErr("Usage: %s <EchoApp.vfuel>\n", argv[0]);
+    return -1;
+  }
+
+  psoup::VirtualMemory snapshot = psoup::VirtualMemory::MapReadOnly(argv[1]);
+  PrimordialSoup_Startup();
+
+  int exit_code = psoup::Run(reinterpret_cast<void*>(snapshot.base()),
+                             snapshot.size());
+
+  PrimordialSoup_Shutdown();
+
+  // TODO(rmacnak): File and anonymous mappings are freed differently on
+  // Windows.
+#if !defined(OS_WINDOWS)
+  snapshot.Free();
+#endif
+
+  return exit_code;
+}
+
+#endif  // !defined(OS_EMSCRIPTEN)
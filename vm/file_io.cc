@@ -0,0 +1,288 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/file_io.h"
+
+#if !defined(OS_EMSCRIPTEN) && !defined(OS_WINDOWS)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vm/assert.h"
+#include "vm/isolate.h"
+#include "vm/message_loop.h"
+#include "vm/port.h"
+#include "vm/thread_pool.h"
+
+namespace psoup {
+
+class FileTask : public ThreadPool::Task {
+ public:
+  FileTask(MessageLoop* loop, intptr_t fd, int64_t offset,
+           uint8_t* data, intptr_t length)
+      : port_(loop->OpenPort()), handle_(loop->NewOperationHandle()),
+        fd_(fd), offset_(offset), data_(data), length_(length) {}
+
+  ~FileTask() {
+    free(data_);
+  }
+
+  intptr_t handle() const { return handle_; }
+
+  void Run() {
+    intptr_t count = Perform();
+    intptr_t status = count < 0 ? errno : 0;
+    uint8_t* data = TakeResultData(status == 0 ? count : 0);
+    // If the isolate has gone away the port is closed and the completion is
+    // dropped.
+    PortMap::PostMessage(new IsolateMessage(port_, handle_, status,
+                                            status == 0 ? count : 0,
+                                            data, data == NULL ? 0 : count));
+  }
+
+ protected:
+  // Answers the result, or -1 with errno set.
+  virtual intptr_t Perform() = 0;
+  virtual uint8_t* TakeResultData(intptr_t count) { return NULL; }
+
+  char* path() const { return reinterpret_cast<char*>(data_); }
+
+  Port port_;
+  intptr_t handle_;
+  intptr_t fd_;
+  int64_t offset_;
+  uint8_t* data_;
+  intptr_t length_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FileTask);
+};
+
+
+static uint8_t* CopyData(const uint8_t* data, intptr_t length) {
+  uint8_t* copy = reinterpret_cast<uint8_t*>(malloc(length + 1));
+  memcpy(copy, data, length);
+  copy[length] = 0;
+  return copy;
+}
+
+
+class OpenTask : public FileTask {
+ public:
+  OpenTask(MessageLoop* loop, uint8_t* path, intptr_t flags)
+      : FileTask(loop, -1, 0, path, 0), flags_(flags) {}
+
+ protected:
+  intptr_t Perform() {
+    int oflag;
+    switch (flags_) {
+      case FileIO::kRead: oflag = O_RDONLY; break;
+      case FileIO::kWrite: oflag = O_WRONLY | O_CREAT | O_TRUNC; break;
+      case FileIO::kReadWrite: oflag = O_RDWR | O_CREAT; break;
+      default: UNREACHABLE();
+    }
+    int fd;
+    do {
+      fd = open(path(), oflag | O_CLOEXEC, 0666);
+    } while (fd == -1 && errno == EINTR);
+    return fd;
+  }
+
+ private:
+  intptr_t flags_;
+};
+
+
+class CloseTask : public FileTask {
+ public:
+  CloseTask(MessageLoop* loop, intptr_t fd)
+      : FileTask(loop, fd, 0, NULL, 0) {}
+
+ protected:
+  intptr_t Perform() {
+    // Not retried on EINTR: the descriptor is released regardless.
+    return close(fd_);
+  }
+};
+
+
+class ReadTask : public FileTask {
+ public:
+  ReadTask(MessageLoop* loop, intptr_t fd, int64_t offset, intptr_t length)
+      : FileTask(loop, fd, offset,
+                 reinterpret_cast<uint8_t*>(malloc(length)), length) {}
+
+ protected:
+  intptr_t Perform() {
+    ssize_t result;
+    do {
+      result = pread(fd_, data_, length_, offset_);
+    } while (result == -1 && errno == EINTR);
+    return result;
+  }
+
+  uint8_t* TakeResultData(intptr_t count) {
+    if (count == 0) {
+      return NULL;
+    }
+    uint8_t* data = data_;
+    data_ = NULL;
+    return data;
+  }
+};
+
+
+class WriteTask : public FileTask {
+ public:
+  WriteTask(MessageLoop* loop, intptr_t fd, int64_t offset,
+            uint8_t* data, intptr_t length)
+      : FileTask(loop, fd, offset, data, length) {}
+
+ protected:
+  intptr_t Perform() {
+    intptr_t written = 0;
+    while (written < length_) {
+      ssize_t result = pwrite(fd_, data_ + written, length_ - written,
+                              offset_ + written);
+      if (result == -1) {
+        if (errno == EINTR) continue;
+        return -1;
+      }
+      written += result;
+    }
+    return written;
+  }
+};
+
+
+class StatTask : public FileTask {
+ public:
+  StatTask(MessageLoop* loop, uint8_t* path)
+      : FileTask(loop, -1, 0, path, 0) {}
+
+ protected:
+  intptr_t Perform() {
+    struct stat st;
+    if (stat(path(), &st) != 0) {
+      return -1;
+    }
+    return st.st_size;
+  }
+};
+
+
+class SaveTask : public FileTask {
+ public:
+  SaveTask(MessageLoop* loop, uint8_t* path, uint8_t* contents,
+           intptr_t length)
+      : FileTask(loop, -1, 0, path, length), contents_(contents) {}
+
+  ~SaveTask() {
+    free(contents_);
+  }
+
+ protected:
+  intptr_t Perform() {
+    // Written beside the destination and renamed over it.
+    intptr_t path_length = strlen(path());
+    char* temp_path = reinterpret_cast<char*>(malloc(path_length + 5));
+    memcpy(temp_path, path(), path_length);
+    memcpy(temp_path + path_length, ".tmp", 5);
+
+    intptr_t result = WriteTo(temp_path);
+    if (result != -1 && rename(temp_path, path()) == -1) {
+      result = -1;
+    }
+    if (result == -1) {
+      int saved_errno = errno;
+      unlink(temp_path);
+      errno = saved_errno;
+    }
+    free(temp_path);
+    return result;
+  }
+
+ private:
+  intptr_t WriteTo(const char* temp_path) {
+    int fd;
+    do {
+      fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+      return -1;
+    }
+    intptr_t written = 0;
+    while (written < length_) {
+      ssize_t result = write(fd, contents_ + written, length_ - written);
+      if (result == -1) {
+        if (errno == EINTR) continue;
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+      }
+      written += result;
+    }
+    if (close(fd) == -1) {
+      return -1;
+    }
+    return written;
+  }
+
+  uint8_t* contents_;
+};
+
+
+static intptr_t Start(FileTask* task) {
+  intptr_t handle = task->handle();
+  Isolate::thread_pool()->Run(task);
+  return handle;
+}
+
+
+intptr_t FileIO::Open(MessageLoop* loop,
+                      const uint8_t* path, intptr_t path_length,
+                      intptr_t flags) {
+  ASSERT(flags >= kRead && flags <= kReadWrite);
+  return Start(new OpenTask(loop, CopyData(path, path_length), flags));
+}
+
+
+intptr_t FileIO::Close(MessageLoop* loop, intptr_t fd) {
+  return Start(new CloseTask(loop, fd));
+}
+
+
+intptr_t FileIO::Read(MessageLoop* loop,
+                      intptr_t fd, int64_t offset, intptr_t length) {
+  return Start(new ReadTask(loop, fd, offset, length));
+}
+
+
+intptr_t FileIO::Write(MessageLoop* loop,
+                       intptr_t fd, int64_t offset,
+                       const uint8_t* data, intptr_t length) {
+  return Start(new WriteTask(loop, fd, offset, CopyData(data, length), length));
+}
+
+
+intptr_t FileIO::Stat(MessageLoop* loop,
+                      const uint8_t* path, intptr_t path_length) {
+  return Start(new StatTask(loop, CopyData(path, path_length)));
+}
+
+
+intptr_t FileIO::Save(MessageLoop* loop,
+                      const uint8_t* path, intptr_t path_length,
+                      uint8_t* data, intptr_t length) {
+  return Start(new SaveTask(loop, CopyData(path, path_length), data, length));
+}
+
+}  // namespace psoup
+
+#endif  // !defined(OS_EMSCRIPTEN) && !defined(OS_WINDOWS)
@@ -0,0 +1,53 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_FILE_IO_H_
+#define VM_FILE_IO_H_
+
+#include "vm/allocation.h"
+#include "vm/globals.h"
+
+namespace psoup {
+
+class MessageLoop;
+
+// Blocking file operations run on the isolate thread pool. Each answers a
+// handle whose completion is signaled through the loop with the operation's
+// errno as the status and its result (a descriptor, byte count or size) as
+// the count. The loop is kept alive while an operation is outstanding.
+class FileIO : public AllStatic {
+ public:
+  // The path and data are copied.
+  static intptr_t Open(MessageLoop* loop,
+                       const uint8_t* path, intptr_t path_length,
+                       intptr_t flags);
+  static intptr_t Close(MessageLoop* loop, intptr_t fd);
+  // Reads into a buffer of the operation's own, which the completion keeps
+  // until the isolate takes it. The thread pool cannot read into a ByteArray
+  // directly, because the isolate may move it while the read runs; the
+  // isolate instead copies the bytes into place when it takes them.
+  static intptr_t Read(MessageLoop* loop,
+                       intptr_t fd, int64_t offset, intptr_t length);
+  static intptr_t Write(MessageLoop* loop,
+                        intptr_t fd, int64_t offset,
+                        const uint8_t* data, intptr_t length);
+  static intptr_t Stat(MessageLoop* loop,
+                       const uint8_t* path, intptr_t path_length);
+  // Replaces the file at path with data, which must have been allocated with
+  // malloc and is taken over. The old contents survive a failed write.
+  static intptr_t Save(MessageLoop* loop,
+                       const uint8_t* path, intptr_t path_length,
+                       uint8_t* data, intptr_t length);
+
+  // Flags for Open.
+  enum {
+    kRead = 0,
+    kWrite = 1,      // Create or truncate.
+    kReadWrite = 2,  // Create if absent.
+  };
+};
+
+}  // namespace psoup
+
+#endif  // VM_FILE_IO_H_
@@ -5,14 +5,20 @@
 #ifndef VM_FLAGS_H_
 #define VM_FLAGS_H_
 
+#define ALLOCATION_SITE_PRETENURING true
+#define BASELINE_JIT false
 #define LOOKUP_CACHE true
 #define STATIC_PREDICTION_BYTECODES true
+#define THREADED_DISPATCH true
 
+#define COMPRESSED_POINTERS false
+#define PROFILE_BYTECODES false
 #define REPORT_GC false
 #define TEST_SLOW_PATH false
 #define TRACE_BECOME false
 #define TRACE_DNU false
 #define TRACE_GROWTH false
+#define TRACE_PRETENURING false
 #define TRACE_PRIMITIVES false
 #define TRACE_SPECIAL_CONTROL false
 
@@ -11,17 +11,14 @@ namespace psoup {
 
 class Region {
  public:
-  static Region* Allocate(intptr_t size) {
-    VirtualMemory memory = VirtualMemory::Allocate(size,
-                                                   VirtualMemory::kReadWrite,
-                                                   "primordialsoup-heap");
+  static Region* Initialize(VirtualMemory memory) {
     Region* region = reinterpret_cast<Region*>(memory.base());
     region->memory_ = memory;
     region->object_end_ = region->object_start();
     return region;
   }
 
-  void Free() { memory_.Free(); }
+  VirtualMemory memory() const { return memory_; }
 
   uword TryAllocate(intptr_t size) {
     ASSERT(Utils::IsAligned(size, kObjectAlignment));
@@ -77,6 +74,89 @@ class MarkStack {
   HeapObject stack_[];
 };
 
+#if USE_COMPRESSED_POINTERS
+Reservation::Reservation() : memory_(), free_ranges_(nullptr) {
+  memory_ = VirtualMemory::Reserve(kCompressedHeapSize, kCompressedHeapSize,
+                                   "primordialsoup-heap");
+  free_ranges_ = new FreeRange;
+  free_ranges_->base = memory_.base();
+  free_ranges_->size = memory_.size();
+  free_ranges_->next = nullptr;
+}
+
+Reservation::~Reservation() {
+  while (free_ranges_ != nullptr) {
+    FreeRange* next = free_ranges_->next;
+    delete free_ranges_;
+    free_ranges_ = next;
+  }
+  memory_.Free();
+}
+
+VirtualMemory Reservation::Allocate(size_t size, const char* name) {
+  size = Utils::RoundUp(size, kGranularity);
+  FreeRange* prev = nullptr;
+  FreeRange* range = free_ranges_;
+  while (range != nullptr) {
+    if (range->size >= size) {
+      uword base = range->base;
+      range->base += size;
+      range->size -= size;
+      if (range->size == 0) {
+        if (prev == nullptr) {
+          free_ranges_ = range->next;
+        } else {
+          prev->next = range->next;
+        }
+        delete range;
+      }
+      return VirtualMemory::Commit(base, size, name);
+    }
+    prev = range;
+    range = range->next;
+  }
+  FATAL1("Failed to allocate %" Pd " bytes in the compressed heap\n", size);
+  return VirtualMemory();
+}
+
+void Reservation::Free(VirtualMemory memory) {
+  memory.Decommit();
+  uword base = memory.base();
+  size_t size = memory.size();
+
+  // Ranges are kept sorted by address so neighbors can be merged.
+  FreeRange* prev = nullptr;
+  FreeRange* next = free_ranges_;
+  while ((next != nullptr) && (next->base < base)) {
+    prev = next;
+    next = next->next;
+  }
+  if ((prev != nullptr) && (prev->base + prev->size == base)) {
+    prev->size += size;
+    if ((next != nullptr) && (prev->base + prev->size == next->base)) {
+      prev->size += next->size;
+      prev->next = next->next;
+      delete next;
+    }
+    return;
+  }
+  if ((next != nullptr) && (base + size == next->base)) {
+    next->base = base;
+    next->size += size;
+    return;
+  }
+  FreeRange* range = new FreeRange;
+  range->base = base;
+  range->size = size;
+  range->next = next;
+  if (prev == nullptr) {
+    free_ranges_ = range;
+  } else {
+    prev->next = range;
+  }
+}
+#endif  // USE_COMPRESSED_POINTERS
+
 Heap::Heap() :
     top_(0),
     end_(0),
@@ -100,9 +180,23 @@ Heap::Heap() :
     handles_(),
     handles_size_(0),
     ephemeron_list_(nullptr),
-    weak_list_(nullptr) {
-  to_.Allocate(kInitialSemispaceCapacity);
-  from_.Allocate(kInitialSemispaceCapacity);
+    ephemeron_table_(nullptr),
+    ephemeron_table_capacity_(0),
+    ephemeron_table_used_(0),
+    ephemeron_table_size_(0),
+    weak_list_(nullptr),
+    allocation_sites_(),
+    new_samples_(),
+    new_samples_size_(0),
+    old_samples_(),
+    old_samples_size_(0),
+    allocation_sample_countdown_(kAllocationSampleInterval),
+    allocation_sample_pending_(false),
+    pretenured_sites_(0) {
+  to_.Initialize(AllocateMemory(kInitialSemispaceCapacity,
+                                "primordialsoup-heap"));
+  from_.Initialize(AllocateMemory(kInitialSemispaceCapacity,
+                                  "primordialsoup-heap"));
   top_ = to_.object_start();
   end_ = to_.limit();
 
@@ -124,16 +218,33 @@ Heap::Heap() :
 }
 
 Heap::~Heap() {
-  to_.Free();
-  from_.Free();
+  FreeMemory(to_.memory_);
+  FreeMemory(from_.memory_);
   Region* region = regions_;
   while (region != nullptr) {
     Region* next = region->next();
-    region->Free();
+    FreeMemory(region->memory());
     region = next;
   }
   delete[] remembered_set_;
   delete[] class_table_;
+  delete[] ephemeron_table_;
+}
+
+VirtualMemory Heap::AllocateMemory(size_t size, const char* name) {
+#if USE_COMPRESSED_POINTERS
+  return reservation_.Allocate(size, name);
+#else
+  return VirtualMemory::Allocate(size, VirtualMemory::kReadWrite, name);
+#endif
+}
+
+void Heap::FreeMemory(VirtualMemory memory) {
+#if USE_COMPRESSED_POINTERS
+  reservation_.Free(memory);
+#else
+  memory.Free();
+#endif
 }
 
 Message Heap::AllocateMessage() {
@@ -252,7 +363,9 @@ uword Heap::AllocateSnapshotSmall(intptr_t size) {
 uword Heap::AllocateSnapshotLarge(intptr_t size) {
   ASSERT(size >= kLargeAllocation);
   uword addr;
-  Region* region = Region::Allocate(size + AllocationSize(sizeof(Region)));
+  Region* region = Region::Initialize(
+      AllocateMemory(size + AllocationSize(sizeof(Region)),
+                     "primordialsoup-heap"));
   old_capacity_ += region->size();
   // Keep the current region since it likely still has free space.
   if (regions_ == nullptr) {
@@ -276,7 +389,8 @@ Region* Heap::AllocateRegion(intptr_t region_size, GrowthPolicy growth) {
   if ((growth == kControlGrowth) && ((old_size_ + region_size) > old_limit_)) {
     MarkSweep(kOldSpace);
   }
-  Region* region = Region::Allocate(region_size);
+  Region* region = Region::Initialize(
+      AllocateMemory(region_size, "primordialsoup-heap"));
   old_capacity_ += region->size();
   region->set_next(regions_);
   regions_ = region;
@@ -338,16 +452,17 @@ void Heap::Scavenge(Reason reason) {
   // Strong references.
   ScavengeRoots();
   uword scan = to_.object_start();
-  while (scan < top_ || end_ < to_.limit()) {
+  while (scan < top_ || end_ < to_.limit() || ephemeron_list_ != nullptr) {
     scan = ScavengeToSpace(scan);
     ProcessTenureStack();
     ScavengeEphemeronList();
   }
 
   // Weak references.
-  MournEphemeronList();
+  MournEphemeronTable();
   MournWeakListScavenge();
   MournClassTableScavenge();
+  MournAllocationSamplesScavenge();
 
 #if defined(DEBUG)
   from_.MarkUnallocated();
@@ -402,8 +517,9 @@ void Heap::FlipSpaces() {
       OS::PrintErr("Growing new space to %" Pd "MB\n",
                    next_semispace_capacity_ / MB);
     }
-    to_.Free();
-    to_.Allocate(next_semispace_capacity_);
+    FreeMemory(to_.memory_);
+    to_.Initialize(AllocateMemory(next_semispace_capacity_,
+                                  "primordialsoup-heap"));
   }
 
   ASSERT(to_.size() >= from_.size());
@@ -426,12 +542,13 @@ static void ForwardClass(Heap* heap, HeapObject object) {
   }
 }
 
-static void ForwardPointer(Object* ptr) {
-  Object old_target = *ptr;
+template<typename type>
+static void ForwardPointer(type* ptr) {
+  Object old_target = LoadSlot(ptr);
   if (old_target->IsForwardingCorpse()) {
     Object new_target = static_cast<ForwardingCorpse>(old_target)->target();
     ASSERT(!new_target->IsForwardingCorpse());
-    *ptr = new_target;
+    StoreSlot(ptr, new_target);
   }
 }
 
@@ -474,10 +591,10 @@ uword Heap::ScavengeToSpace(uword scan) {
     } else if (cid == kEphemeronCid) {
       AddToEphemeronList(static_cast<Ephemeron>(obj));
     } else {
-      Object* from;
-      Object* to;
+      ObjectSlot* from;
+      ObjectSlot* to;
       obj->Pointers(&from, &to);
-      for (Object* ptr = from; ptr <= to; ptr++) {
+      for (ObjectSlot* ptr = from; ptr <= to; ptr++) {
         ScavengePointer(ptr);
       }
     }
@@ -536,8 +653,9 @@ static void SetForwarded(HeapObject old_obj, HeapObject new_obj) {
   *reinterpret_cast<uword*>(old_obj->Addr()) = header;
 }
 
-void Heap::ScavengePointer(Object* ptr) {
-  HeapObject old_target = static_cast<HeapObject>(*ptr);
+template<typename type>
+void Heap::ScavengePointer(type* ptr) {
+  HeapObject old_target = static_cast<HeapObject>(LoadSlot(ptr));
   if (old_target->IsImmediateOrOldObject()) {
     return;
   }
@@ -564,11 +682,14 @@ void Heap::ScavengePointer(Object* ptr) {
            size);
     new_target = HeapObject::FromAddr(new_target_addr);
     SetForwarded(old_target, new_target);
+    if (ephemeron_table_size_ != 0) {
+      ReleaseEphemerons(old_target);
+    }
   }
 
   DEBUG_ASSERT(new_target->IsOldObject() || InToSpace(new_target));
 
-  *ptr = new_target;
+  StoreSlot(ptr, static_cast<Object>(new_target));
 }
 
 void Heap::ScavengeOldObject(HeapObject obj) {
@@ -579,12 +700,12 @@ void Heap::ScavengeOldObject(HeapObject obj) {
   } else if (cid == kEphemeronCid) {
     AddToEphemeronList(static_cast<Ephemeron>(obj));
   } else {
-    Object* from;
-    Object* to;
+    ObjectSlot* from;
+    ObjectSlot* to;
     obj->Pointers(&from, &to);
-    for (Object* ptr = from; ptr <= to; ptr++) {
+    for (ObjectSlot* ptr = from; ptr <= to; ptr++) {
       ScavengePointer(ptr);
-      if ((*ptr)->IsNewObject() && !obj->is_remembered()) {
+      if (LoadSlot(ptr)->IsNewObject() && !obj->is_remembered()) {
         AddToRememberedSet(obj);
       }
     }
@@ -623,6 +744,9 @@ void Heap::ScavengeClass(intptr_t cid) {
          size);
   HeapObject new_target = HeapObject::FromAddr(new_target_addr);
   SetForwarded(old_target, new_target);
+  if (ephemeron_table_size_ != 0) {
+    ReleaseEphemerons(old_target);
+  }
 }
 
 void Heap::MarkSweep(Reason reason) {
@@ -646,7 +770,7 @@ void Heap::MarkSweep(Reason reason) {
 
   // Strong references.
   MarkRoots();
-  while (!mark_stack->IsEmpty()) {
+  while (!mark_stack->IsEmpty() || ephemeron_list_ != nullptr) {
     ProcessMarkStack();
     MarkEphemeronList();
   }
@@ -658,9 +782,10 @@ void Heap::MarkSweep(Reason reason) {
   ASSERT(old_size_ <= old_capacity_);
 
   // Weak references.
-  MournEphemeronList();
+  MournEphemeronTable();
   MournWeakListMarkSweep();
   MournClassTableMarkSweep();
+  MournAllocationSamplesMarkSweep();
 
   interpreter_->GCEpilogue();
 
@@ -709,6 +834,9 @@ void Heap::MarkObject(Object obj) {
   heap_obj->set_is_remembered(false);
   MarkStack* mark_stack = reinterpret_cast<MarkStack*>(from_.base());
   mark_stack->Push(heap_obj);
+  if (ephemeron_table_size_ != 0) {
+    ReleaseEphemerons(heap_obj);
+  }
 }
 
 void Heap::ProcessMarkStack() {
@@ -730,12 +858,12 @@ void Heap::ProcessMarkStack() {
     } else if (cid == kEphemeronCid) {
       AddToEphemeronList(static_cast<Ephemeron>(obj));
     } else {
-      Object* from;
-      Object* to;
+      ObjectSlot* from;
+      ObjectSlot* to;
       obj->Pointers(&from, &to);
       bool has_new_target = ClassAt(cid)->IsNewObject();
-      for (Object* ptr = from; ptr <= to; ptr++) {
-        Object target = *ptr;
+      for (ObjectSlot* ptr = from; ptr <= to; ptr++) {
+        Object target = LoadSlot(ptr);
         has_new_target |= target->IsNewObject();
         MarkObject(target);
       }
@@ -793,7 +921,7 @@ void Heap::Sweep() {
         prev->set_next(next);
       }
       old_capacity_ -= region->size();
-      region->Free();
+      FreeMemory(region->memory());
       region = next;
     }
   }
@@ -841,24 +969,197 @@ void Heap::SetOldAllocationLimit() {
   }
 }
 
+AllocationSite* Heap::LookupAllocationSite(uword key, bool insert) {
+  if (key == 0) {
+    return UnknownAllocationSite();
+  }
+  // Linear probing. Sites are never evicted, since that would lose the
+  // history that stops a site from flipping back and forth; a site whose
+  // probes are all taken is left unattributed.
+  intptr_t index = key % (kAllocationSites - 1);
+  for (intptr_t i = 0; i < kAllocationSiteProbes; i++) {
+    AllocationSite* site = &allocation_sites_[1 + index];
+    if (site->key_ == key) {
+      return site;
+    }
+    if (site->key_ == 0) {
+      if (!insert) {
+        break;
+      }
+      site->key_ = key;
+      return site;
+    }
+    index = (index + 1) % (kAllocationSites - 1);
+  }
+  return UnknownAllocationSite();
+}
+
+void Heap::MournAllocationSamplesScavenge() {
+  // Samples in new space are judged by whether they survived their first
+  // scavenge.
+  for (intptr_t i = 0; i < new_samples_size_; i++) {
+    AllocationSample sample = new_samples_[i];
+    HeapObject obj = HeapObject::FromAddr(sample.addr);
+    DEBUG_ASSERT(InFromSpace(obj));
+    RecordSurvival(sample.site, IsForwarded(obj));
+  }
+  new_samples_size_ = 0;
+}
+
+void Heap::MournAllocationSamplesMarkSweep() {
+  // Samples in old space come from pretenured sites. Samples in new space have
+  // not moved and wait for the next scavenge.
+  for (intptr_t i = 0; i < old_samples_size_; i++) {
+    AllocationSample sample = old_samples_[i];
+    HeapObject obj = HeapObject::FromAddr(sample.addr);
+    ASSERT(obj->IsOldObject());
+    RecordSurvival(sample.site, obj->is_marked());
+  }
+  old_samples_size_ = 0;
+}
+
+void Heap::RecordSurvival(AllocationSite* site, bool survived) {
+  static const intptr_t kMinSamples = 64;
+  static const intptr_t kPretenurePercent = 90;
+  static const intptr_t kDeoptPercent = 50;
+  static const intptr_t kMaxDeopts = 3;
+
+  site->sampled_++;
+  if (survived) {
+    site->survived_++;
+  }
+  if (site->sampled_ < kMinSamples) {
+    return;
+  }
+
+  intptr_t percent = (site->survived_ * 100) / site->sampled_;
+  if (!site->pretenure_) {
+    if ((percent >= kPretenurePercent) && (site->deopts_ < kMaxDeopts)) {
+      site->pretenure_ = true;
+      pretenured_sites_++;
+      if (TRACE_PRETENURING) {
+        OS::PrintErr("Pretenuring site %" Px " (%" Pd "%% survived)\n",
+                     site->key_, percent);
+      }
+    }
+  } else if (percent < kDeoptPercent) {
+    site->pretenure_ = false;
+    site->deopts_++;
+    pretenured_sites_--;
+    if (TRACE_PRETENURING) {
+      OS::PrintErr("Deoptimizing site %" Px " (%" Pd "%% survived)\n",
+                   site->key_, percent);
+    }
+  }
+  site->sampled_ = 0;
+  site->survived_ = 0;
+}
+
 void Heap::AddToEphemeronList(Ephemeron survivor) {
   DEBUG_ASSERT(survivor->IsOldObject() || InToSpace(survivor));
   survivor->set_next(ephemeron_list_);
   ephemeron_list_ = survivor;
 }
 
+static uword EphemeronHash(uword key) {
+  uword hash = (key >> kObjectAlignmentLog2) *
+      static_cast<uword>(0x9E3779B97F4A7C15ULL);
+  return hash ^ (hash >> (kBitsPerWord / 2));
+}
+
+void Heap::AddToEphemeronTable(Ephemeron survivor) {
+  if (2 * (ephemeron_table_used_ + 1) > ephemeron_table_capacity_) {
+    GrowEphemeronTable();
+  }
+
+  uword key = static_cast<HeapObject>(survivor->key())->Addr();
+  intptr_t mask = ephemeron_table_capacity_ - 1;
+  intptr_t index = EphemeronHash(key) & mask;
+  for (;;) {
+    EphemeronBucket* bucket = &ephemeron_table_[index];
+    if (bucket->key == 0) {
+      bucket->key = key;
+      bucket->ephemerons = survivor;
+      survivor->set_next(nullptr);
+      ephemeron_table_used_++;
+      ephemeron_table_size_++;
+      return;
+    }
+    if (bucket->key == key) {
+      // Once released, a key is known to survive and is never waited on again.
+      ASSERT(bucket->ephemerons != nullptr);
+      survivor->set_next(bucket->ephemerons);
+      bucket->ephemerons = survivor;
+      return;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+void Heap::GrowEphemeronTable() {
+  EphemeronBucket* old_table = ephemeron_table_;
+  intptr_t old_capacity = ephemeron_table_capacity_;
+  intptr_t new_capacity = old_capacity == 0 ? 64 : old_capacity;
+  while (new_capacity < 4 * (ephemeron_table_size_ + 1)) {
+    new_capacity *= 2;
+  }
+
+  // Released buckets are dropped.
+  ephemeron_table_ = new EphemeronBucket[new_capacity]();
+  ephemeron_table_capacity_ = new_capacity;
+  ephemeron_table_used_ = ephemeron_table_size_;
+  intptr_t mask = new_capacity - 1;
+  for (intptr_t i = 0; i < old_capacity; i++) {
+    if (old_table[i].ephemerons == nullptr) {
+      continue;
+    }
+    intptr_t index = EphemeronHash(old_table[i].key) & mask;
+    while (ephemeron_table_[index].key != 0) {
+      index = (index + 1) & mask;
+    }
+    ephemeron_table_[index] = old_table[i];
+  }
+  delete[] old_table;
+}
+
+void Heap::ReleaseEphemerons(HeapObject key) {
+  uword addr = key->Addr();
+  intptr_t mask = ephemeron_table_capacity_ - 1;
+  intptr_t index = EphemeronHash(addr) & mask;
+  for (;;) {
+    EphemeronBucket* bucket = &ephemeron_table_[index];
+    if (bucket->key == 0) {
+      return;
+    }
+    if (bucket->key == addr) {
+      Ephemeron last = bucket->ephemerons;
+      ASSERT(last != nullptr);
+      while (last->next() != nullptr) {
+        last = last->next();
+      }
+      // The key now survives; return its ephemerons to the list to have their
+      // values traced.
+      last->set_next(ephemeron_list_);
+      ephemeron_list_ = bucket->ephemerons;
+      bucket->ephemerons = nullptr;
+      ephemeron_table_size_--;
+      return;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
 static bool IsScavengeSurvivor(Object obj) {
   return obj->IsImmediateOrOldObject() ||
       IsForwarded(static_cast<HeapObject>(obj));
 }
 
 void Heap::ScavengeEphemeronList() {
-  Ephemeron survivor = ephemeron_list_;
-  ephemeron_list_ = nullptr;
-
-  while (survivor != nullptr) {
+  // Scavenging may release more ephemerons onto the list as we go.
+  while (ephemeron_list_ != nullptr) {
+    Ephemeron survivor = ephemeron_list_;
     ASSERT(survivor->IsEphemeron());
-    Ephemeron next = survivor->next();
+    ephemeron_list_ = survivor->next();
     survivor->set_next(nullptr);
 
     if (IsScavengeSurvivor(survivor->key())) {
@@ -874,12 +1175,9 @@ void Heap::ScavengeEphemeronList() {
         AddToRememberedSet(survivor);
       }
     } else {
-      // Fate of key is not yet known, return the ephemeron to list.
-      survivor->set_next(ephemeron_list_);
-      ephemeron_list_ = survivor;
+      // Fate of key is not yet known; wait for it to be forwarded.
+      AddToEphemeronTable(survivor);
     }
-
-    survivor = next;
   }
 }
 
@@ -888,18 +1186,14 @@ static bool IsMarkSweepSurvivor(Object obj) {
 }
 
 void Heap::MarkEphemeronList() {
-  Ephemeron survivor = ephemeron_list_;
-  ephemeron_list_ = nullptr;
-
-  while (survivor != nullptr) {
+  // Marking may release more ephemerons onto the list as we go.
+  while (ephemeron_list_ != nullptr) {
+    Ephemeron survivor = ephemeron_list_;
     ASSERT(survivor->IsEphemeron());
-    Ephemeron next = survivor->next();
+    ephemeron_list_ = survivor->next();
     survivor->set_next(nullptr);
 
     if (IsMarkSweepSurvivor(survivor->key())) {
-      // TODO(rmacnak): These scavenges potentially add to the ephemeron list
-      // that we are in the middle of traversing. Add tests for ephemerons
-      // only reachable from another ephemeron.
       MarkObject(survivor->key());
       MarkObject(survivor->value());
       MarkObject(survivor->finalizer());
@@ -912,33 +1206,39 @@ void Heap::MarkEphemeronList() {
         AddToRememberedSet(survivor);
       }
     } else {
-      // Fate of the key is not yet known; add the ephemeron back to the list.
-      survivor->set_next(ephemeron_list_);
-      ephemeron_list_ = survivor;
+      // Fate of the key is not yet known; wait for it to be marked.
+      AddToEphemeronTable(survivor);
     }
-
-    survivor = next;
   }
 }
 
-void Heap::MournEphemeronList() {
-  Object nil = interpreter_->nil_obj();
-  Ephemeron survivor = ephemeron_list_;
-  ephemeron_list_ = nullptr;
-
-  while (survivor != nullptr) {
-    ASSERT(survivor->IsEphemeron());
-
-    survivor->set_key(nil, kNoBarrier);
-    survivor->set_value(nil, kNoBarrier);
-    // TODO(rmacnak): Put the finalizer on a queue for the event loop
-    // to process.
-    survivor->set_finalizer(nil, kNoBarrier);
+void Heap::MournEphemeronTable() {
+  ASSERT(ephemeron_list_ == nullptr);
+  if (ephemeron_table_used_ == 0) {
+    return;
+  }
 
-    Ephemeron next = survivor->next();
-    survivor->set_next(nullptr);
-    survivor = next;
+  Object nil = interpreter_->nil_obj();
+  for (intptr_t i = 0; i < ephemeron_table_capacity_; i++) {
+    Ephemeron survivor = ephemeron_table_[i].ephemerons;
+    while (survivor != nullptr) {
+      ASSERT(survivor->IsEphemeron());
+
+      survivor->set_key(nil, kNoBarrier);
+      survivor->set_value(nil, kNoBarrier);
+      // TODO(rmacnak): Put the finalizer on a queue for the event loop
+      // to process.
+      survivor->set_finalizer(nil, kNoBarrier);
+
+      Ephemeron next = survivor->next();
+      survivor->set_next(nullptr);
+      survivor = next;
+    }
+    ephemeron_table_[i].key = 0;
+    ephemeron_table_[i].ephemerons = nullptr;
   }
+  ephemeron_table_used_ = 0;
+  ephemeron_table_size_ = 0;
 }
 
 void Heap::AddToWeakList(WeakArray survivor) {
@@ -953,13 +1253,13 @@ void Heap::MournWeakListScavenge() {
   while (survivor != nullptr) {
     ASSERT(survivor->IsWeakArray());
 
-    Object* from;
-    Object* to;
+    ObjectSlot* from;
+    ObjectSlot* to;
     survivor->Pointers(&from, &to);
-    for (Object* ptr = from; ptr <= to; ptr++) {
+    for (ObjectSlot* ptr = from; ptr <= to; ptr++) {
       MournWeakPointerScavenge(ptr);
       if (survivor->IsOldObject() &&
-          (*ptr)->IsNewObject() &&
+          LoadSlot(ptr)->IsNewObject() &&
           !survivor->is_remembered()) {
         AddToRememberedSet(survivor);
       }
@@ -978,13 +1278,13 @@ void Heap::MournWeakListMarkSweep() {
   while (survivor != nullptr) {
     ASSERT(survivor->IsWeakArray());
 
-    Object* from;
-    Object* to;
+    ObjectSlot* from;
+    ObjectSlot* to;
     survivor->Pointers(&from, &to);
-    for (Object* ptr = from; ptr <= to; ptr++) {
+    for (ObjectSlot* ptr = from; ptr <= to; ptr++) {
       MournWeakPointerMarkSweep(ptr);
       if (survivor->IsOldObject() &&
-          (*ptr)->IsNewObject() &&
+          LoadSlot(ptr)->IsNewObject() &&
           !survivor->is_remembered()) {
         AddToRememberedSet(survivor);
       }
@@ -998,8 +1298,8 @@ void Heap::MournWeakListMarkSweep() {
 }
 
 
-void Heap::MournWeakPointerScavenge(Object* ptr) {
-  HeapObject old_target = static_cast<HeapObject>(*ptr);
+void Heap::MournWeakPointerScavenge(ObjectSlot* ptr) {
+  HeapObject old_target = static_cast<HeapObject>(LoadSlot(ptr));
   if (old_target->IsImmediateOrOldObject()) {
     return;
   }
@@ -1016,11 +1316,11 @@ void Heap::MournWeakPointerScavenge(Object* ptr) {
 
   DEBUG_ASSERT(new_target->IsOldObject() || InToSpace(new_target));
 
-  *ptr = new_target;
+  StoreSlot(ptr, static_cast<Object>(new_target));
 }
 
-void Heap::MournWeakPointerMarkSweep(Object* ptr) {
-  Object target = *ptr;
+void Heap::MournWeakPointerMarkSweep(ObjectSlot* ptr) {
+  Object target = LoadSlot(ptr);
 
   if (IsMarkSweepSurvivor(target)) {
     // Target is still alive.
@@ -1028,7 +1328,7 @@ void Heap::MournWeakPointerMarkSweep(Object* ptr) {
   }
 
   ASSERT(IsMarkSweepSurvivor(interpreter_->nil_obj()));
-  *ptr = interpreter_->nil_obj();
+  StoreSlot(ptr, interpreter_->nil_obj());
 }
 
 void Heap::MournClassTableScavenge() {
@@ -1130,6 +1430,7 @@ bool Heap::BecomeForward(Array old, Array neu) {
   MournClassTableForwarded();
 
   interpreter_->GCEpilogue();
+  interpreter_->InvalidateCompiledCode();
 
   return true;
 }
@@ -1157,10 +1458,10 @@ void Heap::ForwardHeap() {
     HeapObject obj = HeapObject::FromAddr(scan);
     if (obj->cid() >= kFirstLegalCid) {
       ForwardClass(this, obj);
-      Object* from;
-      Object* to;
+      ObjectSlot* from;
+      ObjectSlot* to;
       obj->Pointers(&from, &to);
-      for (Object* ptr = from; ptr <= to; ptr++) {
+      for (ObjectSlot* ptr = from; ptr <= to; ptr++) {
         ForwardPointer(ptr);
       }
     }
@@ -1175,12 +1476,12 @@ void Heap::ForwardHeap() {
       if (obj->cid() >= kFirstLegalCid) {
         ForwardClass(this, obj);
         obj->set_is_remembered(false);
-        Object* from;
-        Object* to;
+        ObjectSlot* from;
+        ObjectSlot* to;
         obj->Pointers(&from, &to);
-        for (Object* ptr = from; ptr <= to; ptr++) {
+        for (ObjectSlot* ptr = from; ptr <= to; ptr++) {
           ForwardPointer(ptr);
-          if ((*ptr)->IsNewObject() && !obj->is_remembered()) {
+          if (LoadSlot(ptr)->IsNewObject() && !obj->is_remembered()) {
             AddToRememberedSet(obj);
           }
         }
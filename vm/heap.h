@@ -14,6 +14,7 @@
 
 namespace psoup {
 
+class AllocationSite;
 class Interpreter;
 class Region;
 
@@ -32,23 +33,47 @@ static intptr_t AllocationSize(intptr_t size) {
   return Utils::RoundUp(size, kObjectAlignment);
 }
 
+#if USE_COMPRESSED_POINTERS
+// The range that holds all of an isolate's heap, and its interpreter stack,
+// when heap references are compressed. Parts are committed first-fit and
+// coalesce when freed.
+class Reservation {
+ private:
+  friend class Heap;
+
+  static const size_t kGranularity = 64 * KB;
+
+  struct FreeRange {
+    uword base;
+    size_t size;
+    FreeRange* next;
+  };
+
+  Reservation();
+  ~Reservation();
+
+  VirtualMemory Allocate(size_t size, const char* name);
+  void Free(VirtualMemory memory);
+
+  VirtualMemory memory_;
+  FreeRange* free_ranges_;
+
+  DISALLOW_COPY_AND_ASSIGN(Reservation);
+};
+#endif
+
 class Semispace {
  private:
   friend class Heap;
 
-  void Allocate(size_t size) {
-    memory_ = VirtualMemory::Allocate(size,
-                                      VirtualMemory::kReadWrite,
-                                      "primordialsoup-heap");
+  void Initialize(VirtualMemory memory) {
+    memory_ = memory;
     ASSERT(Utils::IsAligned(memory_.base(), kObjectAlignment));
-    ASSERT(memory_.size() == size);
 #if defined(DEBUG)
     MarkUnallocated();
 #endif
   }
 
-  void Free() { memory_.Free(); }
-
   size_t size() const { return memory_.size(); }
   uword base() const { return memory_.base(); }
   uword limit() const { return memory_.limit(); }
@@ -68,6 +93,32 @@ class Semispace {
   VirtualMemory memory_;
 };
 
+// Survival feedback for the objects allocated by one send site (a method and
+// bytecode index). Sites whose sampled objects keep surviving their first
+// scavenge allocate directly in old space, sparing the scavenger from copying
+// them twice; sites whose pretenured objects stop surviving go back to new
+// space.
+//
+// Daniel Clifford, Hannes Payer, Michael Stanton, Ben L. Titzer. "Memento
+// Mori: Dynamic Allocation-Site-Based Optimizations." International Symposium
+// on Memory Management. 2015.
+class AllocationSite {
+ public:
+  bool pretenure() const { return pretenure_; }
+
+ private:
+  friend class Heap;
+
+  AllocationSite()
+      : key_(0), sampled_(0), survived_(0), deopts_(0), pretenure_(false) {}
+
+  uword key_;
+  intptr_t sampled_;
+  intptr_t survived_;
+  intptr_t deopts_;
+  bool pretenure_;
+};
+
 class FreeList {
  private:
   friend class Heap;
@@ -110,8 +161,13 @@ class Heap {
   static const size_t kMaxSemispaceCapacity = 2 * sizeof(uword) * MB;
   static const size_t kRegionSize = 256 * KB;
 
+  struct AllocationSample {
+    uword addr;
+    AllocationSite* site;
+  };
+
  public:
-  enum Allocator { kNormal, kSnapshot };
+  enum Allocator { kNormal, kSnapshot, kPretenured };
 
   enum GrowthPolicy { kControlGrowth, kForceGrowth };
 
@@ -153,18 +209,19 @@ class Heap {
   RegularObject AllocateRegularObject(intptr_t cid, intptr_t num_slots,
                                       Allocator allocator = kNormal) {
     ASSERT(cid == kEphemeronCid || cid >= kFirstRegularObjectCid);
-    const intptr_t heap_size =
-        AllocationSize(num_slots * sizeof(Object) + sizeof(HeapObject::Layout));
+    const intptr_t heap_size = AllocationSize(num_slots * sizeof(ObjectSlot) +
+                                              sizeof(HeapObject::Layout));
     uword addr = Allocate(heap_size, allocator);
     HeapObject obj = HeapObject::Initialize(addr, cid, heap_size);
     RegularObject result = static_cast<RegularObject>(obj);
     ASSERT(result->IsRegularObject() || result->IsEphemeron());
     ASSERT(result->HeapSize() == heap_size);
 
-    const intptr_t header_slots = sizeof(HeapObject::Layout) / sizeof(uword);
-    if (((header_slots + num_slots) & 1) == 1) {
-      // The leftover slot will be visited by the GC. Make it a valid oop.
-      result->set_slot(num_slots, SmallInteger::New(0), kNoBarrier);
+    const intptr_t capacity =
+        (heap_size - sizeof(HeapObject::Layout)) / sizeof(ObjectSlot);
+    for (intptr_t i = num_slots; i < capacity; i++) {
+      // The leftover slots will be visited by the GC. Make them valid oops.
+      result->set_slot(i, SmallInteger::New(0), kNoBarrier);
     }
 
     return result;
@@ -197,7 +254,7 @@ class Heap {
 
   Array AllocateArray(intptr_t num_slots, Allocator allocator = kNormal) {
     const intptr_t heap_size =
-        AllocationSize(num_slots * sizeof(Object) + sizeof(Array::Layout));
+        AllocationSize(num_slots * sizeof(ObjectSlot) + sizeof(Array::Layout));
     uword addr = Allocate(heap_size, allocator);
     HeapObject obj = HeapObject::Initialize(addr, kArrayCid, heap_size);
     Array result = static_cast<Array>(obj);
@@ -209,8 +266,8 @@ class Heap {
 
   WeakArray AllocateWeakArray(intptr_t num_slots,
                               Allocator allocator = kNormal) {
-    const intptr_t heap_size =
-        AllocationSize(num_slots * sizeof(Object) + sizeof(WeakArray::Layout));
+    const intptr_t heap_size = AllocationSize(num_slots * sizeof(ObjectSlot) +
+                                              sizeof(WeakArray::Layout));
     uword addr = Allocate(heap_size, allocator);
     HeapObject obj = HeapObject::Initialize(addr, kWeakArrayCid, heap_size);
     WeakArray result = static_cast<WeakArray>(obj);
@@ -221,8 +278,8 @@ class Heap {
   }
 
   Closure AllocateClosure(intptr_t num_copied, Allocator allocator = kNormal) {
-    const intptr_t heap_size =
-        AllocationSize(num_copied * sizeof(Object) + sizeof(Closure::Layout));
+    const intptr_t heap_size = AllocationSize(num_copied * sizeof(ObjectSlot) +
+                                              sizeof(Closure::Layout));
     uword addr = Allocate(heap_size, allocator);
     HeapObject obj = HeapObject::Initialize(addr, kClosureCid, heap_size);
     Closure result = static_cast<Closure>(obj);
@@ -277,11 +334,56 @@ class Heap {
 
   Message AllocateMessage();
 
+  // Pretenuring. An allocation needs its site only if it will be sampled or
+  // some site might allocate in old space.
+  bool NeedsAllocationSite() {
+    if (!ALLOCATION_SITE_PRETENURING) {
+      return false;
+    }
+    if (--allocation_sample_countdown_ <= 0) {
+      allocation_sample_countdown_ = kAllocationSampleInterval;
+      allocation_sample_pending_ = true;
+      return true;
+    }
+    return pretenured_sites_ != 0;
+  }
+  bool allocation_sample_pending() const { return allocation_sample_pending_; }
+  AllocationSite* UnknownAllocationSite() { return &allocation_sites_[0]; }
+  AllocationSite* LookupAllocationSite(uword key, bool insert);
+  static Allocator AllocatorFor(AllocationSite* site) {
+    return site->pretenure() ? kPretenured : kNormal;
+  }
+  void SampleAllocation(AllocationSite* site, HeapObject object) {
+    if (!allocation_sample_pending_) {
+      return;
+    }
+    allocation_sample_pending_ = false;
+    if (site == UnknownAllocationSite()) {
+      return;
+    }
+    // Old-space samples wait for a mark-sweep, so they get their own budget
+    // and cannot crowd out the samples each scavenge judges.
+    if (object->IsOldObject()) {
+      if (old_samples_size_ < kAllocationSamplesCapacity) {
+        old_samples_[old_samples_size_].addr = object->Addr();
+        old_samples_[old_samples_size_].site = site;
+        old_samples_size_++;
+      }
+    } else {
+      if (new_samples_size_ < kAllocationSamplesCapacity) {
+        new_samples_[new_samples_size_].addr = object->Addr();
+        new_samples_[new_samples_size_].site = site;
+        new_samples_size_++;
+      }
+    }
+  }
+
   size_t Size() const {
     size_t new_size = top_ - to_.object_start();
     return new_size + old_size_;
   }
 
+  void CollectNew(Reason reason) { Scavenge(reason); }
   void CollectAll(Reason reason) { MarkSweep(reason); }
 
   intptr_t CountInstances(intptr_t cid);
@@ -302,6 +404,7 @@ class Heap {
     ASSERT(cid < class_table_size_);
     return static_cast<Behavior>(class_table_[cid]);
   }
+  intptr_t class_table_size() const { return class_table_size_; }
 
   void InitializeInterpreter(Interpreter* interpreter) {
     ASSERT(interpreter_ == nullptr);
@@ -311,6 +414,11 @@ class Heap {
 
   Interpreter* interpreter() const { return interpreter_; }
 
+  // Memory for objects and for the interpreter's stack, which must be in the
+  // reservation when pointers are compressed.
+  VirtualMemory AllocateMemory(size_t size, const char* name);
+  void FreeMemory(VirtualMemory memory);
+
   intptr_t handles() const { return handles_size_; }
   void set_handles(intptr_t value) { handles_size_ = value; }
 
@@ -327,7 +435,8 @@ class Heap {
   uword PopTenureStack();
   bool IsTenureStackEmpty();
   void ProcessTenureStack();
-  void ScavengePointer(Object* ptr);
+  template<typename type>
+  void ScavengePointer(type* ptr);
   void ScavengeOldObject(HeapObject obj);
   void ScavengeClass(intptr_t cid);
 
@@ -340,18 +449,26 @@ class Heap {
   bool SweepRegion(Region* region);
   void SetOldAllocationLimit();
 
+  // Pretenuring.
+  void MournAllocationSamplesScavenge();
+  void MournAllocationSamplesMarkSweep();
+  void RecordSurvival(AllocationSite* site, bool survived);
+
   // Ephemerons.
   void AddToEphemeronList(Ephemeron ephemeron_corpse);
+  void AddToEphemeronTable(Ephemeron survivor);
+  void GrowEphemeronTable();
+  void ReleaseEphemerons(HeapObject key);
   void ScavengeEphemeronList();
   void MarkEphemeronList();
-  void MournEphemeronList();
+  void MournEphemeronTable();
 
   // WeakArrays.
   void AddToWeakList(WeakArray survivor);
   void MournWeakListScavenge();
   void MournWeakListMarkSweep();
-  void MournWeakPointerScavenge(Object* ptr);
-  void MournWeakPointerMarkSweep(Object* ptr);
+  void MournWeakPointerScavenge(ObjectSlot* ptr);
+  void MournWeakPointerMarkSweep(ObjectSlot* ptr);
 
   // Weak class table.
   void MournClassTableScavenge();
@@ -385,6 +502,9 @@ class Heap {
     if (size >= kLargeAllocation) {
       return AllocateOldLarge(size, kControlGrowth);
     }
+    if (allocator == kPretenured) {
+      return AllocateOldSmall(size, kControlGrowth);
+    }
     return AllocateNew(size);
   }
 
@@ -406,6 +526,10 @@ class Heap {
   }
 #endif
 
+#if USE_COMPRESSED_POINTERS
+  Reservation reservation_;
+#endif
+
   // New space.
   uword top_;
   uword end_;
@@ -439,9 +563,38 @@ class Heap {
   intptr_t handles_size_;
   friend class HandleScope;
 
+  // Ephemerons discovered, or whose keys were found to survive, and not yet
+  // examined.
   Ephemeron ephemeron_list_;
+  // Ephemerons whose keys are not yet known to survive, chained through
+  // Ephemeron::next and indexed by the address of their key, so that a key
+  // becoming reachable releases only its own ephemerons. Released buckets keep
+  // their key until the end of the GC so probing continues past them.
+  struct EphemeronBucket {
+    uword key;
+    Ephemeron ephemerons;
+  };
+  EphemeronBucket* ephemeron_table_;
+  intptr_t ephemeron_table_capacity_;
+  intptr_t ephemeron_table_used_;
+  intptr_t ephemeron_table_size_;
+
   WeakArray weak_list_;
 
+  // Pretenuring. Entry 0 is shared by allocations without a known site.
+  static const intptr_t kAllocationSites = 1024;
+  static const intptr_t kAllocationSiteProbes = 4;
+  static const intptr_t kAllocationSampleInterval = 8;
+  static const intptr_t kAllocationSamplesCapacity = 512;
+  AllocationSite allocation_sites_[kAllocationSites];
+  AllocationSample new_samples_[kAllocationSamplesCapacity];
+  intptr_t new_samples_size_;
+  AllocationSample old_samples_[kAllocationSamplesCapacity];
+  intptr_t old_samples_size_;
+  intptr_t allocation_sample_countdown_;
+  bool allocation_sample_pending_;
+  intptr_t pretenured_sites_;
+
   DISALLOW_COPY_AND_ASSIGN(Heap);
 };
 
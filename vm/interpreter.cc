@@ -122,6 +122,8 @@ static Activation FrameBaseSender(Object* fp) {
   return static_cast<Activation>(fp[1]);
 }
 
+std::atomic<size_t> Interpreter::stack_size_(Interpreter::kDefaultStackSize);
+
 Interpreter::Interpreter(Heap* heap, Isolate* isolate) :
     ip_(nullptr),
     sp_(nullptr),
@@ -134,24 +136,40 @@ Interpreter::Interpreter(Heap* heap, Isolate* isolate) :
     object_store_(nullptr),
     heap_(heap),
     isolate_(isolate),
-    environment_(nullptr) {
+    environment_(nullptr),
+    profile_(nullptr) {
   heap->InitializeInterpreter(this);
+  if (PROFILE_BYTECODES) {
+    profile_ = new BytecodeProfile();
+  }
 
-  stack_limit_ = reinterpret_cast<Object*>(malloc(kStackSize));
-  stack_base_ = stack_limit_ + kStackSlots;
+  // Leave room for at least one maximal frame. Frames hold full-width
+  // pointers even when heap slots are compressed.
+  const size_t frame_slots = sizeof(Activation::Layout) / sizeof(ObjectSlot);
+  size_t stack_size = Utils::RoundUp(Interpreter::stack_size(), sizeof(Object));
+  if (stack_size < 2 * frame_slots * sizeof(Object)) {
+    stack_size = 2 * frame_slots * sizeof(Object);
+  }
+  stack_memory_ = heap->AllocateMemory(stack_size, "primordialsoup-stack");
+  stack_limit_ = reinterpret_cast<Object*>(stack_memory_.base());
+  stack_base_ = reinterpret_cast<Object*>(stack_memory_.limit());
   sp_ = stack_base_;
-  checked_stack_limit_ =
-      stack_limit_ + (sizeof(Activation::Layout) / sizeof(Object));
+  checked_stack_limit_ = stack_limit_ + frame_slots;
 
-#if defined(DEBUG)
-  for (intptr_t i = 0; i < kStackSlots; i++) {
-    stack_limit_[i] = static_cast<Object>(kUninitializedWord);
-  }
+#if USE_BASELINE_JIT
+  jit_ = new JIT(this);
 #endif
 }
 
 Interpreter::~Interpreter() {
-  free(stack_limit_);
+  if (PROFILE_BYTECODES) {
+    BytecodeProfile::Merge(profile_);
+    delete profile_;
+  }
+#if USE_BASELINE_JIT
+  delete jit_;
+#endif
+  heap_->FreeMemory(stack_memory_);
 }
 
 void Interpreter::PushIndirectLocal(intptr_t vector_offset, intptr_t offset) {
@@ -283,11 +301,17 @@ void Interpreter::OrdinarySend(String selector,
   Object receiver = Stack(num_args);
   Method target;
   if (lookup_cache_.LookupOrdinary(receiver->ClassId(), selector, &target)) {
+    if (PROFILE_BYTECODES) {
+      CountSend(BytecodeProfile::kOrdinarySend, selector, receiver, true);
+    }
     Activate(target, num_args);  // SAFEPOINT
     return;
   }
 #endif
 
+  if (PROFILE_BYTECODES) {
+    CountSend(BytecodeProfile::kOrdinarySend, selector, Stack(num_args), false);
+  }
   OrdinarySendMiss(selector, num_args);  // SAFEPOINT
 }
 
@@ -344,6 +368,9 @@ void Interpreter::SuperSend(intptr_t selector_index,
                              kSuper,
                              &absent_receiver,
                              &target)) {
+    if (PROFILE_BYTECODES) {
+      CountSend(BytecodeProfile::kSuperSend, selector, receiver, true);
+    }
     ASSERT(absent_receiver == nullptr);
     absent_receiver = receiver;
     ActivateAbsent(target, receiver, num_args);  // SAFEPOINT
@@ -351,6 +378,9 @@ void Interpreter::SuperSend(intptr_t selector_index,
   }
 #endif
 
+  if (PROFILE_BYTECODES) {
+    CountSend(BytecodeProfile::kSuperSend, selector, FrameReceiver(fp_), false);
+  }
   SuperSendMiss(selector, num_args);  // SAFEPOINT
 }
 
@@ -382,6 +412,10 @@ void Interpreter::ImplicitReceiverSend(intptr_t selector_index,
                              kImplicitReceiver,
                              &absent_receiver,
                              &target)) {
+    if (PROFILE_BYTECODES) {
+      CountSend(BytecodeProfile::kImplicitReceiverSend,
+                selector, method_receiver, true);
+    }
     if (absent_receiver == nullptr) {
       absent_receiver = method_receiver;
     }
@@ -390,6 +424,10 @@ void Interpreter::ImplicitReceiverSend(intptr_t selector_index,
   }
 #endif
 
+  if (PROFILE_BYTECODES) {
+    CountSend(BytecodeProfile::kImplicitReceiverSend,
+              selector, FrameReceiver(fp_), false);
+  }
   return ImplicitReceiverSendMiss(selector, num_args);  // SAFEPOINT
 }
 
@@ -438,12 +476,18 @@ void Interpreter::OuterSend(intptr_t selector_index,
                              depth,
                              &absent_receiver,
                              &target)) {
+    if (PROFILE_BYTECODES) {
+      CountSend(BytecodeProfile::kOuterSend, selector, receiver, true);
+    }
     ASSERT(absent_receiver != nullptr);
     ActivateAbsent(target, absent_receiver, num_args);  // SAFEPOINT
     return;
   }
 #endif
 
+  if (PROFILE_BYTECODES) {
+    CountSend(BytecodeProfile::kOuterSend, selector, FrameReceiver(fp_), false);
+  }
   OuterSendMiss(selector, num_args, depth);  // SAFEPOINT
 }
 
@@ -477,12 +521,18 @@ void Interpreter::SelfSend(intptr_t selector_index,
                              kSelf,
                              &absent_receiver,
                              &target)) {
+    if (PROFILE_BYTECODES) {
+      CountSend(BytecodeProfile::kSelfSend, selector, receiver, true);
+    }
     ASSERT(absent_receiver == nullptr);
     ActivateAbsent(target, receiver, num_args);  // SAFEPOINT
     return;
   }
 #endif
 
+  if (PROFILE_BYTECODES) {
+    CountSend(BytecodeProfile::kSelfSend, selector, FrameReceiver(fp_), false);
+  }
   SelfSendMiss(selector, num_args);  // SAFEPOINT
 }
 
@@ -493,6 +543,21 @@ void Interpreter::SelfSendMiss(String selector,
   LexicalSend(selector, num_args, receiver, method_mixin, kSelf);  // SAFEPOINT
 }
 
+void Interpreter::CountSend(BytecodeProfile::SendKind kind,
+                            String selector,
+                            Object receiver,
+                            bool cache_hit) {
+  if (fp_ == 0) {
+    return;
+  }
+  Method method = FrameMethod(fp_);
+  intptr_t hash = EnsureMethodHash(method);
+  intptr_t bci = method->BCI(ip_)->value();
+  uword key = (static_cast<uword>(hash) << 16) ^ static_cast<uword>(bci);
+  profile_->CountSend(key, selector->EnsureHash(isolate_)->value(), kind, H,
+                      method, bci, selector, receiver, cache_hit);
+}
+
 void Interpreter::LexicalSend(String selector,
                               intptr_t num_args,
                               Object receiver,
@@ -732,6 +797,9 @@ void Interpreter::Activate(Method method, intptr_t num_args) {
     }
     if ((prim & 256) != 0) {
       // Getter
+      if (PROFILE_BYTECODES) {
+        profile_->CountGetter();
+      }
       intptr_t offset = prim & 255;
       ASSERT(num_args == 0);
       Object receiver = Stack(0);
@@ -741,6 +809,9 @@ void Interpreter::Activate(Method method, intptr_t num_args) {
       return;
     } else if ((prim & 512) != 0) {
       // Setter
+      if (PROFILE_BYTECODES) {
+        profile_->CountSetter();
+      }
       intptr_t offset = prim & 255;
       ASSERT(num_args == 1);
       Object receiver = Stack(1);
@@ -751,10 +822,17 @@ void Interpreter::Activate(Method method, intptr_t num_args) {
       return;
     } else {
       HandleScope h1(H, reinterpret_cast<Object*>(&method));
+      if (PROFILE_BYTECODES) {
+        // Counted before the call: some primitives do not return.
+        profile_->CountPrimitive(prim);
+      }
       if (Primitives::Invoke(prim, num_args, H, this)) {  // SAFEPOINT
         ASSERT(StackDepth() >= 0);
         return;
       }
+      if (PROFILE_BYTECODES) {
+        profile_->CountPrimitiveFailure(prim);
+      }
     }
   }
 
@@ -870,8 +948,8 @@ void Interpreter::StackOverflow() {
     Exit();
   }
 
-  // True overflow: reclaim stack space by moving all frames except the top
-  // frame to the heap.
+  // True overflow: the whole stack reservation is in use. Reclaim stack space
+  // by moving all frames except the top frame to the heap.
   CreateBaseFrame(FlushAllFrames());  // SAFEPOINT
 }
 
@@ -1067,104 +1145,207 @@ void Interpreter::PrintStack() {
   CreateBaseFrame(top);
 }
 
+#if THREADED_DISPATCH && defined(__GNUC__)
+#define USE_THREADED_DISPATCH 1
+#else
+#define USE_THREADED_DISPATCH 0
+#endif
+
+#if USE_THREADED_DISPATCH
+// Each handler ends in its own indirect jump to the next handler instead of
+// sharing the jump at the top of the switch, giving the branch predictor a
+// history per bytecode.
+#define BYTECODE(n) bytecode_##n
+#define UNUSED_BYTECODE unused_bytecode
+#define DISPATCH()                                                             \
+  ASSERT(ip_ != 0);                                                            \
+  ASSERT(sp_ != 0);                                                            \
+  ASSERT(fp_ != 0);                                                            \
+  byte1 = *ip_++;                                                              \
+  if (PROFILE_BYTECODES) profile_->CountBytecode(byte1);                       \
+  goto *dispatch_table[byte1]
+#else
+#define BYTECODE(n) case n
+#define UNUSED_BYTECODE default
+#define DISPATCH() break
+#endif  // USE_THREADED_DISPATCH
+
+#if USE_BASELINE_JIT
+// After sends and returns the top frame may be one with compiled code.
+#define DISPATCH_FRAME()                                                       \
+  RunCompiled();                                                               \
+  DISPATCH()
+// Backward jumps are sampled so methods that are entered rarely but loop for
+// long are compiled too.
+#define DISPATCH_LOOP()                                                        \
+  if (jit_->SampleBackEdge()) RunCompiledLoop();                               \
+  DISPATCH()
+#else
+#define DISPATCH_FRAME() DISPATCH()
+#define DISPATCH_LOOP() DISPATCH()
+#endif
+
 void Interpreter::Interpret() {
+#if USE_THREADED_DISPATCH
+#define B(n) &&bytecode_##n
+#define U &&unused_bytecode
+  static void* const dispatch_table[256] = {
+      B(0), B(1), B(2), B(3), B(4), B(5), B(6), B(7),
+      B(8), B(9), B(10), B(11), B(12), B(13), B(14), B(15),
+      B(16), B(17), B(18), B(19), B(20), B(21), B(22), B(23),
+      B(24), B(25), B(26), B(27), B(28), B(29), B(30), B(31),
+      B(32), B(33), B(34), B(35), B(36), B(37), B(38), B(39),
+      B(40), B(41), B(42), B(43), B(44), B(45), B(46), B(47),
+      B(48), B(49), B(50), B(51), B(52), B(53), B(54), B(55),
+      B(56), B(57), B(58), B(59), B(60), B(61), B(62), B(63),
+      B(64), B(65), B(66), B(67), B(68), B(69), B(70), B(71),
+      B(72), B(73), B(74), B(75), B(76), B(77), B(78), B(79),
+      B(80), B(81), B(82), B(83), B(84), B(85), B(86), B(87),
+      B(88), B(89), B(90), B(91), B(92), B(93), B(94), B(95),
+      B(96), B(97), B(98), B(99), B(100), B(101), B(102), B(103),
+      B(104), B(105), B(106), B(107), B(108), B(109), B(110), B(111),
+      B(112), B(113), B(114), B(115), B(116), B(117), B(118), B(119),
+      B(120), B(121), B(122), B(123), B(124), B(125), B(126), B(127),
+      B(128), B(129), B(130), B(131), B(132), B(133), B(134), B(135),
+      B(136), B(137), B(138), B(139), B(140), B(141), B(142), B(143),
+      B(144), B(145), B(146), B(147), B(148), B(149), B(150), B(151),
+      B(152), B(153), B(154), B(155), B(156), B(157), B(158), B(159),
+      B(160), B(161), B(162), B(163), U, U, B(166), B(167),
+      B(168), B(169), B(170), B(171), B(172), B(173), B(174), B(175),
+      B(176), B(177), B(178), B(179), B(180), B(181), B(182), B(183),
+      B(184), B(185), B(186), B(187), B(188), B(189), B(190), B(191),
+      B(192), B(193), B(194), B(195), B(196), B(197), B(198), B(199),
+      B(200), B(201), B(202), B(203), B(204), B(205), B(206), B(207),
+      U, U, U, U, U, U, U, U,
+      U, U, U, U, U, U, B(222), B(223),
+      U, U, U, U, B(228), B(229), B(230), B(231),
+      U, B(233), U, U, U, U, U, U,
+      B(240), B(241), B(242), B(243), U, B(245), B(246), B(247),
+      B(248), B(249), B(250), B(251), B(252), B(253), B(254), B(255),
+  };
+#undef B
+#undef U
+
+#if USE_BASELINE_JIT
+  RunCompiled();
+#endif
+  uint8_t byte1;
+  DISPATCH();
+  {
+    {
+#else
+#if USE_BASELINE_JIT
+  RunCompiled();
+#endif
   for (;;) {
     ASSERT(ip_ != 0);
     ASSERT(sp_ != 0);
     ASSERT(fp_ != 0);
 
     uint8_t byte1 = *ip_++;
+    if (PROFILE_BYTECODES) {
+      profile_->CountBytecode(byte1);
+    }
     switch (byte1) {
-    case 0: case 1: case 2: case 3: case 4: case 5: case 6: case 7:
-    case 8: case 9: case 10: case 11: case 12: case 13: case 14: case 15:
+#endif  // USE_THREADED_DISPATCH
+    BYTECODE(0): BYTECODE(1): BYTECODE(2): BYTECODE(3): BYTECODE(4):
+    BYTECODE(5): BYTECODE(6): BYTECODE(7):
+    BYTECODE(8): BYTECODE(9): BYTECODE(10): BYTECODE(11): BYTECODE(12):
+    BYTECODE(13): BYTECODE(14): BYTECODE(15):
       ip_ -= (byte1 & 15);
-      break;
-    case 16: case 17: case 18: case 19: case 20: case 21: case 22: case 23:
-    case 24: case 25: case 26: case 27: case 28: case 29: case 30: case 31:
+      DISPATCH_LOOP();
+    BYTECODE(16): BYTECODE(17): BYTECODE(18): BYTECODE(19): BYTECODE(20):
+    BYTECODE(21): BYTECODE(22): BYTECODE(23):
+    BYTECODE(24): BYTECODE(25): BYTECODE(26): BYTECODE(27): BYTECODE(28):
+    BYTECODE(29): BYTECODE(30): BYTECODE(31):
       ip_ += (byte1 & 15);
-      break;
-    case 32: case 33: case 34: case 35: case 36: case 37: case 38: case 39:
-    case 40: case 41: case 42: case 43: case 44: case 45: case 46: case 47: {
+      DISPATCH();
+    BYTECODE(32): BYTECODE(33): BYTECODE(34): BYTECODE(35): BYTECODE(36):
+    BYTECODE(37): BYTECODE(38): BYTECODE(39):
+    BYTECODE(40): BYTECODE(41): BYTECODE(42): BYTECODE(43): BYTECODE(44):
+    BYTECODE(45): BYTECODE(46): BYTECODE(47): {
       Object top = Pop();
       if (top == true_) {
         ip_ += (byte1 & 15);
       } else if (top != false_) {
         SendNonBooleanReceiver(top);
       }
-      break;
+      DISPATCH();
     }
-    case 48: case 49: case 50: case 51: case 52: case 53: case 54: case 55:
-    case 56: case 57: case 58: case 59: case 60: case 61: case 62: case 63: {
+    BYTECODE(48): BYTECODE(49): BYTECODE(50): BYTECODE(51): BYTECODE(52):
+    BYTECODE(53): BYTECODE(54): BYTECODE(55):
+    BYTECODE(56): BYTECODE(57): BYTECODE(58): BYTECODE(59): BYTECODE(60):
+    BYTECODE(61): BYTECODE(62): BYTECODE(63): {
       Object top = Pop();
       if (top == false_) {
         ip_ += (byte1 & 15);
       } else if (top != true_) {
         SendNonBooleanReceiver(top);
       }
-      break;
+      DISPATCH();
     }
-    case 64: case 65: case 66: case 67:
-    case 68: case 69: case 70: case 71:
-    case 72: case 73: case 74: case 75:
-    case 76: case 77: case 78: case 79:
+    BYTECODE(64): BYTECODE(65): BYTECODE(66): BYTECODE(67):
+    BYTECODE(68): BYTECODE(69): BYTECODE(70): BYTECODE(71):
+    BYTECODE(72): BYTECODE(73): BYTECODE(74): BYTECODE(75):
+    BYTECODE(76): BYTECODE(77): BYTECODE(78): BYTECODE(79):
       OrdinarySend(byte1 & 7, (byte1 >> 3) & 1);
-      break;
-    case 80: case 81: case 82: case 83:
-    case 84: case 85: case 86: case 87:
-    case 88: case 89: case 90: case 91:
-    case 92: case 93: case 94: case 95:
+      DISPATCH_FRAME();
+    BYTECODE(80): BYTECODE(81): BYTECODE(82): BYTECODE(83):
+    BYTECODE(84): BYTECODE(85): BYTECODE(86): BYTECODE(87):
+    BYTECODE(88): BYTECODE(89): BYTECODE(90): BYTECODE(91):
+    BYTECODE(92): BYTECODE(93): BYTECODE(94): BYTECODE(95):
       SelfSend(byte1 & 7, (byte1 >> 3) & 1);
-      break;
-    case 96: case 97: case 98: case 99:
-    case 100: case 101: case 102: case 103:
-    case 104: case 105: case 106: case 107:
-    case 108: case 109: case 110: case 111:
+      DISPATCH_FRAME();
+    BYTECODE(96): BYTECODE(97): BYTECODE(98): BYTECODE(99):
+    BYTECODE(100): BYTECODE(101): BYTECODE(102): BYTECODE(103):
+    BYTECODE(104): BYTECODE(105): BYTECODE(106): BYTECODE(107):
+    BYTECODE(108): BYTECODE(109): BYTECODE(110): BYTECODE(111):
       ImplicitReceiverSend(byte1 & 7, (byte1 >> 3) & 1);
-      break;
-    case 112: case 113: case 114: case 115:
-    case 116: case 117: case 118: case 119:
+      DISPATCH_FRAME();
+    BYTECODE(112): BYTECODE(113): BYTECODE(114): BYTECODE(115):
+    BYTECODE(116): BYTECODE(117): BYTECODE(118): BYTECODE(119):
       Push(FrameParameter(fp_, byte1 & 7));
-      break;
-    case 120: case 121: case 122: case 123:
-    case 124: case 125: case 126: case 127:
+      DISPATCH();
+    BYTECODE(120): BYTECODE(121): BYTECODE(122): BYTECODE(123):
+    BYTECODE(124): BYTECODE(125): BYTECODE(126): BYTECODE(127):
       Push(FrameLocal(fp_, byte1 & 7));
-      break;
-    case 128: case 129: case 130: case 131:
-    case 132: case 133: case 134: case 135:
+      DISPATCH();
+    BYTECODE(128): BYTECODE(129): BYTECODE(130): BYTECODE(131):
+    BYTECODE(132): BYTECODE(133): BYTECODE(134): BYTECODE(135):
       FrameLocalPut(fp_, byte1 & 7, Pop());
-      break;
-    case 136: case 137: case 138: case 139:
-    case 140: case 141: case 142: case 143:
+      DISPATCH();
+    BYTECODE(136): BYTECODE(137): BYTECODE(138): BYTECODE(139):
+    BYTECODE(140): BYTECODE(141): BYTECODE(142): BYTECODE(143):
       FrameLocalPut(fp_, byte1 & 7, Stack(0));
-      break;
-    case 144: case 145: case 146: case 147:
-    case 148: case 149: case 150: case 151:
+      DISPATCH();
+    BYTECODE(144): BYTECODE(145): BYTECODE(146): BYTECODE(147):
+    BYTECODE(148): BYTECODE(149): BYTECODE(150): BYTECODE(151):
       PushLiteral(byte1 & 7);
-      break;
-    case 152: Push(nil_); break;
-    case 153: Push(false_); break;
-    case 154: Push(true_); break;
-    case 155: Push(FrameReceiver(fp_)); break;
-    case 156: Push(FrameMethod(fp_)->mixin()); break;
-    case 157: Push(object_store()->message_loop()); break;
-    case 158: Pop(); break;
-    case 159: Push(Stack(0)); break;
-    case 160: Push(SmallInteger::New(-1)); break;
-    case 161: Push(SmallInteger::New(0)); break;
-    case 162: Push(SmallInteger::New(1)); break;
-    case 163: Push(SmallInteger::New(2)); break;
-    case 166: LocalReturn(nil_); break;
-    case 167: LocalReturn(false_); break;
-    case 168: LocalReturn(true_); break;
-    case 169: LocalReturn(FrameReceiver(fp_)); break;
-    case 170: LocalReturn(Pop()); break;
-    case 171: NonLocalReturn(nil_); break;
-    case 172: NonLocalReturn(false_); break;
-    case 173: NonLocalReturn(true_); break;
-    case 174: NonLocalReturn(FrameReceiver(fp_)); break;
-    case 175: NonLocalReturn(Pop()); break;
+      DISPATCH();
+    BYTECODE(152): Push(nil_); DISPATCH();
+    BYTECODE(153): Push(false_); DISPATCH();
+    BYTECODE(154): Push(true_); DISPATCH();
+    BYTECODE(155): Push(FrameReceiver(fp_)); DISPATCH();
+    BYTECODE(156): Push(FrameMethod(fp_)->mixin()); DISPATCH();
+    BYTECODE(157): Push(object_store()->message_loop()); DISPATCH();
+    BYTECODE(158): Pop(); DISPATCH();
+    BYTECODE(159): Push(Stack(0)); DISPATCH();
+    BYTECODE(160): Push(SmallInteger::New(-1)); DISPATCH();
+    BYTECODE(161): Push(SmallInteger::New(0)); DISPATCH();
+    BYTECODE(162): Push(SmallInteger::New(1)); DISPATCH();
+    BYTECODE(163): Push(SmallInteger::New(2)); DISPATCH();
+    BYTECODE(166): LocalReturn(nil_); DISPATCH_FRAME();
+    BYTECODE(167): LocalReturn(false_); DISPATCH_FRAME();
+    BYTECODE(168): LocalReturn(true_); DISPATCH_FRAME();
+    BYTECODE(169): LocalReturn(FrameReceiver(fp_)); DISPATCH_FRAME();
+    BYTECODE(170): LocalReturn(Pop()); DISPATCH_FRAME();
+    BYTECODE(171): NonLocalReturn(nil_); DISPATCH_FRAME();
+    BYTECODE(172): NonLocalReturn(false_); DISPATCH_FRAME();
+    BYTECODE(173): NonLocalReturn(true_); DISPATCH_FRAME();
+    BYTECODE(174): NonLocalReturn(FrameReceiver(fp_)); DISPATCH_FRAME();
+    BYTECODE(175): NonLocalReturn(Pop()); DISPATCH_FRAME();
 #if STATIC_PREDICTION_BYTECODES
-    case 176: {
+    BYTECODE(176): {
       // +
       Object left = Stack(1);
       Object right = Stack(0);
@@ -1174,12 +1355,19 @@ void Interpreter::Interpret() {
         intptr_t raw_result = raw_left + raw_right;
         if (SmallInteger::IsSmiValue(raw_result)) {
           PopNAndPush(2, SmallInteger::New(raw_result));
-          break;
+          DISPATCH();
         }
+      } else if (left->IsFloat64() && right->IsFloat64()) {
+        double raw_result = static_cast<Float64>(left)->value() +
+            static_cast<Float64>(right)->value();
+        Float64 result = H->AllocateFloat64();  // SAFEPOINT
+        result->set_value(raw_result);
+        PopNAndPush(2, result);
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 177: {
+    BYTECODE(177): {
       // -
       Object left = Stack(1);
       Object right = Stack(0);
@@ -1189,20 +1377,59 @@ void Interpreter::Interpret() {
         intptr_t raw_result = raw_left - raw_right;
         if (SmallInteger::IsSmiValue(raw_result)) {
           PopNAndPush(2, SmallInteger::New(raw_result));
-          break;
+          DISPATCH();
         }
+      } else if (left->IsFloat64() && right->IsFloat64()) {
+        double raw_result = static_cast<Float64>(left)->value() -
+            static_cast<Float64>(right)->value();
+        Float64 result = H->AllocateFloat64();  // SAFEPOINT
+        result->set_value(raw_result);
+        PopNAndPush(2, result);
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 178: {
+    BYTECODE(178): {
       // *
+      Object left = Stack(1);
+      Object right = Stack(0);
+      if (left->IsSmallInteger() && right->IsSmallInteger()) {
+        intptr_t raw_left = static_cast<SmallInteger>(left)->value();
+        intptr_t raw_right = static_cast<SmallInteger>(right)->value();
+        intptr_t raw_result;
+        if (!Math::MultiplyHasOverflow(raw_left, raw_right, &raw_result) &&
+            SmallInteger::IsSmiValue(raw_result)) {
+          PopNAndPush(2, SmallInteger::New(raw_result));
+          DISPATCH();
+        }
+      } else if (left->IsFloat64() && right->IsFloat64()) {
+        double raw_result = static_cast<Float64>(left)->value() *
+            static_cast<Float64>(right)->value();
+        Float64 result = H->AllocateFloat64();  // SAFEPOINT
+        result->set_value(raw_result);
+        PopNAndPush(2, result);
+        DISPATCH();
+      }
       goto CommonSendDispatch;
     }
-    case 179: {
+    BYTECODE(179): {
       // //
+      Object left = Stack(1);
+      Object right = Stack(0);
+      if (left->IsSmallInteger() && right->IsSmallInteger()) {
+        intptr_t raw_left = static_cast<SmallInteger>(left)->value();
+        intptr_t raw_right = static_cast<SmallInteger>(right)->value();
+        if (raw_right != 0) {
+          intptr_t raw_result = Math::FloorDiv(raw_left, raw_right);
+          if (SmallInteger::IsSmiValue(raw_result)) {
+            PopNAndPush(2, SmallInteger::New(raw_result));
+            DISPATCH();
+          }
+        }
+      }
       goto CommonSendDispatch;
     }
-    case 180: {
+    BYTECODE(180): {
       /* \\ */
       Object left = Stack(1);
       Object right = Stack(0);
@@ -1213,42 +1440,67 @@ void Interpreter::Interpret() {
           intptr_t raw_result = Math::FloorMod(raw_left, raw_right);
           ASSERT(SmallInteger::IsSmiValue(raw_result));
           PopNAndPush(2, SmallInteger::New(raw_result));
-          break;
+          DISPATCH();
         }
       }
       goto CommonSendDispatch;
     }
-    case 181: {
+    BYTECODE(181): {
       // <<
+      Object left = Stack(1);
+      Object right = Stack(0);
+      if (left->IsSmallInteger() && right->IsSmallInteger()) {
+        intptr_t raw_left = static_cast<SmallInteger>(left)->value();
+        intptr_t raw_right = static_cast<SmallInteger>(right)->value();
+        if ((raw_right >= 0) &&
+            (Utils::BitLength(raw_left) + raw_right < SmallInteger::kBits)) {
+          intptr_t raw_result = Math::ShiftLeft(raw_left, raw_right);
+          PopNAndPush(2, SmallInteger::New(raw_result));
+          DISPATCH();
+        }
+      }
       goto CommonSendDispatch;
     }
-    case 182: {
+    BYTECODE(182): {
       // >>
+      Object left = Stack(1);
+      Object right = Stack(0);
+      if (left->IsSmallInteger() && right->IsSmallInteger()) {
+        intptr_t raw_left = static_cast<SmallInteger>(left)->value();
+        intptr_t raw_right = static_cast<SmallInteger>(right)->value();
+        if (raw_right >= 0) {
+          if (raw_right > SmallInteger::kBits) {
+            raw_right = SmallInteger::kBits;
+          }
+          PopNAndPush(2, SmallInteger::New(raw_left >> raw_right));
+          DISPATCH();
+        }
+      }
       goto CommonSendDispatch;
     }
-    case 183: {
+    BYTECODE(183): {
       // &
       Object left = Stack(1);
       Object right = Stack(0);
       if (left->IsSmallInteger() && right->IsSmallInteger()) {
         PopNAndPush(2, static_cast<SmallInteger>(
             static_cast<intptr_t>(left) & static_cast<intptr_t>(right)));
-        break;
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 184: {
+    BYTECODE(184): {
       // |
       Object left = Stack(1);
       Object right = Stack(0);
       if (left->IsSmallInteger() && right->IsSmallInteger()) {
         PopNAndPush(2, static_cast<SmallInteger>(
             static_cast<intptr_t>(left) | static_cast<intptr_t>(right)));
-        break;
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 185: {
+    BYTECODE(185): {
       // <
       Object left = Stack(1);
       Object right = Stack(0);
@@ -1258,11 +1510,19 @@ void Interpreter::Interpret() {
         } else {
           PopNAndPush(2, false_);
         }
-        break;
+        DISPATCH();
+      } else if (left->IsFloat64() && right->IsFloat64()) {
+        if (static_cast<Float64>(left)->value() <
+            static_cast<Float64>(right)->value()) {
+          PopNAndPush(2, true_);
+        } else {
+          PopNAndPush(2, false_);
+        }
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 186: {
+    BYTECODE(186): {
       // >
       Object left = Stack(1);
       Object right = Stack(0);
@@ -1272,11 +1532,19 @@ void Interpreter::Interpret() {
         } else {
           PopNAndPush(2, false_);
         }
-        break;
+        DISPATCH();
+      } else if (left->IsFloat64() && right->IsFloat64()) {
+        if (static_cast<Float64>(left)->value() >
+            static_cast<Float64>(right)->value()) {
+          PopNAndPush(2, true_);
+        } else {
+          PopNAndPush(2, false_);
+        }
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 187: {
+    BYTECODE(187): {
       // <=
       Object left = Stack(1);
       Object right = Stack(0);
@@ -1286,11 +1554,19 @@ void Interpreter::Interpret() {
         } else {
           PopNAndPush(2, false_);
         }
-        break;
+        DISPATCH();
+      } else if (left->IsFloat64() && right->IsFloat64()) {
+        if (static_cast<Float64>(left)->value() <=
+            static_cast<Float64>(right)->value()) {
+          PopNAndPush(2, true_);
+        } else {
+          PopNAndPush(2, false_);
+        }
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 188: {
+    BYTECODE(188): {
       // >=
       Object left = Stack(1);
       Object right = Stack(0);
@@ -1300,11 +1576,19 @@ void Interpreter::Interpret() {
         } else {
           PopNAndPush(2, false_);
         }
-        break;
+        DISPATCH();
+      } else if (left->IsFloat64() && right->IsFloat64()) {
+        if (static_cast<Float64>(left)->value() >=
+            static_cast<Float64>(right)->value()) {
+          PopNAndPush(2, true_);
+        } else {
+          PopNAndPush(2, false_);
+        }
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 189: {
+    BYTECODE(189): {
       // =
       Object left = Stack(1);
       Object right = Stack(0);
@@ -1314,19 +1598,32 @@ void Interpreter::Interpret() {
         } else {
           PopNAndPush(2, false_);
         }
-        break;
+        DISPATCH();
+      } else if (left->IsFloat64() && right->IsFloat64()) {
+        if (static_cast<Float64>(left)->value() ==
+            static_cast<Float64>(right)->value()) {
+          PopNAndPush(2, true_);
+        } else {
+          PopNAndPush(2, false_);
+        }
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 190: {
+    BYTECODE(190): {
       // new
+      // Not predicted: #new is answered by a class's factory method, which is
+      // ordinary Newspeak code rather than a primitive with a known format.
       goto CommonSendDispatch;
     }
-    case 191: {
+    BYTECODE(191): {
       // new:
+      // Not predicted: the receiver's #new: is only known to be an allocation
+      // primitive after a lookup, which the send does anyway, and Activate
+      // already runs primitives without building a frame.
       goto CommonSendDispatch;
     }
-    case 192: {
+    BYTECODE(192): {
       // at:
       Object array = Stack(1);
       SmallInteger index = static_cast<SmallInteger>(Stack(0));
@@ -1337,20 +1634,20 @@ void Interpreter::Interpret() {
               (raw_index < static_cast<Array>(array)->Size())) {
             Object value = static_cast<Array>(array)->element(raw_index);
             PopNAndPush(2, value);
-            break;
+            DISPATCH();
           }
         } else if (array->IsBytes()) {
           if ((raw_index >= 0) &&
               (raw_index < static_cast<Bytes>(array)->Size())) {
             uint8_t raw_value = static_cast<Bytes>(array)->element(raw_index);
             PopNAndPush(2, SmallInteger::New(raw_value));
-            break;
+            DISPATCH();
           }
         }
       }
       goto CommonSendDispatch;
     }
-    case 193: {
+    BYTECODE(193): {
       // at:put:
       Object array = Stack(2);
       SmallInteger index = static_cast<SmallInteger>(Stack(1));
@@ -1362,7 +1659,7 @@ void Interpreter::Interpret() {
             Object value = Stack(0);
             static_cast<Array>(array)->set_element(raw_index, value);
             PopNAndPush(3, value);
-            break;
+            DISPATCH();
           }
         } else if (array->IsByteArray()) {
           SmallInteger value = static_cast<SmallInteger>(Stack(0));
@@ -1372,96 +1669,96 @@ void Interpreter::Interpret() {
             static_cast<ByteArray>(array)->set_element(raw_index,
                                                         value->value());
             PopNAndPush(3, value);
-            break;
+            DISPATCH();
           }
         }
       }
       goto CommonSendDispatch;
     }
-    case 194: {
+    BYTECODE(194): {
       // size
       Object array = Stack(0);
       if (array->IsArray()) {
         PopNAndPush(1, static_cast<Array>(array)->size());
-        break;
+        DISPATCH();
       } else if (array->IsBytes()) {
         PopNAndPush(1, static_cast<Bytes>(array)->size());
-        break;
+        DISPATCH();
       }
       goto CommonSendDispatch;
     }
-    case 195:
-    case 196: case 197: case 198: case 199:
-    case 200: case 201: case 202: case 203:
-    case 204: case 205: case 206: case 207:
+    BYTECODE(195):
+    BYTECODE(196): BYTECODE(197): BYTECODE(198): BYTECODE(199):
+    BYTECODE(200): BYTECODE(201): BYTECODE(202): BYTECODE(203):
+    BYTECODE(204): BYTECODE(205): BYTECODE(206): BYTECODE(207):
       CommonSendDispatch:
       CommonSend(byte1 - 176);
-      break;
+      DISPATCH_FRAME();
 #else  // !STATIC_PREDICTION_BYTECODES
-    case 176: case 177: case 178: case 179:
-    case 180: case 181: case 182: case 183:
-    case 184: case 185: case 186: case 187:
-    case 188: case 189: case 190: case 191:
-    case 192: case 193: case 194: case 195:
-    case 196: case 197: case 198: case 199:
-    case 200: case 201: case 202: case 203:
-    case 204: case 205: case 206: case 207:
+    BYTECODE(176): BYTECODE(177): BYTECODE(178): BYTECODE(179):
+    BYTECODE(180): BYTECODE(181): BYTECODE(182): BYTECODE(183):
+    BYTECODE(184): BYTECODE(185): BYTECODE(186): BYTECODE(187):
+    BYTECODE(188): BYTECODE(189): BYTECODE(190): BYTECODE(191):
+    BYTECODE(192): BYTECODE(193): BYTECODE(194): BYTECODE(195):
+    BYTECODE(196): BYTECODE(197): BYTECODE(198): BYTECODE(199):
+    BYTECODE(200): BYTECODE(201): BYTECODE(202): BYTECODE(203):
+    BYTECODE(204): BYTECODE(205): BYTECODE(206): BYTECODE(207):
       CommonSend(byte1 - 176);
-      break;
+      DISPATCH_FRAME();
 #endif  // STATIC_PREDICTION_BYTECODES
-    case 222: {
+    BYTECODE(222): {
       uint8_t byte2 = *ip_++;
       PushNewArray(byte2);
-      break;
+      DISPATCH();
     }
-    case 223: {
+    BYTECODE(223): {
       uint8_t byte2 = *ip_++;
       PushNewArrayWithElements(byte2);
-      break;
+      DISPATCH();
     }
-    case 228: {
+    BYTECODE(228): {
       uint8_t byte2 = *ip_++;
       Push(FrameParameter(fp_, byte2));
-      break;
+      DISPATCH();
     }
-    case 229: {
+    BYTECODE(229): {
       uint8_t byte2 = *ip_++;
       ASSERT(byte2 < StackDepth());
       Push(FrameLocal(fp_, byte2));
-      break;
+      DISPATCH();
     }
-    case 230: {
+    BYTECODE(230): {
       uint8_t byte2 = *ip_++;
       ASSERT(byte2 < StackDepth());
       FrameLocalPut(fp_, byte2, Pop());
-      break;
+      DISPATCH();
     }
-    case 231: {
+    BYTECODE(231): {
       uint8_t byte2 = *ip_++;
       ASSERT(byte2 < StackDepth());
       FrameLocalPut(fp_, byte2, Stack(0));
-      break;
+      DISPATCH();
     }
-    case 233: {
+    BYTECODE(233): {
       uint8_t byte2 = *ip_++;
       PushEnclosingObject(byte2);
-      break;
+      DISPATCH();
     }
-    case 240: {
+    BYTECODE(240): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       intptr_t delta = (byte3 << 8) | byte2;
       ip_ -= delta;
-      break;
+      DISPATCH_LOOP();
     }
-    case 241: {
+    BYTECODE(241): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       intptr_t delta = (byte3 << 8) | byte2;
       ip_ += delta;
-      break;
+      DISPATCH();
     }
-    case 242: {
+    BYTECODE(242): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       intptr_t delta = (byte3 << 8) | byte2;
@@ -1471,9 +1768,9 @@ void Interpreter::Interpret() {
       } else if (top != false_) {
         SendNonBooleanReceiver(top);
       }
-      break;
+      DISPATCH();
     }
-    case 243: {
+    BYTECODE(243): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       intptr_t delta = (byte3 << 8) | byte2;
@@ -1483,71 +1780,71 @@ void Interpreter::Interpret() {
       } else if (top != true_) {
         SendNonBooleanReceiver(top);
       }
-      break;
+      DISPATCH();
     }
-    case 245: {
+    BYTECODE(245): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       PushIndirectLocal(byte3, byte2);
-      break;
+      DISPATCH();
     }
-    case 246: {
+    BYTECODE(246): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       PopIntoIndirectLocal(byte3, byte2);
-      break;
+      DISPATCH();
     }
-    case 247: {
+    BYTECODE(247): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       StoreIntoIndirectLocal(byte3, byte2);
-      break;
+      DISPATCH();
     }
-    case 248: {
+    BYTECODE(248): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       PushLiteral((byte3 << 8) | byte2);
-      break;
+      DISPATCH();
     }
-    case 249: {
+    BYTECODE(249): {
       uint8_t byte2 = *ip_++;
       int8_t byte3 = *ip_++;
       Push(SmallInteger::New((byte3 << 8) | byte2));
-      break;
+      DISPATCH();
     }
-    case 250: {
+    BYTECODE(250): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       intptr_t num_args = byte3 >> 4;
       intptr_t selector_index = ((byte3 & 0xF) << 8) | byte2;
       OrdinarySend(selector_index, num_args);
-      break;
+      DISPATCH_FRAME();
     }
-    case 251: {
+    BYTECODE(251): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       intptr_t num_args = byte3 >> 4;
       intptr_t selector_index = ((byte3 & 0xF) << 8) | byte2;
       SelfSend(selector_index, num_args);
-      break;
+      DISPATCH_FRAME();
     }
-    case 252: {
+    BYTECODE(252): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       intptr_t num_args = byte3 >> 4;
       intptr_t selector_index = ((byte3 & 0xF) << 8) | byte2;
       SuperSend(selector_index, num_args);
-      break;
+      DISPATCH_FRAME();
     }
-    case 253: {
+    BYTECODE(253): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       intptr_t num_args = byte3 >> 4;
       intptr_t selector_index = ((byte3 & 0xF) << 8) | byte2;
       ImplicitReceiverSend(selector_index, num_args);
-      break;
+      DISPATCH_FRAME();
     }
-    case 254: {
+    BYTECODE(254): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       uint8_t byte4 = *ip_++;
@@ -1555,9 +1852,9 @@ void Interpreter::Interpret() {
       intptr_t selector_index = ((byte3 & 0xF) << 8) | byte2;
       intptr_t depth = byte4;
       OuterSend(selector_index, num_args, depth);
-      break;
+      DISPATCH_FRAME();
     }
-    case 255: {
+    BYTECODE(255): {
       uint8_t byte2 = *ip_++;
       uint8_t byte3 = *ip_++;
       uint8_t byte4 = *ip_++;
@@ -1565,9 +1862,9 @@ void Interpreter::Interpret() {
       intptr_t num_args = byte2 & 7;
       intptr_t block_size = byte3 | (byte4 << 8);
       PushClosure(num_copied, num_args, block_size);
-      break;
+      DISPATCH();
     }
-    default:
+    UNUSED_BYTECODE:
       FATAL("Unused bytecode");
     }
   }
@@ -1603,6 +1900,9 @@ Activation Interpreter::EnsureActivation(Object* fp) {
 Activation Interpreter::FlushAllFrames() {
   Activation top = EnsureActivation(fp_);  // SAFEPOINT
   HandleScope h1(H, reinterpret_cast<Object*>(&top));
+#if defined(DEBUG)
+  Object* stack_top = sp_;
+#endif
 
   while (fp_ != 0) {
     EnsureActivation(fp_);  // SAFEPOINT
@@ -1637,8 +1937,9 @@ Activation Interpreter::FlushAllFrames() {
   ASSERT(sp_ == stack_base_);
   ASSERT(fp_ == 0);
 #if defined(DEBUG)
-  for (intptr_t i = 0; i < kStackSlots; i++) {
-    stack_limit_[i] = static_cast<Object>(kUninitializedWord);
+  // Only zap what was used to avoid committing the whole reservation.
+  for (Object* ptr = stack_top; ptr < stack_base_; ptr++) {
+    *ptr = static_cast<Object>(kUninitializedWord);
   }
 #endif
 
@@ -1668,6 +1969,36 @@ bool Interpreter::HasLivingFrame(Activation activation) {
   return false;
 }
 
+AllocationSite* Interpreter::CurrentAllocationSite() {
+  if (!heap_->NeedsAllocationSite() || (fp_ == 0)) {
+    return heap_->UnknownAllocationSite();
+  }
+  // Sites are created only by sampling, so an unsampled method without a hash
+  // has none.
+  bool sampled = heap_->allocation_sample_pending();
+  Method method = FrameMethod(fp_);
+  intptr_t hash = sampled ? EnsureMethodHash(method) : method->header_hash();
+  if (hash == 0) {
+    return heap_->UnknownAllocationSite();
+  }
+  intptr_t bci = method->BCI(ip_)->value();
+  uword key = (static_cast<uword>(hash) << 16) ^ static_cast<uword>(bci);
+  return heap_->LookupAllocationSite(key, sampled);
+}
+
+// Methods move, so send and allocation sites identify them by identity hash.
+intptr_t Interpreter::EnsureMethodHash(Method method) {
+  intptr_t hash = method->header_hash();
+  if (hash == 0) {
+    hash = isolate_->random().NextUInt64() & SmallInteger::kMaxValue;
+    if (hash == 0) {
+      hash = 1;
+    }
+    method->set_header_hash(hash);
+  }
+  return hash;
+}
+
 Activation Interpreter::CurrentActivation() {
   return EnsureActivation(fp_);  // SAFEPOINT
 }
@@ -1870,6 +2201,475 @@ void Interpreter::ActivationTempSizePut(Activation activation,
   }
 }
 
+enum HandlerMatch { kNoHandlerMatch, kHandlerMatch, kHandlerUnknown };
+
+// Mirrors Exception>>is:interestedIn:, comparing mixins along the superclass
+// chain of the signaled class.
+static HandlerMatch MatchHandler(Heap* heap,
+                                 Object nil_obj,
+                                 Object handler_class,
+                                 Behavior exception_class) {
+  if (!handler_class->IsRegularObject() ||
+      (handler_class->Klass(heap)->format()->value() < 4)) {
+    return kHandlerUnknown;
+  }
+  Object mixin = static_cast<Behavior>(handler_class)->mixin();
+  Behavior cls = exception_class;
+  while (cls != nil_obj) {
+    if (!cls->IsRegularObject()) {
+      return kHandlerUnknown;
+    }
+    if (cls->mixin() == mixin) {
+      return kHandlerMatch;
+    }
+    cls = cls->superclass();
+  }
+  return kNoHandlerMatch;
+}
+
+Object Interpreter::FindExceptionHandler(Activation start,
+                                         Behavior exception_class) {
+  // Walk frames directly while they are on the stack, and activations once
+  // past the base frame. Only the handler found is given an activation.
+  Object* fp = 0;
+  Activation activation = start;
+  if (HasLivingFrame(start)) {
+    fp = FrameSavedFP(start->sender_fp());
+    if (fp == 0) {
+      activation = FrameBaseSender(start->sender_fp());
+    }
+  } else {
+    activation = start->sender();
+  }
+
+  for (;;) {
+    if (fp != 0) {
+      intptr_t prim = FrameMethod(fp)->Primitive();
+      if (Primitives::IsSimulationRoot(prim)) {
+        return EnsureActivation(fp);  // SAFEPOINT
+      }
+      if (Primitives::IsExceptionHandler(prim) &&
+          (FrameTemp(fp, 2) == true_)) {
+        HandlerMatch match = MatchHandler(H, nil, FrameTemp(fp, 0),
+                                          exception_class);
+        if (match == kHandlerUnknown) {
+          return nullptr;
+        }
+        if (match == kHandlerMatch) {
+          return EnsureActivation(fp);  // SAFEPOINT
+        }
+      }
+      Object* saved_fp = FrameSavedFP(fp);
+      if (saved_fp == 0) {
+        activation = FrameBaseSender(fp);
+      }
+      fp = saved_fp;
+      continue;
+    }
+
+    if (activation == nil) {
+      return nil;
+    }
+    if (!activation->IsActivation()) {
+      return nullptr;
+    }
+    if (HasLivingFrame(activation)) {
+      fp = activation->sender_fp();
+      continue;
+    }
+    intptr_t prim = activation->method()->Primitive();
+    if (Primitives::IsSimulationRoot(prim)) {
+      return activation;
+    }
+    if (Primitives::IsExceptionHandler(prim)) {
+      if (activation->StackDepth() < 3) {
+        return nullptr;
+      }
+      if (activation->temp(2) == true_) {
+        HandlerMatch match = MatchHandler(H, nil, activation->temp(0),
+                                          exception_class);
+        if (match == kHandlerUnknown) {
+          return nullptr;
+        }
+        if (match == kHandlerMatch) {
+          return activation;
+        }
+      }
+    }
+    activation = activation->sender();
+  }
+}
+
+bool Interpreter::ResumeActivation(Activation target, Object result) {
+  if (!target->sender()->IsSmallInteger()) {
+    return false;  // Not on the stack.
+  }
+  Object* target_fp = target->sender_fp();
+
+  // Like the fast path of NonLocalReturn, cutting the stack back to the
+  // target implicitly zaps every frame above it.
+  Object* callee_fp = 0;
+  for (Object* fp = fp_; fp != 0; fp = FrameSavedFP(fp)) {
+    if (fp == target_fp) {
+      if ((callee_fp == 0) || (FrameActivation(fp) != target)) {
+        return false;
+      }
+      ip_ = FrameSavedIP(callee_fp);
+      sp_ = FrameSavedSP(callee_fp);
+      fp_ = fp;
+      Push(result);
+      return true;
+    }
+
+    intptr_t prim = FrameMethod(fp)->Primitive();
+    if (Primitives::IsUnwindProtect(prim) && (FrameTemp(fp, 1) == nil)) {
+      return false;  // The image must run the unwind block.
+    }
+    if (Primitives::IsSimulationRoot(prim)) {
+      return false;
+    }
+    callee_fp = fp;
+  }
+  return false;
+}
+
+#if USE_BASELINE_JIT
+// Executes the bytecode at bci of the top frame on behalf of compiled code,
+// which calls here for the bytecodes it does not compile inline.
+uword Interpreter::CompiledStep(intptr_t bci) {
+  Object* fp = fp_;
+  Method method = FrameMethod(fp);
+  HandleScope h1(H, reinterpret_cast<Object*>(&method));
+  ip_ = method->IP(SmallInteger::New(bci));
+  uint8_t byte1 = *ip_++;
+  intptr_t next_bci = bci + JIT::BytecodeLength(byte1);
+
+  switch (byte1) {
+    case 32: case 33: case 34: case 35: case 36: case 37: case 38: case 39:
+    case 40: case 41: case 42: case 43: case 44: case 45: case 46: case 47: {
+      Object top = Pop();
+      if (top == true_) {
+        ip_ += (byte1 & 15);
+      } else if (top != false_) {
+        SendNonBooleanReceiver(top);
+      }
+      break;
+    }
+    case 48: case 49: case 50: case 51: case 52: case 53: case 54: case 55:
+    case 56: case 57: case 58: case 59: case 60: case 61: case 62: case 63: {
+      Object top = Pop();
+      if (top == false_) {
+        ip_ += (byte1 & 15);
+      } else if (top != true_) {
+        SendNonBooleanReceiver(top);
+      }
+      break;
+    }
+    case 64: case 65: case 66: case 67: case 68: case 69: case 70: case 71:
+    case 72: case 73: case 74: case 75: case 76: case 77: case 78: case 79:
+      OrdinarySend(byte1 & 7, (byte1 >> 3) & 1);
+      break;
+    case 80: case 81: case 82: case 83: case 84: case 85: case 86: case 87:
+    case 88: case 89: case 90: case 91: case 92: case 93: case 94: case 95:
+      SelfSend(byte1 & 7, (byte1 >> 3) & 1);
+      break;
+    case 96: case 97: case 98: case 99:
+    case 100: case 101: case 102: case 103:
+    case 104: case 105: case 106: case 107:
+    case 108: case 109: case 110: case 111:
+      ImplicitReceiverSend(byte1 & 7, (byte1 >> 3) & 1);
+      break;
+    case 144: case 145: case 146: case 147:
+    case 148: case 149: case 150: case 151:
+      PushLiteral(byte1 & 7);
+      break;
+    case 156: Push(FrameMethod(fp_)->mixin()); break;
+    case 157: Push(object_store()->message_loop()); break;
+    case 166: LocalReturn(nil_); break;
+    case 167: LocalReturn(false_); break;
+    case 168: LocalReturn(true_); break;
+    case 169: LocalReturn(FrameReceiver(fp_)); break;
+    case 170: LocalReturn(Pop()); break;
+    case 171: NonLocalReturn(nil_); break;
+    case 172: NonLocalReturn(false_); break;
+    case 173: NonLocalReturn(true_); break;
+    case 174: NonLocalReturn(FrameReceiver(fp_)); break;
+    case 175: NonLocalReturn(Pop()); break;
+    case 176: case 177: case 178: case 179:
+    case 180: case 181: case 182: case 183:
+    case 184: case 185: case 186: case 187:
+    case 188: case 189: case 190: case 191:
+    case 192: case 193: case 194: case 195:
+    case 196: case 197: case 198: case 199:
+    case 200: case 201: case 202: case 203:
+    case 204: case 205: case 206: case 207:
+      CommonSend(byte1 - 176);
+      break;
+    case 222: PushNewArray(*ip_++); break;
+    case 223: PushNewArrayWithElements(*ip_++); break;
+    case 233: PushEnclosingObject(*ip_++); break;
+    case 242:
+    case 243: {
+      uint8_t byte2 = *ip_++;
+      uint8_t byte3 = *ip_++;
+      intptr_t delta = (byte3 << 8) | byte2;
+      Object top = Pop();
+      Object jump_on = (byte1 == 242) ? true_ : false_;
+      Object other = (byte1 == 242) ? false_ : true_;
+      if (top == jump_on) {
+        ip_ += delta;
+      } else if (top != other) {
+        SendNonBooleanReceiver(top);
+      }
+      break;
+    }
+    case 245:
+    case 246:
+    case 247: {
+      uint8_t byte2 = *ip_++;
+      uint8_t byte3 = *ip_++;
+      if (byte1 == 245) {
+        PushIndirectLocal(byte3, byte2);
+      } else if (byte1 == 246) {
+        PopIntoIndirectLocal(byte3, byte2);
+      } else {
+        StoreIntoIndirectLocal(byte3, byte2);
+      }
+      break;
+    }
+    case 248: {
+      uint8_t byte2 = *ip_++;
+      uint8_t byte3 = *ip_++;
+      PushLiteral((byte3 << 8) | byte2);
+      break;
+    }
+    case 250:
+    case 251:
+    case 252:
+    case 253:
+    case 254: {
+      uint8_t byte2 = *ip_++;
+      uint8_t byte3 = *ip_++;
+      intptr_t num_args = byte3 >> 4;
+      intptr_t selector_index = ((byte3 & 0xF) << 8) | byte2;
+      if (byte1 == 250) {
+        OrdinarySend(selector_index, num_args);
+      } else if (byte1 == 251) {
+        SelfSend(selector_index, num_args);
+      } else if (byte1 == 252) {
+        SuperSend(selector_index, num_args);
+      } else if (byte1 == 253) {
+        ImplicitReceiverSend(selector_index, num_args);
+      } else {
+        uint8_t byte4 = *ip_++;
+        OuterSend(selector_index, num_args, byte4);
+      }
+      break;
+    }
+    case 255: {
+      uint8_t byte2 = *ip_++;
+      uint8_t byte3 = *ip_++;
+      uint8_t byte4 = *ip_++;
+      intptr_t num_copied = byte2 >> 4;
+      intptr_t num_args = byte2 & 7;
+      intptr_t block_size = byte3 | (byte4 << 8);
+      PushClosure(num_copied, num_args, block_size);
+      next_bci += block_size;
+      break;
+    }
+    case 164: case 165:
+    case 208: case 209: case 210: case 211: case 212: case 213: case 214:
+    case 215: case 216: case 217: case 218: case 219: case 220: case 221:
+    case 224: case 225: case 226: case 227: case 232:
+    case 234: case 235: case 236: case 237: case 238: case 239: case 244:
+      FATAL("Unused bytecode");
+    default:
+      // Compiled inline.
+      UNREACHABLE();
+  }
+
+  return CompiledContinue(fp, method, next_bci);  // SAFEPOINT
+}
+
+// A send whose inline cache hit something compiled code does not activate
+// itself, such as a method without code or a primitive.
+uword Interpreter::CompiledSend(InlineCache* cache) {
+  Object* fp = fp_;
+  Method method = FrameMethod(fp);
+  HandleScope h1(H, reinterpret_cast<Object*>(&method));
+  intptr_t next_bci = cache->next_bci;
+  ip_ = method->IP(SmallInteger::New(next_bci));
+  Method target = cache->target;
+  if (target->Primitive() == 0) {
+    // The target may have been compiled since.
+    jit_->NoteTarget(cache);
+  }
+  if (cache->rule == InlineCache::kOrdinary) {
+    Activate(target, cache->num_args);  // SAFEPOINT
+  } else {
+    Object receiver = cache->absent_receiver;
+    if (receiver == nullptr) {
+      receiver = FrameReceiver(fp_);
+    }
+    ActivateAbsent(target, receiver, cache->num_args);  // SAFEPOINT
+  }
+  return CompiledContinue(fp, method, next_bci);  // SAFEPOINT
+}
+
+// A send whose inline cache missed. For ordinary sends, refills the cache if
+// the lookup finds a public method, and otherwise leaves the send to the
+// interpreter. For other sends, performs the send and refills the cache from
+// whatever it left in the lookup cache.
+uword Interpreter::CompiledSendMiss(intptr_t bci, InlineCache* cache) {
+  if (cache->rule != InlineCache::kOrdinary) {
+    return CompiledLexicalSendMiss(cache);  // SAFEPOINT
+  }
+
+  String selector;
+  if (cache->selector >= 0) {
+    selector = SelectorAt(cache->selector);
+  } else {
+    Array common_selectors = object_store()->common_selectors();
+    selector = static_cast<String>(
+        common_selectors->element((-1 - cache->selector) * 2));
+  }
+  Object receiver = Stack(cache->num_args);
+  Behavior lookup_class = receiver->Klass(H);
+  while (lookup_class != nil) {
+    Method method = MethodAt(lookup_class, selector);
+    if (method != nil) {
+      if (method->IsPublic()) {
+        cache->cid = receiver->ClassId();
+        cache->target = method;
+        cache->absent_receiver = nullptr;
+        cache->entry = 0;
+        cache->slot_offset = 0;
+        cache->activates_closure = 0;
+        jit_->NoteTarget(cache);
+        return CompiledSend(cache);  // SAFEPOINT
+      } else if (method->IsProtected()) {
+        break;
+      }
+    }
+    lookup_class = lookup_class->superclass();
+  }
+  return CompiledStep(bci);  // SAFEPOINT
+}
+
+uword Interpreter::CompiledLexicalSendMiss(InlineCache* cache) {
+  Object* fp = fp_;
+  Method method = FrameMethod(fp);
+  String selector = SelectorAt(cache->selector);
+  intptr_t cid = FrameReceiver(fp)->ClassId();
+  HandleScope h1(H, reinterpret_cast<Object*>(&method));
+  HandleScope h2(H, reinterpret_cast<Object*>(&selector));
+  intptr_t next_bci = cache->next_bci;
+  ip_ = method->IP(SmallInteger::New(next_bci));
+  switch (cache->rule) {
+    case kSelf:
+      SelfSend(cache->selector, cache->num_args);  // SAFEPOINT
+      break;
+    case kSuper:
+      SuperSend(cache->selector, cache->num_args);  // SAFEPOINT
+      break;
+    case kImplicitReceiver:
+      ImplicitReceiverSend(cache->selector, cache->num_args);  // SAFEPOINT
+      break;
+    default:
+      OuterSend(cache->selector, cache->num_args, cache->rule);  // SAFEPOINT
+  }
+#if LOOKUP_CACHE
+  Object absent_receiver;
+  Method target;
+  if (lookup_cache_.LookupNS(cid, selector, method, cache->rule,
+                             &absent_receiver, &target)) {
+    cache->cid = cid;
+    cache->target = target;
+    cache->absent_receiver = absent_receiver;
+    cache->entry = 0;
+    cache->slot_offset = 0;
+    cache->activates_closure = 0;
+    jit_->NoteTarget(cache);
+  }
+#endif
+  return CompiledContinue(fp, method, next_bci);  // SAFEPOINT
+}
+
+// Control reached a bytecode index with no code, such as a jump into the middle
+// of an instruction.
+uword Interpreter::CompiledLeave(intptr_t bci) {
+  ip_ = FrameMethod(fp_)->IP(SmallInteger::New(bci));
+  return 0;
+}
+
+// A frame built by a compiled send overflowed the stack.
+uword Interpreter::CompiledStackOverflow() {
+  ip_ = FrameMethod(fp_)->IP(SmallInteger::New(1));
+  StackOverflow();  // SAFEPOINT
+  if (jit_->flush_pending()) {
+    return 0;
+  }
+  return CompiledEntry();
+}
+
+uword Interpreter::CompiledContinue(Object* fp, Method method,
+                                    intptr_t next_bci) {
+  if (jit_->flush_pending()) {
+    return 0;
+  }
+  if ((fp_ == fp) &&
+      (FrameMethod(fp_) == method) &&
+      (method->BCI(ip_)->value() == next_bci)) {
+    return JIT::kFallThrough;
+  }
+  return CompiledEntry();
+}
+
+uword Interpreter::CompiledEntry() {
+  Method method = FrameMethod(fp_);
+  intptr_t bci = method->BCI(ip_)->value();
+  // Activations of the method and of its closures count as invocations.
+  bool count = (bci == 1);
+  if (!count && FlagsIsClosure(FrameFlags(fp_))) {
+    Closure closure = static_cast<Closure>(FrameTemp(fp_, -1));
+    count = (closure->initial_bci()->value() == bci);
+  }
+  intptr_t hash;
+  if (count) {
+    hash = EnsureMethodHash(method);
+  } else {
+    hash = method->header_hash();
+    if (hash == 0) {
+      return 0;
+    }
+  }
+  return jit_->Entry(method, hash, bci, count);
+}
+
+void Interpreter::RunCompiled() {
+  if (jit_->flush_pending()) {
+    jit_->Flush();
+  }
+  uword entry = CompiledEntry();
+  if (entry != 0) {
+    jit_->Enter(entry);
+  }
+}
+
+void Interpreter::RunCompiledLoop() {
+  if (jit_->flush_pending()) {
+    jit_->Flush();
+  }
+  Method method = FrameMethod(fp_);
+  intptr_t hash = EnsureMethodHash(method);
+  intptr_t bci = method->BCI(ip_)->value();
+  uword entry = jit_->Entry(method, hash, bci, true);
+  if (entry != 0) {
+    jit_->Enter(entry);
+  }
+}
+#endif  // USE_BASELINE_JIT
+
 void Interpreter::GCPrologue() {
   // Convert IPs to BCIs. The makes every slot on the stack a valid object
   // pointer. Frame flags and saved FPs are valid as SmallIntegers.
@@ -1904,6 +2704,15 @@ void Interpreter::GCEpilogue() {
 #if LOOKUP_CACHE
   lookup_cache_.Clear();
 #endif
+#if USE_BASELINE_JIT
+  jit_->GCEpilogue();
+#endif
+}
+
+void Interpreter::InvalidateCompiledCode() {
+#if USE_BASELINE_JIT
+  jit_->Invalidate();
+#endif
 }
 
 }  // namespace psoup
@@ -7,14 +7,20 @@
 
 #include <setjmp.h>
 
+#include <atomic>
+
 #include "vm/globals.h"
 #include "vm/assert.h"
+#include "vm/bytecode_profile.h"
 #include "vm/flags.h"
+#include "vm/jit.h"
 #include "vm/lookup_cache.h"
 #include "vm/object.h"
+#include "vm/virtual_memory.h"
 
 namespace psoup {
 
+class AllocationSite;
 class Heap;
 class Isolate;
 class Object;
@@ -36,10 +42,23 @@ class Interpreter {
   void ActivateClosure(intptr_t num_args);
 
   void Interrupt() { checked_stack_limit_ = reinterpret_cast<Object*>(-1); }
+
+  // Size of the stacks of subsequently created interpreters. May be set while
+  // other isolates are running and creating interpreters.
+  static size_t stack_size() {
+    return stack_size_.load(std::memory_order_relaxed);
+  }
+  static void set_stack_size(size_t value) {
+    stack_size_.store(value, std::memory_order_relaxed);
+  }
   void PrintStack();
 
   const uint8_t* IPForAssert() { return ip_; }
 
+  // The allocation site for the send (method and bytecode index) that invoked
+  // the current allocation primitive. Only computed when the heap needs it.
+  AllocationSite* CurrentAllocationSite();
+
   Activation CurrentActivation();
   void SetCurrentActivation(Activation new_activation);
   Object ActivationSender(Activation activation);
@@ -55,16 +74,32 @@ class Interpreter {
   intptr_t ActivationTempSize(Activation activation);
   void ActivationTempSizePut(Activation activation, intptr_t new_size);
 
+  // Searches the senders of start for the nearest simulation root or active
+  // #on:do: handler for exception_class without materializing the frames
+  // passed over. Answers nil if there is none, or nullptr if the search must
+  // be left to the image.
+  Object FindExceptionHandler(Activation start, Behavior exception_class);
+  // Returns result to target if it is a living frame and no pending
+  // unwind-protect or simulation root is in the way. Answers false otherwise.
+  bool ResumeActivation(Activation target, Object result);
+
   void GCPrologue();
   void RootPointers(Object** from, Object** to) {
     *from = &nil_;
+#if USE_BASELINE_JIT
+    *to = &compiled_methods_[JIT::kTableSize - 1];
+#else
     *to = reinterpret_cast<Object*>(&object_store_);
+#endif
   }
   void StackPointers(Object** from, Object** to) {
     *from = sp_;
     *to = stack_base_ - 1;
   }
   void GCEpilogue();
+  // Discards compiled code, which may have inlined the identity of objects
+  // that were just forwarded.
+  void InvalidateCompiledCode();
 
   void Push(Object value) {
     ASSERT(sp_ <= stack_base_);
@@ -137,6 +172,10 @@ class Interpreter {
                               intptr_t depth);
   INLINE void SelfSend(intptr_t selector_index, intptr_t num_args);
   NOINLINE void SelfSendMiss(String selector, intptr_t num_args);
+  NOINLINE void CountSend(BytecodeProfile::SendKind kind,
+                          String selector,
+                          Object receiver,
+                          bool cache_hit);
 
   Behavior FindApplicationOf(AbstractMixin mixin, Behavior klass);
   bool HasMethod(Behavior, String selector);
@@ -176,9 +215,29 @@ class Interpreter {
   NOINLINE Activation EnsureActivation(Object* fp);
   NOINLINE Activation FlushAllFrames();
   bool HasLivingFrame(Activation activation);
+  intptr_t EnsureMethodHash(Method method);
 
-  static constexpr intptr_t kStackSlots = 1024;
-  static constexpr intptr_t kStackSize = kStackSlots * sizeof(Object);
+#if USE_BASELINE_JIT
+  // Entries from compiled code, see jit.h. Each answers JIT::kFallThrough, the
+  // address of the compiled code to continue at, or 0 to continue in the
+  // interpreter.
+  uword CompiledStep(intptr_t bci);
+  uword CompiledSend(InlineCache* cache);
+  uword CompiledSendMiss(intptr_t bci, InlineCache* cache);
+  uword CompiledLexicalSendMiss(InlineCache* cache);
+  uword CompiledLeave(intptr_t bci);
+  uword CompiledStackOverflow();
+  uword CompiledContinue(Object* fp, Method method, intptr_t next_bci);
+  uword CompiledEntry();
+  void RunCompiled();
+  void RunCompiledLoop();
+#endif
+
+  // The stack is reserved up front and committed by the OS as it is touched,
+  // so deep recursion only falls back to flushing frames to the heap when the
+  // whole reservation is exhausted.
+  static constexpr size_t kDefaultStackSize = 1 * MB;
+  static std::atomic<size_t> stack_size_;
 
   const uint8_t* ip_;
   Object* sp_;
@@ -186,16 +245,27 @@ class Interpreter {
   Object* stack_base_;
   Object* stack_limit_;
   Object* volatile checked_stack_limit_;
+  VirtualMemory stack_memory_;
 
   Object nil_;
   Object false_;
   Object true_;
   ObjectStore object_store_;
+#if USE_BASELINE_JIT
+  // Methods with invocation counts or code, visited as roots after the above.
+  Method compiled_methods_[JIT::kTableSize];
+#endif
 
   Heap* const heap_;
   Isolate* const isolate_;
   jmp_buf* environment_;
   LookupCache lookup_cache_;
+  BytecodeProfile* profile_;
+#if USE_BASELINE_JIT
+  JIT* jit_;
+#endif
+
+  friend class JIT;
 };
 
 }  // namespace psoup
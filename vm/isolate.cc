@@ -23,17 +23,47 @@ thread_local Isolate* Isolate::current_ = NULL;
 Monitor* Isolate::isolates_list_monitor_ = NULL;
 Isolate* Isolate::isolates_list_head_ = NULL;
 ThreadPool* Isolate::thread_pool_ = NULL;
+Mutex* Isolate::pool_mutex_ = NULL;
+Isolate::SnapshotPool* Isolate::pools_ = NULL;
+intptr_t Isolate::pool_size_ = 0;
+intptr_t Isolate::pool_refill_below_ = 0;
+bool Isolate::pools_draining_ = false;
+Isolate::HostIsolateTask* Isolate::host_isolates_ = NULL;
+int64_t Isolate::next_host_id_ = 0;
+
+
+// The idle isolates made from one snapshot.
+struct Isolate::SnapshotPool {
+  void* snapshot;
+  size_t snapshot_length;
+  intptr_t warming;
+  intptr_t idle_count;
+  PooledIsolateTask* idle;
+  SnapshotPool* next;
+};
 
 
 void Isolate::Startup() {
   isolates_list_monitor_ = new Monitor();
   thread_pool_ = new ThreadPool();
+  pool_mutex_ = new Mutex();
 }
 
 
 void Isolate::Shutdown() {
+  DrainPools();
+  TerminateHostIsolates();
   delete thread_pool_;  // Waits for all tasks to complete.
   thread_pool_ = NULL;
+  while (pools_ != NULL) {
+    SnapshotPool* pool = pools_;
+    pools_ = pool->next;
+    ASSERT((pool->warming == 0) && (pool->idle == NULL));
+    delete pool;
+  }
+  delete pool_mutex_;
+  pool_mutex_ = NULL;
+  pools_draining_ = false;
   ASSERT(isolates_list_head_ == NULL);
   delete isolates_list_monitor_;
   isolates_list_monitor_ = NULL;
@@ -104,10 +134,23 @@ Isolate::Isolate(void* snapshot, size_t snapshot_length, uint64_t seed) :
     snapshot_length_(snapshot_length),
     salt_(static_cast<uintptr_t>(seed)),
     random_(seed),
-    next_(NULL) {
+    next_(NULL),
+    stats_mutex_(new Mutex()),
+    unpublished_messages_(0) {
+  stats_.heap_size = 0;
+  stats_.messages = 0;
+  stats_.turns = 0;
   heap_ = new Heap();
   interpreter_ = new Interpreter(heap_, this);
+#if defined(OS_LINUX)
+  if (IOURingMessageLoop::IsSupported()) {
+    loop_ = new IOURingMessageLoop(this);
+  } else {
+    loop_ = new PlatformMessageLoop(this);
+  }
+#else
   loop_ = new PlatformMessageLoop(this);
+#endif
   {
     Deserializer deserializer(heap_, snapshot, snapshot_length);
     deserializer.Deserialize();
@@ -125,54 +168,98 @@ Isolate::~Isolate() {
   current_ = NULL;
 
   RemoveIsolateFromList(this);
+  delete interpreter_;  // Its stack is allocated by the heap.
   delete heap_;
-  delete interpreter_;
   delete loop_;
+  delete stats_mutex_;
 }
 
 
-void Isolate::ActivateMessage(IsolateMessage* isolate_message) {
-  Object message;
+Object Isolate::MessageData(IsolateMessage* isolate_message) {
   if (isolate_message->data() != NULL) {
     intptr_t length = isolate_message->length();
     ByteArray bytes = heap_->AllocateByteArray(length);  // SAFEPOINT
     memcpy(bytes->element_addr(0), isolate_message->data(), length);
-    message = bytes;
-  } else {
-    int argc = isolate_message->argc();
-    Array strings = heap_->AllocateArray(argc);  // SAFEPOINT
-    for (intptr_t i = 0; i < argc; i++) {
-      strings->set_element(i, SmallInteger::New(0));
-    }
+    return bytes;
+  }
 
-    HandleScope h1(heap_, reinterpret_cast<Object*>(&strings));
-    for (intptr_t i = 0; i < argc; i++) {
-      const char* cstr = isolate_message->argv()[i];
-      intptr_t length = strlen(cstr);
-      String string = heap_->AllocateString(length);  // SAFEPOINT
-      memcpy(string->element_addr(0), cstr, length);
-      strings->set_element(i, string);
-    }
-    message = strings;
+  int argc = isolate_message->argc();
+  Array strings = heap_->AllocateArray(argc);  // SAFEPOINT
+  for (intptr_t i = 0; i < argc; i++) {
+    strings->set_element(i, SmallInteger::New(0));
   }
 
-  Port port_id = isolate_message->dest_port();
-  Object port;
+  HandleScope h1(heap_, reinterpret_cast<Object*>(&strings));
+  for (intptr_t i = 0; i < argc; i++) {
+    const char* cstr = isolate_message->argv()[i];
+    intptr_t length = strlen(cstr);
+    String string = heap_->AllocateString(length);  // SAFEPOINT
+    memcpy(string->element_addr(0), cstr, length);
+    strings->set_element(i, string);
+  }
+  return strings;
+}
+
+
+Object Isolate::PortObject(Port port_id) {
   if (port_id == ILLEGAL_PORT) {
-    port = interpreter_->nil_obj();
-  } else if (SmallInteger::IsSmiValue(port_id)) {
-    port = SmallInteger::New(port_id);
-  } else {
-    HandleScope h1(heap_, reinterpret_cast<Object*>(&message));
-    MediumInteger mint = heap_->AllocateMediumInteger();  // SAFEPOINT
-    mint->set_value(port_id);
-    port = mint;
+    return interpreter_->nil_obj();
+  }
+  if (SmallInteger::IsSmiValue(port_id)) {
+    return SmallInteger::New(port_id);
   }
+  MediumInteger mint = heap_->AllocateMediumInteger();  // SAFEPOINT
+  mint->set_value(port_id);
+  return mint;
+}
+
 
+void Isolate::ActivateMessage(IsolateMessage* isolate_message) {
+  unpublished_messages_++;
+  Object message = MessageData(isolate_message);  // SAFEPOINT
+  HandleScope h1(heap_, &message);
+  Object port = PortObject(isolate_message->dest_port());  // SAFEPOINT
   Activate(message, port);
 }
 
 
+bool Isolate::CanActivateMessages() {
+  return interpreter_->object_store()->has_dispatch_messages();
+}
+
+
+void Isolate::ActivateMessages(IsolateMessage* messages, intptr_t count) {
+  ASSERT(CanActivateMessages());
+  unpublished_messages_ += count;
+
+  // Each message's data followed by its port.
+  Array batch = heap_->AllocateArray(2 * count);  // SAFEPOINT
+  for (intptr_t i = 0; i < 2 * count; i++) {
+    batch->set_element(i, SmallInteger::New(0));
+  }
+
+  HandleScope h1(heap_, reinterpret_cast<Object*>(&batch));
+  IsolateMessage* isolate_message = messages;
+  for (intptr_t i = 0; i < count; i++) {
+    Object message = MessageData(isolate_message);  // SAFEPOINT
+    batch->set_element(2 * i, message);
+    Object port = PortObject(isolate_message->dest_port());  // SAFEPOINT
+    batch->set_element(2 * i + 1, port);
+    isolate_message = isolate_message->next_;
+  }
+
+  Object message_loop = interpreter_->object_store()->message_loop();
+
+  Behavior cls = message_loop->Klass(heap_);
+  String selector = interpreter_->object_store()->dispatch_messages();
+  Method method = interpreter_->MethodAt(cls, selector);
+
+  interpreter_->Push(message_loop);
+  interpreter_->Push(batch);
+  interpreter_->ActivateDispatch(method, 1);  // SAFEPOINT
+}
+
+
 void Isolate::ActivateWakeup() {
   Object nil = interpreter_->nil_obj();
   Activate(nil, nil);
@@ -214,6 +301,12 @@ void Isolate::ActivateSignal(intptr_t handle,
 
 void Isolate::Interpret() {
   interpreter_->Enter();
+
+  MutexLocker ml(stats_mutex_);
+  stats_.heap_size = heap_->Size();
+  stats_.messages += unpublished_messages_;
+  stats_.turns++;
+  unpublished_messages_ = 0;
 }
 
 
@@ -248,7 +341,362 @@ class SpawnIsolateTask : public ThreadPool::Task {
 };
 
 
+// Constructs an isolate ahead of need, then waits on the same thread, which
+// the isolate is bound to, until Spawn hands it an initial message.
+class Isolate::PooledIsolateTask : public ThreadPool::Task {
+ public:
+  PooledIsolateTask(void* snapshot, size_t snapshot_length) :
+    snapshot_(snapshot),
+    snapshot_length_(snapshot_length),
+    initial_message_(NULL),
+    released_(false),
+    next_(NULL) {
+  }
+
+  virtual void Run() {
+    uint64_t seed = OS::CurrentMonotonicNanos();
+    Isolate* isolate = new Isolate(snapshot_, snapshot_length_, seed);
+    if (!AddToPool(this)) {
+      delete isolate;
+      return;
+    }
+
+    IsolateMessage* initial_message;
+    {
+      MonitorLocker ml(&monitor_);
+      while (!released_) {
+        ml.Wait();
+      }
+      initial_message = initial_message_;
+    }
+    if (initial_message == NULL) {
+      // Drained at shutdown.
+      delete isolate;
+      return;
+    }
+
+    isolate->loop()->PostMessage(initial_message);
+    intptr_t exit_code = isolate->loop()->Run();
+    delete isolate;
+    if (exit_code != 0) {
+      OS::Exit(exit_code);
+    }
+  }
+
+  // Must not be called while holding pool_mutex_.
+  void Release(IsolateMessage* initial_message) {
+    MonitorLocker ml(&monitor_);
+    initial_message_ = initial_message;
+    released_ = true;
+    ml.Notify();
+  }
+
+ private:
+  friend class Isolate;
+
+  void* snapshot_;
+  size_t snapshot_length_;
+  Monitor monitor_;
+  IsolateMessage* initial_message_;
+  bool released_;
+  PooledIsolateTask* next_;  // Protected by pool_mutex_.
+
+  DISALLOW_COPY_AND_ASSIGN(PooledIsolateTask);
+};
+
+
+void Isolate::ConfigurePool(intptr_t size, intptr_t refill_below) {
+#if defined(OS_EMSCRIPTEN)
+  // Isolates cannot wait on their own threads.
+  size = 0;
+#endif
+  ASSERT(size >= 0);
+  ASSERT((refill_below >= 0) && (refill_below <= size));
+  MutexLocker ml(pool_mutex_);
+  pool_size_ = size;
+  pool_refill_below_ = refill_below;
+}
+
+
+Isolate::SnapshotPool* Isolate::LookupPoolLocked(void* snapshot,
+                                                 size_t snapshot_length) {
+  for (SnapshotPool* pool = pools_; pool != NULL; pool = pool->next) {
+    if (pool->snapshot == snapshot) {
+      ASSERT(pool->snapshot_length == snapshot_length);
+      return pool;
+    }
+  }
+  return NULL;
+}
+
+
+void Isolate::RefillPoolLocked(SnapshotPool* pool) {
+  intptr_t available = pool->warming + pool->idle_count;
+  for (intptr_t i = available; i < pool_size_; i++) {
+    pool->warming++;
+    thread_pool_->Run(new PooledIsolateTask(pool->snapshot,
+                                            pool->snapshot_length));
+  }
+}
+
+
+void Isolate::FillPool(void* snapshot, size_t snapshot_length) {
+  MutexLocker ml(pool_mutex_);
+  if ((pool_size_ == 0) || pools_draining_) {
+    return;
+  }
+  if (LookupPoolLocked(snapshot, snapshot_length) != NULL) {
+    return;
+  }
+  SnapshotPool* pool = new SnapshotPool();
+  pool->snapshot = snapshot;
+  pool->snapshot_length = snapshot_length;
+  pool->warming = 0;
+  pool->idle_count = 0;
+  pool->idle = NULL;
+  pool->next = pools_;
+  pools_ = pool;
+  RefillPoolLocked(pool);
+}
+
+
+bool Isolate::AddToPool(PooledIsolateTask* task) {
+  MutexLocker ml(pool_mutex_);
+  SnapshotPool* pool = LookupPoolLocked(task->snapshot_,
+                                        task->snapshot_length_);
+  ASSERT(pool != NULL);
+  pool->warming--;
+  if (pools_draining_) {
+    return false;
+  }
+  task->next_ = pool->idle;
+  pool->idle = task;
+  pool->idle_count++;
+  return true;
+}
+
+
+Isolate::PooledIsolateTask* Isolate::TakeFromPool(void* snapshot,
+                                                  size_t snapshot_length) {
+  MutexLocker ml(pool_mutex_);
+  if (pools_draining_) {
+    return NULL;
+  }
+  SnapshotPool* pool = LookupPoolLocked(snapshot, snapshot_length);
+  if (pool == NULL) {
+    return NULL;
+  }
+  PooledIsolateTask* task = pool->idle;
+  if (task != NULL) {
+    pool->idle = task->next_;
+    pool->idle_count--;
+    task->next_ = NULL;
+  }
+  if (pool->warming + pool->idle_count < pool_refill_below_) {
+    RefillPoolLocked(pool);
+  }
+  return task;
+}
+
+
+void Isolate::DrainPools() {
+  PooledIsolateTask* idle = NULL;
+  {
+    MutexLocker ml(pool_mutex_);
+    pools_draining_ = true;
+    for (SnapshotPool* pool = pools_; pool != NULL; pool = pool->next) {
+      while (pool->idle != NULL) {
+        PooledIsolateTask* task = pool->idle;
+        pool->idle = task->next_;
+        task->next_ = idle;
+        idle = task;
+      }
+      pool->idle_count = 0;
+    }
+  }
+  while (idle != NULL) {
+    PooledIsolateTask* task = idle;
+    idle = task->next_;
+    task->Release(NULL);
+  }
+}
+
+
+// Runs an isolate for an embedder. The task stays on the host list, where the
+// embedder finds it by id, until its isolate has exited.
+class Isolate::HostIsolateTask : public ThreadPool::Task {
+ public:
+  HostIsolateTask(int64_t id,
+                  void* snapshot,
+                  size_t snapshot_length,
+                  int argc,
+                  const char** argv) :
+    id_(id),
+    snapshot_(snapshot),
+    snapshot_length_(snapshot_length),
+    argc_(argc),
+    argv_(new char*[argc]),
+    initial_message_(NULL),
+    isolate_(NULL),
+    terminated_(false),
+    next_(NULL) {
+    for (intptr_t i = 0; i < argc; i++) {
+      argv_[i] = strdup(argv[i]);
+    }
+    initial_message_ = new IsolateMessage(
+        ILLEGAL_PORT, argc_, const_cast<const char**>(argv_));
+  }
+
+  ~HostIsolateTask() {
+    // The initial message refers to the arguments until it is dispatched.
+    delete initial_message_;
+    for (intptr_t i = 0; i < argc_; i++) {
+      free(argv_[i]);
+    }
+    delete[] argv_;
+  }
+
+  virtual void Run() {
+    uint64_t seed = OS::CurrentMonotonicNanos();
+    Isolate* isolate = new Isolate(snapshot_, snapshot_length_, seed);
+    bool terminated;
+    {
+      MonitorLocker ml(isolates_list_monitor_);
+      terminated = terminated_;
+      if (terminated) {
+        RemoveHostIsolateLocked(this);
+      } else {
+        isolate_ = isolate;
+      }
+    }
+    if (terminated) {
+      delete initial_message_;
+      initial_message_ = NULL;
+      delete isolate;
+      return;
+    }
+
+    isolate->loop()->PostMessage(initial_message_);
+    initial_message_ = NULL;
+    isolate->loop()->Run();
+    {
+      MonitorLocker ml(isolates_list_monitor_);
+      RemoveHostIsolateLocked(this);
+      isolate_ = NULL;
+    }
+    delete isolate;
+  }
+
+ private:
+  friend class Isolate;
+
+  const int64_t id_;
+  void* snapshot_;
+  size_t snapshot_length_;
+  int argc_;
+  char** argv_;
+  IsolateMessage* initial_message_;
+  Isolate* isolate_;  // Protected by isolates_list_monitor_.
+  bool terminated_;  // Protected by isolates_list_monitor_.
+  HostIsolateTask* next_;  // Protected by isolates_list_monitor_.
+
+  DISALLOW_COPY_AND_ASSIGN(HostIsolateTask);
+};
+
+
+int64_t Isolate::CreateForHost(void* snapshot,
+                               size_t snapshot_length,
+                               int argc, const char** argv) {
+  HostIsolateTask* task;
+  {
+    MonitorLocker ml(isolates_list_monitor_);
+    task = new HostIsolateTask(++next_host_id_, snapshot, snapshot_length,
+                               argc, argv);
+    task->next_ = host_isolates_;
+    host_isolates_ = task;
+  }
+  int64_t id = task->id_;
+  thread_pool_->Run(task);
+  return id;
+}
+
+
+bool Isolate::TerminateForHost(int64_t id) {
+  MonitorLocker ml(isolates_list_monitor_);
+  HostIsolateTask* task = LookupHostIsolateLocked(id);
+  if ((task == NULL) || task->terminated_) {
+    return false;
+  }
+  task->terminated_ = true;
+  if (task->isolate_ != NULL) {
+    task->isolate_->loop_->Interrupt();
+  }
+  return true;
+}
+
+
+bool Isolate::StatsForHost(int64_t id, IsolateStats* stats) {
+  MonitorLocker ml(isolates_list_monitor_);
+  HostIsolateTask* task = LookupHostIsolateLocked(id);
+  if (task == NULL) {
+    return false;
+  }
+  Isolate* isolate = task->isolate_;
+  if (isolate == NULL) {
+    // Not yet started.
+    stats->heap_size = 0;
+    stats->messages = 0;
+    stats->turns = 0;
+    return true;
+  }
+  MutexLocker sl(isolate->stats_mutex_);
+  *stats = isolate->stats_;
+  return true;
+}
+
+
+Isolate::HostIsolateTask* Isolate::LookupHostIsolateLocked(int64_t id) {
+  for (HostIsolateTask* task = host_isolates_;
+       task != NULL;
+       task = task->next_) {
+    if (task->id_ == id) {
+      return task;
+    }
+  }
+  return NULL;
+}
+
+
+void Isolate::RemoveHostIsolateLocked(HostIsolateTask* task) {
+  HostIsolateTask** link = &host_isolates_;
+  while (*link != task) {
+    ASSERT(*link != NULL);
+    link = &(*link)->next_;
+  }
+  *link = task->next_;
+  task->next_ = NULL;
+}
+
+
+void Isolate::TerminateHostIsolates() {
+  MonitorLocker ml(isolates_list_monitor_);
+  for (HostIsolateTask* task = host_isolates_;
+       task != NULL;
+       task = task->next_) {
+    task->terminated_ = true;
+    if (task->isolate_ != NULL) {
+      task->isolate_->loop_->Interrupt();
+    }
+  }
+}
+
+
 void Isolate::Spawn(IsolateMessage* initial_message) {
+  PooledIsolateTask* task = TakeFromPool(snapshot_, snapshot_length_);
+  if (task != NULL) {
+    task->Release(initial_message);
+    return;
+  }
   thread_pool_->Run(new SpawnIsolateTask(snapshot_, snapshot_length_,
                                          initial_message));
 }
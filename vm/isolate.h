@@ -16,9 +16,16 @@ class Heap;
 class Interpreter;
 class MessageLoop;
 class Monitor;
+class Mutex;
 class Object;
 class ThreadPool;
 
+struct IsolateStats {
+  intptr_t heap_size;  // As of the end of the last turn.
+  int64_t messages;
+  int64_t turns;
+};
+
 class Isolate {
  public:
   Isolate(void* snapshot, size_t snapshot_length, uint64_t seed);
@@ -27,9 +34,16 @@ class Isolate {
   Heap* heap() const { return heap_; }
   MessageLoop* loop() const { return loop_; }
   uintptr_t salt() const { return salt_; }
+  // A checkpoint's string hashes were computed with the salt of the isolate
+  // that wrote it.
+  void set_salt(uintptr_t salt) { salt_ = salt; }
   Random& random() { return random_; }
 
   void ActivateMessage(IsolateMessage* message);
+  // Whether the image takes several port messages in one activation.
+  bool CanActivateMessages();
+  // Activates the first 'count' messages of the list linked by next_.
+  void ActivateMessages(IsolateMessage* messages, intptr_t count);
   void ActivateWakeup();
   void ActivateSignal(intptr_t handle,
                       intptr_t status,
@@ -43,13 +57,34 @@ class Isolate {
   static Isolate* Current() { return current_; }
   static void Startup();
   static void Shutdown();
+  static ThreadPool* thread_pool() { return thread_pool_; }
+
+  // Keeps up to 'size' isolates per snapshot constructed and waiting for
+  // their initial message, so Spawn does not deserialize on the critical path.
+  // Once fewer than 'refill_below' are left, more are constructed in the
+  // background. A size of 0, the default, disables the pool.
+  static void ConfigurePool(intptr_t size, intptr_t refill_below);
+  static void FillPool(void* snapshot, size_t snapshot_length);
 
   static void InterruptAll();
   void Interrupt();
   void PrintStack();
 
+  // Isolates started by an embedder are named by an id rather than a pointer,
+  // since they may exit at any time. Each runs on the thread pool until it
+  // exits or is terminated; its exit code does not end the process. The
+  // arguments are copied.
+  static int64_t CreateForHost(void* snapshot,
+                               size_t snapshot_length,
+                               int argc, const char** argv);
+  // Asks the isolate to exit once its current turn ends.
+  static bool TerminateForHost(int64_t id);
+  static bool StatsForHost(int64_t id, IsolateStats* stats);
+
  private:
   void Activate(Object message, Object port);
+  Object MessageData(IsolateMessage* message);
+  Object PortObject(Port port);
 
   Heap* heap_;
   Interpreter* interpreter_;
@@ -60,9 +95,31 @@ class Isolate {
   Random random_;
   Isolate* next_;
 
+  // Published after each turn for StatsForHost.
+  Mutex* stats_mutex_;
+  IsolateStats stats_;
+  int64_t unpublished_messages_;
+
   void AddIsolateToList(Isolate* isolate);
   void RemoveIsolateFromList(Isolate* isolate);
 
+  class PooledIsolateTask;
+  struct SnapshotPool;
+
+  static SnapshotPool* LookupPoolLocked(void* snapshot,
+                                        size_t snapshot_length);
+  static void RefillPoolLocked(SnapshotPool* pool);
+  static bool AddToPool(PooledIsolateTask* task);
+  static PooledIsolateTask* TakeFromPool(void* snapshot,
+                                         size_t snapshot_length);
+  static void DrainPools();
+
+  class HostIsolateTask;
+
+  static HostIsolateTask* LookupHostIsolateLocked(int64_t id);
+  static void RemoveHostIsolateLocked(HostIsolateTask* task);
+  static void TerminateHostIsolates();
+
 #if defined(OS_EMSCRIPTEN)
   static Isolate* current_;
 #else
@@ -72,6 +129,16 @@ class Isolate {
   static Isolate* isolates_list_head_;
   static ThreadPool* thread_pool_;
 
+  static Mutex* pool_mutex_;
+  static SnapshotPool* pools_;
+  static intptr_t pool_size_;
+  static intptr_t pool_refill_below_;
+  static bool pools_draining_;
+
+  // Protected by isolates_list_monitor_.
+  static HostIsolateTask* host_isolates_;
+  static int64_t next_host_id_;
+
   DISALLOW_COPY_AND_ASSIGN(Isolate);
 };
 
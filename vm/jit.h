@@ -0,0 +1,184 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_JIT_H_
+#define VM_JIT_H_
+
+#include "vm/globals.h"
+#include "vm/flags.h"
+#include "vm/object.h"
+#include "vm/virtual_memory.h"
+
+#if BASELINE_JIT && !PROFILE_BYTECODES && defined(OS_LINUX) &&              \
+    defined(__x86_64__)
+#define USE_BASELINE_JIT 1
+#else
+#define USE_BASELINE_JIT 0
+#endif
+
+namespace psoup {
+
+class Interpreter;
+
+// A send site's monomorphic inline cache. Ordinary sends are keyed by the
+// class of the receiver, and self, super, implicit receiver and outer sends by
+// the class of the frame's receiver, as in the lookup cache. Cleared with the
+// lookup cache after every GC.
+struct InlineCache {
+  static const intptr_t kOrdinary = -1;
+
+  intptr_t cid;
+  Method target;
+  // For sends other than ordinary sends, the receiver to insert below the
+  // arguments, or nullptr for the frame's receiver.
+  Object absent_receiver;
+  // The compiled code that activates target, or 0.
+  uword entry;
+  // For targets that are slot accessors, the offset of the slot from the
+  // tagged receiver, or 0.
+  intptr_t slot_offset;
+  // Whether target is a primitive that activates the receiver closure.
+  intptr_t activates_closure;
+  intptr_t selector;  // Literal index, or -1 - offset for common selectors.
+  intptr_t num_args;
+  intptr_t rule;  // kOrdinary, or the LookupRule or depth of the send.
+  intptr_t next_bci;
+};
+
+// A baseline compiler from bytecode to x86-64 machine code.
+//
+// Compiled code runs in the interpreter's frames: it keeps the stack and frame
+// pointers in registers and leaves the saved IPs, methods and activations in
+// the slots the interpreter uses, so stack walking, activation mapping and GC
+// see no difference. Stack operations, jumps and SmallInteger arithmetic are
+// compiled inline. Sends whose inline cache hits a compiled method build the
+// callee's frame and jump to its code, and local returns pop the frame and
+// continue at the code for the saved IP of the sender, looking the sender's
+// method up by identity like any other entry. Everything else calls back into
+// the interpreter to execute the bytecode, after which compiled code falls
+// through if the frame is still at the next bytecode, and otherwise continues
+// at the compiled code for whatever frame is now on top, or returns to the
+// interpreter if there is none. As a consequence, code never holds state the
+// interpreter cannot see, and a frame whose method or bytecode index is
+// changed by the mirrors simply continues wherever that lands.
+//
+// Compiled methods are held strongly by a table the interpreter visits as
+// roots, and matched by identity hash, so code survives the methods moving.
+// Code is only discarded as a whole, after a become or when the code space
+// fills, and only between runs of compiled code.
+class JIT {
+ public:
+  // Returned by runtime entries when compiled code should fall through.
+  static const uword kFallThrough = 1;
+
+  static const intptr_t kTableSize = 4096;
+
+  explicit JIT(Interpreter* interpreter);
+  ~JIT();
+
+  static intptr_t BytecodeLength(uint8_t byte1);
+
+  // Answers the address of the code for the bytecode at bci of method, or 0.
+  // Counted entries, at the first bytecode or at a sampled loop, may compile
+  // the method.
+  uword Entry(Method method, intptr_t hash, intptr_t bci, bool count);
+  // Answers the address of the code that completes a frame for method built by
+  // a compiled send, or 0 if method has no code.
+  uword ActivationEntry(Method method);
+  // Notes how compiled code can complete a hit on the cache without calling
+  // the runtime, if it can.
+  void NoteTarget(InlineCache* cache);
+
+  // Runs compiled code starting at entry until it returns to the interpreter.
+  void Enter(uword entry);
+
+  // Answers true for one in back_edge_sample_rate_ backward jumps.
+  bool SampleBackEdge() {
+    if (--back_edge_countdown_ != 0) {
+      return false;
+    }
+    back_edge_countdown_ = back_edge_sample_rate_;
+    return true;
+  }
+
+  // Forgets everything that refers to objects that may have moved.
+  void GCEpilogue();
+
+  // Requests the code be discarded before compiled code next runs.
+  void Invalidate() { flush_pending_ = true; }
+  bool flush_pending() const { return flush_pending_; }
+  void Flush();
+
+ private:
+  struct Code;
+
+  // Called from compiled code with the bytecode index of the instruction and
+  // one argument.
+  static uword StepEntry(Interpreter* interpreter, intptr_t bci, uword unused);
+  static uword SendEntry(Interpreter* interpreter, intptr_t bci, uword cache);
+  static uword SendMissEntry(Interpreter* interpreter, intptr_t bci,
+                             uword cache);
+  static uword LeaveEntry(Interpreter* interpreter, intptr_t bci, uword unused);
+  static uword StackOverflowEntry(Interpreter* interpreter, intptr_t bci,
+                                  uword unused);
+
+  static const intptr_t kProbes = 4;
+  static const intptr_t kCompileThreshold = 1000;
+  static const intptr_t kBackEdgeSampleRate = 16;
+  static const size_t kCodeSpaceSize = 8 * MB;
+  static const size_t kCacheSpaceSize = 1 * MB;
+
+  // With PSOUP_JIT_STRESS set in the environment, methods are compiled on
+  // their first invocation into spaces small enough that they fill and are
+  // flushed many times over during a test run.
+  static const size_t kStressCodeSpaceSize = 256 * KB;
+  static const size_t kStressCacheSpaceSize = 16 * KB;
+
+  bool EnsureSpaces();
+  void GenerateStubs();
+  Code* Compile(Method method);
+  InlineCache* AllocateCache();
+
+  Interpreter* const interpreter_;
+  Method* const methods_;
+  intptr_t counts_[kTableSize];
+  Code* codes_[kTableSize];
+  // The method of the last uncounted entry that found no code, or nullptr.
+  Method interpreted_;
+  intptr_t compile_threshold_;
+  intptr_t back_edge_sample_rate_;
+  intptr_t back_edge_countdown_;
+  size_t code_space_size_;
+  size_t cache_space_size_;
+
+  VirtualMemory code_space_;
+  uword code_top_;
+  uword stubs_end_;
+  VirtualMemory cache_space_;
+  InlineCache* cache_top_;
+  InlineCache* cache_end_;
+
+  uword enter_stub_;
+  uword resume_stub_;
+  uword return_stub_;
+  uword continue_stub_;
+
+  // Offsets of interpreter fields used by compiled code.
+  int32_t ip_offset_;
+  int32_t sp_offset_;
+  int32_t fp_offset_;
+  int32_t stack_limit_offset_;
+  int32_t nil_offset_;
+  int32_t false_offset_;
+  int32_t true_offset_;
+
+  bool flush_pending_;
+  bool disabled_;
+
+  friend class Compiler;
+};
+
+}  // namespace psoup
+
+#endif  // VM_JIT_H_
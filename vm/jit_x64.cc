@@ -0,0 +1,1413 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/jit.h"
+
+#if USE_BASELINE_JIT
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm/assert.h"
+#include "vm/interpreter.h"
+#include "vm/primitives.h"
+#include "vm/utils.h"
+
+namespace psoup {
+
+// Register assignment for compiled code. The remaining registers are scratch.
+//
+// rbx: the interpreter
+// r12: the stack pointer (the interpreter's sp_)
+// r13: the frame pointer (the interpreter's fp_)
+//
+// These are callee-saved, so they survive calls into the runtime. On entry to
+// a runtime function, compiled code stores the stack and frame pointers into
+// the interpreter. On return, it reloads the stack pointer, or if the runtime
+// answers anything other than kFallThrough, reloads both from the interpreter
+// and continues at the answered address.
+
+enum Register {
+  RAX = 0,
+  RCX = 1,
+  RDX = 2,
+  RBX = 3,
+  RSP = 4,
+  RBP = 5,
+  RSI = 6,
+  RDI = 7,
+  R8 = 8,
+  R9 = 9,
+  R10 = 10,
+  R11 = 11,
+  R12 = 12,
+  R13 = 13,
+  R14 = 14,
+  R15 = 15,
+};
+
+static const Register THR = RBX;
+static const Register SP = R12;
+static const Register FP = R13;
+
+enum Condition {
+  OVERFLOW = 0,
+  NO_OVERFLOW = 1,
+  BELOW = 2,
+  ABOVE_EQUAL = 3,
+  EQUAL = 4,
+  NOT_EQUAL = 5,
+  BELOW_EQUAL = 6,
+  ABOVE = 7,
+  LESS = 12,
+  GREATER_EQUAL = 13,
+  LESS_EQUAL = 14,
+  GREATER = 15,
+
+  ZERO = EQUAL,
+  NOT_ZERO = NOT_EQUAL,
+};
+
+struct Address {
+  Address(Register base, int32_t disp) : base(base), disp(disp) {}
+
+  Register base;
+  int32_t disp;
+};
+
+// Offsets of fields without offsetof, which warns for non-POD types.
+static const uword kOffsetOfBase = 0x1000;
+#define OFFSET_OF(type, field)                                                 \
+  static_cast<int32_t>(                                                        \
+      reinterpret_cast<uword>(&(reinterpret_cast<type*>(kOffsetOfBase)->field))\
+      - kOffsetOfBase)
+
+class Label {
+ public:
+  Label() : position_(-1), link_(-1) {}
+
+  bool IsBound() const { return position_ >= 0; }
+  bool IsLinked() const { return link_ >= 0; }
+
+ private:
+  // Position of the label once bound.
+  intptr_t position_;
+  // Position of the last unresolved use. Unresolved uses hold the position of
+  // the previous one, or -1.
+  intptr_t link_;
+
+  friend class Assembler;
+};
+
+// Just enough of an x86-64 assembler for the compiler below. Branches always
+// use 32-bit displacements.
+class Assembler {
+ public:
+  // Generates code that will run at address.
+  explicit Assembler(uword address)
+      : address_(address), buffer_(nullptr), size_(0), capacity_(0) {}
+  ~Assembler() { free(buffer_); }
+
+  intptr_t size() const { return size_; }
+  const uint8_t* buffer() const { return buffer_; }
+  uword CurrentAddress() const { return address_ + size_; }
+
+  void movq(Register dst, Register src) {
+    EmitRex(true, dst, src);
+    EmitUint8(0x8B);
+    EmitRegisterOperand(dst, src);
+  }
+  void movq(Register dst, Address src) {
+    EmitRex(true, dst, src.base);
+    EmitUint8(0x8B);
+    EmitOperand(dst, src);
+  }
+  void movq(Address dst, Register src) {
+    EmitRex(true, src, dst.base);
+    EmitUint8(0x89);
+    EmitOperand(src, dst);
+  }
+  void movl(Register dst, Address src) {
+    EmitRex(false, dst, src.base);
+    EmitUint8(0x8B);
+    EmitOperand(dst, src);
+  }
+  void movsxd(Register dst, Register src) {
+    EmitRex(true, dst, src);
+    EmitUint8(0x63);
+    EmitRegisterOperand(dst, src);
+  }
+  void LoadImmediate(Register dst, int64_t value) {
+    if ((value >= 0) && (value <= 0xFFFFFFFF)) {
+      EmitRex(false, RAX, dst);
+      EmitUint8(0xB8 | (dst & 7));
+      EmitInt32(static_cast<int32_t>(value));
+    } else if ((value >= kMinInt32) && (value <= kMaxInt32)) {
+      EmitRex(true, RAX, dst);
+      EmitUint8(0xC7);
+      EmitRegisterOperand(RAX, dst);
+      EmitInt32(static_cast<int32_t>(value));
+    } else {
+      EmitRex(true, RAX, dst);
+      EmitUint8(0xB8 | (dst & 7));
+      EmitInt64(value);
+    }
+  }
+
+  void addq(Register dst, Register src) { EmitAlu(0x01, dst, src); }
+  void orq(Register dst, Register src) { EmitAlu(0x09, dst, src); }
+  void andq(Register dst, Register src) { EmitAlu(0x21, dst, src); }
+  void subq(Register dst, Register src) { EmitAlu(0x29, dst, src); }
+  void cmpq(Register dst, Register src) { EmitAlu(0x39, dst, src); }
+  void addq(Register dst, int32_t value) { EmitAluImmediate(0, dst, value); }
+  void andq(Register dst, int32_t value) { EmitAluImmediate(4, dst, value); }
+  void subq(Register dst, int32_t value) { EmitAluImmediate(5, dst, value); }
+  void cmpq(Register dst, int32_t value) { EmitAluImmediate(7, dst, value); }
+  void cmpq(Register left, Address right) {
+    EmitRex(true, left, right.base);
+    EmitUint8(0x3B);
+    EmitOperand(left, right);
+  }
+  void imulq(Register dst, Register src) {
+    EmitRex(true, dst, src);
+    EmitUint8(0x0F);
+    EmitUint8(0xAF);
+    EmitRegisterOperand(dst, src);
+  }
+  void shlq(Register dst, int8_t shift) { EmitShift(4, dst, shift); }
+  void shrq(Register dst, int8_t shift) { EmitShift(5, dst, shift); }
+  void sarq(Register dst, int8_t shift) { EmitShift(7, dst, shift); }
+  void testl(Register reg, int32_t value) {
+    EmitRex(false, RAX, reg);
+    EmitUint8(0xF7);
+    EmitRegisterOperand(RAX, reg);
+    EmitInt32(value);
+  }
+  void cmovq(Condition condition, Register dst, Address src) {
+    EmitRex(true, dst, src.base);
+    EmitUint8(0x0F);
+    EmitUint8(0x40 | condition);
+    EmitOperand(dst, src);
+  }
+
+  void pushq(Register reg) {
+    EmitRex(false, RAX, reg);
+    EmitUint8(0x50 | (reg & 7));
+  }
+  void popq(Register reg) {
+    EmitRex(false, RAX, reg);
+    EmitUint8(0x58 | (reg & 7));
+  }
+  void call(Register target) {
+    EmitRex(false, RAX, target);
+    EmitUint8(0xFF);
+    EmitRegisterOperand(static_cast<Register>(2), target);
+  }
+  void jmp(Register target) {
+    EmitRex(false, RAX, target);
+    EmitUint8(0xFF);
+    EmitRegisterOperand(static_cast<Register>(4), target);
+  }
+  void ret() { EmitUint8(0xC3); }
+
+  void jmp(Label* label) {
+    EmitUint8(0xE9);
+    EmitLabel(label);
+  }
+  void j(Condition condition, Label* label) {
+    EmitUint8(0x0F);
+    EmitUint8(0x80 | condition);
+    EmitLabel(label);
+  }
+  // Branches to code in the same code space.
+  void jmp(uword target) {
+    EmitUint8(0xE9);
+    EmitTarget(target);
+  }
+  void j(Condition condition, uword target) {
+    EmitUint8(0x0F);
+    EmitUint8(0x80 | condition);
+    EmitTarget(target);
+  }
+
+  void Bind(Label* label) {
+    ASSERT(!label->IsBound());
+    intptr_t link = label->link_;
+    while (link >= 0) {
+      intptr_t next = LoadInt32(link);
+      StoreInt32(link, static_cast<int32_t>(size_ - (link + 4)));
+      link = next;
+    }
+    label->position_ = size_;
+    label->link_ = -1;
+  }
+
+ private:
+  void EmitUint8(uint8_t value) {
+    if (size_ == capacity_) {
+      capacity_ = (capacity_ == 0) ? 256 : (capacity_ * 2);
+      buffer_ = reinterpret_cast<uint8_t*>(realloc(buffer_, capacity_));
+      if (buffer_ == nullptr) {
+        FATAL("Out of memory");
+      }
+    }
+    buffer_[size_++] = value;
+  }
+  void EmitInt32(int32_t value) {
+    uint32_t bits = static_cast<uint32_t>(value);
+    for (intptr_t i = 0; i < 4; i++) {
+      EmitUint8(bits >> (8 * i));
+    }
+  }
+  void EmitInt64(int64_t value) {
+    uint64_t bits = static_cast<uint64_t>(value);
+    for (intptr_t i = 0; i < 8; i++) {
+      EmitUint8(bits >> (8 * i));
+    }
+  }
+  int32_t LoadInt32(intptr_t position) {
+    int32_t value;
+    memcpy(&value, &buffer_[position], sizeof(value));
+    return value;
+  }
+  void StoreInt32(intptr_t position, int32_t value) {
+    memcpy(&buffer_[position], &value, sizeof(value));
+  }
+
+  void EmitRex(bool wide, Register reg, Register base) {
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) | (base >> 3);
+    if (rex != 0x40) {
+      EmitUint8(rex);
+    }
+  }
+  void EmitRegisterOperand(Register reg, Register rm) {
+    EmitUint8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+  }
+  void EmitOperand(Register reg, Address address) {
+    uint8_t base = address.base & 7;
+    uint8_t mod;
+    if ((address.disp == 0) && (base != (RBP & 7))) {
+      mod = 0;
+    } else if ((address.disp >= -128) && (address.disp <= 127)) {
+      mod = 1;
+    } else {
+      mod = 2;
+    }
+    EmitUint8((mod << 6) | ((reg & 7) << 3) | base);
+    if (base == (RSP & 7)) {
+      EmitUint8(0x24);  // SIB: no index.
+    }
+    if (mod == 1) {
+      EmitUint8(static_cast<int8_t>(address.disp));
+    } else if (mod == 2) {
+      EmitInt32(address.disp);
+    }
+  }
+  void EmitAlu(uint8_t opcode, Register dst, Register src) {
+    EmitRex(true, src, dst);
+    EmitUint8(opcode);
+    EmitRegisterOperand(src, dst);
+  }
+  void EmitShift(int extension, Register dst, int8_t shift) {
+    EmitRex(true, RAX, dst);
+    EmitUint8(0xC1);
+    EmitRegisterOperand(static_cast<Register>(extension), dst);
+    EmitUint8(shift);
+  }
+  void EmitAluImmediate(int extension, Register dst, int32_t value) {
+    EmitRex(true, RAX, dst);
+    if ((value >= -128) && (value <= 127)) {
+      EmitUint8(0x83);
+      EmitRegisterOperand(static_cast<Register>(extension), dst);
+      EmitUint8(static_cast<int8_t>(value));
+    } else {
+      EmitUint8(0x81);
+      EmitRegisterOperand(static_cast<Register>(extension), dst);
+      EmitInt32(value);
+    }
+  }
+  void EmitLabel(Label* label) {
+    if (label->IsBound()) {
+      EmitInt32(static_cast<int32_t>(label->position_ - (size_ + 4)));
+    } else {
+      EmitInt32(static_cast<int32_t>(label->link_));
+      label->link_ = size_ - 4;
+    }
+  }
+  void EmitTarget(uword target) {
+    intptr_t displacement = target - (CurrentAddress() + 4);
+    ASSERT((displacement >= kMinInt32) && (displacement <= kMaxInt32));
+    EmitInt32(static_cast<int32_t>(displacement));
+  }
+
+  const uword address_;
+  uint8_t* buffer_;
+  intptr_t size_;
+  intptr_t capacity_;
+};
+
+struct JIT::Code {
+  // Offset from the start of this header to the code for each bytecode
+  // index, or 0 if no instruction starts there.
+  uword Entry(intptr_t bci) {
+    if ((bci < 1) || (bci > length)) {
+      return 0;
+    }
+    uint32_t offset = entries[bci];
+    if (offset == 0) {
+      return 0;
+    }
+    return reinterpret_cast<uword>(this) + offset;
+  }
+  uword ActivationEntry() {
+    return reinterpret_cast<uword>(this) + activation_entry;
+  }
+
+  static intptr_t HeaderSize(intptr_t length) {
+    return Utils::RoundUp(sizeof(Code) + (length + 1) * sizeof(uint32_t),
+                          kCodeAlignment);
+  }
+
+  static const intptr_t kCodeAlignment = 16;
+
+  intptr_t length;
+  // Offset to the code that pushes the temporaries of a frame built by a
+  // compiled send and checks for stack overflow before the first bytecode.
+  intptr_t activation_entry;
+  uint32_t entries[];
+};
+
+// Loads a pointer from a field of a heap object.
+static void LoadPointerField(Assembler* assembler, Register dst, Register base,
+                             int32_t offset, Register scratch) {
+#if USE_COMPRESSED_POINTERS
+  // The high half comes from the address of the object itself.
+  assembler->movl(dst, Address(base, offset));
+  assembler->movq(scratch, base);
+  assembler->shrq(scratch, 32);
+  assembler->shlq(scratch, 32);
+  assembler->orq(dst, scratch);
+#else
+  assembler->movq(dst, Address(base, offset));
+#endif
+}
+
+class Compiler {
+ public:
+  Compiler(JIT* jit, Method method, uword start, uint32_t* entries)
+      : jit_(jit),
+        method_(method),
+        assembler_(start + JIT::Code::HeaderSize(method->bytecode()->Size())),
+        header_size_(JIT::Code::HeaderSize(method->bytecode()->Size())),
+        bytecode_(method->bytecode()->element_addr(0)),
+        length_(method->bytecode()->Size()),
+        entries_(entries),
+        labels_(new Label[length_ + 2]),
+        activation_entry_(0),
+        out_of_caches_(false) {}
+  ~Compiler() { delete[] labels_; }
+
+  // Answers false if the inline caches ran out.
+  bool Compile();
+
+  const Assembler& assembler() const { return assembler_; }
+  intptr_t activation_entry() const { return activation_entry_; }
+
+ private:
+  void CompileBytecode(intptr_t bci, intptr_t next_bci, uint8_t byte1);
+
+  void Push(Register reg) {
+    assembler_.subq(SP, kWordSize);
+    assembler_.movq(Address(SP, 0), reg);
+  }
+  void PushInterpreterField(int32_t offset) {
+    assembler_.movq(RAX, Address(THR, offset));
+    Push(RAX);
+  }
+  void PushFrameSlot(intptr_t index) {
+    assembler_.movq(RAX, Address(FP, index * kWordSize));
+    Push(RAX);
+  }
+  void PushSmallInteger(intptr_t value) {
+    assembler_.LoadImmediate(RAX, static_cast<uword>(SmallInteger::New(value)));
+    Push(RAX);
+  }
+  void PushLiteral(intptr_t bci, intptr_t next_bci, intptr_t index);
+  void CheckSmallIntegerRange(Label* overflow);
+  void Jump(intptr_t target);
+  void JumpIf(bool jump_on_true, intptr_t bci, intptr_t next_bci,
+              intptr_t target);
+  void CallRuntime(uword function, intptr_t bci, uword argument);
+  void Step(intptr_t bci, intptr_t next_bci);
+  void Leave(intptr_t bci);
+  void Send(intptr_t bci, intptr_t next_bci,
+            intptr_t selector, intptr_t num_args, intptr_t rule);
+  void Return(intptr_t bci, intptr_t next_bci, uint8_t byte1);
+  void Prologue();
+  void PushCallerFrame(intptr_t next_bci);
+#if !USE_COMPRESSED_POINTERS
+  void ActivateClosure(intptr_t next_bci, intptr_t num_args, Label* slow);
+#endif
+  void CommonSend(intptr_t bci, intptr_t next_bci, intptr_t offset);
+  void SmallIntegerOperation(intptr_t bci, intptr_t next_bci, uint8_t byte1);
+
+  static intptr_t LocalIndex(intptr_t index) { return -5 - index; }
+  static intptr_t ParameterIndex(intptr_t index) { return 1 + index; }
+
+  JIT* const jit_;
+  const Method method_;
+  Assembler assembler_;
+  const intptr_t header_size_;
+  const uint8_t* const bytecode_;
+  const intptr_t length_;
+  uint32_t* const entries_;
+  Label* const labels_;  // By bytecode index, up to the end of the bytecode.
+  intptr_t activation_entry_;
+  bool out_of_caches_;
+};
+
+bool Compiler::Compile() {
+  activation_entry_ = header_size_ + assembler_.size();
+  Prologue();
+
+  intptr_t bci = 1;
+  while (bci <= length_) {
+    uint8_t byte1 = bytecode_[bci - 1];
+    intptr_t next_bci = bci + JIT::BytecodeLength(byte1);
+    if (next_bci > length_ + 1) {
+      break;  // Truncated instruction.
+    }
+    assembler_.Bind(&labels_[bci]);
+    entries_[bci] = header_size_ + assembler_.size();
+    CompileBytecode(bci, next_bci, byte1);
+    bci = next_bci;
+  }
+
+  // Running off the end of the bytecode, and jumps that do not land on the
+  // start of an instruction, continue in the interpreter.
+  if (!labels_[bci].IsBound()) {
+    assembler_.Bind(&labels_[bci]);
+  }
+  Leave(bci);
+  for (intptr_t i = 0; i <= length_ + 1; i++) {
+    if (!labels_[i].IsBound() && labels_[i].IsLinked()) {
+      assembler_.Bind(&labels_[i]);
+      Leave(i);
+    }
+  }
+  return !out_of_caches_;
+}
+
+void Compiler::CompileBytecode(intptr_t bci, intptr_t next_bci, uint8_t byte1) {
+  const uint8_t* operands = &bytecode_[bci];
+  if (byte1 < 16) {
+    Jump(next_bci - (byte1 & 15));
+  } else if (byte1 < 32) {
+    Jump(next_bci + (byte1 & 15));
+  } else if (byte1 < 48) {
+    JumpIf(true, bci, next_bci, next_bci + (byte1 & 15));
+  } else if (byte1 < 64) {
+    JumpIf(false, bci, next_bci, next_bci + (byte1 & 15));
+  } else if (byte1 < 80) {
+    Send(bci, next_bci, byte1 & 7, (byte1 >> 3) & 1, InlineCache::kOrdinary);
+  } else if (byte1 < 96) {
+    Send(bci, next_bci, byte1 & 7, (byte1 >> 3) & 1, kSelf);
+  } else if (byte1 < 112) {
+    Send(bci, next_bci, byte1 & 7, (byte1 >> 3) & 1, kImplicitReceiver);
+  } else if (byte1 < 120) {
+    PushFrameSlot(ParameterIndex(byte1 & 7));
+  } else if (byte1 < 128) {
+    PushFrameSlot(LocalIndex(byte1 & 7));
+  } else if (byte1 < 136) {
+    assembler_.movq(RAX, Address(SP, 0));
+    assembler_.addq(SP, kWordSize);
+    assembler_.movq(Address(FP, LocalIndex(byte1 & 7) * kWordSize), RAX);
+  } else if (byte1 < 144) {
+    assembler_.movq(RAX, Address(SP, 0));
+    assembler_.movq(Address(FP, LocalIndex(byte1 & 7) * kWordSize), RAX);
+  } else if (byte1 < 152) {
+    PushLiteral(bci, next_bci, byte1 & 7);
+  } else if (byte1 >= 176 && byte1 < 208) {
+    SmallIntegerOperation(bci, next_bci, byte1);
+  } else {
+    switch (byte1) {
+      case 152: PushInterpreterField(jit_->nil_offset_); break;
+      case 153: PushInterpreterField(jit_->false_offset_); break;
+      case 154: PushInterpreterField(jit_->true_offset_); break;
+      case 155: PushFrameSlot(-4); break;
+      case 158: assembler_.addq(SP, kWordSize); break;
+      case 159:
+        assembler_.movq(RAX, Address(SP, 0));
+        Push(RAX);
+        break;
+      case 160: PushSmallInteger(-1); break;
+      case 161: PushSmallInteger(0); break;
+      case 162: PushSmallInteger(1); break;
+      case 163: PushSmallInteger(2); break;
+      case 166: case 167: case 168: case 169: case 170:
+        Return(bci, next_bci, byte1);
+        break;
+      case 228: PushFrameSlot(ParameterIndex(operands[0])); break;
+      case 229: PushFrameSlot(LocalIndex(operands[0])); break;
+      case 230:
+        assembler_.movq(RAX, Address(SP, 0));
+        assembler_.addq(SP, kWordSize);
+        assembler_.movq(Address(FP, LocalIndex(operands[0]) * kWordSize), RAX);
+        break;
+      case 231:
+        assembler_.movq(RAX, Address(SP, 0));
+        assembler_.movq(Address(FP, LocalIndex(operands[0]) * kWordSize), RAX);
+        break;
+      case 240:
+        Jump(next_bci - ((operands[1] << 8) | operands[0]));
+        break;
+      case 241:
+        Jump(next_bci + ((operands[1] << 8) | operands[0]));
+        break;
+      case 242:
+        JumpIf(true, bci, next_bci,
+               next_bci + ((operands[1] << 8) | operands[0]));
+        break;
+      case 243:
+        JumpIf(false, bci, next_bci,
+               next_bci + ((operands[1] << 8) | operands[0]));
+        break;
+#if !USE_COMPRESSED_POINTERS
+      case 245: {
+        // Push indirect local: an element of the array in a local.
+        intptr_t offset = operands[0];
+        intptr_t vector_offset = operands[1];
+        assembler_.movq(RAX, Address(FP, LocalIndex(vector_offset) * kWordSize));
+        assembler_.movq(RAX, Address(RAX, OFFSET_OF(Array::Layout, elements_) +
+                                              offset * kWordSize -
+                                              kHeapObjectTag));
+        Push(RAX);
+        break;
+      }
+#endif
+      case 248:
+        PushLiteral(bci, next_bci, (operands[1] << 8) | operands[0]);
+        break;
+      case 249: {
+        int8_t high = operands[1];
+        PushSmallInteger((high << 8) | operands[0]);
+        break;
+      }
+      case 250:
+        Send(bci, next_bci, ((operands[1] & 0xF) << 8) | operands[0],
+             operands[1] >> 4, InlineCache::kOrdinary);
+        break;
+      case 251:
+        Send(bci, next_bci, ((operands[1] & 0xF) << 8) | operands[0],
+             operands[1] >> 4, kSelf);
+        break;
+      case 252:
+        Send(bci, next_bci, ((operands[1] & 0xF) << 8) | operands[0],
+             operands[1] >> 4, kSuper);
+        break;
+      case 253:
+        Send(bci, next_bci, ((operands[1] & 0xF) << 8) | operands[0],
+             operands[1] >> 4, kImplicitReceiver);
+        break;
+      case 254:
+        Send(bci, next_bci, ((operands[1] & 0xF) << 8) | operands[0],
+             operands[1] >> 4, operands[2]);
+        break;
+      case 255: {
+        intptr_t block_size = operands[1] | (operands[2] << 8);
+        Step(bci, next_bci + block_size);
+        break;
+      }
+      default:
+        // Non-local returns, and the rest of the bytecodes that allocate,
+        // store into the heap or search the environment.
+        Step(bci, next_bci);
+    }
+  }
+}
+
+void Compiler::PushLiteral(intptr_t bci, intptr_t next_bci, intptr_t index) {
+#if USE_COMPRESSED_POINTERS
+  // Leave decompressing the literal array to the interpreter.
+  Step(bci, next_bci);
+#else
+  assembler_.movq(RAX, Address(FP, -2 * kWordSize));  // Method.
+  assembler_.movq(RAX, Address(RAX, OFFSET_OF(Method::Layout, literals_) -
+                                        kHeapObjectTag));
+  assembler_.movq(RAX, Address(RAX, OFFSET_OF(Array::Layout, elements_) +
+                                        index * kWordSize - kHeapObjectTag));
+  Push(RAX);
+#endif
+}
+
+void Compiler::Jump(intptr_t target) {
+  if ((target >= 1) && (target <= length_ + 1)) {
+    assembler_.jmp(&labels_[target]);
+  } else {
+    Leave(target);
+  }
+}
+
+void Compiler::JumpIf(bool jump_on_true, intptr_t bci, intptr_t next_bci,
+                      intptr_t target) {
+  Label not_jump_value, not_boolean, done;
+  int32_t jump_value = jump_on_true ? jit_->true_offset_ : jit_->false_offset_;
+  int32_t other_value = jump_on_true ? jit_->false_offset_ : jit_->true_offset_;
+  assembler_.movq(RAX, Address(SP, 0));
+  assembler_.cmpq(RAX, Address(THR, jump_value));
+  assembler_.j(NOT_EQUAL, &not_jump_value);
+  assembler_.addq(SP, kWordSize);
+  Jump(target);
+  assembler_.Bind(&not_jump_value);
+  assembler_.cmpq(RAX, Address(THR, other_value));
+  assembler_.j(NOT_EQUAL, &not_boolean);
+  assembler_.addq(SP, kWordSize);
+  assembler_.jmp(&done);
+  assembler_.Bind(&not_boolean);
+  Step(bci, next_bci);
+  assembler_.Bind(&done);
+}
+
+void Compiler::CallRuntime(uword function, intptr_t bci, uword argument) {
+  assembler_.movq(Address(THR, jit_->sp_offset_), SP);
+  assembler_.movq(Address(THR, jit_->fp_offset_), FP);
+  assembler_.movq(RDI, THR);
+  assembler_.LoadImmediate(RSI, bci);
+  assembler_.LoadImmediate(RDX, argument);
+  assembler_.LoadImmediate(RAX, function);
+  assembler_.call(RAX);
+  assembler_.cmpq(RAX, static_cast<int32_t>(JIT::kFallThrough));
+  assembler_.j(NOT_EQUAL, jit_->resume_stub_);
+  assembler_.movq(SP, Address(THR, jit_->sp_offset_));
+}
+
+void Compiler::Step(intptr_t bci, intptr_t next_bci) {
+  CallRuntime(reinterpret_cast<uword>(&JIT::StepEntry), bci, 0);
+  if (next_bci != bci + JIT::BytecodeLength(bytecode_[bci - 1])) {
+    Jump(next_bci);
+  }
+}
+
+void Compiler::Leave(intptr_t bci) {
+  CallRuntime(reinterpret_cast<uword>(&JIT::LeaveEntry), bci, 0);
+}
+
+// On a hit for a method with code, builds the frame as Activate does and jumps
+// to the code. Other hits, such as primitives, and misses call the runtime.
+void Compiler::Send(intptr_t bci, intptr_t next_bci,
+                    intptr_t selector, intptr_t num_args, intptr_t rule) {
+  InlineCache* cache = jit_->AllocateCache();
+  if (cache == nullptr) {
+    out_of_caches_ = true;
+    Step(bci, next_bci);
+    return;
+  }
+  cache->cid = kIllegalCid;
+  cache->target = nullptr;
+  cache->absent_receiver = nullptr;
+  cache->entry = 0;
+  cache->slot_offset = 0;
+  cache->activates_closure = 0;
+  cache->selector = selector;
+  cache->num_args = num_args;
+  cache->rule = rule;
+  cache->next_bci = next_bci;
+
+  Label have_cid, miss, slow, done;
+  if (rule == InlineCache::kOrdinary) {
+    assembler_.movq(RAX, Address(SP, num_args * kWordSize));
+  } else {
+    assembler_.movq(RAX, Address(FP, -4 * kWordSize));  // Frame's receiver.
+  }
+  assembler_.LoadImmediate(RCX, kSmiCid);
+  assembler_.testl(RAX, kSmiTagMask);
+  assembler_.j(ZERO, &have_cid);
+  assembler_.movl(RCX, Address(RAX, kClassIdFieldOffset / kBitsPerByte -
+                                        kHeapObjectTag));
+  assembler_.Bind(&have_cid);
+  assembler_.LoadImmediate(RDX, reinterpret_cast<uword>(cache));
+  assembler_.cmpq(RCX, Address(RDX, OFFSET_OF(InlineCache, cid)));
+  assembler_.j(NOT_EQUAL, &miss);
+
+  if (rule != InlineCache::kOrdinary) {
+    // The receiver is the absent receiver, or else the frame's receiver.
+    Label have_receiver;
+    assembler_.movq(R8, Address(RDX, OFFSET_OF(InlineCache, absent_receiver)));
+    assembler_.cmpq(R8, 0);
+    assembler_.j(EQUAL, &have_receiver);
+    assembler_.movq(RAX, R8);
+    assembler_.Bind(&have_receiver);
+  }
+
+#if !USE_COMPRESSED_POINTERS
+  if (num_args <= 1) {
+    // Getters and setters, as in Activate.
+    Label not_accessor, store;
+    assembler_.movq(R9, Address(RDX, OFFSET_OF(InlineCache, slot_offset)));
+    assembler_.cmpq(R9, 0);
+    assembler_.j(EQUAL, &not_accessor);
+    assembler_.addq(R9, RAX);
+    if (num_args == 0) {
+      assembler_.movq(RCX, Address(R9, 0));
+      if (rule == InlineCache::kOrdinary) {
+        assembler_.movq(Address(SP, 0), RCX);
+      } else {
+        Push(RCX);
+      }
+    } else {
+      // Leave stores that need the write barrier to the runtime.
+      assembler_.movq(RCX, Address(SP, 0));
+      assembler_.movq(R10, RCX);
+      assembler_.andq(R10, kObjectAlignmentMask);
+      assembler_.cmpq(R10, kNewObjectBits);
+      assembler_.j(NOT_EQUAL, &store);
+      assembler_.movq(R10, RAX);
+      assembler_.andq(R10, kObjectAlignmentMask);
+      assembler_.cmpq(R10, kOldObjectBits);
+      assembler_.j(EQUAL, &slow);
+      assembler_.Bind(&store);
+      assembler_.movq(Address(R9, 0), RCX);
+      if (rule == InlineCache::kOrdinary) {
+        assembler_.addq(SP, kWordSize);
+      } else {
+        assembler_.movq(Address(SP, 0), RAX);
+      }
+    }
+    assembler_.jmp(&done);
+    assembler_.Bind(&not_accessor);
+  }
+
+  if ((rule == InlineCache::kOrdinary) && (num_args <= 3)) {
+    ActivateClosure(next_bci, num_args, &slow);
+  }
+#endif
+
+  assembler_.movq(R9, Address(RDX, OFFSET_OF(InlineCache, entry)));
+  assembler_.cmpq(R9, 0);
+  assembler_.j(EQUAL, &slow);
+
+  if (rule != InlineCache::kOrdinary) {
+    // Insert the absent receiver below the arguments.
+    assembler_.subq(SP, kWordSize);
+    for (intptr_t i = 0; i < num_args; i++) {
+      assembler_.movq(RCX, Address(SP, (i + 1) * kWordSize));
+      assembler_.movq(Address(SP, i * kWordSize), RCX);
+    }
+    assembler_.movq(Address(SP, num_args * kWordSize), RAX);
+  }
+
+  PushCallerFrame(next_bci);
+  assembler_.subq(SP, 4 * kWordSize);
+  // Frame flags: the number of arguments, not a closure.
+  assembler_.LoadImmediate(RCX,
+                           static_cast<uword>(SmallInteger::New(num_args << 1)));
+  assembler_.movq(Address(SP, 3 * kWordSize), RCX);
+  assembler_.movq(RCX, Address(RDX, OFFSET_OF(InlineCache, target)));
+  assembler_.movq(Address(SP, 2 * kWordSize), RCX);
+  assembler_.LoadImmediate(RCX, 0);
+  assembler_.movq(Address(SP, 1 * kWordSize), RCX);  // Activation.
+  assembler_.movq(Address(SP, 0), RAX);  // Receiver.
+  assembler_.jmp(R9);
+
+  assembler_.Bind(&slow);
+  CallRuntime(reinterpret_cast<uword>(&JIT::SendEntry), bci,
+              reinterpret_cast<uword>(cache));
+  assembler_.jmp(&done);
+  assembler_.Bind(&miss);
+  CallRuntime(reinterpret_cast<uword>(&JIT::SendMissEntry), bci,
+              reinterpret_cast<uword>(cache));
+  assembler_.Bind(&done);
+}
+
+// Pushes the saved IP and FP of a new frame, and makes it the current frame.
+void Compiler::PushCallerFrame(intptr_t next_bci) {
+  // The saved IP is the address of next_bci in this frame's bytecode.
+  assembler_.movq(RCX, Address(FP, -2 * kWordSize));
+  LoadPointerField(&assembler_, R10, RCX,
+                   OFFSET_OF(Method::Layout, bytecode_) - kHeapObjectTag, R11);
+  assembler_.addq(R10, static_cast<int32_t>(sizeof(Bytes::Layout)) -
+                           kHeapObjectTag + (next_bci - 1));
+  Push(R10);
+  Push(FP);
+  assembler_.movq(FP, SP);
+}
+
+#if !USE_COMPRESSED_POINTERS
+// On a hit for a closure value primitive with the closure in rax, builds the
+// frame as Interpreter::ActivateClosure does and continues at the code for the
+// closure's method. Closures with the wrong number of arguments and frames
+// that would overflow the stack go to slow.
+void Compiler::ActivateClosure(intptr_t next_bci, intptr_t num_args,
+                               Label* slow) {
+  Label not_closure, copy, copied;
+  assembler_.movq(R9, Address(RDX, OFFSET_OF(InlineCache, activates_closure)));
+  assembler_.cmpq(R9, 0);
+  assembler_.j(EQUAL, &not_closure);
+  assembler_.movq(R9, Address(RAX, OFFSET_OF(Closure::Layout, num_args_) -
+                                       kHeapObjectTag));
+  assembler_.cmpq(R9, static_cast<int32_t>(
+      static_cast<uword>(SmallInteger::New(num_args))));
+  assembler_.j(NOT_EQUAL, slow);
+  assembler_.movq(R8, Address(RAX, OFFSET_OF(Closure::Layout, num_copied_) -
+                                       kHeapObjectTag));
+  assembler_.sarq(R8, kSmiTagShift);
+  assembler_.movq(R9, R8);
+  assembler_.shlq(R9, kWordSizeLog2);
+  assembler_.movq(R10, SP);
+  assembler_.subq(R10, R9);
+  assembler_.subq(R10, 6 * kWordSize);
+  assembler_.cmpq(R10, Address(THR, jit_->stack_limit_offset_));
+  assembler_.j(BELOW, slow);
+
+  PushCallerFrame(next_bci);
+  assembler_.movq(R10, Address(RAX, OFFSET_OF(Closure::Layout,
+                                              defining_activation_) -
+                                        kHeapObjectTag));
+  assembler_.movq(R11, Address(R10, OFFSET_OF(Activation::Layout, method_) -
+                                        kHeapObjectTag));
+  assembler_.subq(SP, 4 * kWordSize);
+  // Frame flags: the number of arguments, a closure.
+  assembler_.LoadImmediate(
+      RCX, static_cast<uword>(SmallInteger::New((num_args << 1) | 1)));
+  assembler_.movq(Address(SP, 3 * kWordSize), RCX);
+  assembler_.movq(Address(SP, 2 * kWordSize), R11);
+  assembler_.LoadImmediate(RCX, 0);
+  assembler_.movq(Address(SP, 1 * kWordSize), RCX);  // Activation.
+  assembler_.movq(RCX, Address(R10, OFFSET_OF(Activation::Layout, receiver_) -
+                                        kHeapObjectTag));
+  assembler_.movq(Address(SP, 0), RCX);
+
+  assembler_.movq(R9, RAX);
+  assembler_.addq(R9, OFFSET_OF(Closure::Layout, copied_) - kHeapObjectTag);
+  assembler_.Bind(&copy);
+  assembler_.cmpq(R8, 0);
+  assembler_.j(EQUAL, &copied);
+  assembler_.movq(RCX, Address(R9, 0));
+  Push(RCX);
+  assembler_.addq(R9, kWordSize);
+  assembler_.subq(R8, 1);
+  assembler_.jmp(&copy);
+  assembler_.Bind(&copied);
+
+  // Continue at the closure's initial bytecode.
+  assembler_.movq(RCX, Address(R11, OFFSET_OF(Method::Layout, bytecode_) -
+                                        kHeapObjectTag));
+  assembler_.movq(R9, Address(RAX, OFFSET_OF(Closure::Layout, initial_bci_) -
+                                       kHeapObjectTag));
+  assembler_.sarq(R9, kSmiTagShift);
+  assembler_.addq(RCX, R9);
+  assembler_.addq(RCX, static_cast<int32_t>(sizeof(Bytes::Layout)) -
+                           kHeapObjectTag - 1);
+  assembler_.jmp(jit_->continue_stub_);
+  assembler_.Bind(&not_closure);
+}
+#endif
+
+// Local returns from frames with a sender on the stack pop the frame and
+// continue at the sender's code. Returns from the base frame call the runtime.
+void Compiler::Return(intptr_t bci, intptr_t next_bci, uint8_t byte1) {
+  Label base;
+  assembler_.movq(RDX, Address(FP, 0));  // Saved FP.
+  assembler_.cmpq(RDX, 0);
+  assembler_.j(EQUAL, &base);
+  switch (byte1) {
+    case 166: assembler_.movq(RAX, Address(THR, jit_->nil_offset_)); break;
+    case 167: assembler_.movq(RAX, Address(THR, jit_->false_offset_)); break;
+    case 168: assembler_.movq(RAX, Address(THR, jit_->true_offset_)); break;
+    case 169: assembler_.movq(RAX, Address(FP, -4 * kWordSize)); break;
+    case 170: assembler_.movq(RAX, Address(SP, 0)); break;
+    default: UNREACHABLE();
+  }
+  assembler_.jmp(jit_->return_stub_);
+  assembler_.Bind(&base);
+  Step(bci, next_bci);
+}
+
+// Completes a frame built by a compiled send: pushes the temporaries past the
+// arguments and checks for stack overflow, as Activate does.
+void Compiler::Prologue() {
+  intptr_t num_nils = method_->NumTemps() - method_->NumArgs();
+  if (num_nils > 0) {
+    assembler_.movq(RAX, Address(THR, jit_->nil_offset_));
+    assembler_.subq(SP, num_nils * kWordSize);
+    for (intptr_t i = 0; i < num_nils; i++) {
+      assembler_.movq(Address(SP, i * kWordSize), RAX);
+    }
+  }
+  Label no_overflow;
+  assembler_.cmpq(SP, Address(THR, jit_->stack_limit_offset_));
+  assembler_.j(ABOVE_EQUAL, &no_overflow);
+  CallRuntime(reinterpret_cast<uword>(&JIT::StackOverflowEntry), 1, 0);
+  assembler_.Bind(&no_overflow);
+}
+
+void Compiler::CommonSend(intptr_t bci, intptr_t next_bci, intptr_t offset) {
+  Array common_selectors = jit_->interpreter_->object_store()->common_selectors();
+  SmallInteger arity =
+      static_cast<SmallInteger>(common_selectors->element(offset * 2 + 1));
+  ASSERT(arity->IsSmallInteger());
+  Send(bci, next_bci, -1 - offset, arity->value(), InlineCache::kOrdinary);
+}
+
+// Follows a tagged add, subtract or multiply.
+void Compiler::CheckSmallIntegerRange(Label* overflow) {
+  assembler_.j(OVERFLOW, overflow);
+#if USE_COMPRESSED_POINTERS
+  // SmallIntegers are narrower than the registers.
+  assembler_.movsxd(RDX, RAX);
+  assembler_.cmpq(RDX, RAX);
+  assembler_.j(NOT_EQUAL, overflow);
+#endif
+}
+
+// SmallInteger arithmetic and comparisons inline, with other receivers and
+// overflow taking the send.
+void Compiler::SmallIntegerOperation(intptr_t bci, intptr_t next_bci,
+                                     uint8_t byte1) {
+  Condition condition;
+  switch (byte1) {
+    case 176:  // +
+    case 177:  // -
+    case 178:  // *
+    case 183:  // &
+    case 184:  // |
+      condition = OVERFLOW;  // Unused.
+      break;
+    case 185: condition = LESS; break;
+    case 186: condition = GREATER; break;
+    case 187: condition = LESS_EQUAL; break;
+    case 188: condition = GREATER_EQUAL; break;
+    case 189: condition = EQUAL; break;
+    default:
+      CommonSend(bci, next_bci, byte1 - 176);
+      return;
+  }
+
+  Label slow, done;
+  assembler_.movq(RAX, Address(SP, kWordSize));  // Left.
+  assembler_.movq(RCX, Address(SP, 0));  // Right.
+  assembler_.movq(RDX, RAX);
+  assembler_.orq(RDX, RCX);
+  assembler_.testl(RDX, kSmiTagMask);
+  assembler_.j(NOT_ZERO, &slow);
+  switch (byte1) {
+    case 176:
+      assembler_.addq(RAX, RCX);
+      CheckSmallIntegerRange(&slow);
+      break;
+    case 177:
+      assembler_.subq(RAX, RCX);
+      CheckSmallIntegerRange(&slow);
+      break;
+    case 178:
+      assembler_.sarq(RAX, kSmiTagShift);
+      assembler_.imulq(RAX, RCX);
+      CheckSmallIntegerRange(&slow);
+      break;
+    case 183:
+      assembler_.andq(RAX, RCX);
+      break;
+    case 184:
+      assembler_.orq(RAX, RCX);
+      break;
+    default:
+      assembler_.cmpq(RAX, RCX);
+      assembler_.movq(RAX, Address(THR, jit_->false_offset_));
+      assembler_.cmovq(condition, RAX, Address(THR, jit_->true_offset_));
+  }
+  assembler_.addq(SP, kWordSize);
+  assembler_.movq(Address(SP, 0), RAX);
+  assembler_.jmp(&done);
+  assembler_.Bind(&slow);
+  CommonSend(bci, next_bci, byte1 - 176);
+  assembler_.Bind(&done);
+}
+
+
+JIT::JIT(Interpreter* interpreter)
+    : interpreter_(interpreter),
+      methods_(interpreter->compiled_methods_),
+      interpreted_(nullptr),
+      compile_threshold_(kCompileThreshold),
+      back_edge_sample_rate_(kBackEdgeSampleRate),
+      back_edge_countdown_(kBackEdgeSampleRate),
+      code_space_size_(kCodeSpaceSize),
+      cache_space_size_(kCacheSpaceSize),
+      code_top_(0),
+      stubs_end_(0),
+      cache_top_(nullptr),
+      cache_end_(nullptr),
+      enter_stub_(0),
+      resume_stub_(0),
+      return_stub_(0),
+      continue_stub_(0),
+      flush_pending_(false),
+      disabled_(false) {
+  uword base = reinterpret_cast<uword>(interpreter);
+  ip_offset_ = reinterpret_cast<uword>(&interpreter->ip_) - base;
+  sp_offset_ = reinterpret_cast<uword>(&interpreter->sp_) - base;
+  fp_offset_ = reinterpret_cast<uword>(&interpreter->fp_) - base;
+  stack_limit_offset_ =
+      reinterpret_cast<uword>(&interpreter->checked_stack_limit_) - base;
+  nil_offset_ = reinterpret_cast<uword>(&interpreter->nil_) - base;
+  false_offset_ = reinterpret_cast<uword>(&interpreter->false_) - base;
+  true_offset_ = reinterpret_cast<uword>(&interpreter->true_) - base;
+  for (intptr_t i = 0; i < kTableSize; i++) {
+    counts_[i] = 0;
+    codes_[i] = nullptr;
+  }
+  if (getenv("PSOUP_JIT_STRESS") != nullptr) {
+    compile_threshold_ = 1;
+    back_edge_sample_rate_ = 1;
+    back_edge_countdown_ = 1;
+    code_space_size_ = kStressCodeSpaceSize;
+    cache_space_size_ = kStressCacheSpaceSize;
+  }
+}
+
+JIT::~JIT() {
+  if (code_space_.size() != 0) {
+    code_space_.Free();
+  }
+  if (cache_space_.size() != 0) {
+    cache_space_.Free();
+  }
+}
+
+intptr_t JIT::BytecodeLength(uint8_t byte1) {
+  switch (byte1) {
+    case 222: case 223: case 228: case 229: case 230: case 231: case 233:
+      return 2;
+    case 240: case 241: case 242: case 243: case 245: case 246: case 247:
+    case 248: case 249: case 250: case 251: case 252: case 253:
+      return 3;
+    case 254: case 255:
+      return 4;
+    default:
+      return 1;
+  }
+}
+
+uword JIT::Entry(Method method, intptr_t hash, intptr_t bci, bool count) {
+  if (disabled_) {
+    return 0;
+  }
+  if (!count && (method == interpreted_)) {
+    return 0;
+  }
+
+  intptr_t victim = -1;
+  for (intptr_t probe = 0; probe < kProbes; probe++) {
+    intptr_t i = (hash + probe) & (kTableSize - 1);
+    if (methods_[i] == method) {
+      Code* code = codes_[i];
+      if (code == nullptr) {
+        if (!count) {
+          interpreted_ = method;
+          return 0;
+        }
+        if (++counts_[i] < compile_threshold_) {
+          return 0;
+        }
+        code = Compile(method);
+        if (code == nullptr) {
+          counts_[i] = 0;
+          return 0;
+        }
+        codes_[i] = code;
+      }
+      return code->Entry(bci);
+    }
+    // Replace an empty entry, or else the least used entry without code.
+    if (codes_[i] == nullptr) {
+      if ((victim == -1) || (counts_[i] < counts_[victim])) {
+        victim = i;
+      }
+    }
+  }
+
+  if (!count) {
+    interpreted_ = method;
+  } else if (victim != -1) {
+    methods_[victim] = method;
+    counts_[victim] = 1;
+  }
+  return 0;
+}
+
+void JIT::NoteTarget(InlineCache* cache) {
+  intptr_t prim = cache->target->Primitive();
+  if (prim == 0) {
+    cache->entry = ActivationEntry(cache->target);
+  } else if (USE_COMPRESSED_POINTERS) {
+    // Compiled code leaves decompressing fields to the runtime.
+  } else if ((prim & (256 | 512)) != 0) {
+    cache->slot_offset = OFFSET_OF(RegularObject::Layout, slots_) +
+                         (prim & 255) * kWordSize - kHeapObjectTag;
+  } else if (Primitives::IsClosureValue(prim)) {
+    cache->activates_closure = 1;
+  }
+}
+
+uword JIT::ActivationEntry(Method method) {
+  intptr_t hash = method->header_hash();
+  if (hash == 0) {
+    return 0;
+  }
+  for (intptr_t probe = 0; probe < kProbes; probe++) {
+    intptr_t i = (hash + probe) & (kTableSize - 1);
+    if (methods_[i] == method) {
+      Code* code = codes_[i];
+      return (code == nullptr) ? 0 : code->ActivationEntry();
+    }
+  }
+  return 0;
+}
+
+void JIT::Enter(uword entry) {
+  typedef void (*EnterFunction)(Interpreter* interpreter, uword entry);
+  reinterpret_cast<EnterFunction>(enter_stub_)(interpreter_, entry);
+}
+
+void JIT::GCEpilogue() {
+  interpreted_ = nullptr;
+  if (cache_space_.size() == 0) {
+    return;
+  }
+  for (InlineCache* cache = reinterpret_cast<InlineCache*>(cache_space_.base());
+       cache < cache_top_;
+       cache++) {
+    cache->cid = kIllegalCid;
+    cache->target = nullptr;
+    cache->absent_receiver = nullptr;
+    cache->entry = 0;
+    cache->slot_offset = 0;
+    cache->activates_closure = 0;
+  }
+}
+
+void JIT::Flush() {
+  ASSERT(flush_pending_);
+  for (intptr_t i = 0; i < kTableSize; i++) {
+    methods_[i] = nullptr;
+    counts_[i] = 0;
+    codes_[i] = nullptr;
+  }
+  interpreted_ = nullptr;
+  code_top_ = stubs_end_;
+  if (cache_space_.size() != 0) {
+    cache_top_ = reinterpret_cast<InlineCache*>(cache_space_.base());
+  }
+  flush_pending_ = false;
+}
+
+uword JIT::StepEntry(Interpreter* interpreter, intptr_t bci, uword unused) {
+  return interpreter->CompiledStep(bci);
+}
+
+uword JIT::SendEntry(Interpreter* interpreter, intptr_t bci, uword cache) {
+  return interpreter->CompiledSend(reinterpret_cast<InlineCache*>(cache));
+}
+
+uword JIT::SendMissEntry(Interpreter* interpreter, intptr_t bci, uword cache) {
+  return interpreter->CompiledSendMiss(bci,
+                                       reinterpret_cast<InlineCache*>(cache));
+}
+
+uword JIT::LeaveEntry(Interpreter* interpreter, intptr_t bci, uword unused) {
+  return interpreter->CompiledLeave(bci);
+}
+
+uword JIT::StackOverflowEntry(Interpreter* interpreter, intptr_t bci,
+                              uword unused) {
+  return interpreter->CompiledStackOverflow();
+}
+
+bool JIT::EnsureSpaces() {
+  if (code_space_.size() != 0) {
+    return true;
+  }
+  code_space_ = VirtualMemory::Allocate(code_space_size_,
+                                        VirtualMemory::kReadWrite,
+                                        "primordialsoup-code");
+  cache_space_ = VirtualMemory::Allocate(cache_space_size_,
+                                         VirtualMemory::kReadWrite,
+                                         "primordialsoup-inline-caches");
+  cache_top_ = reinterpret_cast<InlineCache*>(cache_space_.base());
+  cache_end_ = cache_top_ + (cache_space_.size() / sizeof(InlineCache));
+  code_top_ = code_space_.base();
+  GenerateStubs();
+  if (!code_space_.Protect(VirtualMemory::kReadExecute)) {
+    // W^X is enforced differently here; stay in the interpreter.
+    disabled_ = true;
+    return false;
+  }
+  return true;
+}
+
+// Enter: called from C with the interpreter and the entry. Saves the
+// callee-saved registers compiled code uses, keeping the stack aligned for the
+// calls compiled code makes into the runtime.
+//
+// Resume: compiled code jumps here when a runtime function answers something
+// other than kFallThrough: either 0, to return to the interpreter, or the code
+// to continue at with the stack and frame pointers the interpreter now has.
+//
+// Return: compiled code jumps here for a local return with the result in rax
+// and the saved FP in rdx. Pops the frame as LocalReturn does, then continues.
+//
+// Continue: continues the frame in the frame pointer at the IP in rcx, looking
+// up the code for the frame's method as Entry does, but without counting. If
+// there is none, returns to the interpreter.
+void JIT::GenerateStubs() {
+  Assembler assembler(code_top_);
+  Label leave, leave_at_ip;
+
+  assembler.pushq(RBP);
+  assembler.movq(RBP, RSP);
+  assembler.pushq(THR);
+  assembler.pushq(SP);
+  assembler.pushq(FP);
+  assembler.pushq(R14);
+  assembler.movq(THR, RDI);
+  assembler.movq(SP, Address(THR, sp_offset_));
+  assembler.movq(FP, Address(THR, fp_offset_));
+  assembler.jmp(RSI);
+
+  assembler.Bind(&leave);
+  assembler.popq(R14);
+  assembler.popq(FP);
+  assembler.popq(SP);
+  assembler.popq(THR);
+  assembler.popq(RBP);
+  assembler.ret();
+
+  intptr_t resume_offset = assembler.size();
+  assembler.cmpq(RAX, 0);
+  assembler.j(EQUAL, &leave);
+  assembler.movq(SP, Address(THR, sp_offset_));
+  assembler.movq(FP, Address(THR, fp_offset_));
+  assembler.jmp(RAX);
+
+  intptr_t return_offset = assembler.size();
+  assembler.movq(RCX, Address(FP, kWordSize));  // Saved IP.
+  assembler.movq(R8, Address(FP, -kWordSize));  // Flags.
+  assembler.sarq(R8, kSmiTagShift + 1);  // Number of arguments.
+  assembler.shlq(R8, kWordSizeLog2);
+  assembler.movq(SP, FP);
+  assembler.addq(SP, R8);
+  assembler.addq(SP, 3 * kWordSize);
+  assembler.movq(FP, RDX);
+  assembler.subq(SP, kWordSize);
+  assembler.movq(Address(SP, 0), RAX);
+
+  intptr_t continue_offset = assembler.size();
+  Label found, probes[kProbes];
+  assembler.movq(RDX, Address(FP, -2 * kWordSize));  // Method.
+  assembler.movq(RAX, Address(RDX, OFFSET_OF(HeapObject::Layout, header_hash_)
+                                       - kHeapObjectTag));
+  for (intptr_t probe = 0; probe < kProbes; probe++) {
+    assembler.movq(R8, RAX);
+    assembler.addq(R8, static_cast<int32_t>(probe));
+    assembler.andq(R8, static_cast<int32_t>(kTableSize - 1));
+    assembler.shlq(R8, kWordSizeLog2);
+    assembler.LoadImmediate(R9, reinterpret_cast<uword>(methods_));
+    assembler.addq(R9, R8);
+    assembler.cmpq(RDX, Address(R9, 0));
+    assembler.j(EQUAL, &probes[probe]);
+  }
+  assembler.jmp(&leave_at_ip);
+  for (intptr_t probe = 0; probe < kProbes; probe++) {
+    assembler.Bind(&probes[probe]);
+    assembler.LoadImmediate(R9, reinterpret_cast<uword>(codes_));
+    assembler.addq(R9, R8);
+    assembler.movq(R9, Address(R9, 0));
+    assembler.jmp(&found);
+  }
+  assembler.Bind(&found);
+  assembler.cmpq(R9, 0);
+  assembler.j(EQUAL, &leave_at_ip);
+  // The bytecode index of the IP.
+  LoadPointerField(&assembler, R10, RDX,
+                   OFFSET_OF(Method::Layout, bytecode_) - kHeapObjectTag, R11);
+  assembler.movq(R11, RCX);
+  assembler.subq(R11, R10);
+  assembler.subq(R11, static_cast<int32_t>(sizeof(Bytes::Layout)) -
+                          kHeapObjectTag - 1);
+  assembler.cmpq(R11, Address(R9, OFFSET_OF(Code, length)));
+  assembler.j(ABOVE, &leave_at_ip);
+  assembler.shlq(R11, 2);
+  assembler.addq(R11, R9);
+  assembler.movl(R11, Address(R11, OFFSET_OF(Code, entries)));
+  assembler.cmpq(R11, 0);
+  assembler.j(EQUAL, &leave_at_ip);
+  assembler.addq(R11, R9);
+  assembler.jmp(R11);
+
+  assembler.Bind(&leave_at_ip);
+  assembler.movq(Address(THR, ip_offset_), RCX);
+  assembler.movq(Address(THR, sp_offset_), SP);
+  assembler.movq(Address(THR, fp_offset_), FP);
+  assembler.jmp(&leave);
+
+  memcpy(reinterpret_cast<void*>(code_top_), assembler.buffer(),
+         assembler.size());
+  enter_stub_ = code_top_;
+  resume_stub_ = code_top_ + resume_offset;
+  return_stub_ = code_top_ + return_offset;
+  continue_stub_ = code_top_ + continue_offset;
+  code_top_ = Utils::RoundUp(code_top_ + assembler.size(),
+                             Code::kCodeAlignment);
+  stubs_end_ = code_top_;
+}
+
+InlineCache* JIT::AllocateCache() {
+  if (cache_top_ >= cache_end_) {
+    return nullptr;
+  }
+  return cache_top_++;
+}
+
+JIT::Code* JIT::Compile(Method method) {
+  if (!EnsureSpaces()) {
+    return nullptr;
+  }
+
+  intptr_t length = method->bytecode()->Size();
+  intptr_t header_size = Code::HeaderSize(length);
+  uint32_t* entries = new uint32_t[length + 1];
+  memset(entries, 0, (length + 1) * sizeof(uint32_t));
+  Compiler compiler(this, method, code_top_, entries);
+  bool complete = compiler.Compile();
+  intptr_t size = header_size + compiler.assembler().size();
+  if (!complete || (code_top_ + size > code_space_.limit())) {
+    // Start over once compiled code is no longer running.
+    delete[] entries;
+    Invalidate();
+    return nullptr;
+  }
+
+  if (!code_space_.Protect(VirtualMemory::kReadWrite)) {
+    FATAL("Failed to make code writable");
+  }
+  Code* code = reinterpret_cast<Code*>(code_top_);
+  code->length = length;
+  code->activation_entry = compiler.activation_entry();
+  memcpy(code->entries, entries, (length + 1) * sizeof(uint32_t));
+  memcpy(reinterpret_cast<void*>(code_top_ + header_size),
+         compiler.assembler().buffer(),
+         compiler.assembler().size());
+  if (!code_space_.Protect(VirtualMemory::kReadExecute)) {
+    FATAL("Failed to make code executable");
+  }
+  delete[] entries;
+
+  code_top_ = Utils::RoundUp(code_top_ + size, Code::kCodeAlignment);
+  interpreted_ = nullptr;
+  return code;
+}
+
+}  // namespace psoup
+
+#endif  // USE_BASELINE_JIT
@@ -0,0 +1,446 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/json.h"
+
+#include <string.h>
+
+#include "vm/heap.h"
+#include "vm/interpreter.h"
+
+namespace psoup {
+
+static bool IsWhitespace(uint8_t byte) {
+  return (byte == ' ') || (byte == '\n') || (byte == '\r') || (byte == '\t');
+}
+
+
+static bool IsDigit(uint8_t byte) {
+  return (byte >= '0') && (byte <= '9');
+}
+
+
+// Returns the byte an escape sequence stands for, or 0 if it is not one the
+// image's decoder accepts.
+static uint8_t Unescape(uint8_t byte) {
+  switch (byte) {
+    case '"': return '"';
+    case '\\': return '\\';
+    case '/': return '/';
+    case 'b': return '\b';
+    case 'f': return '\f';
+    case 'n': return '\n';
+    case 'r': return '\r';
+    case 't': return '\t';
+    default: return 0;
+  }
+}
+
+
+static uint8_t Escape(uint8_t byte) {
+  switch (byte) {
+    case '"': return '"';
+    case '\\': return '\\';
+    case '/': return '/';
+    case '\b': return 'b';
+    case '\f': return 'f';
+    case '\n': return 'n';
+    case '\r': return 'r';
+    case '\t': return 't';
+    default: return 0;
+  }
+}
+
+
+// An iterative parser. Values are accumulated on an Array used as a stack
+// rather than on the C stack, so deep nesting cannot overflow and every
+// intermediate object stays visible to the GC. Each open container pushes a
+// SmallInteger recording the start of the enclosing container and whether it
+// is a map; closing a container moves the elements above that mark into a new
+// Array.
+class JSONDecoder : public ValueObject {
+ public:
+  JSONDecoder(Heap* heap, Bytes input, Object map_marker)
+      : heap_(heap),
+        input_(input),
+        map_marker_(map_marker),
+        stack_(static_cast<Array>(heap->interpreter()->nil_obj())),
+        value_(heap->interpreter()->nil_obj()),
+        size_(input->Size()),
+        position_(0),
+        sp_(0),
+        frame_(-1),
+        in_map_(false) {}
+
+  Object Decode();
+
+ private:
+  static const intptr_t kInitialStackSize = 32;
+
+  uint8_t ByteAt(intptr_t position) const {
+    ASSERT(position < size_);
+    return *input_->element_addr(position);
+  }
+
+  bool SkipWhitespace() {
+    while (position_ < size_ && IsWhitespace(ByteAt(position_))) {
+      position_++;
+    }
+    return position_ < size_;
+  }
+
+  bool Match(const char* literal, intptr_t length) {
+    if ((size_ - position_ < length) ||
+        (memcmp(input_->element_addr(position_), literal, length) != 0)) {
+      return false;
+    }
+    position_ += length;
+    return true;
+  }
+
+  void Push(Object value);  // SAFEPOINT
+  void Open(bool is_map);  // SAFEPOINT
+  void Close();  // SAFEPOINT
+  bool ParseString();  // SAFEPOINT
+  bool ParseNumber();  // SAFEPOINT
+  bool ParseValue();  // SAFEPOINT
+  bool ParseKey();  // SAFEPOINT
+
+  Heap* heap_;
+  Bytes input_;
+  Object map_marker_;
+  Array stack_;
+  Object value_;
+  intptr_t size_;
+  intptr_t position_;
+  intptr_t sp_;
+  intptr_t frame_;
+  bool in_map_;
+
+  DISALLOW_COPY_AND_ASSIGN(JSONDecoder);
+};
+
+
+void JSONDecoder::Push(Object value) {
+  if (sp_ == stack_->Size()) {
+    value_ = value;
+    intptr_t new_size = sp_ * 2;
+    Array new_stack = heap_->AllocateArray(new_size);  // SAFEPOINT
+    for (intptr_t i = 0; i < sp_; i++) {
+      new_stack->set_element(i, stack_->element(i));
+    }
+    Object nil = heap_->interpreter()->nil_obj();
+    for (intptr_t i = sp_; i < new_size; i++) {
+      new_stack->set_element(i, nil, kNoBarrier);
+    }
+    stack_ = new_stack;
+    value = value_;
+    value_ = nil;
+  }
+  stack_->set_element(sp_++, value);
+}
+
+
+void JSONDecoder::Open(bool is_map) {
+  // Offset by one so the mark is never negative.
+  Push(SmallInteger::New(((frame_ + 1) << 1) | (in_map_ ? 1 : 0)));
+  frame_ = sp_;
+  in_map_ = is_map;
+}
+
+
+void JSONDecoder::Close() {
+  intptr_t length = sp_ - frame_;
+  intptr_t offset = in_map_ ? 1 : 0;
+  Array result = heap_->AllocateArray(offset + length);  // SAFEPOINT
+  if (in_map_) {
+    result->set_element(0, map_marker_);
+  }
+  for (intptr_t i = 0; i < length; i++) {
+    result->set_element(offset + i, stack_->element(frame_ + i));
+  }
+  intptr_t mark =
+      static_cast<SmallInteger>(stack_->element(frame_ - 1))->value();
+  sp_ = frame_ - 1;
+  frame_ = (mark >> 1) - 1;
+  in_map_ = (mark & 1) != 0;
+  Push(result);
+}
+
+
+bool JSONDecoder::ParseString() {
+  ASSERT(ByteAt(position_) == '"');
+  intptr_t start = position_ + 1;
+  const uint8_t* bytes = input_->element_addr(0);
+  const uint8_t* quote = reinterpret_cast<const uint8_t*>(
+      memchr(bytes + start, '"', size_ - start));
+  if (quote == nullptr) {
+    return false;
+  }
+  intptr_t stop = quote - bytes;
+  if (memchr(bytes + start, '\\', stop - start) == nullptr) {
+    String result = heap_->AllocateString(stop - start);  // SAFEPOINT
+    memcpy(result->element_addr(0), input_->element_addr(start), stop - start);
+    position_ = stop + 1;
+    Push(result);
+    return true;
+  }
+
+  // Slow path: the string contains escapes, one of which may be an escaped
+  // quote, so the end must be found by walking the escapes.
+  intptr_t length = 0;
+  stop = start;
+  for (;;) {
+    if (stop >= size_) {
+      return false;
+    }
+    uint8_t byte = bytes[stop];
+    if (byte == '"') {
+      break;
+    }
+    if (byte == '\\') {
+      if ((stop + 1 >= size_) || (Unescape(bytes[stop + 1]) == 0)) {
+        return false;
+      }
+      stop += 2;
+    } else {
+      stop++;
+    }
+    length++;
+  }
+  String result = heap_->AllocateString(length);  // SAFEPOINT
+  bytes = input_->element_addr(0);
+  uint8_t* out = result->element_addr(0);
+  for (intptr_t i = start; i < stop; i++) {
+    uint8_t byte = bytes[i];
+    if (byte == '\\') {
+      byte = Unescape(bytes[++i]);
+    }
+    *out++ = byte;
+  }
+  position_ = stop + 1;
+  Push(result);
+  return true;
+}
+
+
+// "-"? digit+ ("." digit+)? ((e|E) (+|-)? digit+)?
+bool JSONDecoder::ParseNumber() {
+  intptr_t start = position_;
+  bool negative = ByteAt(position_) == '-';
+  if (negative) {
+    position_++;
+  }
+  intptr_t digits_start = position_;
+  while (position_ < size_ && IsDigit(ByteAt(position_))) {
+    position_++;
+  }
+  intptr_t digits = position_ - digits_start;
+  if (digits == 0) {
+    return false;
+  }
+  // Eighteen decimal digits always fit in an int64_t. Longer integers are left
+  // to the image as text.
+  bool is_integer = digits <= 18;
+  if (position_ < size_ && ByteAt(position_) == '.') {
+    is_integer = false;
+    position_++;
+    intptr_t fraction_start = position_;
+    while (position_ < size_ && IsDigit(ByteAt(position_))) {
+      position_++;
+    }
+    if (position_ == fraction_start) {
+      return false;
+    }
+  }
+  if (position_ < size_ &&
+      (ByteAt(position_) == 'e' || ByteAt(position_) == 'E')) {
+    is_integer = false;
+    position_++;
+    if (position_ < size_ &&
+        (ByteAt(position_) == '+' || ByteAt(position_) == '-')) {
+      position_++;
+    }
+    intptr_t exponent_start = position_;
+    while (position_ < size_ && IsDigit(ByteAt(position_))) {
+      position_++;
+    }
+    if (position_ == exponent_start) {
+      return false;
+    }
+  }
+
+  if (is_integer) {
+    int64_t value = 0;
+    for (intptr_t i = digits_start; i < digits_start + digits; i++) {
+      value = value * 10 + (ByteAt(i) - '0');
+    }
+    if (negative) {
+      value = -value;
+    }
+    if (SmallInteger::IsSmiValue(value)) {
+      Push(SmallInteger::New(value));
+    } else {
+      MediumInteger result = heap_->AllocateMediumInteger();  // SAFEPOINT
+      result->set_value(value);
+      Push(result);
+    }
+    return true;
+  }
+
+  intptr_t length = position_ - start;
+  ByteArray text = heap_->AllocateByteArray(length);  // SAFEPOINT
+  memcpy(text->element_addr(0), input_->element_addr(start), length);
+  Push(text);
+  return true;
+}
+
+
+bool JSONDecoder::ParseValue() {
+  if (!SkipWhitespace()) {
+    return false;
+  }
+  uint8_t byte = ByteAt(position_);
+  switch (byte) {
+    case '"':
+      return ParseString();
+    case 't':
+      if (!Match("true", 4)) return false;
+      Push(heap_->interpreter()->true_obj());
+      return true;
+    case 'f':
+      if (!Match("false", 5)) return false;
+      Push(heap_->interpreter()->false_obj());
+      return true;
+    case 'n':
+      if (!Match("null", 4)) return false;
+      Push(heap_->interpreter()->nil_obj());
+      return true;
+    default:
+      if (IsDigit(byte) || byte == '-') {
+        return ParseNumber();
+      }
+      return false;
+  }
+}
+
+
+// string ":"
+bool JSONDecoder::ParseKey() {
+  if (!SkipWhitespace() || ByteAt(position_) != '"' || !ParseString()) {
+    return false;
+  }
+  if (!SkipWhitespace() || ByteAt(position_) != ':') {
+    return false;
+  }
+  position_++;
+  return true;
+}
+
+
+Object JSONDecoder::Decode() {
+  HandleScope h1(heap_, reinterpret_cast<Object*>(&input_));
+  HandleScope h2(heap_, &map_marker_);
+  HandleScope h3(heap_, reinterpret_cast<Object*>(&stack_));
+  HandleScope h4(heap_, &value_);
+
+  Array stack = heap_->AllocateArray(kInitialStackSize);  // SAFEPOINT
+  Object nil = heap_->interpreter()->nil_obj();
+  for (intptr_t i = 0; i < kInitialStackSize; i++) {
+    stack->set_element(i, nil, kNoBarrier);
+  }
+  stack_ = stack;
+
+  for (;;) {
+    // Expecting a value.
+    if (!SkipWhitespace()) {
+      return nullptr;
+    }
+    uint8_t byte = ByteAt(position_);
+    if (byte == '[' || byte == '{') {
+      position_++;
+      Open(byte == '{');
+      if (!SkipWhitespace()) {
+        return nullptr;
+      }
+      if (ByteAt(position_) == (in_map_ ? '}' : ']')) {
+        position_++;
+        Close();
+      } else {
+        if (in_map_ && !ParseKey()) {
+          return nullptr;
+        }
+        continue;
+      }
+    } else if (!ParseValue()) {
+      return nullptr;
+    }
+
+    // After a value: finish the enclosing containers it completes.
+    for (;;) {
+      if (frame_ < 0) {
+        ASSERT(sp_ == 1);
+        return stack_->element(0);
+      }
+      if (!SkipWhitespace()) {
+        return nullptr;
+      }
+      byte = ByteAt(position_);
+      position_++;
+      if (byte == ',') {
+        if (in_map_ && !ParseKey()) {
+          return nullptr;
+        }
+        break;
+      }
+      if (byte != (in_map_ ? '}' : ']')) {
+        return nullptr;
+      }
+      Close();
+    }
+  }
+}
+
+
+Object JSON::Decode(Heap* heap, Bytes input, Object map_marker) {
+  JSONDecoder decoder(heap, input, map_marker);
+  return decoder.Decode();
+}
+
+
+String JSON::Quote(Heap* heap, Bytes input) {
+  intptr_t size = input->Size();
+  intptr_t length = size + 2;
+  const uint8_t* bytes = input->element_addr(0);
+  for (intptr_t i = 0; i < size; i++) {
+    if (Escape(bytes[i]) != 0) {
+      length++;
+    }
+  }
+
+  HandleScope h1(heap, reinterpret_cast<Object*>(&input));
+  String result = heap->AllocateString(length);  // SAFEPOINT
+  bytes = input->element_addr(0);
+  uint8_t* out = result->element_addr(0);
+  *out++ = '"';
+  if (length == size + 2) {
+    memcpy(out, bytes, size);
+    out += size;
+  } else {
+    for (intptr_t i = 0; i < size; i++) {
+      uint8_t escape = Escape(bytes[i]);
+      if (escape != 0) {
+        *out++ = '\\';
+        *out++ = escape;
+      } else {
+        *out++ = bytes[i];
+      }
+    }
+  }
+  *out++ = '"';
+  ASSERT(out == result->element_addr(0) + length);
+  return result;
+}
+
+}  // namespace psoup
@@ -0,0 +1,36 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_JSON_H_
+#define VM_JSON_H_
+
+#include "vm/allocation.h"
+#include "vm/globals.h"
+#include "vm/object.h"
+
+namespace psoup {
+
+class Heap;
+
+// Native support for newspeak/JSON.ns. Anything the fast paths do not handle
+// is reported as failure so the image can fall back to its own decoder and
+// signal its own errors.
+class JSON : public AllStatic {
+ public:
+  // Parses the value at the start of input. JSON arrays become Arrays, objects
+  // become Arrays of map_marker followed by alternating keys and values, and
+  // strings become Strings. Integers that fit in 64 bits become SmallIntegers
+  // or MediumIntegers; other numbers become ByteArrays holding their text for
+  // the image to convert exactly. Returns nullptr on malformed input.
+  static Object Decode(Heap* heap,
+                       Bytes input,
+                       Object map_marker);  // SAFEPOINT
+
+  // Returns input as a quoted and escaped JSON string.
+  static String Quote(Heap* heap, Bytes input);  // SAFEPOINT
+};
+
+}  // namespace psoup
+
+#endif  // VM_JSON_H_
@@ -6,6 +6,7 @@
 #if !defined(OS_EMSCRIPTEN)
 
 #include <signal.h>
+#include <stdlib.h>
 
 #include "vm/os.h"
 #include "vm/primordial_soup.h"
@@ -23,6 +24,10 @@ int main(int argc, const char** argv) {
 
   psoup::VirtualMemory snapshot = psoup::VirtualMemory::MapReadOnly(argv[1]);
   PrimordialSoup_Startup();
+  const char* pool_size = getenv("PSOUP_ISOLATE_POOL");
+  if (pool_size != NULL && atoi(pool_size) > 0) {
+    PrimordialSoup_SetIsolatePool(atoi(pool_size), atoi(pool_size));
+  }
   void (*defaultSIGINT)(int) = signal(SIGINT, SIGINT_handler);
 
   intptr_t exit_code =
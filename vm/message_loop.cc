@@ -10,9 +10,16 @@
 namespace psoup {
 
 MessageLoop::MessageLoop(Isolate* isolate)
-    : isolate_(isolate), open_ports_(0), open_waits_(0), exit_code_(0) {}
+    : isolate_(isolate), open_ports_(0), open_waits_(0), exit_code_(0),
+      last_operation_handle_(0), completions_(NULL) {}
 
-MessageLoop::~MessageLoop() {}
+MessageLoop::~MessageLoop() {
+  while (completions_ != NULL) {
+    IsolateMessage* message = completions_;
+    completions_ = message->next_;
+    delete message;
+  }
+}
 
 void MessageLoop::DispatchMessage(IsolateMessage* message) {
   if (isolate_ == NULL) {
@@ -20,11 +27,54 @@ void MessageLoop::DispatchMessage(IsolateMessage* message) {
     return;
   }
 
+  if (message->is_completion()) {
+    DispatchCompletion(message);
+    return;
+  }
+
   isolate_->ActivateMessage(message);
   delete message;
   isolate_->Interpret();
 }
 
+void MessageLoop::DispatchMessages(IsolateMessage* message) {
+  // Bounds the work done before the next epilogue.
+  static const intptr_t kMaxBatch = 256;
+
+  while (message != NULL) {
+    if ((isolate_ == NULL) ||
+        message->is_completion() ||
+        (message->next_ == NULL) ||
+        message->next_->is_completion() ||
+        !isolate_->CanActivateMessages()) {
+      IsolateMessage* next = message->next_;
+      DispatchMessage(message);
+      message = next;
+      continue;
+    }
+
+    IsolateMessage* last = message;
+    intptr_t count = 1;
+    while ((last->next_ != NULL) &&
+           !last->next_->is_completion() &&
+           (count < kMaxBatch)) {
+      last = last->next_;
+      count++;
+    }
+    IsolateMessage* rest = last->next_;
+    last->next_ = NULL;
+
+    isolate_->ActivateMessages(message, count);
+    while (message != NULL) {
+      IsolateMessage* next = message->next_;
+      delete message;
+      message = next;
+    }
+    isolate_->Interpret();
+    message = rest;
+  }
+}
+
 void MessageLoop::DispatchWakeup() {
   if (isolate_ == NULL) {
     return;
@@ -46,6 +96,36 @@ void MessageLoop::DispatchSignal(intptr_t handle,
   isolate_->Interpret();
 }
 
+void MessageLoop::DispatchCompletion(IsolateMessage* message) {
+  // The port only kept the loop alive while the operation was outstanding.
+  ClosePort(message->dest_port());
+
+  intptr_t handle = message->handle();
+  intptr_t status = message->status();
+  intptr_t count = message->count();
+  if (message->data() != NULL) {
+    message->next_ = completions_;
+    completions_ = message;
+  } else {
+    delete message;
+  }
+  DispatchSignal(handle, status, 0, count);
+}
+
+IsolateMessage* MessageLoop::TakeCompletion(intptr_t handle) {
+  IsolateMessage** link = &completions_;
+  while (*link != NULL) {
+    IsolateMessage* message = *link;
+    if (message->handle() == handle) {
+      *link = message->next_;
+      message->next_ = NULL;
+      return message;
+    }
+    link = &message->next_;
+  }
+  return NULL;
+}
+
 Port MessageLoop::OpenPort() {
   open_ports_++;
   return PortMap::CreatePort(this);
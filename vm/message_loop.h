@@ -16,11 +16,24 @@ class IsolateMessage {
   IsolateMessage(Port dest, uint8_t* data, intptr_t length)
       : next_(NULL), dest_(dest),
         data_(data), length_(length),
-        argv_(NULL), argc_(0) {}
+        argv_(NULL), argc_(0),
+        is_completion_(false), handle_(0),
+        status_(0), count_(0) {}
   IsolateMessage(Port dest, int argc, const char** argv)
       : next_(NULL), dest_(dest),
         data_(NULL), length_(0),
-        argv_(argv), argc_(argc) {}
+        argv_(argv), argc_(argc),
+        is_completion_(false), handle_(0),
+        status_(0), count_(0) {}
+  // The completion of an operation run off the isolate's thread, delivered as
+  // a signal on 'handle'. Any data is kept until taken by TakeCompletion.
+  IsolateMessage(Port dest, intptr_t handle, intptr_t status, intptr_t count,
+                 uint8_t* data, intptr_t length)
+      : next_(NULL), dest_(dest),
+        data_(data), length_(length),
+        argv_(NULL), argc_(0),
+        is_completion_(true), handle_(handle),
+        status_(status), count_(count) {}
 
   ~IsolateMessage() { free(data_); }
 
@@ -29,12 +42,19 @@ class IsolateMessage {
   intptr_t length() const { return length_; }
   int argc() const { return argc_; }
   const char** argv() const { return argv_; }
+  bool is_completion() const { return is_completion_; }
+  intptr_t handle() const { return handle_; }
+  intptr_t status() const { return status_; }
+  intptr_t count() const { return count_; }
 
  private:
+  friend class Isolate;
   friend class MessageLoop;
   friend class EPollMessageLoop;
   friend class EmscriptenMessageLoop;
   friend class FuchsiaMessageLoop;
+  friend class HostPort;
+  friend class IOURingMessageLoop;
   friend class IOCPMessageLoop;
   friend class KQueueMessageLoop;
 
@@ -44,6 +64,10 @@ class IsolateMessage {
   intptr_t length_;
   const char** argv_;  // Not owned by message.
   int argc_;
+  bool is_completion_;
+  intptr_t handle_;
+  intptr_t status_;
+  intptr_t count_;
 
   DISALLOW_COPY_AND_ASSIGN(IsolateMessage);
 };
@@ -72,8 +96,18 @@ class MessageLoop {
   Port OpenPort();
   void ClosePort(Port p);
 
+  // Operations run off the isolate's thread signal their completion on a
+  // handle from here. Negative, so they cannot collide with file descriptors
+  // passed to AwaitSignal.
+  intptr_t NewOperationHandle() { return --last_operation_handle_; }
+  IsolateMessage* TakeCompletion(intptr_t handle);
+
  protected:
   void DispatchMessage(IsolateMessage* message);
+  // Dispatches a list taken from the queue. Runs of port messages go to the
+  // image in one activation when it supports that, else one at a time.
+  void DispatchMessages(IsolateMessage* messages);
+  void DispatchCompletion(IsolateMessage* message);
   void DispatchWakeup();
   void DispatchSignal(intptr_t handle,
                       intptr_t status,
@@ -84,6 +118,8 @@ class MessageLoop {
   intptr_t open_ports_;
   intptr_t open_waits_;
   intptr_t exit_code_;
+  intptr_t last_operation_handle_;
+  IsolateMessage* completions_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(MessageLoop);
@@ -99,6 +135,7 @@ class MessageLoop {
 #include "vm/message_loop_fuchsia.h"
 #elif defined(OS_LINUX)
 #include "vm/message_loop_epoll.h"
+#include "vm/message_loop_io_uring.h"
 #elif defined(OS_MACOS)
 #include "vm/message_loop_kqueue.h"
 #elif defined(OS_WINDOWS)
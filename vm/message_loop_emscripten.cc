@@ -17,18 +17,22 @@ EmscriptenMessageLoop::EmscriptenMessageLoop(Isolate* isolate)
     : MessageLoop(isolate),
       head_(NULL),
       tail_(NULL),
-      wakeup_(0) {}
+      wakeup_(0),
+      last_wait_id_(0) {}
 
 EmscriptenMessageLoop::~EmscriptenMessageLoop() {}
 
+// Signals are delivered by the host page calling handle_signal, and the
+// browser keeps the page alive regardless, so a wait only needs an id.
 intptr_t EmscriptenMessageLoop::AwaitSignal(intptr_t handle,
                                             intptr_t signals) {
-  UNIMPLEMENTED();
-  return 0;
+  open_waits_++;
+  return ++last_wait_id_;
 }
 
 void EmscriptenMessageLoop::CancelSignalWait(intptr_t wait_id) {
-  UNIMPLEMENTED();
+  ASSERT((wait_id > 0) && (wait_id <= last_wait_id_));
+  open_waits_--;
 }
 
 void EmscriptenMessageLoop::MessageEpilogue(int64_t new_wakeup) {
@@ -41,6 +41,7 @@ class EmscriptenMessageLoop : public MessageLoop {
   IsolateMessage* head_;
   IsolateMessage* tail_;
   int64_t wakeup_;
+  intptr_t last_wait_id_;
 
   DISALLOW_COPY_AND_ASSIGN(EmscriptenMessageLoop);
 };
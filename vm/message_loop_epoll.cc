@@ -96,11 +96,16 @@ intptr_t EPollMessageLoop::AwaitSignal(intptr_t fd, intptr_t signals) {
   if (status == -1) {
     FATAL("Failed to add to epoll");
   }
+  open_waits_++;
   return fd;
 }
 
 void EPollMessageLoop::CancelSignalWait(intptr_t wait_id) {
-  UNIMPLEMENTED();
+  int status = epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, wait_id, NULL);
+  if (status == -1) {
+    FATAL("Failed to remove from epoll");
+  }
+  open_waits_--;
 }
 
 void EPollMessageLoop::MessageEpilogue(int64_t new_wakeup) {
@@ -114,7 +119,7 @@ void EPollMessageLoop::MessageEpilogue(int64_t new_wakeup) {
   }
   timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &it, NULL);
 
-  if ((open_ports_ == 0) && (wakeup_ == 0)) {
+  if ((open_ports_ == 0) && (open_waits_ == 0) && (wakeup_ == 0)) {
     Exit(0);
   }
 }
@@ -197,12 +202,7 @@ intptr_t EPollMessageLoop::Run() {
       }
     }
 
-    IsolateMessage* message = TakeMessages();
-    while (message != NULL) {
-      IsolateMessage* next = message->next_;
-      DispatchMessage(message);
-      message = next;
-    }
+    DispatchMessages(TakeMessages());
   }
 
   if (open_ports_ > 0) {
@@ -0,0 +1,433 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/globals.h"  // NOLINT
+#if defined(OS_LINUX)
+
+#include "vm/message_loop.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "vm/lockers.h"
+#include "vm/os.h"
+
+namespace psoup {
+
+// The low byte of a request's user_data says what it is for. Polls keep their
+// wait's serial in the next 24 bits and their descriptor above that.
+enum {
+  kNotifyRequest = 0,
+  kTimeoutRequest = 1,
+  kPollRequest = 2,
+  kIgnoredRequest = 3,
+};
+
+static const uint32_t kRingEntries = 64;
+
+static int io_uring_setup(uint32_t entries, struct io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+                          uint32_t flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 NULL, 0);
+}
+
+static uint64_t PollUserData(intptr_t fd, uint32_t serial) {
+  return (static_cast<uint64_t>(fd) << 32) | (serial << 8) | kPollRequest;
+}
+
+bool IOURingMessageLoop::IsSupported() {
+  static int supported = -1;  // Racy, but every thread computes the same.
+  if (supported == -1) {
+    const char* choice = getenv("PSOUP_MESSAGE_LOOP");
+    if ((choice != NULL) && (strcmp(choice, "epoll") == 0)) {
+      supported = 0;
+    } else {
+      struct io_uring_params params;
+      memset(&params, 0, sizeof(params));
+      int fd = io_uring_setup(1, &params);
+      if (fd == -1) {
+        supported = 0;  // ENOSYS, or disabled by sysctl or seccomp.
+      } else {
+        close(fd);
+        // Multishot polls and absolute timeouts arrived with RSRC_TAGS in
+        // 5.13.
+        const uint32_t required = IORING_FEAT_SINGLE_MMAP |
+                                  IORING_FEAT_NODROP |
+                                  IORING_FEAT_RSRC_TAGS;
+        supported = ((params.features & required) == required) ? 1 : 0;
+      }
+    }
+  }
+  return supported == 1;
+}
+
+IOURingMessageLoop::IOURingMessageLoop(Isolate* isolate)
+    : MessageLoop(isolate),
+      mutex_(),
+      head_(NULL),
+      tail_(NULL),
+      wakeup_(0),
+      timer_generation_(0),
+      waits_(NULL),
+      waits_capacity_(0),
+      last_wait_serial_(0),
+      notify_value_(0),
+      unsubmitted_(0),
+      deferred_(NULL),
+      deferred_size_(0),
+      deferred_capacity_(0),
+      deferred_next_(0) {
+  waits_capacity_ = 64;
+  waits_ = reinterpret_cast<uint32_t*>(calloc(waits_capacity_,
+                                              sizeof(uint32_t)));
+
+  notify_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (notify_fd_ == -1) {
+    FATAL("Failed to create eventfd");
+  }
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = io_uring_setup(kRingEntries, &params);
+  if (ring_fd_ == -1) {
+    FATAL("Failed to create io_uring");
+  }
+  ASSERT((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+
+  // The submission and completion rings share one mapping.
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  size_t cq_size = params.cq_off.cqes +
+                   params.cq_entries * sizeof(struct io_uring_cqe);
+  ring_size_ = sq_size > cq_size ? sq_size : cq_size;
+  ring_ = mmap(NULL, ring_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (ring_ == MAP_FAILED) {
+    FATAL("Failed to map io_uring");
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    FATAL("Failed to map io_uring submissions");
+  }
+  sqes_ = reinterpret_cast<io_uring_sqe*>(sqes);
+
+  uint8_t* ring = reinterpret_cast<uint8_t*>(ring_);
+  sq_head_ = reinterpret_cast<uint32_t*>(ring + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<uint32_t*>(ring + params.sq_off.tail);
+  sq_array_ = reinterpret_cast<uint32_t*>(ring + params.sq_off.array);
+  sq_mask_ = *reinterpret_cast<uint32_t*>(ring + params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+  cq_head_ = reinterpret_cast<uint32_t*>(ring + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<uint32_t*>(ring + params.cq_off.tail);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+  cq_mask_ = *reinterpret_cast<uint32_t*>(ring + params.cq_off.ring_mask);
+
+  ArmNotify();
+}
+
+IOURingMessageLoop::~IOURingMessageLoop() {
+  free(deferred_);
+  free(waits_);
+  munmap(sqes_, sqes_size_);
+  munmap(ring_, ring_size_);
+  close(ring_fd_);
+  close(notify_fd_);
+}
+
+io_uring_sqe* IOURingMessageLoop::NextSubmission() {
+  uint32_t tail = *sq_tail_;
+  while (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+    // Full: flush what is queued. The kernel takes nothing while completions
+    // it has not been able to post are pending (EBUSY), so move the posted
+    // ones aside for Run to make room, and try again.
+    if (SubmitAndWait(0) == 0) {
+      DeferCompletions();
+    }
+  }
+  uint32_t index = tail & sq_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  unsubmitted_++;
+  return sqe;
+}
+
+// Answers the number of requests the kernel took, which is 0 if it was
+// interrupted or is waiting for completions to be reaped.
+intptr_t IOURingMessageLoop::SubmitAndWait(intptr_t wait_for) {
+  uint32_t flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+  int result = io_uring_enter(ring_fd_, unsubmitted_, wait_for, flags);
+  if (result < 0) {
+    if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+      FATAL1("io_uring_enter failed: %d", errno);
+    }
+    return 0;
+  }
+  unsubmitted_ -= result;
+  return result;
+}
+
+void IOURingMessageLoop::DeferCompletions() {
+  uint32_t head = *cq_head_;
+  uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    if (deferred_size_ == deferred_capacity_) {
+      deferred_capacity_ =
+          deferred_capacity_ == 0 ? 64 : deferred_capacity_ * 2;
+      deferred_ = reinterpret_cast<Completion*>(
+          realloc(deferred_, deferred_capacity_ * sizeof(Completion)));
+    }
+    io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+    deferred_[deferred_size_].user_data = cqe->user_data;
+    deferred_[deferred_size_].result = cqe->res;
+    deferred_[deferred_size_].flags = cqe->flags;
+    deferred_size_++;
+    head++;
+  }
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+// Deferred completions were posted before any still in the ring.
+bool IOURingMessageLoop::TakeCompletion(Completion* completion) {
+  if (deferred_next_ < deferred_size_) {
+    *completion = deferred_[deferred_next_++];
+    if (deferred_next_ == deferred_size_) {
+      deferred_next_ = deferred_size_ = 0;
+    }
+    return true;
+  }
+  uint32_t head = *cq_head_;
+  if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+  completion->user_data = cqe->user_data;
+  completion->result = cqe->res;
+  completion->flags = cqe->flags;
+  __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+void IOURingMessageLoop::ArmNotify() {
+  io_uring_sqe* sqe = NextSubmission();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = notify_fd_;
+  sqe->addr = reinterpret_cast<uint64_t>(&notify_value_);
+  sqe->len = sizeof(notify_value_);
+  sqe->user_data = kNotifyRequest;
+}
+
+void IOURingMessageLoop::ArmPoll(intptr_t fd) {
+  intptr_t signals = waits_[fd] & 0xFF;
+  uint32_t events = POLLRDHUP;
+  if (signals & (1 << kReadEvent)) {
+    events |= POLLIN;
+  }
+  if (signals & (1 << kWriteEvent)) {
+    events |= POLLOUT;
+  }
+  io_uring_sqe* sqe = NextSubmission();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = PollUserData(fd, waits_[fd] >> 8);
+}
+
+intptr_t IOURingMessageLoop::AwaitSignal(intptr_t fd, intptr_t signals) {
+  ASSERT(fd >= 0);
+  if (fd >= waits_capacity_) {
+    intptr_t new_capacity = waits_capacity_ * 2;
+    while (new_capacity <= fd) {
+      new_capacity *= 2;
+    }
+    waits_ = reinterpret_cast<uint32_t*>(
+        realloc(waits_, new_capacity * sizeof(uint32_t)));
+    memset(&waits_[waits_capacity_], 0,
+           (new_capacity - waits_capacity_) * sizeof(uint32_t));
+    waits_capacity_ = new_capacity;
+  }
+  ASSERT(waits_[fd] == 0);
+  last_wait_serial_ = (last_wait_serial_ + 1) & 0xFFFFFF;
+  if (last_wait_serial_ == 0) {
+    last_wait_serial_ = 1;
+  }
+  waits_[fd] = (last_wait_serial_ << 8) | (signals & 0xFF);
+  ArmPoll(fd);
+  open_waits_++;
+  return fd;
+}
+
+void IOURingMessageLoop::CancelSignalWait(intptr_t fd) {
+  ASSERT(fd < waits_capacity_ && waits_[fd] != 0);
+  io_uring_sqe* sqe = NextSubmission();
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->addr = PollUserData(fd, waits_[fd] >> 8);
+  sqe->user_data = kIgnoredRequest;
+  // Completions of the poll that are already queued, or that arrive before
+  // the removal is submitted, are recognized as stale by their serial. The
+  // descriptor may be closed and reused in the meantime.
+  waits_[fd] = 0;
+  open_waits_--;
+}
+
+void IOURingMessageLoop::MessageEpilogue(int64_t new_wakeup) {
+  if (new_wakeup != wakeup_) {
+    if (wakeup_ != 0) {
+      io_uring_sqe* sqe = NextSubmission();
+      sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+      sqe->addr = (timer_generation_ << 8) | kTimeoutRequest;
+      sqe->user_data = kIgnoredRequest;
+    }
+    timer_generation_++;
+    wakeup_ = new_wakeup;
+    if (new_wakeup != 0) {
+      timeout_[0] = new_wakeup / kNanosecondsPerSecond;
+      timeout_[1] = new_wakeup % kNanosecondsPerSecond;
+      io_uring_sqe* sqe = NextSubmission();
+      sqe->opcode = IORING_OP_TIMEOUT;
+      sqe->addr = reinterpret_cast<uint64_t>(&timeout_);
+      sqe->len = 1;
+      sqe->timeout_flags = IORING_TIMEOUT_ABS;
+      sqe->user_data = (timer_generation_ << 8) | kTimeoutRequest;
+    }
+  }
+
+  if ((open_ports_ == 0) && (open_waits_ == 0) && (wakeup_ == 0)) {
+    Exit(0);
+  }
+}
+
+void IOURingMessageLoop::Exit(intptr_t exit_code) {
+  exit_code_ = exit_code;
+  isolate_ = NULL;
+}
+
+void IOURingMessageLoop::PostMessage(IsolateMessage* message) {
+  MutexLocker locker(&mutex_);
+  if (head_ == NULL) {
+    head_ = tail_ = message;
+    Notify();
+  } else {
+    tail_->next_ = message;
+    tail_ = message;
+  }
+}
+
+void IOURingMessageLoop::Notify() {
+  uint64_t value = 1;
+  ssize_t written = write(notify_fd_, &value, sizeof(value));
+  if (written != sizeof(value)) {
+    FATAL("Failed to write notify eventfd");
+  }
+}
+
+IsolateMessage* IOURingMessageLoop::TakeMessages() {
+  MutexLocker locker(&mutex_);
+  IsolateMessage* message = head_;
+  head_ = tail_ = NULL;
+  return message;
+}
+
+void IOURingMessageLoop::HandleCompletion(uint64_t user_data,
+                                          int32_t result,
+                                          uint32_t flags) {
+  switch (user_data & 0xFF) {
+    case kNotifyRequest:
+      if (result != sizeof(notify_value_)) {
+        FATAL1("Failed to read notify eventfd: %d", result);
+      }
+      ArmNotify();  // Messages are taken after the completions.
+      break;
+    case kTimeoutRequest:
+      // Superseded timeouts complete with -ECANCELED, or expire in the same
+      // batch as their removal.
+      if ((result == -ETIME) && ((user_data >> 8) == timer_generation_)) {
+        wakeup_ = 0;
+        DispatchWakeup();
+      }
+      break;
+    case kPollRequest: {
+      intptr_t fd = user_data >> 32;
+      uint32_t serial = (user_data >> 8) & 0xFFFFFF;
+      if ((result < 0) || (fd >= waits_capacity_) ||
+          ((waits_[fd] >> 8) != serial)) {
+        break;  // Cancelled.
+      }
+      if ((flags & IORING_CQE_F_MORE) == 0) {
+        ArmPoll(fd);  // The kernel ended the multishot poll.
+      }
+      intptr_t pending = 0;
+      if (result & POLLERR) {
+        pending |= 1 << kErrorEvent;
+      }
+      if (result & POLLIN) {
+        pending |= 1 << kReadEvent;
+      }
+      if (result & POLLOUT) {
+        pending |= 1 << kWriteEvent;
+      }
+      if (result & (POLLHUP | POLLRDHUP)) {
+        pending |= 1 << kCloseEvent;
+      }
+      DispatchSignal(fd, 0, pending, 0);
+      break;
+    }
+    case kIgnoredRequest:
+      break;
+    default:
+      UNREACHABLE();
+  }
+}
+
+intptr_t IOURingMessageLoop::Run() {
+  while (isolate_ != NULL) {
+    // Submissions made while dispatching messages may have deferred
+    // completions, which must not wait for another.
+    SubmitAndWait(deferred_next_ < deferred_size_ ? 0 : 1);
+
+    Completion completion;
+    while ((isolate_ != NULL) && TakeCompletion(&completion)) {
+      HandleCompletion(completion.user_data, completion.result,
+                       completion.flags);
+    }
+
+    DispatchMessages(TakeMessages());
+  }
+
+  if (open_ports_ > 0) {
+    PortMap::CloseAllPorts(this);
+  }
+
+  while (head_ != NULL) {
+    IsolateMessage* message = head_;
+    head_ = message->next_;
+    delete message;
+  }
+
+  return exit_code_;
+}
+
+void IOURingMessageLoop::Interrupt() {
+  Exit(SIGINT);
+  Notify();
+}
+
+}  // namespace psoup
+
+#endif  // defined(OS_LINUX)
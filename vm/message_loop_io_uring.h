@@ -0,0 +1,101 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_MESSAGE_LOOP_IO_URING_H_
+#define VM_MESSAGE_LOOP_IO_URING_H_
+
+#if !defined(VM_MESSAGE_LOOP_H_)
+#error Do not include message_loop_io_uring.h directly; use message_loop.h \
+  instead.
+#endif
+
+#include "vm/message_loop.h"
+#include "vm/thread.h"
+
+struct io_uring_cqe;
+struct io_uring_sqe;
+
+namespace psoup {
+
+// Waits for signals, timeouts and notifications from other threads as
+// completions on a single io_uring. Requests queued while dispatching are
+// submitted together by the one io_uring_enter that waits for the next
+// completion.
+class IOURingMessageLoop : public MessageLoop {
+ public:
+  explicit IOURingMessageLoop(Isolate* isolate);
+  ~IOURingMessageLoop();
+
+  // Whether the kernel provides the io_uring features used here. Set
+  // PSOUP_MESSAGE_LOOP=epoll in the environment to use the epoll loop
+  // instead.
+  static bool IsSupported();
+
+  void PostMessage(IsolateMessage* message);
+  intptr_t AwaitSignal(intptr_t handle, intptr_t signals);
+  void CancelSignalWait(intptr_t wait_id);
+  void MessageEpilogue(int64_t new_wakeup);
+  void Exit(intptr_t exit_code);
+
+  intptr_t Run();
+  void Interrupt();
+
+ private:
+  IsolateMessage* TakeMessages();
+  void Notify();
+
+  struct Completion {
+    uint64_t user_data;
+    int32_t result;
+    uint32_t flags;
+  };
+
+  io_uring_sqe* NextSubmission();
+  intptr_t SubmitAndWait(intptr_t wait_for);
+  void DeferCompletions();
+  bool TakeCompletion(Completion* completion);
+  void ArmNotify();
+  void ArmPoll(intptr_t fd);
+  void HandleCompletion(uint64_t user_data, int32_t result, uint32_t flags);
+
+  Mutex mutex_;
+  IsolateMessage* head_;
+  IsolateMessage* tail_;
+  int64_t wakeup_;
+  uint64_t timer_generation_;
+  // The serial and signals of the wait on each descriptor, or 0.
+  uint32_t* waits_;
+  intptr_t waits_capacity_;
+  uint32_t last_wait_serial_;
+  int64_t timeout_[2];  // A __kernel_timespec.
+  uint64_t notify_value_;
+  int notify_fd_;
+
+  int ring_fd_;
+  void* ring_;
+  size_t ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  uint32_t* sq_head_;
+  uint32_t* sq_tail_;
+  uint32_t* sq_array_;
+  uint32_t sq_mask_;
+  uint32_t sq_entries_;
+  uint32_t* cq_head_;
+  uint32_t* cq_tail_;
+  io_uring_cqe* cqes_;
+  uint32_t cq_mask_;
+  uint32_t unsubmitted_;
+  // Completions moved out of the ring to make room while it was full.
+  Completion* deferred_;
+  intptr_t deferred_size_;
+  intptr_t deferred_capacity_;
+  intptr_t deferred_next_;
+
+  DISALLOW_COPY_AND_ASSIGN(IOURingMessageLoop);
+};
+
+}  // namespace psoup
+
+#endif  // VM_MESSAGE_LOOP_IO_URING_H_
@@ -19,7 +19,9 @@ IOCPMessageLoop::IOCPMessageLoop(Isolate* isolate)
       mutex_(),
       head_(NULL),
       tail_(NULL),
-      wakeup_(0) {
+      wakeup_(0),
+      waits_(NULL),
+      last_wait_id_(0) {
   completion_port_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, NULL,
                                             1);
   if (completion_port_ == NULL) {
@@ -28,22 +30,75 @@ IOCPMessageLoop::IOCPMessageLoop(Isolate* isolate)
 }
 
 IOCPMessageLoop::~IOCPMessageLoop() {
+  while (waits_ != NULL) {
+    CancelSignalWait(waits_->id);
+  }
   CloseHandle(completion_port_);
 }
 
-intptr_t IOCPMessageLoop::AwaitSignal(intptr_t fd, intptr_t signals) {
-  UNIMPLEMENTED();
-  return 0;
+VOID CALLBACK IOCPMessageLoop::WaitCallback(PVOID context,
+                                            BOOLEAN timed_out) {
+  Wait* wait = reinterpret_cast<Wait*>(context);
+  // Keyed by id rather than the Wait, which may be freed by a cancellation
+  // before this completion is taken.
+  BOOL ok = PostQueuedCompletionStatus(wait->loop->completion_port_, 0,
+                                       static_cast<ULONG_PTR>(wait->id),
+                                       NULL);
+  if (!ok) {
+    FATAL("PostQueuedCompletionStatus failed");
+  }
+}
+
+// Windows has no readiness notification for arbitrary handles, so any
+// waitable handle signals kReadEvent when it becomes signaled.
+intptr_t IOCPMessageLoop::AwaitSignal(intptr_t handle, intptr_t signals) {
+  Wait* wait = new Wait();
+  wait->loop = this;
+  wait->id = ++last_wait_id_;
+  wait->handle = handle;
+  BOOL ok = RegisterWaitForSingleObject(&wait->registration,
+                                        reinterpret_cast<HANDLE>(handle),
+                                        WaitCallback, wait, INFINITE,
+                                        WT_EXECUTEDEFAULT);
+  if (!ok) {
+    FATAL("RegisterWaitForSingleObject failed");
+  }
+  wait->next = waits_;
+  waits_ = wait;
+  open_waits_++;
+  return wait->id;
 }
 
 void IOCPMessageLoop::CancelSignalWait(intptr_t wait_id) {
-  UNIMPLEMENTED();
+  Wait** link = &waits_;
+  while ((*link)->id != wait_id) {
+    link = &(*link)->next;
+  }
+  Wait* wait = *link;
+  *link = wait->next;
+
+  // Blocks until running callbacks finish, so none can see the freed Wait.
+  BOOL ok = UnregisterWaitEx(wait->registration, INVALID_HANDLE_VALUE);
+  if (!ok) {
+    FATAL("UnregisterWaitEx failed");
+  }
+  delete wait;
+  open_waits_--;
+}
+
+IOCPMessageLoop::Wait* IOCPMessageLoop::LookupWait(intptr_t wait_id) {
+  for (Wait* wait = waits_; wait != NULL; wait = wait->next) {
+    if (wait->id == wait_id) {
+      return wait;
+    }
+  }
+  return NULL;
 }
 
 void IOCPMessageLoop::MessageEpilogue(int64_t new_wakeup) {
   wakeup_ = new_wakeup;
 
-  if ((open_ports_ == 0) && (wakeup_ == 0)) {
+  if ((open_ports_ == 0) && (open_waits_ == 0) && (wakeup_ == 0)) {
     Exit(0);
   }
 }
@@ -110,15 +165,13 @@ intptr_t IOCPMessageLoop::Run() {
     } else if (key == NULL) {
       // Interrupt: will check messages below.
     } else {
-      UNIMPLEMENTED();
+      Wait* wait = LookupWait(static_cast<intptr_t>(key));
+      if (wait != NULL) {  // Else cancelled after it was posted.
+        DispatchSignal(wait->handle, 0, 1 << kReadEvent, 0);
+      }
     }
 
-    IsolateMessage* message = TakeMessages();
-    while (message != NULL) {
-      IsolateMessage* next = message->next_;
-      DispatchMessage(message);
-      message = next;
-    }
+    DispatchMessages(TakeMessages());
   }
 
   if (open_ports_ > 0) {
@@ -31,14 +31,29 @@ class IOCPMessageLoop : public MessageLoop {
   void Interrupt();
 
  private:
+  // A handle waited on by the thread pool, which posts the wait's id to the
+  // completion port each time the handle is signaled.
+  struct Wait {
+    IOCPMessageLoop* loop;
+    intptr_t id;
+    intptr_t handle;
+    HANDLE registration;
+    Wait* next;
+  };
+
+  static VOID CALLBACK WaitCallback(PVOID context, BOOLEAN timed_out);
+
   IsolateMessage* TakeMessages();
   void Notify();
+  Wait* LookupWait(intptr_t wait_id);
 
   Mutex mutex_;
   IsolateMessage* head_;
   IsolateMessage* tail_;
   int64_t wakeup_;
   HANDLE completion_port_;
+  Wait* waits_;
+  intptr_t last_wait_id_;
 
   DISALLOW_COPY_AND_ASSIGN(IOCPMessageLoop);
 };
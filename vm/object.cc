@@ -4,6 +4,8 @@
 
 #include "vm/object.h"
 
+#include <string.h>
+
 #include "vm/heap.h"
 #include "vm/interpreter.h"
 #include "vm/isolate.h"
@@ -43,17 +45,18 @@ intptr_t HeapObject::HeapSizeFromClass() const {
                           sizeof(uint8_t) * String::Cast(*this)->Size());
   case kArrayCid:
     return AllocationSize(sizeof(Array::Layout) +
-                          sizeof(Object) * Array::Cast(*this)->Size());
+                          sizeof(ObjectSlot) * Array::Cast(*this)->Size());
   case kWeakArrayCid:
     return AllocationSize(sizeof(WeakArray::Layout) +
-                          sizeof(Object) * WeakArray::Cast(*this)->Size());
+                          sizeof(ObjectSlot) * WeakArray::Cast(*this)->Size());
   case kEphemeronCid:
     return AllocationSize(sizeof(Ephemeron::Layout));
   case kActivationCid:
     return AllocationSize(sizeof(Activation::Layout));
   case kClosureCid:
-    return AllocationSize(sizeof(Closure::Layout) +
-                          sizeof(Object) * Closure::Cast(*this)->NumCopied());
+    return AllocationSize(
+        sizeof(Closure::Layout) +
+        sizeof(ObjectSlot) * Closure::Cast(*this)->NumCopied());
   default:
     UNREACHABLE();
     // Need to get num slots from class.
@@ -62,7 +65,7 @@ intptr_t HeapObject::HeapSizeFromClass() const {
 }
 
 
-void HeapObject::Pointers(Object** from, Object** to) {
+void HeapObject::Pointers(ObjectSlot** from, ObjectSlot** to) {
   ASSERT(IsHeapObject());
 
   switch (cid()) {
@@ -77,8 +80,8 @@ void HeapObject::Pointers(Object** from, Object** to) {
   case kByteArrayCid:
   case kStringCid:
     // No pointers (or only smis for size/hash)
-    *from = reinterpret_cast<Object*>(1);
-    *to = reinterpret_cast<Object*>(0);
+    *from = reinterpret_cast<ObjectSlot*>(1);
+    *to = reinterpret_cast<ObjectSlot*>(0);
     return;
   case kArrayCid:
     *from = Array::Cast(*this)->from();
@@ -241,28 +244,41 @@ void Activation::PrintStack(Heap* heap) {
 }
 
 
-#if defined(ARCH_IS_32_BIT)
-static uintptr_t kFNVPrime = 16777619;
-#elif defined(ARCH_IS_64_BIT)
-static uintptr_t kFNVPrime = 1099511628211;
-#endif
+// Multiply-rotate over 8-byte words, keyed by the isolate's salt, with a final
+// avalanche so the low bits used to index hash tables depend on every byte.
+static const uint64_t kHashMultiplier = 0x9E3779B97F4A7C15ULL;
+static const uint64_t kHashFinalizer = 0xFF51AFD7ED558CCDULL;
 
+static inline uint64_t HashStep(uint64_t h, uint64_t word) {
+  return (((h << 5) | (h >> 59)) ^ word) * kHashMultiplier;
+}
 
 SmallInteger String::EnsureHash(Isolate* isolate) {
   if (header_hash() == 0) {
-    // FNV-1a hash
     intptr_t length = Size();
-    uintptr_t h = length + 1;
-    for (intptr_t i = 0; i < length; i++) {
-      h = h ^ element(i);
-      h = h * kFNVPrime;
+    const uint8_t* cursor = element_addr(0);
+    uint64_t h = static_cast<uint64_t>(isolate->salt()) ^
+        (static_cast<uint64_t>(length) * kHashMultiplier);
+    while (length >= 8) {
+      uint64_t word;
+      memcpy(&word, cursor, sizeof(word));
+      h = HashStep(h, word);
+      cursor += 8;
+      length -= 8;
+    }
+    if (length > 0) {
+      uint64_t word = 0;
+      memcpy(&word, cursor, length);
+      h = HashStep(h, word);
     }
-    h = h ^ isolate->salt();
-    h = h & SmallInteger::kMaxValue;
-    if (h == 0) {
-      h = 1;
+    h ^= h >> 33;
+    h *= kHashFinalizer;
+    h ^= h >> 33;
+    uintptr_t hash = static_cast<uintptr_t>(h) & SmallInteger::kMaxValue;
+    if (hash == 0) {
+      hash = 1;
     }
-    set_header_hash(h);
+    set_header_hash(hash);
   }
   return SmallInteger::New(header_hash());
 }
@@ -8,8 +8,18 @@
 #include "vm/assert.h"
 #include "vm/globals.h"
 #include "vm/bitfield.h"
+#include "vm/flags.h"
 #include "vm/utils.h"
 
+#if COMPRESSED_POINTERS && defined(ARCH_IS_64_BIT)
+#if !defined(OS_ANDROID) && !defined(OS_LINUX) && !defined(OS_MACOS)
+#error Compressed pointers need VirtualMemory::Reserve.
+#endif
+#define USE_COMPRESSED_POINTERS 1
+#else
+#define USE_COMPRESSED_POINTERS 0
+#endif
+
 namespace psoup {
 
 enum PointerBits {
@@ -200,6 +210,64 @@ class Object {
   uword tagged_pointer_;
 };
 
+#if USE_COMPRESSED_POINTERS
+// All of an isolate's heap lives in one reservation of this size, aligned to
+// its size.
+static const uword kCompressedHeapSize = static_cast<uword>(4) * GB;
+
+// A reference stored in the heap as the low half of the tagged pointer. The
+// high half of a heap object's address is recovered from the address of the
+// slot itself, since both are in the same reservation. SmallIntegers are
+// sign-extended, which limits them to 31 bits.
+template<typename type>
+class Slot {
+ public:
+  type Load() const {
+    if ((bits_ & kSmiTagMask) == kSmiTag) {
+      return type(static_cast<uword>(
+          static_cast<intptr_t>(static_cast<int32_t>(bits_))));
+    }
+    return type(LoadAddress());
+  }
+  void Store(type value) {
+    bits_ = static_cast<uint32_t>(static_cast<uword>(value));
+    ASSERT(Load() == value);
+  }
+
+  // For addresses in the reservation that are not objects.
+  uword LoadAddress() const {
+    uword base = reinterpret_cast<uword>(this) & ~(kCompressedHeapSize - 1);
+    return base | bits_;
+  }
+  void StoreAddress(uword address) {
+    bits_ = static_cast<uint32_t>(address);
+    ASSERT(LoadAddress() == address);
+  }
+
+ private:
+  uint32_t bits_;
+};
+
+template<typename type>
+inline type LoadSlot(const Slot<type>* slot) { return slot->Load(); }
+template<typename type>
+inline void StoreSlot(Slot<type>* slot, type value) { slot->Store(value); }
+
+// Roots outside the heap are always full width.
+inline Object LoadSlot(const Object* slot) { return *slot; }
+inline void StoreSlot(Object* slot, Object value) { *slot = value; }
+#else
+template<typename type>
+using Slot = type;
+
+template<typename type>
+inline type LoadSlot(const type* slot) { return *slot; }
+template<typename type>
+inline void StoreSlot(type* slot, type value) { *slot = value; }
+#endif
+
+typedef Slot<Object> ObjectSlot;
+
 class HeapObject : public Object {
   HEAP_OBJECT_IMPLEMENTATION(HeapObject, Object);
 
@@ -207,9 +275,15 @@ class HeapObject : public Object {
   void AssertCouldBeBehavior() const {
     ASSERT(IsHeapObject());
     ASSERT(IsRegularObject());
+#if USE_COMPRESSED_POINTERS
+    // 6 to 8 slots plus the header all round up to 12 slots.
+    intptr_t heap_slots = heap_size() / sizeof(ObjectSlot);
+    ASSERT(heap_slots == 12);
+#else
     // 8 slots for a class, 7 slots for a metaclass, plus 1 header.
     intptr_t heap_slots = heap_size() / sizeof(uword);
     ASSERT((heap_slots == 8) || (heap_slots == 10));
+#endif
   }
 
   inline bool is_marked() const;
@@ -244,17 +318,17 @@ class HeapObject : public Object {
     return HeapSizeFromClass();
   }
   intptr_t HeapSizeFromClass() const;
-  void Pointers(Object** from, Object** to);
+  void Pointers(ObjectSlot** from, ObjectSlot** to);
 
  protected:
   template<typename type>
-  type Load(type* addr, Barrier barrier = kBarrier) const {
-    return *addr;
+  type Load(const Slot<type>* addr, Barrier barrier = kBarrier) const {
+    return LoadSlot(addr);
   }
 
   template<typename type>
-  void Store(type* addr, type value, Barrier barrier) {
-    *addr = value;
+  void Store(Slot<type>* addr, type value, Barrier barrier) {
+    StoreSlot(addr, value);
     if (barrier == kNoBarrier) {
       ASSERT(value->IsImmediateOrOldObject());
     } else {
@@ -307,7 +381,11 @@ class FreeListElement : public HeapObject {
 
 class SmallInteger : public Object {
  public:
+#if USE_COMPRESSED_POINTERS
+  static const intptr_t kBits = 30;
+#else
   static const intptr_t kBits = kBitsPerWord - 2;
+#endif
   static const intptr_t kMaxValue = (static_cast<intptr_t>(1) << kBits) - 1;
   static const intptr_t kMinValue = -(static_cast<intptr_t>(1) << kBits);
 
@@ -333,9 +411,13 @@ class SmallInteger : public Object {
 #endif
 
   static bool IsSmiValue(intptr_t value) {
+#if USE_COMPRESSED_POINTERS
+    return (value >= kMinValue) && (value <= kMaxValue);
+#else
     intptr_t tagged = static_cast<uintptr_t>(value) << kSmiTagShift;
     intptr_t untagged = tagged >> kSmiTagShift;
     return untagged == value;
+#endif
   }
 };
 
@@ -430,8 +512,8 @@ class RegularObject : public HeapObject {
   inline void set_slot(intptr_t index, Object value,
                        Barrier barrier = kBarrier);
 
-  inline Object* from();
-  inline Object* to();
+  inline ObjectSlot* from();
+  inline ObjectSlot* to();
 };
 
 class Array : public HeapObject {
@@ -446,8 +528,8 @@ class Array : public HeapObject {
   inline void set_element(intptr_t index, Object value,
                           Barrier barrier = kBarrier);
 
-  inline Object* from();
-  inline Object* to();
+  inline ObjectSlot* from();
+  inline ObjectSlot* to();
 };
 
 class WeakArray : public HeapObject {
@@ -466,8 +548,8 @@ class WeakArray : public HeapObject {
   inline void set_element(intptr_t index, Object value,
                           Barrier barrier = kBarrier);
 
-  inline Object* from();
-  inline Object* to();
+  inline ObjectSlot* from();
+  inline ObjectSlot* to();
 };
 
 class Ephemeron : public HeapObject {
@@ -475,23 +557,23 @@ class Ephemeron : public HeapObject {
 
  public:
   inline Object key() const;
-  inline Object* key_ptr();
+  inline ObjectSlot* key_ptr();
   inline void set_key(Object key, Barrier barrier = kBarrier);
 
   inline Object value() const;
-  inline Object* value_ptr();
+  inline ObjectSlot* value_ptr();
   inline void set_value(Object value, Barrier barrier = kBarrier);
 
   inline Object finalizer() const;
-  inline Object* finalizer_ptr();
+  inline ObjectSlot* finalizer_ptr();
   inline void set_finalizer(Object finalizer, Barrier barrier = kBarrier);
 
   // Only accessed by the GC. Bypasses barrier, including assertions.
   inline Ephemeron next() const;
   inline void set_next(Ephemeron value);
 
-  inline Object* from();
-  inline Object* to();
+  inline ObjectSlot* from();
+  inline ObjectSlot* to();
 };
 
 class Bytes : public HeapObject {
@@ -527,14 +609,8 @@ class Activation : public HeapObject {
  public:
   inline Activation sender() const;
   inline void set_sender(Activation s, Barrier barrier = kBarrier);
-  Object* sender_fp() const {
-    return reinterpret_cast<Object*>(static_cast<uword>(sender()));
-  }
-  void set_sender_fp(Object* fp) {
-    Activation sender = static_cast<Activation>(reinterpret_cast<uword>(fp));
-    ASSERT(sender->IsSmallInteger());
-    set_sender(sender, kNoBarrier);
-  }
+  inline Object* sender_fp() const;
+  inline void set_sender_fp(Object* fp);
 
   inline SmallInteger bci() const;
   inline void set_bci(SmallInteger i);
@@ -567,8 +643,8 @@ class Activation : public HeapObject {
 
   void PrintStack(Heap* heap);
 
-  inline Object* from();
-  inline Object* to();
+  inline ObjectSlot* from();
+  inline ObjectSlot* to();
 };
 
 class Method : public HeapObject {
@@ -643,8 +719,8 @@ class Closure : public HeapObject {
   inline Object copied(intptr_t index) const;
   inline void set_copied(intptr_t index, Object o, Barrier barrier = kBarrier);
 
-  inline Object* from();
-  inline Object* to();
+  inline ObjectSlot* from();
+  inline ObjectSlot* to();
 };
 
 class Behavior : public HeapObject {
@@ -709,6 +785,8 @@ class ObjectStore : public HeapObject {
   inline class String unused_bytecode() const;
   inline class String dispatch_message() const;
   inline class String dispatch_signal() const;
+  inline bool has_dispatch_messages() const;
+  inline class String dispatch_messages() const;
   inline Behavior Array() const;
   inline Behavior ByteArray() const;
   inline Behavior String() const;
@@ -755,33 +833,33 @@ class LargeInteger::Layout : public HeapObject::Layout {
 
 class RegularObject::Layout : public HeapObject::Layout {
  public:
-  Object slots_[];
+  Slot<Object> slots_[];
 };
 
 class Array::Layout : public HeapObject::Layout {
  public:
-  SmallInteger size_;
-  Object elements_[];
+  Slot<SmallInteger> size_;
+  Slot<Object> elements_[];
 };
 
 class WeakArray::Layout : public HeapObject::Layout {
  public:
-  SmallInteger size_;  // Not visited.
-  WeakArray next_;  // Not visited.
-  Object elements_[];
+  Slot<SmallInteger> size_;  // Not visited.
+  Slot<WeakArray> next_;  // Not visited.
+  Slot<Object> elements_[];
 };
 
 class Ephemeron::Layout : public HeapObject::Layout {
  public:
-  Object key_;
-  Object value_;
-  Object finalizer_;
-  Ephemeron next_;  // Not visited.
+  Slot<Object> key_;
+  Slot<Object> value_;
+  Slot<Object> finalizer_;
+  Slot<Ephemeron> next_;  // Not visited.
 };
 
 class Bytes::Layout : public HeapObject::Layout {
  public:
-  SmallInteger size_;
+  Slot<SmallInteger> size_;
 };
 
 class String::Layout : public Bytes::Layout {};
@@ -790,23 +868,23 @@ class ByteArray::Layout : public Bytes::Layout {};
 
 class Method::Layout : public HeapObject::Layout {
  public:
-  SmallInteger header_;
-  Array literals_;
-  ByteArray bytecode_;
-  AbstractMixin mixin_;
-  String selector_;
-  Object source_;
+  Slot<SmallInteger> header_;
+  Slot<Array> literals_;
+  Slot<ByteArray> bytecode_;
+  Slot<AbstractMixin> mixin_;
+  Slot<String> selector_;
+  Slot<Object> source_;
 };
 
 class Activation::Layout : public HeapObject::Layout {
  public:
-  Activation sender_;
-  SmallInteger bci_;
-  Method method_;
-  Closure closure_;
-  Object receiver_;
-  SmallInteger stack_depth_;
-  Object temps_[kMaxTemps];
+  Slot<Activation> sender_;
+  Slot<SmallInteger> bci_;
+  Slot<Method> method_;
+  Slot<Closure> closure_;
+  Slot<Object> receiver_;
+  Slot<SmallInteger> stack_depth_;
+  Slot<Object> temps_[kMaxTemps];
 };
 
 class Float64::Layout : public HeapObject::Layout {
@@ -816,75 +894,77 @@ class Float64::Layout : public HeapObject::Layout {
 
 class Closure::Layout : public HeapObject::Layout {
  public:
-  SmallInteger num_copied_;
-  Activation defining_activation_;
-  SmallInteger initial_bci_;
-  SmallInteger num_args_;
-  Object copied_[];
+  Slot<SmallInteger> num_copied_;
+  Slot<Activation> defining_activation_;
+  Slot<SmallInteger> initial_bci_;
+  Slot<SmallInteger> num_args_;
+  Slot<Object> copied_[];
 };
 
 class Behavior::Layout : public HeapObject::Layout {
  public:
-  Behavior superclass_;
-  Array methods_;
-  Object enclosing_object_;
-  AbstractMixin mixin_;
-  SmallInteger classid_;
-  SmallInteger format_;
+  Slot<Behavior> superclass_;
+  Slot<Array> methods_;
+  Slot<Object> enclosing_object_;
+  Slot<AbstractMixin> mixin_;
+  Slot<SmallInteger> classid_;
+  Slot<SmallInteger> format_;
 };
 
 class Class::Layout : public Behavior::Layout {
  public:
-  String name_;
-  WeakArray subclasses_;
+  Slot<String> name_;
+  Slot<WeakArray> subclasses_;
 };
 
 class Metaclass::Layout : public Behavior::Layout {
  public:
-  Class this_class_;
+  Slot<Class> this_class_;
 };
 
 class AbstractMixin::Layout : public HeapObject::Layout {
  public:
-  String name_;
-  Array methods_;
-  AbstractMixin enclosing_mixin_;
+  Slot<String> name_;
+  Slot<Array> methods_;
+  Slot<AbstractMixin> enclosing_mixin_;
 };
 
 class Message::Layout : public HeapObject::Layout {
  public:
-  String selector_;
-  Array arguments_;
+  Slot<String> selector_;
+  Slot<Array> arguments_;
 };
 
 class ObjectStore::Layout : public HeapObject::Layout {
  public:
-  class SmallInteger array_size_;
-  Object nil_;
-  Object false_;
-  Object true_;
-  Object message_loop_;
-  class Array common_selectors_;
-  class String does_not_understand_;
-  class String non_boolean_receiver_;
-  class String cannot_return_;
-  class String about_to_return_through_;
-  class String unused_bytecode_;
-  class String dispatch_message_;
-  class String dispatch_signal_;
-  Behavior Array_;
-  Behavior ByteArray_;
-  Behavior String_;
-  Behavior Closure_;
-  Behavior Ephemeron_;
-  Behavior Float64_;
-  Behavior LargeInteger_;
-  Behavior MediumInteger_;
-  Behavior Message_;
-  Behavior SmallInteger_;
-  Behavior WeakArray_;
-  Behavior Activation_;
-  Behavior Method_;
+  Slot<class SmallInteger> array_size_;
+  Slot<Object> nil_;
+  Slot<Object> false_;
+  Slot<Object> true_;
+  Slot<Object> message_loop_;
+  Slot<class Array> common_selectors_;
+  Slot<class String> does_not_understand_;
+  Slot<class String> non_boolean_receiver_;
+  Slot<class String> cannot_return_;
+  Slot<class String> about_to_return_through_;
+  Slot<class String> unused_bytecode_;
+  Slot<class String> dispatch_message_;
+  Slot<class String> dispatch_signal_;
+  Slot<Behavior> Array_;
+  Slot<Behavior> ByteArray_;
+  Slot<Behavior> String_;
+  Slot<Behavior> Closure_;
+  Slot<Behavior> Ephemeron_;
+  Slot<Behavior> Float64_;
+  Slot<Behavior> LargeInteger_;
+  Slot<Behavior> MediumInteger_;
+  Slot<Behavior> Message_;
+  Slot<Behavior> SmallInteger_;
+  Slot<Behavior> WeakArray_;
+  Slot<Behavior> Activation_;
+  Slot<Behavior> Method_;
+  // Last, so snapshots written before batched dispatch still load.
+  Slot<class String> dispatch_messages_;
 };
 
 bool HeapObject::is_marked() const {
@@ -1005,12 +1085,12 @@ void RegularObject::set_slot(intptr_t index, Object value,
                              Barrier barrier) {
   Store(&ptr()->slots_[index], value, barrier);
 }
-Object* RegularObject::from() {
+ObjectSlot* RegularObject::from() {
   return &ptr()->slots_[0];
 }
-Object* RegularObject::to() {
+ObjectSlot* RegularObject::to() {
   intptr_t num_slots =
-      (heap_size() - sizeof(HeapObject::Layout)) >> kWordSizeLog2;
+      (heap_size() - sizeof(HeapObject::Layout)) / sizeof(ObjectSlot);
   return &ptr()->slots_[num_slots - 1];
 }
 
@@ -1022,10 +1102,10 @@ Object Array::element(intptr_t index) const {
 void Array::set_element(intptr_t index, Object value, Barrier barrier) {
   Store(&ptr()->elements_[index], value, barrier);
 }
-Object* Array::from() {
+ObjectSlot* Array::from() {
   return &ptr()->elements_[0];
 }
-Object* Array::to() {
+ObjectSlot* Array::to() {
   return &ptr()->elements_[Size() - 1];
 }
 
@@ -1033,40 +1113,40 @@ SmallInteger WeakArray::size() const { return Load(&ptr()->size_, kNoBarrier); }
 void WeakArray::set_size(SmallInteger s) {
   Store(&ptr()->size_, s, kNoBarrier);
 }
-WeakArray WeakArray::next() const { return ptr()->next_; }
-void WeakArray::set_next(WeakArray value) { ptr()->next_ = value; }
+WeakArray WeakArray::next() const { return LoadSlot(&ptr()->next_); }
+void WeakArray::set_next(WeakArray value) { StoreSlot(&ptr()->next_, value); }
 Object WeakArray::element(intptr_t index) const {
   return Load(&ptr()->elements_[index]);
 }
 void WeakArray::set_element(intptr_t index, Object value, Barrier barrier) {
   Store(&ptr()->elements_[index], value, barrier);
 }
-Object* WeakArray::from() {
+ObjectSlot* WeakArray::from() {
   return &ptr()->elements_[0];
 }
-Object* WeakArray::to() {
+ObjectSlot* WeakArray::to() {
   return &ptr()->elements_[Size() - 1];
 }
 
-Object Ephemeron::key() const { return ptr()->key_; }
-Object* Ephemeron::key_ptr() { return &ptr()->key_; }
+Object Ephemeron::key() const { return LoadSlot(&ptr()->key_); }
+ObjectSlot* Ephemeron::key_ptr() { return &ptr()->key_; }
 void Ephemeron::set_key(Object key, Barrier barrier) {
   Store(&ptr()->key_, key, barrier);
 }
 Object Ephemeron::value() const { return Load(&ptr()->value_); }
-Object* Ephemeron::value_ptr() { return &ptr()->value_; }
+ObjectSlot* Ephemeron::value_ptr() { return &ptr()->value_; }
 void Ephemeron::set_value(Object value, Barrier barrier) {
   Store(&ptr()->value_, value, barrier);
 }
 Object Ephemeron::finalizer() const { return Load(&ptr()->finalizer_); }
-Object* Ephemeron::finalizer_ptr() { return &ptr()->finalizer_; }
+ObjectSlot* Ephemeron::finalizer_ptr() { return &ptr()->finalizer_; }
 void Ephemeron::set_finalizer(Object finalizer, Barrier barrier) {
   Store(&ptr()->finalizer_, finalizer, barrier);
 }
-Ephemeron Ephemeron::next() const { return ptr()->next_; }
-void Ephemeron::set_next(Ephemeron value) { ptr()->next_ = value; }
-Object* Ephemeron::from() { return &ptr()->key_; }
-Object* Ephemeron::to() { return &ptr()->finalizer_; }
+Ephemeron Ephemeron::next() const { return LoadSlot(&ptr()->next_); }
+void Ephemeron::set_next(Ephemeron value) { StoreSlot(&ptr()->next_, value); }
+ObjectSlot* Ephemeron::from() { return &ptr()->key_; }
+ObjectSlot* Ephemeron::to() { return &ptr()->finalizer_; }
 
 SmallInteger Bytes::size() const { return Load(&ptr()->size_, kNoBarrier); }
 void Bytes::set_size(SmallInteger s) { Store(&ptr()->size_, s, kNoBarrier); }
@@ -1098,6 +1178,23 @@ Activation Activation::sender() const { return Load(&ptr()->sender_); }
 void Activation::set_sender(Activation s, Barrier barrier) {
   Store(&ptr()->sender_, s, barrier);
 }
+Object* Activation::sender_fp() const {
+#if USE_COMPRESSED_POINTERS
+  // The interpreter's stack is in the heap's reservation.
+  return reinterpret_cast<Object*>(ptr()->sender_.LoadAddress());
+#else
+  return reinterpret_cast<Object*>(static_cast<uword>(sender()));
+#endif
+}
+void Activation::set_sender_fp(Object* fp) {
+  Activation sender = static_cast<Activation>(reinterpret_cast<uword>(fp));
+  ASSERT(sender->IsSmallInteger());
+#if USE_COMPRESSED_POINTERS
+  ptr()->sender_.StoreAddress(reinterpret_cast<uword>(fp));
+#else
+  set_sender(sender, kNoBarrier);
+#endif
+}
 SmallInteger Activation::bci() const { return Load(&ptr()->bci_, kNoBarrier); }
 void Activation::set_bci(SmallInteger i) { Store(&ptr()->bci_, i, kNoBarrier); }
 Method Activation::method() const { return Load(&ptr()->method_); }
@@ -1124,11 +1221,11 @@ Object Activation::temp(intptr_t index) const {
 void Activation::set_temp(intptr_t index, Object o, Barrier barrier) {
   Store(&ptr()->temps_[index], o, barrier);
 }
-Object* Activation::from() {
-  return reinterpret_cast<Object*>(&ptr()->sender_);
+ObjectSlot* Activation::from() {
+  return reinterpret_cast<ObjectSlot*>(&ptr()->sender_);
 }
-Object* Activation::to() {
-  return reinterpret_cast<Object*>(&ptr()->stack_depth_) + StackDepth();
+ObjectSlot* Activation::to() {
+  return reinterpret_cast<ObjectSlot*>(&ptr()->stack_depth_) + StackDepth();
 }
 
 double Float64::value() const { return ptr()->value_; }
@@ -1164,11 +1261,11 @@ Object Closure::copied(intptr_t index) const {
 void Closure::set_copied(intptr_t index, Object o, Barrier barrier ) {
   Store(&ptr()->copied_[index], o, barrier);
 }
-Object* Closure::from() {
-  return reinterpret_cast<Object*>(&ptr()->num_copied_);
+ObjectSlot* Closure::from() {
+  return reinterpret_cast<ObjectSlot*>(&ptr()->num_copied_);
 }
-Object* Closure::to() {
-  return reinterpret_cast<Object*>(&ptr()->copied_[NumCopied() - 1]);
+ObjectSlot* Closure::to() {
+  return reinterpret_cast<ObjectSlot*>(&ptr()->copied_[NumCopied() - 1]);
 }
 
 Behavior Behavior::superclass() const { return Load(&ptr()->superclass_); }
@@ -1203,48 +1300,66 @@ void Message::set_arguments(Array arguments, Barrier barrier) {
   Store(&ptr()->arguments_, arguments, barrier);
 }
 
-class SmallInteger ObjectStore::size() const { return ptr()->array_size_; }
-Object ObjectStore::nil_obj() const { return ptr()->nil_; }
-Object ObjectStore::false_obj() const { return ptr()->false_; }
-Object ObjectStore::true_obj() const { return ptr()->true_; }
-Object ObjectStore::message_loop() const { return ptr()->message_loop_; }
+class SmallInteger ObjectStore::size() const {
+  return Load(&ptr()->array_size_);
+}
+Object ObjectStore::nil_obj() const { return Load(&ptr()->nil_); }
+Object ObjectStore::false_obj() const { return Load(&ptr()->false_); }
+Object ObjectStore::true_obj() const { return Load(&ptr()->true_); }
+Object ObjectStore::message_loop() const { return Load(&ptr()->message_loop_); }
 class Array ObjectStore::common_selectors() const {
-  return ptr()->common_selectors_;
+  return Load(&ptr()->common_selectors_);
 }
 class String ObjectStore::does_not_understand() const {
-  return ptr()->does_not_understand_;
+  return Load(&ptr()->does_not_understand_);
 }
 class String ObjectStore::non_boolean_receiver() const {
-  return ptr()->non_boolean_receiver_;
+  return Load(&ptr()->non_boolean_receiver_);
 }
 class String ObjectStore::cannot_return() const {
-  return ptr()->cannot_return_;
+  return Load(&ptr()->cannot_return_);
 }
 class String ObjectStore::about_to_return_through() const {
-  return ptr()->about_to_return_through_;
+  return Load(&ptr()->about_to_return_through_);
 }
 class String ObjectStore::unused_bytecode() const {
-  return ptr()->unused_bytecode_;
+  return Load(&ptr()->unused_bytecode_);
 }
 class String ObjectStore::dispatch_message() const {
-  return ptr()->dispatch_message_;
+  return Load(&ptr()->dispatch_message_);
 }
 class String ObjectStore::dispatch_signal() const {
-  return ptr()->dispatch_signal_;
-}
-Behavior ObjectStore::Array() const { return ptr()->Array_; }
-Behavior ObjectStore::ByteArray() const { return ptr()->ByteArray_; }
-Behavior ObjectStore::String() const { return ptr()->String_; }
-Behavior ObjectStore::Closure() const { return ptr()->Closure_; }
-Behavior ObjectStore::Ephemeron() const { return ptr()->Ephemeron_; }
-Behavior ObjectStore::Float64() const { return ptr()->Float64_; }
-Behavior ObjectStore::LargeInteger() const { return ptr()->LargeInteger_; }
-Behavior ObjectStore::MediumInteger() const { return ptr()->MediumInteger_; }
-Behavior ObjectStore::Message() const { return ptr()->Message_; }
-Behavior ObjectStore::SmallInteger() const { return ptr()->SmallInteger_; }
-Behavior ObjectStore::WeakArray() const { return ptr()->WeakArray_; }
-Behavior ObjectStore::Activation() const { return ptr()->Activation_; }
-Behavior ObjectStore::Method() const { return ptr()->Method_; }
+  return Load(&ptr()->dispatch_signal_);
+}
+Behavior ObjectStore::Array() const { return Load(&ptr()->Array_); }
+Behavior ObjectStore::ByteArray() const { return Load(&ptr()->ByteArray_); }
+Behavior ObjectStore::String() const { return Load(&ptr()->String_); }
+Behavior ObjectStore::Closure() const { return Load(&ptr()->Closure_); }
+Behavior ObjectStore::Ephemeron() const { return Load(&ptr()->Ephemeron_); }
+Behavior ObjectStore::Float64() const { return Load(&ptr()->Float64_); }
+Behavior ObjectStore::LargeInteger() const {
+  return Load(&ptr()->LargeInteger_);
+}
+Behavior ObjectStore::MediumInteger() const {
+  return Load(&ptr()->MediumInteger_);
+}
+Behavior ObjectStore::Message() const { return Load(&ptr()->Message_); }
+Behavior ObjectStore::SmallInteger() const {
+  return Load(&ptr()->SmallInteger_);
+}
+Behavior ObjectStore::WeakArray() const { return Load(&ptr()->WeakArray_); }
+Behavior ObjectStore::Activation() const { return Load(&ptr()->Activation_); }
+Behavior ObjectStore::Method() const { return Load(&ptr()->Method_); }
+bool ObjectStore::has_dispatch_messages() const {
+  intptr_t index =
+      reinterpret_cast<const ObjectSlot*>(&ptr()->dispatch_messages_) -
+      &ptr()->nil_;
+  return size()->value() > index;
+}
+class String ObjectStore::dispatch_messages() const {
+  ASSERT(has_dispatch_messages());
+  return Load(&ptr()->dispatch_messages_);
+}
 
 }  // namespace psoup
 
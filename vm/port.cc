@@ -14,16 +14,72 @@
 
 namespace psoup {
 
-Mutex* PortMap::mutex_ = NULL;
-PortMap::Entry* PortMap::map_ = NULL;
-MessageLoop* PortMap::deleted_entry_ = reinterpret_cast<MessageLoop*>(1);
-intptr_t PortMap::capacity_ = 0;
-intptr_t PortMap::used_ = 0;
-intptr_t PortMap::deleted_ = 0;
-Random* PortMap::prng_ = NULL;
+class PortMap::Shard {
+ public:
+  explicit Shard(uint64_t seed);
+  ~Shard();
 
+  Port CreatePort(MessageLoop* loop, intptr_t shard_index);
+  bool PostMessage(IsolateMessage* message);
+  bool ClosePort(Port port);
+  void CloseAllPorts(MessageLoop* loop);
 
-intptr_t PortMap::FindPort(Port port) {
+ private:
+  // Allocate a new unique port.
+  Port AllocatePort(intptr_t shard_index);
+
+  intptr_t FindPort(Port port);
+  void Rehash(intptr_t new_capacity);
+
+  void MaintainInvariants();
+
+  // The shard's bits are constant within a shard, so hash on the rest.
+  intptr_t IndexFor(Port port, intptr_t capacity) {
+    return static_cast<intptr_t>(port >> kShardBits) & (capacity - 1);
+  }
+
+  typedef struct {
+    Port port;
+    MessageLoop* loop;
+  } Entry;
+
+  Mutex mutex_;
+
+  Entry* map_;
+  intptr_t capacity_;
+  intptr_t used_;
+  intptr_t deleted_;
+
+  Random prng_;
+
+  DISALLOW_COPY_AND_ASSIGN(Shard);
+};
+
+
+static MessageLoop* const deleted_entry_ = reinterpret_cast<MessageLoop*>(1);
+
+PortMap::Shard* PortMap::shards_[kNumShards] = { NULL };
+
+
+PortMap::Shard::Shard(uint64_t seed) : prng_(seed) {
+  static const intptr_t kInitialCapacity = 8;
+  // TODO(iposva): Verify whether we want to keep exponentially growing.
+  ASSERT(Utils::IsPowerOfTwo(kInitialCapacity));
+  map_ = new Entry[kInitialCapacity];
+  memset(map_, 0, kInitialCapacity * sizeof(Entry));
+  capacity_ = kInitialCapacity;
+  used_ = 0;
+  deleted_ = 0;
+}
+
+
+PortMap::Shard::~Shard() {
+  delete[] map_;
+  map_ = NULL;
+}
+
+
+intptr_t PortMap::Shard::FindPort(Port port) {
   // ILLEGAL_PORT (0) is used as a sentinel value in Entry.port. The loop below
   // could return the index to a deleted port when we are searching for
   // port id ILLEGAL_PORT. Return -1 immediately to indicate the port
@@ -32,14 +88,14 @@ intptr_t PortMap::FindPort(Port port) {
     return -1;
   }
   ASSERT(port != ILLEGAL_PORT);
-  intptr_t index = port % capacity_;
+  intptr_t index = IndexFor(port, capacity_);
   intptr_t start_index = index;
   Entry entry = map_[index];
   while (entry.loop != NULL) {
     if (entry.port == port) {
       return index;
     }
-    index = (index + 1) % capacity_;
+    index = (index + 1) & (capacity_ - 1);
     // Prevent endless loops.
     ASSERT(index != start_index);
     entry = map_[index];
@@ -48,7 +104,8 @@ intptr_t PortMap::FindPort(Port port) {
 }
 
 
-void PortMap::Rehash(intptr_t new_capacity) {
+void PortMap::Shard::Rehash(intptr_t new_capacity) {
+  ASSERT(Utils::IsPowerOfTwo(new_capacity));
   Entry* new_ports = new Entry[new_capacity];
   memset(new_ports, 0, new_capacity * sizeof(Entry));
 
@@ -56,9 +113,9 @@ void PortMap::Rehash(intptr_t new_capacity) {
     Entry entry = map_[i];
     // Skip free and deleted entries.
     if (entry.port != 0) {
-      intptr_t new_index = entry.port % new_capacity;
+      intptr_t new_index = IndexFor(entry.port, new_capacity);
       while (new_ports[new_index].port != 0) {
-        new_index = (new_index + 1) % new_capacity;
+        new_index = (new_index + 1) & (new_capacity - 1);
       }
       new_ports[new_index] = entry;
     }
@@ -70,13 +127,14 @@ void PortMap::Rehash(intptr_t new_capacity) {
 }
 
 
-Port PortMap::AllocatePort() {
-  Port result = prng_->NextUInt64() & kMaxInt64;
+Port PortMap::Shard::AllocatePort(intptr_t shard_index) {
+  const Port kShardMask = kNumShards - 1;
+  Port result = ((prng_.NextUInt64() & kMaxInt64) & ~kShardMask) | shard_index;
 
   // Keep getting new values while we have an illegal port number or the port
   // number is already in use.
   while ((result == ILLEGAL_PORT) || (FindPort(result) >= 0)) {
-    result = prng_->NextUInt64() & kMaxInt64;
+    result = ((prng_.NextUInt64() & kMaxInt64) & ~kShardMask) | shard_index;
   }
 
   ASSERT(result != 0);
@@ -85,7 +143,7 @@ Port PortMap::AllocatePort() {
 }
 
 
-void PortMap::MaintainInvariants() {
+void PortMap::Shard::MaintainInvariants() {
   intptr_t empty = capacity_ - used_ - deleted_;
   if (used_ > ((capacity_ / 4) * 3)) {
     // Grow the port map.
@@ -98,26 +156,21 @@ void PortMap::MaintainInvariants() {
 }
 
 
-Port PortMap::CreatePort(MessageLoop* loop) {
-  ASSERT(loop != NULL);
-  MutexLocker ml(mutex_);
-#if defined(DEBUG)
-  /// queue->CheckAccess();
-#endif
+Port PortMap::Shard::CreatePort(MessageLoop* loop, intptr_t shard_index) {
+  MutexLocker ml(&mutex_);
 
   Entry entry;
-  entry.port = AllocatePort();
+  entry.port = AllocatePort(shard_index);
   entry.loop = loop;
-  /// entry.state = kNewPort;
 
   // Search for the first unused slot. Make use of the knowledge that here is
   // currently no port with this id in the port map.
   ASSERT(FindPort(entry.port) < 0);
-  intptr_t index = entry.port % capacity_;
+  intptr_t index = IndexFor(entry.port, capacity_);
   Entry cur = map_[index];
   // Stop the search at the first found unused (free or deleted) slot.
   while (cur.port != 0) {
-    index = (index + 1) % capacity_;
+    index = (index + 1) & (capacity_ - 1);
     cur = map_[index];
   }
 
@@ -141,8 +194,8 @@ Port PortMap::CreatePort(MessageLoop* loop) {
 }
 
 
-bool PortMap::PostMessage(IsolateMessage* message) {
-  MutexLocker ml(mutex_);
+bool PortMap::Shard::PostMessage(IsolateMessage* message) {
+  MutexLocker ml(&mutex_);
   intptr_t index = FindPort(message->dest_port());
   if (index < 0) {
     delete message;
@@ -153,13 +206,15 @@ bool PortMap::PostMessage(IsolateMessage* message) {
   MessageLoop* loop = map_[index].loop;
   ASSERT(map_[index].port != 0);
   ASSERT((loop != NULL) && (loop != deleted_entry_));
+  // Still under the lock: CloseAllPorts must wait for this before the loop
+  // can go away.
   loop->PostMessage(message);
   return true;
 }
 
 
-bool PortMap::ClosePort(Port port) {
-  MutexLocker ml(mutex_);
+bool PortMap::Shard::ClosePort(Port port) {
+  MutexLocker ml(&mutex_);
   intptr_t index = FindPort(port);
   if (index < 0) {
     return false;
@@ -179,8 +234,8 @@ bool PortMap::ClosePort(Port port) {
 }
 
 
-void PortMap::CloseAllPorts(MessageLoop* loop) {
-  MutexLocker ml(mutex_);
+void PortMap::Shard::CloseAllPorts(MessageLoop* loop) {
+  MutexLocker ml(&mutex_);
   for (intptr_t index = 0; index < capacity_; index++) {
     if (map_[index].loop == loop) {
       ASSERT(map_[index].port != 0);
@@ -194,28 +249,56 @@ void PortMap::CloseAllPorts(MessageLoop* loop) {
 }
 
 
-void PortMap::Startup() {
-  mutex_ = new Mutex();
-  prng_ = new Random(OS::CurrentMonotonicNanos());
+PortMap::Shard* PortMap::ShardFor(Port port) {
+  return shards_[port & (kNumShards - 1)];
+}
 
-  static const intptr_t kInitialCapacity = 8;
-  // TODO(iposva): Verify whether we want to keep exponentially growing.
-  ASSERT(Utils::IsPowerOfTwo(kInitialCapacity));
-  map_ = new Entry[kInitialCapacity];
-  memset(map_, 0, kInitialCapacity * sizeof(Entry));
-  capacity_ = kInitialCapacity;
-  used_ = 0;
-  deleted_ = 0;
+
+intptr_t PortMap::ShardIndexFor(MessageLoop* loop) {
+  // Fibonacci hashing: loops are allocated with similar low bits.
+  uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(loop));
+  hash *= 0x9E3779B97F4A7C15ULL;
+  return static_cast<intptr_t>(hash >> (64 - kShardBits));
+}
+
+
+Port PortMap::CreatePort(MessageLoop* loop) {
+  ASSERT(loop != NULL);
+  intptr_t index = ShardIndexFor(loop);
+  return shards_[index]->CreatePort(loop, index);
+}
+
+
+bool PortMap::PostMessage(IsolateMessage* message) {
+  return ShardFor(message->dest_port())->PostMessage(message);
+}
+
+
+bool PortMap::ClosePort(Port port) {
+  return ShardFor(port)->ClosePort(port);
+}
+
+
+void PortMap::CloseAllPorts(MessageLoop* loop) {
+  // CreatePort puts all of a loop's ports in its shard.
+  shards_[ShardIndexFor(loop)]->CloseAllPorts(loop);
+}
+
+
+void PortMap::Startup() {
+  uint64_t seed = OS::CurrentMonotonicNanos();
+  for (intptr_t i = 0; i < kNumShards; i++) {
+    ASSERT(shards_[i] == NULL);
+    shards_[i] = new Shard(seed + i);
+  }
 }
 
 
 void PortMap::Shutdown() {
-  delete mutex_;
-  mutex_ = NULL;
-  delete prng_;
-  prng_ = NULL;
-  delete[] map_;
-  map_ = NULL;
+  for (intptr_t i = 0; i < kNumShards; i++) {
+    delete shards_[i];
+    shards_[i] = NULL;
+  }
 }
 
 }  // namespace psoup
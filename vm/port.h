@@ -15,8 +15,6 @@ typedef int64_t Port;
 
 class IsolateMessage;
 class MessageLoop;
-class Mutex;
-class Random;
 
 class PortMap : public AllStatic {
  public:
@@ -29,28 +27,18 @@ class PortMap : public AllStatic {
   static void Shutdown();
 
  private:
-  // Allocate a new unique port.
-  static Port AllocatePort();
+  // Ports are spread over shards, each with its own lock and table, so sends
+  // to different isolates do not contend. The low bits of a port id name its
+  // shard; an isolate's ports all live in the shard chosen by its loop.
+  static const intptr_t kShardBits = 4;
+  static const intptr_t kNumShards = 1 << kShardBits;
 
-  static intptr_t FindPort(Port port);
-  static void Rehash(intptr_t new_capacity);
+  class Shard;
 
-  static void MaintainInvariants();
+  static Shard* ShardFor(Port port);
+  static intptr_t ShardIndexFor(MessageLoop* loop);
 
-  typedef struct {
-    Port port;
-    MessageLoop* loop;
-  } Entry;
-
-  static Mutex* mutex_;
-
-  static Entry* map_;
-  static MessageLoop* deleted_entry_;
-  static intptr_t capacity_;
-  static intptr_t used_;
-  static intptr_t deleted_;
-
-  static Random* prng_;
+  static Shard* shards_[kNumShards];
 };
 
 }  // namespace psoup
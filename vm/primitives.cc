@@ -5,6 +5,7 @@
 #include "vm/primitives.h"
 
 #include <math.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #if defined(OS_FUCHSIA)
@@ -16,13 +17,18 @@
 
 #include "vm/assert.h"
 #include "vm/double_conversion.h"
+#include "vm/file_io.h"
 #include "vm/heap.h"
 #include "vm/interpreter.h"
 #include "vm/isolate.h"
+#include "vm/json.h"
 #include "vm/math.h"
 #include "vm/message_loop.h"
 #include "vm/object.h"
 #include "vm/os.h"
+#include "vm/snapshot.h"
+#include "vm/socket.h"
+#include "vm/utf8.h"
 
 #define nil I->nil_obj()
 
@@ -195,7 +201,62 @@ const bool kFailure = false;
   V(165, ZXStatus_getString)                                                   \
   V(166, JS_performInstanceOf)                                                 \
   V(167, JS_performHas)                                                        \
+  V(168, Exception_findHandler)                                                \
+  V(169, Activation_resume)                                                    \
+  V(170, Float64Array_at)                                                      \
+  V(171, Float64Array_atPut)                                                   \
+  V(172, Int32Array_at)                                                        \
+  V(173, Int32Array_atPut)                                                     \
+  V(174, Int64Array_at)                                                        \
+  V(175, Int64Array_atPut)                                                     \
+  V(176, TypedArray_replace)                                                   \
+  V(177, Float64Array_add)                                                     \
+  V(178, Float64Array_multiply)                                                \
+  V(179, Float64Array_addProduct)                                              \
+  V(180, Float64Array_scale)                                                   \
+  V(181, Float64Array_dot)                                                     \
+  V(182, Float64Array_sum)                                                     \
+  V(183, Float64Array_min)                                                     \
+  V(184, Float64Array_max)                                                     \
+  V(185, JSON_decode)                                                          \
+  V(186, JSON_quote)                                                           \
+  V(187, Map_scan)                                                             \
+  V(188, Map_identityScan)                                                     \
+  V(189, Set_scan)                                                             \
+  V(190, OrderedMap_scan)                                                      \
+  V(191, StringBuilder_add)                                                    \
+  V(192, StringBuilder_addByte)                                                \
+  V(193, StringBuilder_print)                                                  \
+  V(194, String_concatenate)                                                   \
+  V(195, Array_copyWithSize)                                                   \
+  V(196, Array_fromToPut)                                                      \
+  V(197, File_open)                                                            \
+  V(198, File_close)                                                           \
+  V(199, File_read)                                                            \
   V(200, quickReturnSelf)                                                      \
+  V(201, File_write)                                                           \
+  V(202, File_stat)                                                            \
+  V(203, File_takeData)                                                        \
+  V(204, File_errorString)                                                     \
+  V(205, Socket_listenTCP)                                                     \
+  V(206, Socket_listenUnix)                                                    \
+  V(207, Socket_connectTCP)                                                    \
+  V(208, Socket_connectUnix)                                                   \
+  V(209, Socket_accept)                                                        \
+  V(210, Socket_read)                                                          \
+  V(211, Socket_write)                                                         \
+  V(212, Socket_close)                                                         \
+  V(213, Socket_pendingError)                                                  \
+  V(214, Socket_localPort)                                                     \
+  V(215, File_saveSnapshot)                                                    \
+  V(216, String_isAscii)                                                       \
+  V(217, String_isUtf8)                                                        \
+  V(218, String_codeUnitCount)                                                 \
+  V(219, String_decodeInto)                                                    \
+  V(220, String_class_fromCodeUnits)                                           \
+  V(221, Object_isOld)                                                         \
+  V(222, pretenuresAllocationSites)                                            \
+  V(223, File_takeDataInto)                                                   \
 
 
 #define DEFINE_PRIMITIVE(name)                                                 \
@@ -1174,8 +1235,11 @@ DEFINE_PRIMITIVE(Behavior_basicNew) {
   ASSERT(num_slots >= 0);
   ASSERT(num_slots < 255);
 
-  RegularObject new_instance = H->AllocateRegularObject(id->value(),
-                                                         num_slots);
+  AllocationSite* site = I->CurrentAllocationSite();
+  RegularObject new_instance =
+      H->AllocateRegularObject(id->value(), num_slots,
+                               Heap::AllocatorFor(site));  // SAFEPOINT
+  H->SampleAllocation(site, new_instance);
   for (intptr_t i = 0; i < num_slots; i++) {
     new_instance->set_slot(i, nil, kNoBarrier);
   }
@@ -1222,7 +1286,10 @@ DEFINE_PRIMITIVE(Array_class_new) {
   if (length < 0) {
     return kFailure;
   }
-  Array result = H->AllocateArray(length);  // SAFEPOINT
+  AllocationSite* site = I->CurrentAllocationSite();
+  Array result =
+      H->AllocateArray(length, Heap::AllocatorFor(site));  // SAFEPOINT
+  H->SampleAllocation(site, result);
   for (intptr_t i = 0; i < length; i++) {
     result->set_element(i, nil, kNoBarrier);
   }
@@ -1322,7 +1389,10 @@ DEFINE_PRIMITIVE(ByteArray_class_new) {
   if (length < 0) {
     return kFailure;
   }
-  ByteArray result = H->AllocateByteArray(length);  // SAFEPOINT
+  AllocationSite* site = I->CurrentAllocationSite();
+  ByteArray result =
+      H->AllocateByteArray(length, Heap::AllocatorFor(site));  // SAFEPOINT
+  H->SampleAllocation(site, result);
   memset(result->element_addr(0), 0, length);
   RETURN(result);
 }
@@ -1438,6 +1508,52 @@ DEFINE_PRIMITIVE(ByteArray_replaceFromToWithStartingAt) {
 }
 
 
+// The bulk Array primitives store elements with memmove and then apply the
+// generational barrier once for the destination instead of once per element.
+// Only an old destination that is not yet remembered can need it, and only if
+// one of the stored values is new. If the values came from an old source that
+// is not remembered, none of them can be new.
+static void BulkStoreBarrier(Array destination, intptr_t index,
+                             intptr_t count, Object source) {
+  if (!destination->IsOldObject() || destination->is_remembered()) {
+    return;
+  }
+  if (source->IsOldObject() &&
+      !static_cast<HeapObject>(source)->is_remembered()) {
+    return;
+  }
+  for (intptr_t i = index; i < index + count; i++) {
+    Object value = destination->element(i);
+    if (value->IsNewObject()) {
+      destination->set_element(i, value);  // Adds to the remembered set.
+      return;
+    }
+  }
+}
+
+
+static void CopyElements(Array destination, intptr_t destination_index,
+                         Array source, intptr_t source_index,
+                         intptr_t count) {
+  memmove(destination->from() + destination_index,
+          source->from() + source_index,
+          count * sizeof(ObjectSlot));
+  BulkStoreBarrier(destination, destination_index, count, source);
+}
+
+
+static void FillElements(Array array, intptr_t index, intptr_t count,
+                         Object value) {
+  ObjectSlot* elements = array->from() + index;
+  for (intptr_t i = 0; i < count; i++) {
+    StoreSlot(&elements[i], value);
+  }
+  if ((count > 0) && value->IsNewObject()) {
+    array->set_element(index, value);  // Barrier.
+  }
+}
+
+
 DEFINE_PRIMITIVE(Array_replaceFromToWithStartingAt) {
   ASSERT(num_args == 4);
   Array receiver = static_cast<Array>(I->Stack(4));
@@ -1472,22 +1588,13 @@ DEFINE_PRIMITIVE(Array_replaceFromToWithStartingAt) {
     return kFailure;
   }
 
-  // Note replacement may be receiver.
-  if (replacementStart < start) {
-    for (intptr_t i = count - 1; i >= 0; i--) {
-      receiver->set_element(start - 1 + i,
-                            replacement->element(replacementStart - 1 + i));
-    }
-  } else {
-    for (intptr_t i = 0; i < count; i++) {
-      receiver->set_element(start - 1 + i,
-                            replacement->element(replacementStart - 1 + i));
-    }
-  }
+  // Note replacement may be receiver, which memmove allows.
+  CopyElements(receiver, start - 1, replacement, replacementStart - 1, count);
 
   RETURN_SELF();
 }
 
+
 DEFINE_PRIMITIVE(Array_copyFromTo) {
   ASSERT(num_args == 2);
 
@@ -1509,12 +1616,45 @@ DEFINE_PRIMITIVE(Array_copyFromTo) {
 
   Array result = H->AllocateArray(subsize);  // SAFEPOINT
   array = static_cast<Array>(I->Stack(2));
-  for (intptr_t i = 0; i < subsize; i++) {
-    result->set_element(i, array->element(i + start - 1));
+  CopyElements(result, 0, array, start - 1, subsize);
+  RETURN(result);
+}
+
+
+DEFINE_PRIMITIVE(Array_copyWithSize) {
+  ASSERT(num_args == 1);
+  SMI_ARGUMENT(new_size, 0);
+  if (new_size < 0) {
+    return kFailure;
   }
+
+  Array result = H->AllocateArray(new_size);  // SAFEPOINT
+  Array array = static_cast<Array>(I->Stack(1));
+  ASSERT(array->IsArray());
+  intptr_t overlap = array->Size() < new_size ? array->Size() : new_size;
+  CopyElements(result, 0, array, 0, overlap);
+  FillElements(result, overlap, new_size - overlap, nil);
   RETURN(result);
 }
 
+
+DEFINE_PRIMITIVE(Array_fromToPut) {
+  ASSERT(num_args == 3);
+  Array array = static_cast<Array>(I->Stack(3));
+  ASSERT(array->IsArray());
+  SMI_ARGUMENT(start, 2);
+  SMI_ARGUMENT(stop, 1);
+  Object value = I->Stack(0);
+  if (stop < start) {
+    RETURN_SELF();
+  }
+  if ((start <= 0) || (stop > array->Size())) {
+    return kFailure;
+  }
+  FillElements(array, start - 1, stop - start + 1, value);
+  RETURN_SELF();
+}
+
 DEFINE_PRIMITIVE(String_at) {
   ASSERT(num_args == 1);
   String string = static_cast<String>(I->Stack(1));
@@ -1861,35 +2001,39 @@ DEFINE_PRIMITIVE(Object_identical) {
 }
 
 
-DEFINE_PRIMITIVE(Object_identityHash) {
-  ASSERT(num_args == 0 || num_args == 1);
-  Object receiver = I->Stack(0);
+static intptr_t IdentityHash(Interpreter* I, Object object) {
   intptr_t hash;
-  if (receiver->IsSmallInteger()) {
-    hash = static_cast<SmallInteger>(receiver)->value();
+  if (object->IsSmallInteger()) {
+    hash = static_cast<SmallInteger>(object)->value();
     if (hash == 0) {
       hash = 1;
     }
-  } else if (receiver->IsMediumInteger()) {
-    hash = static_cast<MediumInteger>(receiver)->value();
+  } else if (object->IsMediumInteger()) {
+    hash = static_cast<MediumInteger>(object)->value();
     hash &= SmallInteger::kMaxValue;
     if (hash == 0) {
       hash = 1;
     }
-  } else if (receiver->IsString()) {
-    static_cast<String>(receiver)->EnsureHash(I->isolate());
-    hash = static_cast<String>(receiver)->header_hash();
+  } else if (object->IsString()) {
+    static_cast<String>(object)->EnsureHash(I->isolate());
+    hash = static_cast<String>(object)->header_hash();
   } else {
-    hash = static_cast<HeapObject>(receiver)->header_hash();
+    hash = static_cast<HeapObject>(object)->header_hash();
     if (hash == 0) {
       hash = I->isolate()->random().NextUInt64() & SmallInteger::kMaxValue;
       if (hash == 0) {
         hash = 1;
       }
-      static_cast<HeapObject>(receiver)->set_header_hash(hash);
+      static_cast<HeapObject>(object)->set_header_hash(hash);
     }
   }
-  RETURN_SMI(hash);
+  return hash;
+}
+
+
+DEFINE_PRIMITIVE(Object_identityHash) {
+  ASSERT(num_args == 0 || num_args == 1);
+  RETURN_SMI(IdentityHash(I, I->Stack(0)));
 }
 
 
@@ -2006,154 +2150,880 @@ DEFINE_PRIMITIVE(Activation_jump) {
 }
 
 
-DEFINE_PRIMITIVE(Behavior_allInstances) {
-  ASSERT(num_args == 1);
-  Behavior cls = static_cast<Behavior>(I->Stack(0));
-  if (!cls->IsRegularObject()) {
-    UNREACHABLE();
+DEFINE_PRIMITIVE(Exception_findHandler) {
+  ASSERT(num_args == 2);
+  Activation start = static_cast<Activation>(I->Stack(1));
+  Behavior exception_class = static_cast<Behavior>(I->Stack(0));
+  if (!start->IsActivation() || !exception_class->IsRegularObject()) {
+    return kFailure;
   }
-  if (cls->id() == nil) {
-    // Class not yet registered: no instance has been allocated.
-    Array result = H->AllocateArray(0);  // SAFEPOINT
-    RETURN(result);
+  Object handler =
+      I->FindExceptionHandler(start, exception_class);  // SAFEPOINT
+  if (handler == nullptr) {
+    return kFailure;
   }
+  RETURN(handler);
+}
 
-  ASSERT(cls->id()->IsSmallInteger());
-  intptr_t cid = cls->id()->value();
-  if (cid == kIllegalCid) {
-    UNREACHABLE();
+
+DEFINE_PRIMITIVE(Activation_resume) {
+  ASSERT(num_args == 1);
+  Activation target = static_cast<Activation>(I->Stack(1));
+  ASSERT(target->IsActivation());
+  Object result = I->Stack(0);
+  if (!I->ResumeActivation(target, result)) {
+    return kFailure;
   }
-  intptr_t num_instances = H->CountInstances(cid);
-  if (cid == kArrayCid) {
-    num_instances++;
+  return kSuccess;
+}
+
+
+// Typed arrays are regular objects whose first slot holds a ByteArray of raw
+// elements. Element access boxes lazily; the bulk operations run directly over
+// the raw storage in loops simple enough for the compiler to vectorize.
+static bool TypedArrayElements(Object array, intptr_t width,
+                               uint8_t** elements, intptr_t* length) {
+  if (!array->IsRegularObject()) {
+    return false;
   }
-  Array result = H->AllocateArray(num_instances);  // SAFEPOINT
-  result->set_size(SmallInteger::New(num_instances));
-  intptr_t num_instances2 = H->CollectInstances(cid, result);
+  RegularObject object = static_cast<RegularObject>(array);
+  if (object->to() < object->from()) {
+    return false;
+  }
+  Object storage = object->slot(0);
+  if (!storage->IsByteArray()) {
+    return false;
+  }
+  *elements = static_cast<ByteArray>(storage)->element_addr(0);
+  *length = static_cast<ByteArray>(storage)->Size() / width;
+  return true;
+}
 
-  ASSERT(num_instances == num_instances2);
-  // Note that if a GC happens there may be fewer instances than
-  // we initially counted. TODO(rmacnak): truncate result.
-  // OS::PrintErr("Found %" Pd " instances of %" Pd "\n", num_instances, cid);
 
-  RETURN(result);
+// ByteArray elements are only word aligned, so 8-byte elements on 32-bit
+// hosts are accessed through memcpy, which compiles to plain loads and stores
+// where alignment does not matter.
+template<typename type>
+static inline type LoadElement(const uint8_t* elements, intptr_t index) {
+  type value;
+  memcpy(&value, elements + index * sizeof(type), sizeof(type));
+  return value;
 }
 
 
-DEFINE_PRIMITIVE(Array_elementsForwardIdentity) {
-  ASSERT(num_args == 2);
-  Array left = static_cast<Array>(I->Stack(1));
-  Array right = static_cast<Array>(I->Stack(0));
-  if (left->IsArray() && right->IsArray()) {
-    if (H->BecomeForward(left, right)) {
-      RETURN_SELF();
-    }
-  }
-  return kFailure;
+template<typename type>
+static inline void StoreElement(uint8_t* elements, intptr_t index,
+                                type value) {
+  memcpy(elements + index * sizeof(type), &value, sizeof(type));
 }
 
 
-DEFINE_PRIMITIVE(Platform_operatingSystem) {
-  const char* name = OS::Name();
-  intptr_t length = strlen(name);
-  String result = H->AllocateString(length);  // SAFEPOINT
-  memcpy(result->element_addr(0), name, length);
-  RETURN(result);
+// The argument of a bulk operation must be an array of the same kind and
+// length as the receiver.
+static bool SameFloat64Elements(Object receiver, Object argument,
+                                intptr_t length, uint8_t** elements) {
+  if (argument->ClassId() != receiver->ClassId()) {
+    return false;
+  }
+  intptr_t argument_length;
+  if (!TypedArrayElements(argument, sizeof(double), elements,
+                          &argument_length)) {
+    return false;
+  }
+  return argument_length == length;
 }
 
 
-DEFINE_PRIMITIVE(Time_monotonicNanos) {
-  ASSERT(num_args == 0);
-  int64_t now = OS::CurrentMonotonicNanos();
-  RETURN_MINT(now);
+DEFINE_PRIMITIVE(Float64Array_at) {
+  ASSERT(num_args == 1);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(1), sizeof(double), &elements, &length)) {
+    return kFailure;
+  }
+  SMI_ARGUMENT(index, 0);
+  index--;
+  if ((index < 0) || (index >= length)) {
+    return kFailure;
+  }
+  RETURN_FLOAT(LoadElement<double>(elements, index));
 }
 
 
-DEFINE_PRIMITIVE(Time_utcEpochNanos) { UNIMPLEMENTED(); return kSuccess; }
+DEFINE_PRIMITIVE(Float64Array_atPut) {
+  ASSERT(num_args == 2);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(2), sizeof(double), &elements, &length)) {
+    return kFailure;
+  }
+  SMI_ARGUMENT(index, 1);
+  index--;
+  if ((index < 0) || (index >= length)) {
+    return kFailure;
+  }
+  Object value = I->Stack(0);
+  double raw_value;
+  FLOAT_VALUE(raw_value, value);
+  StoreElement(elements, index, raw_value);
+  RETURN(value);
+}
 
 
-DEFINE_PRIMITIVE(print) {
+DEFINE_PRIMITIVE(Int32Array_at) {
   ASSERT(num_args == 1);
-  ASSERT(I->StackDepth() >= 2);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(1), sizeof(int32_t), &elements, &length)) {
+    return kFailure;
+  }
+  SMI_ARGUMENT(index, 0);
+  index--;
+  if ((index < 0) || (index >= length)) {
+    return kFailure;
+  }
+  int64_t value = LoadElement<int32_t>(elements, index);
+  RETURN_MINT(value);  // SmallIntegers may be narrower than 32 bits.
+}
 
-  Object message = I->Stack(0);
-  if (message->IsString()) {
-    String string = static_cast<String>(message);
-    const char* cstr =
-        reinterpret_cast<const char*>(string->element_addr(0));
-    OS::Print("%.*s\n", static_cast<int>(string->Size()), cstr);
-  } else {
-    char* cstr = message->ToCString(H);
-    OS::Print("[print] %s\n", cstr);
-    free(cstr);
+
+DEFINE_PRIMITIVE(Int32Array_atPut) {
+  ASSERT(num_args == 2);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(2), sizeof(int32_t), &elements, &length)) {
+    return kFailure;
   }
-  RETURN_SELF();
+  SMI_ARGUMENT(index, 1);
+  index--;
+  if ((index < 0) || (index >= length)) {
+    return kFailure;
+  }
+  MINT_ARGUMENT(value, 0);
+  if ((value < kMinInt32) || (value > kMaxInt32)) {
+    return kFailure;
+  }
+  StoreElement(elements, index, static_cast<int32_t>(value));
+  RETURN(I->Stack(0));
 }
 
 
-DEFINE_PRIMITIVE(panic) {
-  OS::PrintErr("Panic:\n");
-  I->PrintStack();
-  OS::Exit(-1);
-  UNREACHABLE();
-  return kFailure;
+DEFINE_PRIMITIVE(Int64Array_at) {
+  ASSERT(num_args == 1);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(1), sizeof(int64_t), &elements, &length)) {
+    return kFailure;
+  }
+  SMI_ARGUMENT(index, 0);
+  index--;
+  if ((index < 0) || (index >= length)) {
+    return kFailure;
+  }
+  int64_t value = LoadElement<int64_t>(elements, index);
+  RETURN_MINT(value);
 }
 
 
-DEFINE_PRIMITIVE(flushCache) {
-  // Atomicity may require this to be part of an atomic install's become. If so,
-  // remove this separate primitive.
-  UNREACHABLE();
-  return kFailure;
+DEFINE_PRIMITIVE(Int64Array_atPut) {
+  ASSERT(num_args == 2);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(2), sizeof(int64_t), &elements, &length)) {
+    return kFailure;
+  }
+  SMI_ARGUMENT(index, 1);
+  index--;
+  if ((index < 0) || (index >= length)) {
+    return kFailure;
+  }
+  MINT_ARGUMENT(value, 0);
+  StoreElement(elements, index, value);
+  RETURN(I->Stack(0));
 }
 
 
-DEFINE_PRIMITIVE(collectGarbage) {
-  H->CollectAll(Heap::kPrimitive);  // SAFEPOINT
+DEFINE_PRIMITIVE(TypedArray_replace) {
+  ASSERT(num_args == 5);
+  Object receiver = I->Stack(5);
+  Object replacement = I->Stack(2);
+  if (replacement->ClassId() != receiver->ClassId()) {
+    return kFailure;
+  }
+  SMI_ARGUMENT(width, 0);
+  if ((width != 4) && (width != 8)) {
+    return kFailure;
+  }
+  uint8_t* dest;
+  intptr_t dest_length;
+  uint8_t* src;
+  intptr_t src_length;
+  if (!TypedArrayElements(receiver, width, &dest, &dest_length) ||
+      !TypedArrayElements(replacement, width, &src, &src_length)) {
+    return kFailure;
+  }
+  SMI_ARGUMENT(start, 4);
+  SMI_ARGUMENT(stop, 3);
+  SMI_ARGUMENT(replacement_start, 1);
+  intptr_t count = stop - start + 1;
+  if ((start <= 0) || (count < 0) || (stop > dest_length) ||
+      (replacement_start <= 0) ||
+      (replacement_start - 1 + count > src_length)) {
+    return kFailure;
+  }
+  memmove(dest + (start - 1) * width,
+          src + (replacement_start - 1) * width,
+          count * width);
   RETURN_SELF();
 }
 
 
-DEFINE_PRIMITIVE(MessageLoop_exit) {
+DEFINE_PRIMITIVE(Float64Array_add) {
   ASSERT(num_args == 1);
-  SmallInteger exit_code = static_cast<SmallInteger>(I->Stack(0));
-  if (!exit_code->IsSmallInteger()) {
+  uint8_t* left;
+  uint8_t* right;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(1), sizeof(double), &left, &length) ||
+      !SameFloat64Elements(I->Stack(1), I->Stack(0), length, &right)) {
     return kFailure;
   }
-  I->isolate()->loop()->Exit(exit_code->value());
-  I->Exit();
-  UNREACHABLE();
-  return kFailure;
+  for (intptr_t i = 0; i < length; i++) {
+    StoreElement(left, i,
+                 LoadElement<double>(left, i) + LoadElement<double>(right, i));
+  }
+  RETURN_SELF();
 }
 
-DEFINE_PRIMITIVE(Double_asStringFixed) {
+
+DEFINE_PRIMITIVE(Float64Array_multiply) {
   ASSERT(num_args == 1);
-  FLOAT_ARGUMENT(value, 1);
-  SMI_ARGUMENT(fraction_digits, 0);
-  if (fraction_digits < 0 || fraction_digits > 20) {
+  uint8_t* left;
+  uint8_t* right;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(1), sizeof(double), &left, &length) ||
+      !SameFloat64Elements(I->Stack(1), I->Stack(0), length, &right)) {
     return kFailure;
   }
+  for (intptr_t i = 0; i < length; i++) {
+    StoreElement(left, i,
+                 LoadElement<double>(left, i) * LoadElement<double>(right, i));
+  }
+  RETURN_SELF();
+}
 
-  char buffer[64];
+
+DEFINE_PRIMITIVE(Float64Array_addProduct) {
+  ASSERT(num_args == 2);
+  uint8_t* accumulator;
+  uint8_t* left;
+  uint8_t* right;
   intptr_t length;
-  if (value < 1e21 && value > -1e21) {
-    length = DoubleToCStringAsFixed(value, fraction_digits,
-                                    buffer, sizeof(buffer));
-  } else {
-    length = DoubleToCStringAsShortest(value, buffer, sizeof(buffer));
+  if (!TypedArrayElements(I->Stack(2), sizeof(double), &accumulator, &length) ||
+      !SameFloat64Elements(I->Stack(2), I->Stack(1), length, &left) ||
+      !SameFloat64Elements(I->Stack(2), I->Stack(0), length, &right)) {
+    return kFailure;
   }
-  ASSERT(length < 64);
-
-  String result = H->AllocateString(length);  // SAFEPOINT
-  memcpy(result->element_addr(0), buffer, length);
-  RETURN(result);
+  for (intptr_t i = 0; i < length; i++) {
+    StoreElement(accumulator, i,
+                 LoadElement<double>(accumulator, i) +
+                 LoadElement<double>(left, i) * LoadElement<double>(right, i));
+  }
+  RETURN_SELF();
 }
 
-DEFINE_PRIMITIVE(Double_asStringExponential) {
+
+DEFINE_PRIMITIVE(Float64Array_scale) {
   ASSERT(num_args == 1);
-  FLOAT_ARGUMENT(value, 1);
-  SMI_ARGUMENT(fraction_digits, 0);
-  if (fraction_digits < 0 || fraction_digits > 20) {
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(1), sizeof(double), &elements, &length)) {
+    return kFailure;
+  }
+  Object factor = I->Stack(0);
+  double raw_factor;
+  FLOAT_VALUE(raw_factor, factor);
+  for (intptr_t i = 0; i < length; i++) {
+    StoreElement(elements, i, LoadElement<double>(elements, i) * raw_factor);
+  }
+  RETURN_SELF();
+}
+
+
+// Reductions keep four independent partial sums so that the additions are not
+// serialized on one register. The result may therefore differ in rounding from
+// a left-to-right fold.
+DEFINE_PRIMITIVE(Float64Array_dot) {
+  ASSERT(num_args == 1);
+  uint8_t* left;
+  uint8_t* right;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(1), sizeof(double), &left, &length) ||
+      !SameFloat64Elements(I->Stack(1), I->Stack(0), length, &right)) {
+    return kFailure;
+  }
+  double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+  intptr_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    sum0 += LoadElement<double>(left, i) * LoadElement<double>(right, i);
+    sum1 += LoadElement<double>(left, i + 1) *
+            LoadElement<double>(right, i + 1);
+    sum2 += LoadElement<double>(left, i + 2) *
+            LoadElement<double>(right, i + 2);
+    sum3 += LoadElement<double>(left, i + 3) *
+            LoadElement<double>(right, i + 3);
+  }
+  for (; i < length; i++) {
+    sum0 += LoadElement<double>(left, i) * LoadElement<double>(right, i);
+  }
+  RETURN_FLOAT((sum0 + sum1) + (sum2 + sum3));
+}
+
+
+DEFINE_PRIMITIVE(Float64Array_sum) {
+  ASSERT(num_args == 0);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(0), sizeof(double), &elements, &length)) {
+    return kFailure;
+  }
+  double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+  intptr_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    sum0 += LoadElement<double>(elements, i);
+    sum1 += LoadElement<double>(elements, i + 1);
+    sum2 += LoadElement<double>(elements, i + 2);
+    sum3 += LoadElement<double>(elements, i + 3);
+  }
+  for (; i < length; i++) {
+    sum0 += LoadElement<double>(elements, i);
+  }
+  RETURN_FLOAT((sum0 + sum1) + (sum2 + sum3));
+}
+
+
+// Same as folding with Number>>min:, including its treatment of NaN.
+DEFINE_PRIMITIVE(Float64Array_min) {
+  ASSERT(num_args == 0);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(0), sizeof(double), &elements, &length) ||
+      (length == 0)) {
+    return kFailure;
+  }
+  double extreme = LoadElement<double>(elements, 0);
+  for (intptr_t i = 1; i < length; i++) {
+    double element = LoadElement<double>(elements, i);
+    extreme = extreme < element ? extreme : element;
+  }
+  RETURN_FLOAT(extreme);
+}
+
+
+// Same as folding with Number>>max:, including its treatment of NaN.
+DEFINE_PRIMITIVE(Float64Array_max) {
+  ASSERT(num_args == 0);
+  uint8_t* elements;
+  intptr_t length;
+  if (!TypedArrayElements(I->Stack(0), sizeof(double), &elements, &length) ||
+      (length == 0)) {
+    return kFailure;
+  }
+  double extreme = LoadElement<double>(elements, 0);
+  for (intptr_t i = 1; i < length; i++) {
+    double element = LoadElement<double>(elements, i);
+    extreme = extreme > element ? extreme : element;
+  }
+  RETURN_FLOAT(extreme);
+}
+
+// Code units for the UTF-8 primitives travel in Int32Arrays: code points at
+// width 4 and UTF-16 code units at width 2.
+static bool CodeUnitElements(Object array, int32_t** elements,
+                             intptr_t* length) {
+  uint8_t* raw;
+  if (!TypedArrayElements(array, sizeof(int32_t), &raw, length)) {
+    return false;
+  }
+  *elements = reinterpret_cast<int32_t*>(raw);
+  return true;
+}
+
+
+DEFINE_PRIMITIVE(String_isAscii) {
+  ASSERT(num_args == 0);
+  String string = static_cast<String>(I->Stack(0));
+  ASSERT(string->IsString());
+  RETURN_BOOL(UTF8::IsAscii(string->element_addr(0), string->Size()));
+}
+
+
+DEFINE_PRIMITIVE(String_isUtf8) {
+  ASSERT(num_args == 0);
+  String string = static_cast<String>(I->Stack(0));
+  ASSERT(string->IsString());
+  intptr_t units;
+  RETURN_BOOL(UTF8::Validate(string->element_addr(0), string->Size(),
+                             4, &units));
+}
+
+
+DEFINE_PRIMITIVE(String_codeUnitCount) {
+  ASSERT(num_args == 1);
+  String string = static_cast<String>(I->Stack(1));
+  ASSERT(string->IsString());
+  SMI_ARGUMENT(width, 0);
+  if ((width != 2) && (width != 4)) {
+    return kFailure;
+  }
+  intptr_t units;
+  if (!UTF8::Validate(string->element_addr(0), string->Size(),
+                      width, &units)) {
+    return kFailure;
+  }
+  RETURN_SMI(units);
+}
+
+
+DEFINE_PRIMITIVE(String_decodeInto) {
+  ASSERT(num_args == 2);
+  String string = static_cast<String>(I->Stack(2));
+  ASSERT(string->IsString());
+  SMI_ARGUMENT(width, 0);
+  if ((width != 2) && (width != 4)) {
+    return kFailure;
+  }
+  int32_t* units;
+  intptr_t length;
+  if (!CodeUnitElements(I->Stack(1), &units, &length)) {
+    return kFailure;
+  }
+  intptr_t expected;
+  if (!UTF8::Validate(string->element_addr(0), string->Size(),
+                      width, &expected) ||
+      (expected != length)) {
+    return kFailure;
+  }
+  UTF8::Decode(string->element_addr(0), string->Size(), width, units);
+  RETURN(I->Stack(1));
+}
+
+
+DEFINE_PRIMITIVE(String_class_fromCodeUnits) {
+  ASSERT(num_args == 2);
+  SMI_ARGUMENT(width, 0);
+  if ((width != 2) && (width != 4)) {
+    return kFailure;
+  }
+  int32_t* units;
+  intptr_t length;
+  if (!CodeUnitElements(I->Stack(1), &units, &length)) {
+    return kFailure;
+  }
+  intptr_t size = UTF8::EncodedLength(units, length, width);
+  if (size < 0) {
+    return kFailure;
+  }
+  String result = H->AllocateString(size);  // SAFEPOINT
+  CodeUnitElements(I->Stack(1), &units, &length);
+  UTF8::Encode(units, length, width, result->element_addr(0));
+  RETURN(result);
+}
+
+
+DEFINE_PRIMITIVE(JSON_decode) {
+  ASSERT(num_args == 2);
+  Bytes input = static_cast<Bytes>(I->Stack(1));
+  if (!input->IsBytes()) {
+    return kFailure;
+  }
+  Object result = JSON::Decode(H, input, I->Stack(0));  // SAFEPOINT
+  if (result == nullptr) {
+    return kFailure;
+  }
+  RETURN(result);
+}
+
+
+DEFINE_PRIMITIVE(JSON_quote) {
+  ASSERT(num_args == 1);
+  Bytes input = static_cast<Bytes>(I->Stack(0));
+  if (!input->IsBytes()) {
+    return kFailure;
+  }
+  RETURN(JSON::Quote(H, input));  // SAFEPOINT
+}
+
+
+// The scan primitives run the probe loops of the hash collections without
+// sending #hash and #= for keys whose answers the VM knows: SmallIntegers
+// (Integer>>hash is the value itself) and Strings (the cached content hash).
+// They fail for other keys, or when the table is full, leaving the probe to
+// the Newspeak fallback.
+static bool KnownHash(Interpreter* I, Object key, intptr_t* hash) {
+  if (key->IsSmallInteger()) {
+    *hash = static_cast<SmallInteger>(key)->value();
+    return true;
+  }
+  if (key->IsString()) {
+    *hash = static_cast<String>(key)->EnsureHash(I->isolate())->value();
+    return true;
+  }
+  return false;
+}
+
+
+enum KnownEquality { kNotEqual, kEqual, kUnknown };
+
+// Evaluates 'key = element' for a key accepted by KnownHash.
+static KnownEquality KnownEquals(Object key, Object element) {
+  if (key == element) {
+    return kEqual;
+  }
+  if (key->IsSmallInteger()) {
+    if (element->IsSmallInteger()) {
+      return kNotEqual;
+    }
+    if (element->IsFloat64() ||
+        element->IsMediumInteger() ||
+        element->IsLargeInteger()) {
+      return kUnknown;
+    }
+    return kNotEqual;
+  }
+
+  ASSERT(key->IsString());
+  if (!element->IsString()) {
+    return kNotEqual;
+  }
+  String left = static_cast<String>(key);
+  String right = static_cast<String>(element);
+  if (left->size() != right->size()) {
+    return kNotEqual;
+  }
+  intptr_t right_hash = right->header_hash();
+  if ((right_hash != 0) && (right_hash != left->header_hash())) {
+    return kNotEqual;
+  }
+  return memcmp(left->element_addr(0), right->element_addr(0),
+                left->Size()) == 0 ? kEqual : kNotEqual;
+}
+
+
+static intptr_t FlooredMod(intptr_t dividend, intptr_t divisor) {
+  ASSERT(divisor > 0);
+  intptr_t remainder = dividend % divisor;
+  return remainder < 0 ? remainder + divisor : remainder;
+}
+
+
+// Map's flattened table: keys at odd (one-based) indices, each followed by
+// its value, with the table itself marking an empty slot. Answers the
+// one-based index of the key or of the empty slot where it belongs, or 0.
+static intptr_t ScanPairs(Array table, Object key, intptr_t hash,
+                          bool identity) {
+  intptr_t size = table->Size();
+  if ((size == 0) || ((size & 1) != 0)) {
+    return 0;
+  }
+  intptr_t start = FlooredMod(hash | 1, size);
+  intptr_t index = start;
+  do {
+    Object element = table->element(index - 1);
+    if (element == table) {
+      return index;
+    }
+    if (identity) {
+      if (element == key) {
+        return index;
+      }
+    } else {
+      KnownEquality equality = KnownEquals(key, element);
+      if (equality == kEqual) {
+        return index;
+      }
+      if (equality == kUnknown) {
+        return 0;
+      }
+    }
+    index = (index + 1) % size + 1;
+  } while (index != start);
+  return 0;
+}
+
+
+DEFINE_PRIMITIVE(Map_scan) {
+  ASSERT(num_args == 2);
+  Array table = static_cast<Array>(I->Stack(1));
+  Object key = I->Stack(0);
+  intptr_t hash;
+  if (!table->IsArray() || !KnownHash(I, key, &hash)) {
+    return kFailure;
+  }
+  intptr_t index = ScanPairs(table, key, hash, false);
+  if (index == 0) {
+    return kFailure;
+  }
+  RETURN_SMI(index);
+}
+
+
+DEFINE_PRIMITIVE(Map_identityScan) {
+  ASSERT(num_args == 2);
+  Array table = static_cast<Array>(I->Stack(1));
+  Object key = I->Stack(0);
+  if (!table->IsArray()) {
+    return kFailure;
+  }
+  intptr_t index = ScanPairs(table, key, IdentityHash(I, key), true);
+  if (index == 0) {
+    return kFailure;
+  }
+  RETURN_SMI(index);
+}
+
+
+DEFINE_PRIMITIVE(Set_scan) {
+  ASSERT(num_args == 2);
+  Array table = static_cast<Array>(I->Stack(1));
+  Object element = I->Stack(0);
+  intptr_t hash;
+  if (!table->IsArray() || !KnownHash(I, element, &hash)) {
+    return kFailure;
+  }
+  intptr_t size = table->Size();
+  if (size == 0) {
+    return kFailure;
+  }
+  intptr_t start = FlooredMod(hash, size) + 1;
+  intptr_t index = start;
+  do {
+    Object entry = table->element(index - 1);
+    if (entry == table) {
+      RETURN_SMI(index);
+    }
+    KnownEquality equality = KnownEquals(element, entry);
+    if (equality == kEqual) {
+      RETURN_SMI(index);
+    }
+    if (equality == kUnknown) {
+      return kFailure;
+    }
+    index = index % size + 1;
+  } while (index != start);
+  return kFailure;
+}
+
+
+// OrderedMap and OrderedSet: [1, buckets] hold 0 for empty, 1 for deleted,
+// or the index of the key. Answers the bucket of the key, or the negated
+// bucket where it belongs.
+DEFINE_PRIMITIVE(OrderedMap_scan) {
+  ASSERT(num_args == 3);
+  Array table = static_cast<Array>(I->Stack(2));
+  Object buckets_obj = I->Stack(1);
+  Object key = I->Stack(0);
+  intptr_t hash;
+  if (!table->IsArray() ||
+      !buckets_obj->IsSmallInteger() ||
+      !KnownHash(I, key, &hash)) {
+    return kFailure;
+  }
+  intptr_t size = table->Size();
+  intptr_t buckets = static_cast<SmallInteger>(buckets_obj)->value();
+  if ((buckets <= 0) || (buckets > size)) {
+    return kFailure;
+  }
+  intptr_t start = FlooredMod(hash, buckets) + 1;
+  intptr_t bucket = start;
+  do {
+    Object key_index = table->element(bucket - 1);
+    if (!key_index->IsSmallInteger()) {
+      return kFailure;
+    }
+    intptr_t raw_key_index = static_cast<SmallInteger>(key_index)->value();
+    if (raw_key_index == 0) {
+      RETURN_SMI(-bucket);
+    }
+    if (raw_key_index != 1) {
+      if ((raw_key_index <= buckets) || (raw_key_index > size)) {
+        return kFailure;
+      }
+      KnownEquality equality =
+          KnownEquals(key, table->element(raw_key_index - 1));
+      if (equality == kEqual) {
+        RETURN_SMI(bucket);
+      }
+      if (equality == kUnknown) {
+        return kFailure;
+      }
+    }
+    bucket = bucket % buckets + 1;
+  } while (bucket != start);
+  return kFailure;
+}
+
+
+DEFINE_PRIMITIVE(Behavior_allInstances) {
+  ASSERT(num_args == 1);
+  Behavior cls = static_cast<Behavior>(I->Stack(0));
+  if (!cls->IsRegularObject()) {
+    UNREACHABLE();
+  }
+  if (cls->id() == nil) {
+    // Class not yet registered: no instance has been allocated.
+    Array result = H->AllocateArray(0);  // SAFEPOINT
+    RETURN(result);
+  }
+
+  ASSERT(cls->id()->IsSmallInteger());
+  intptr_t cid = cls->id()->value();
+  if (cid == kIllegalCid) {
+    UNREACHABLE();
+  }
+  intptr_t num_instances = H->CountInstances(cid);
+  if (cid == kArrayCid) {
+    num_instances++;
+  }
+  Array result = H->AllocateArray(num_instances);  // SAFEPOINT
+  result->set_size(SmallInteger::New(num_instances));
+  intptr_t num_instances2 = H->CollectInstances(cid, result);
+
+  ASSERT(num_instances == num_instances2);
+  // Note that if a GC happens there may be fewer instances than
+  // we initially counted. TODO(rmacnak): truncate result.
+  // OS::PrintErr("Found %" Pd " instances of %" Pd "\n", num_instances, cid);
+
+  RETURN(result);
+}
+
+
+DEFINE_PRIMITIVE(Array_elementsForwardIdentity) {
+  ASSERT(num_args == 2);
+  Array left = static_cast<Array>(I->Stack(1));
+  Array right = static_cast<Array>(I->Stack(0));
+  if (left->IsArray() && right->IsArray()) {
+    if (H->BecomeForward(left, right)) {
+      RETURN_SELF();
+    }
+  }
+  return kFailure;
+}
+
+
+DEFINE_PRIMITIVE(Platform_operatingSystem) {
+  const char* name = OS::Name();
+  intptr_t length = strlen(name);
+  String result = H->AllocateString(length);  // SAFEPOINT
+  memcpy(result->element_addr(0), name, length);
+  RETURN(result);
+}
+
+
+DEFINE_PRIMITIVE(Time_monotonicNanos) {
+  ASSERT(num_args == 0);
+  int64_t now = OS::CurrentMonotonicNanos();
+  RETURN_MINT(now);
+}
+
+
+DEFINE_PRIMITIVE(Time_utcEpochNanos) { UNIMPLEMENTED(); return kSuccess; }
+
+
+DEFINE_PRIMITIVE(print) {
+  ASSERT(num_args == 1);
+  ASSERT(I->StackDepth() >= 2);
+
+  Object message = I->Stack(0);
+  if (message->IsString()) {
+    String string = static_cast<String>(message);
+    const char* cstr =
+        reinterpret_cast<const char*>(string->element_addr(0));
+    OS::Print("%.*s\n", static_cast<int>(string->Size()), cstr);
+  } else {
+    char* cstr = message->ToCString(H);
+    OS::Print("[print] %s\n", cstr);
+    free(cstr);
+  }
+  RETURN_SELF();
+}
+
+
+DEFINE_PRIMITIVE(panic) {
+  OS::PrintErr("Panic:\n");
+  I->PrintStack();
+  OS::Exit(-1);
+  UNREACHABLE();
+  return kFailure;
+}
+
+
+DEFINE_PRIMITIVE(flushCache) {
+  // Atomicity may require this to be part of an atomic install's become. If so,
+  // remove this separate primitive.
+  UNREACHABLE();
+  return kFailure;
+}
+
+
+DEFINE_PRIMITIVE(collectGarbage) {
+  H->CollectAll(Heap::kPrimitive);  // SAFEPOINT
+  RETURN_SELF();
+}
+
+
+DEFINE_PRIMITIVE(Object_isOld) {
+  ASSERT(num_args == 1);
+  Object object = I->Stack(0);
+  RETURN_BOOL(object->IsHeapObject() && object->IsOldObject());
+}
+
+
+DEFINE_PRIMITIVE(pretenuresAllocationSites) {
+  ASSERT(num_args == 0);
+  RETURN_BOOL(ALLOCATION_SITE_PRETENURING);
+}
+
+
+DEFINE_PRIMITIVE(MessageLoop_exit) {
+  ASSERT(num_args == 1);
+  SmallInteger exit_code = static_cast<SmallInteger>(I->Stack(0));
+  if (!exit_code->IsSmallInteger()) {
+    return kFailure;
+  }
+  I->isolate()->loop()->Exit(exit_code->value());
+  I->Exit();
+  UNREACHABLE();
+  return kFailure;
+}
+
+DEFINE_PRIMITIVE(Double_asStringFixed) {
+  ASSERT(num_args == 1);
+  FLOAT_ARGUMENT(value, 1);
+  SMI_ARGUMENT(fraction_digits, 0);
+  if (fraction_digits < 0 || fraction_digits > 20) {
+    return kFailure;
+  }
+
+  char buffer[64];
+  intptr_t length;
+  if (value < 1e21 && value > -1e21) {
+    length = DoubleToCStringAsFixed(value, fraction_digits,
+                                    buffer, sizeof(buffer));
+  } else {
+    length = DoubleToCStringAsShortest(value, buffer, sizeof(buffer));
+  }
+  ASSERT(length < 64);
+
+  String result = H->AllocateString(length);  // SAFEPOINT
+  memcpy(result->element_addr(0), buffer, length);
+  RETURN(result);
+}
+
+DEFINE_PRIMITIVE(Double_asStringExponential) {
+  ASSERT(num_args == 1);
+  FLOAT_ARGUMENT(value, 1);
+  SMI_ARGUMENT(fraction_digits, 0);
+  if (fraction_digits < 0 || fraction_digits > 20) {
     return kFailure;
   }
 
@@ -2185,29 +3055,41 @@ DEFINE_PRIMITIVE(Double_asStringPrecision) {
   RETURN(result);
 }
 
+// Answers the length of the printString of a SmallInteger, MediumInteger or
+// Float64, or -1 for other objects.
+static intptr_t PrintNumber(Object number, char* buffer, intptr_t size) {
+  intptr_t length;
+  if (number->IsSmallInteger()) {
+    intptr_t value = static_cast<SmallInteger>(number)->value();
+    length = snprintf(buffer, size, "%" Pd "", value);
+  } else if (number->IsMediumInteger()) {
+    int64_t value = static_cast<MediumInteger>(number)->value();
+    length = snprintf(buffer, size, "%" Pd64 "", value);
+  } else if (number->IsFloat64()) {
+    double value = static_cast<Float64>(number)->value();
+    length = DoubleToCStringAsShortest(value, buffer, size);
+  } else {
+    return -1;
+  }
+  ASSERT(length < size);
+  return length;
+}
+
+
 DEFINE_PRIMITIVE(Number_asString) {
   ASSERT(num_args == 0);
   Object receiver = I->Stack(0);
 
   char buffer[64];
-  intptr_t length = -1;
-  if (receiver->IsSmallInteger()) {
-    intptr_t value = static_cast<SmallInteger>(receiver)->value();
-    length = snprintf(buffer, sizeof(buffer), "%" Pd "", value);
-  } else if (receiver->IsMediumInteger()) {
-    int64_t value = static_cast<MediumInteger>(receiver)->value();
-    length = snprintf(buffer, sizeof(buffer), "%" Pd64 "", value);
-  } else if (receiver->IsFloat64()) {
-    double value = static_cast<Float64>(receiver)->value();
-    length = DoubleToCStringAsShortest(value, buffer, sizeof(buffer));
-  } else if (receiver->IsLargeInteger()) {
+  intptr_t length = PrintNumber(receiver, buffer, sizeof(buffer));
+  if (length < 0) {
+    if (!receiver->IsLargeInteger()) {
+      UNIMPLEMENTED();
+    }
     LargeInteger large = static_cast<LargeInteger>(receiver);
     String result = LargeInteger::PrintString(large, H);  // SAFEPOINT
     RETURN(result);
-  } else {
-    UNIMPLEMENTED();
   }
-  ASSERT(length < 64);
 
   String result = H->AllocateString(length);  // SAFEPOINT
   memcpy(result->element_addr(0), buffer, length);
@@ -2216,6 +3098,140 @@ DEFINE_PRIMITIVE(Number_asString) {
 }
 
 
+// A StringBuilder keeps its size in slot 0 and its contents in a ByteArray in
+// slot 1. Answers the contents, grown if needed to hold 'length' more bytes,
+// or nullptr if the slots do not have the expected shape. The builder is
+// reloaded from its stack slot because growing can move it.
+static ByteArray ReserveStringBuilder(Heap* H, Interpreter* I,
+                                      intptr_t builder_depth,
+                                      intptr_t length) {
+  RegularObject builder = static_cast<RegularObject>(I->Stack(builder_depth));
+  ASSERT(builder->IsRegularObject());
+  Object size = builder->slot(0);
+  Object data = builder->slot(1);
+  if (!size->IsSmallInteger() || !data->IsByteArray()) {
+    return static_cast<ByteArray>(nullptr);
+  }
+  intptr_t used = static_cast<SmallInteger>(size)->value();
+  intptr_t capacity = static_cast<ByteArray>(data)->Size();
+  if ((used < 0) || (used > capacity)) {
+    return static_cast<ByteArray>(nullptr);
+  }
+  if (length <= capacity - used) {
+    return static_cast<ByteArray>(data);
+  }
+
+  intptr_t new_capacity = (capacity + (capacity >> 1)) | 7;
+  if (new_capacity < used + length) {
+    new_capacity = used + length;
+  }
+  ByteArray new_data = H->AllocateByteArray(new_capacity);  // SAFEPOINT
+  builder = static_cast<RegularObject>(I->Stack(builder_depth));
+  data = builder->slot(1);
+  memcpy(new_data->element_addr(0),
+         static_cast<ByteArray>(data)->element_addr(0), used);
+  memset(new_data->element_addr(used), 0, new_capacity - used);
+  builder->set_slot(1, new_data);
+  return new_data;
+}
+
+
+static void GrowStringBuilder(RegularObject builder, intptr_t length) {
+  intptr_t used = static_cast<SmallInteger>(builder->slot(0))->value();
+  builder->set_slot(0, SmallInteger::New(used + length), kNoBarrier);
+}
+
+
+DEFINE_PRIMITIVE(StringBuilder_add) {
+  ASSERT(num_args == 1);
+  Bytes bytes = static_cast<Bytes>(I->Stack(0));
+  if (!bytes->IsBytes()) {
+    return kFailure;
+  }
+  intptr_t length = bytes->Size();
+  ByteArray data = ReserveStringBuilder(H, I, 1, length);  // SAFEPOINT
+  if (data == nullptr) {
+    return kFailure;
+  }
+  RegularObject builder = static_cast<RegularObject>(I->Stack(1));
+  bytes = static_cast<Bytes>(I->Stack(0));
+  intptr_t used = static_cast<SmallInteger>(builder->slot(0))->value();
+  memcpy(data->element_addr(used), bytes->element_addr(0), length);
+  GrowStringBuilder(builder, length);
+  RETURN(bytes);
+}
+
+
+DEFINE_PRIMITIVE(StringBuilder_addByte) {
+  ASSERT(num_args == 1);
+  Object byte = I->Stack(0);
+  if (!byte->IsSmallInteger()) {
+    return kFailure;
+  }
+  intptr_t value = static_cast<SmallInteger>(byte)->value();
+  if ((value < 0) || (value > 255)) {
+    return kFailure;
+  }
+  ByteArray data = ReserveStringBuilder(H, I, 1, 1);  // SAFEPOINT
+  if (data == nullptr) {
+    return kFailure;
+  }
+  RegularObject builder = static_cast<RegularObject>(I->Stack(1));
+  intptr_t used = static_cast<SmallInteger>(builder->slot(0))->value();
+  *data->element_addr(used) = value;
+  GrowStringBuilder(builder, 1);
+  RETURN(byte);
+}
+
+
+DEFINE_PRIMITIVE(StringBuilder_print) {
+  ASSERT(num_args == 1);
+  char buffer[64];
+  intptr_t length = PrintNumber(I->Stack(0), buffer, sizeof(buffer));
+  if (length < 0) {
+    return kFailure;
+  }
+  ByteArray data = ReserveStringBuilder(H, I, 1, length);  // SAFEPOINT
+  if (data == nullptr) {
+    return kFailure;
+  }
+  RegularObject builder = static_cast<RegularObject>(I->Stack(1));
+  intptr_t used = static_cast<SmallInteger>(builder->slot(0))->value();
+  memcpy(data->element_addr(used), buffer, length);
+  GrowStringBuilder(builder, length);
+  RETURN(I->Stack(0));
+}
+
+
+DEFINE_PRIMITIVE(String_concatenate) {
+  ASSERT(num_args == 1);
+  Array strings = static_cast<Array>(I->Stack(0));
+  if (!strings->IsArray()) {
+    return kFailure;
+  }
+  intptr_t count = strings->Size();
+  intptr_t length = 0;
+  for (intptr_t i = 0; i < count; i++) {
+    Object string = strings->element(i);
+    if (!string->IsString()) {
+      return kFailure;
+    }
+    length += static_cast<String>(string)->Size();
+  }
+
+  String result = H->AllocateString(length);  // SAFEPOINT
+  strings = static_cast<Array>(I->Stack(0));
+  intptr_t offset = 0;
+  for (intptr_t i = 0; i < count; i++) {
+    String string = static_cast<String>(strings->element(i));
+    intptr_t size = string->Size();
+    memcpy(result->element_addr(offset), string->element_addr(0), size);
+    offset += size;
+  }
+  RETURN(result);
+}
+
+
 DEFINE_PRIMITIVE(Closure_ensure) {
   // This is a marker primitive checked on non-local return.
   return kFailure;
@@ -2237,16 +3253,16 @@ DEFINE_PRIMITIVE(String_equals) {
   if (left->size() != right->size()) {
     RETURN_BOOL(false);
   }
-  if (left->EnsureHash(I->isolate()) != right->EnsureHash(I->isolate())) {
+  // Only use hashes that are already cached: computing them reads both
+  // strings in full, which is no cheaper than comparing them.
+  intptr_t left_hash = left->header_hash();
+  intptr_t right_hash = right->header_hash();
+  if ((left_hash != 0) && (right_hash != 0) && (left_hash != right_hash)) {
     RETURN_BOOL(false);
   }
   intptr_t length = left->Size();
-  for (intptr_t i = 0; i < length; i++) {
-    if (left->element(i) != right->element(i)) {
-      RETURN_BOOL(false);
-    }
-  }
-  RETURN_BOOL(true);
+  RETURN_BOOL(memcmp(left->element_addr(0), right->element_addr(0),
+                     length) == 0);
 }
 
 
@@ -2288,12 +3304,8 @@ DEFINE_PRIMITIVE(Bytes_startsWith) {
   if (prefix_length > string_length) {
     RETURN_BOOL(false);
   }
-  for (intptr_t i = 0; i < prefix_length; i++) {
-    if (string->element(i) != prefix->element(i)) {
-      RETURN_BOOL(false);
-    }
-  }
-  RETURN_BOOL(true);
+  RETURN_BOOL(memcmp(string->element_addr(0), prefix->element_addr(0),
+                     prefix_length) == 0);
 }
 
 
@@ -2311,13 +3323,53 @@ DEFINE_PRIMITIVE(Bytes_endsWith) {
     RETURN_BOOL(false);
   }
   intptr_t offset = string_length - suffix_length;
-  for (intptr_t i = 0; i < suffix_length; i++) {
-    if (string->element(offset + i) != suffix->element(i)) {
-      RETURN_BOOL(false);
+  RETURN_BOOL(memcmp(string->element_addr(offset), suffix->element_addr(0),
+                     suffix_length) == 0);
+}
+
+
+// Candidate positions are found with memchr on the first byte and confirmed
+// with memcmp. Both are vectorized by the C library, which selects an
+// SSE2/AVX2 or NEON implementation for the running CPU. Answers the 0-based
+// position of the first match in [start, limit], or -1.
+static intptr_t IndexOfBytes(const uint8_t* string, intptr_t limit,
+                             const uint8_t* substring, intptr_t length,
+                             intptr_t start) {
+  if (length == 0) {
+    return start <= limit ? start : -1;
+  }
+  uint8_t first = substring[0];
+  while (start <= limit) {
+    const uint8_t* candidate = static_cast<const uint8_t*>(
+        memchr(&string[start], first, limit - start + 1));
+    if (candidate == nullptr) {
+      return -1;
+    }
+    if (memcmp(candidate + 1, substring + 1, length - 1) == 0) {
+      return candidate - string;
     }
+    start = (candidate - string) + 1;
   }
+  return -1;
+}
+
 
-  RETURN_BOOL(true);
+// Answers the 0-based position of the last match in [0, limit], or -1.
+static intptr_t LastIndexOfBytes(const uint8_t* string, intptr_t limit,
+                                 const uint8_t* substring, intptr_t length) {
+  if (length == 0) {
+    return limit;
+  }
+  uint8_t first = substring[0];
+  uint8_t last = substring[length - 1];
+  for (intptr_t start = limit; start >= 0; start--) {
+    if ((string[start] == first) &&
+        (string[start + length - 1] == last) &&
+        (memcmp(&string[start], substring, length) == 0)) {
+      return start;
+    }
+  }
+  return -1;
 }
 
 
@@ -2352,19 +3404,9 @@ DEFINE_PRIMITIVE(Bytes_indexOf) {
   }
 
   intptr_t limit = string_length - substring_length;
-  for (intptr_t start = start_index; start <= limit; start++) {
-    bool found = true;
-    for (intptr_t i = 0; i < substring_length; i++) {
-      if (string->element(start + i) != substring->element(i)) {
-        found = false;
-        break;
-      }
-    }
-    if (found) {
-      RETURN_SMI(start + 1);
-    }
-  }
-  RETURN_SMI(static_cast<intptr_t>(0));
+  RETURN_SMI(IndexOfBytes(string->element_addr(0), limit,
+                          substring->element_addr(0), substring_length,
+                          start_index) + 1);
 }
 
 
@@ -2402,18 +3444,9 @@ DEFINE_PRIMITIVE(Bytes_lastIndexOf) {
   if (limit > start_index) {
     limit = start_index;
   }
-  for (intptr_t start = limit; start >= 0; start--) {
-    bool found = true;
-    for (intptr_t i = 0; i < substring_length; i++) {
-      if (string->element(start + i) != substring->element(i)) {
-        found = false;
-      }
-    }
-    if (found) {
-      RETURN_SMI(start + 1);
-    }
-  }
-  RETURN_SMI(static_cast<intptr_t>(0));
+  RETURN_SMI(LastIndexOfBytes(string->element_addr(0), limit,
+                              substring->element_addr(0), substring_length) +
+             1);
 }
 
 
@@ -2576,8 +3609,9 @@ DEFINE_PRIMITIVE(writeBytesToFile) {
   memcpy(raw_filename, filename->element_addr(0), filename->Size());
   raw_filename[filename->Size()] = 0;
   FILE* f = fopen(raw_filename, "wb");
+  free(raw_filename);
   if (f == NULL) {
-    FATAL1("Cannot open %s\n", raw_filename);
+    return kFailure;
   }
 
   size_t length = content->Size();
@@ -2585,14 +3619,14 @@ DEFINE_PRIMITIVE(writeBytesToFile) {
   while (start != length) {
     size_t written = fwrite(content->element_addr(start), 1, length - start, f);
     if (written == 0) {
-      FATAL1("Failed to write '%s'\n", raw_filename);
+      fclose(f);
+      return kFailure;
     }
     start += written;
   }
-  fflush(f);
-  fclose(f);
-
-  free(raw_filename);
+  if (fclose(f) != 0) {
+    return kFailure;
+  }
 
   RETURN_SELF();
 }
@@ -2609,12 +3643,14 @@ DEFINE_PRIMITIVE(readFileAsBytes) {
   memcpy(raw_filename, filename->element_addr(0), filename->Size());
   raw_filename[filename->Size()] = 0;
   FILE* f = fopen(raw_filename, "rb");
+  free(raw_filename);
   if (f == NULL) {
-    FATAL1("Failed to stat '%s'\n", raw_filename);
+    return kFailure;
   }
   struct stat st;
   if (fstat(fileno(f), &st) != 0) {
-    FATAL1("Failed to stat '%s'\n", raw_filename);
+    fclose(f);
+    return kFailure;
   }
   size_t length = st.st_size;
 
@@ -2624,14 +3660,16 @@ DEFINE_PRIMITIVE(readFileAsBytes) {
   while (remaining > 0) {
     size_t bytes_read = fread(result->element_addr(start), 1, remaining, f);
     if (bytes_read == 0) {
-      FATAL1("Failed to read '%s'\n", raw_filename);
+      // The file shrank or could not be read. The partially filled result is
+      // garbage.
+      fclose(f);
+      return kFailure;
     }
     start += bytes_read;
     remaining -= bytes_read;
   }
 
   fclose(f);
-  free(raw_filename);
 
   RETURN(result);
 }
@@ -2848,6 +3886,345 @@ DEFINE_PRIMITIVE(MessageLoop_cancelSignalWait) {
   RETURN_SELF();
 }
 
+#if defined(OS_EMSCRIPTEN) || defined(OS_WINDOWS)
+#define FILE_IO_UNSUPPORTED 1
+#endif
+
+DEFINE_PRIMITIVE(File_open) {
+#if defined(FILE_IO_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 2);
+  String path = static_cast<String>(I->Stack(1));
+  SMI_ARGUMENT(flags, 0);
+  if (!path->IsString() ||
+      flags < FileIO::kRead || flags > FileIO::kReadWrite) {
+    return kFailure;
+  }
+  intptr_t handle = FileIO::Open(I->isolate()->loop(),
+                                 path->element_addr(0), path->Size(), flags);
+  RETURN_SMI(handle);
+#endif
+}
+
+DEFINE_PRIMITIVE(File_close) {
+#if defined(FILE_IO_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 1);
+  SMI_ARGUMENT(fd, 0);
+  if (fd < 0) {
+    return kFailure;
+  }
+  intptr_t handle = FileIO::Close(I->isolate()->loop(), fd);
+  RETURN_SMI(handle);
+#endif
+}
+
+DEFINE_PRIMITIVE(File_read) {
+#if defined(FILE_IO_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 3);
+  SMI_ARGUMENT(fd, 2);
+  MINT_ARGUMENT(offset, 1);
+  SMI_ARGUMENT(length, 0);
+  if (fd < 0 || offset < 0 || length <= 0) {
+    return kFailure;
+  }
+  intptr_t handle = FileIO::Read(I->isolate()->loop(), fd, offset, length);
+  RETURN_SMI(handle);
+#endif
+}
+
+DEFINE_PRIMITIVE(File_write) {
+#if defined(FILE_IO_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 5);
+  SMI_ARGUMENT(fd, 4);
+  MINT_ARGUMENT(offset, 3);
+  ByteArray bytes = static_cast<ByteArray>(I->Stack(2));
+  SMI_ARGUMENT(start, 1);
+  SMI_ARGUMENT(stop, 0);
+  if (fd < 0 || offset < 0 || !(bytes->IsByteArray() || bytes->IsString())) {
+    return kFailure;
+  }
+  if (start < 1 || stop < start - 1 || stop > bytes->Size()) {
+    return kFailure;
+  }
+  intptr_t handle = FileIO::Write(I->isolate()->loop(), fd, offset,
+                                  bytes->element_addr(start - 1),
+                                  stop - start + 1);
+  RETURN_SMI(handle);
+#endif
+}
+
+DEFINE_PRIMITIVE(File_stat) {
+#if defined(FILE_IO_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 1);
+  String path = static_cast<String>(I->Stack(0));
+  if (!path->IsString()) {
+    return kFailure;
+  }
+  intptr_t handle = FileIO::Stat(I->isolate()->loop(),
+                                 path->element_addr(0), path->Size());
+  RETURN_SMI(handle);
+#endif
+}
+
+DEFINE_PRIMITIVE(File_takeData) {
+  ASSERT(num_args == 1);
+  SMI_ARGUMENT(handle, 0);
+  IsolateMessage* completion = I->isolate()->loop()->TakeCompletion(handle);
+  if (completion == NULL) {
+    RETURN(nil);
+  }
+  ByteArray result = H->AllocateByteArray(completion->length());  // SAFEPOINT
+  memcpy(result->element_addr(0), completion->data(), completion->length());
+  delete completion;
+  RETURN(result);
+}
+
+DEFINE_PRIMITIVE(File_takeDataInto) {
+  ASSERT(num_args == 3);
+  SMI_ARGUMENT(handle, 2);
+  ByteArray bytes = static_cast<ByteArray>(I->Stack(1));
+  SMI_ARGUMENT(start, 0);
+  if (!bytes->IsByteArray() || start < 1) {
+    return kFailure;
+  }
+  IsolateMessage* completion = I->isolate()->loop()->TakeCompletion(handle);
+  if (completion == NULL) {
+    RETURN_SMI(0);
+  }
+  intptr_t length = completion->length();
+  if (start - 1 + length > bytes->Size()) {
+    delete completion;
+    return kFailure;
+  }
+  memcpy(bytes->element_addr(start - 1), completion->data(), length);
+  delete completion;
+  RETURN_SMI(length);
+}
+
+DEFINE_PRIMITIVE(File_errorString) {
+  ASSERT(num_args == 1);
+  SMI_ARGUMENT(error, 0);
+  const char* raw_string = strerror(error);
+  intptr_t length = strlen(raw_string);
+  String result = H->AllocateString(length);  // SAFEPOINT
+  memcpy(result->element_addr(0), raw_string, length);
+  RETURN(result);
+}
+
+DEFINE_PRIMITIVE(File_saveSnapshot) {
+#if defined(FILE_IO_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 1);
+  if (!I->Stack(0)->IsString()) {
+    return kFailure;
+  }
+  // Move the frames to the heap so suspended activations are written whole.
+  I->SetCurrentActivation(I->CurrentActivation());  // SAFEPOINT
+  String path = static_cast<String>(I->Stack(0));
+
+  Serializer serializer(H);
+  if (!serializer.Serialize(I->object_store())) {
+    return kFailure;
+  }
+  intptr_t length = serializer.length();
+  intptr_t handle = FileIO::Save(I->isolate()->loop(),
+                                 path->element_addr(0), path->Size(),
+                                 serializer.TakeBytes(), length);
+  RETURN_SMI(handle);
+#endif
+}
+
+#if !defined(OS_ANDROID) && !defined(OS_LINUX) && !defined(OS_MACOS)
+#define SOCKETS_UNSUPPORTED 1
+#else
+static char* NewCString(String string) {
+  char* result = reinterpret_cast<char*>(malloc(string->Size() + 1));
+  memcpy(result, string->element_addr(0), string->Size());
+  result[string->Size()] = 0;
+  return result;
+}
+#endif
+
+DEFINE_PRIMITIVE(Socket_listenTCP) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 3);
+  String host = static_cast<String>(I->Stack(2));
+  SMI_ARGUMENT(port, 1);
+  SMI_ARGUMENT(backlog, 0);
+  if (!host->IsString()) {
+    return kFailure;
+  }
+  char* raw_host = NewCString(host);
+  intptr_t result = Socket::ListenTCP(raw_host, port, backlog);
+  free(raw_host);
+  RETURN_SMI(result);
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_listenUnix) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 2);
+  String path = static_cast<String>(I->Stack(1));
+  SMI_ARGUMENT(backlog, 0);
+  if (!path->IsString()) {
+    return kFailure;
+  }
+  char* raw_path = NewCString(path);
+  intptr_t result = Socket::ListenUnix(raw_path, backlog);
+  free(raw_path);
+  RETURN_SMI(result);
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_connectTCP) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 2);
+  String host = static_cast<String>(I->Stack(1));
+  SMI_ARGUMENT(port, 0);
+  if (!host->IsString()) {
+    return kFailure;
+  }
+  char* raw_host = NewCString(host);
+  intptr_t result = Socket::ConnectTCP(raw_host, port);
+  free(raw_host);
+  RETURN_SMI(result);
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_connectUnix) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 1);
+  String path = static_cast<String>(I->Stack(0));
+  if (!path->IsString()) {
+    return kFailure;
+  }
+  char* raw_path = NewCString(path);
+  intptr_t result = Socket::ConnectUnix(raw_path);
+  free(raw_path);
+  RETURN_SMI(result);
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_accept) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 2);
+  SMI_ARGUMENT(fd, 1);
+  Array fds = static_cast<Array>(I->Stack(0));
+  if (!fds->IsArray() || fds->Size() == 0) {
+    return kFailure;
+  }
+  static const intptr_t kMaxAccepts = 64;
+  intptr_t accepted[kMaxAccepts];
+  intptr_t length = fds->Size() < kMaxAccepts ? fds->Size() : kMaxAccepts;
+  intptr_t result = Socket::Accept(fd, accepted, length);
+  if (result == Socket::kWouldBlock) {
+    RETURN(nil);
+  }
+  for (intptr_t i = 0; i < result; i++) {
+    fds->set_element(i, SmallInteger::New(accepted[i]), kNoBarrier);
+  }
+  RETURN_SMI(result);
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_read) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 4);
+  SMI_ARGUMENT(fd, 3);
+  ByteArray bytes = static_cast<ByteArray>(I->Stack(2));
+  SMI_ARGUMENT(start, 1);
+  SMI_ARGUMENT(stop, 0);
+  if (!bytes->IsByteArray() ||
+      start < 1 || stop < start || stop > bytes->Size()) {
+    return kFailure;
+  }
+  intptr_t result = Socket::Read(fd, bytes->element_addr(start - 1),
+                                 stop - start + 1);
+  if (result == Socket::kWouldBlock) {
+    RETURN(nil);
+  }
+  RETURN_SMI(result);
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_write) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 4);
+  SMI_ARGUMENT(fd, 3);
+  ByteArray bytes = static_cast<ByteArray>(I->Stack(2));
+  SMI_ARGUMENT(start, 1);
+  SMI_ARGUMENT(stop, 0);
+  if (!(bytes->IsByteArray() || bytes->IsString()) ||
+      start < 1 || stop < start - 1 || stop > bytes->Size()) {
+    return kFailure;
+  }
+  intptr_t result = Socket::Write(fd, bytes->element_addr(start - 1),
+                                  stop - start + 1);
+  if (result == Socket::kWouldBlock) {
+    RETURN(nil);
+  }
+  RETURN_SMI(result);
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_close) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 1);
+  SMI_ARGUMENT(fd, 0);
+  RETURN_SMI(Socket::Close(fd));
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_pendingError) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 1);
+  SMI_ARGUMENT(fd, 0);
+  intptr_t result = Socket::PendingError(fd);
+  if (result == Socket::kWouldBlock) {
+    RETURN(nil);
+  }
+  RETURN_SMI(result);
+#endif
+}
+
+DEFINE_PRIMITIVE(Socket_localPort) {
+#if defined(SOCKETS_UNSUPPORTED)
+  return kFailure;
+#else
+  ASSERT(num_args == 1);
+  SMI_ARGUMENT(fd, 0);
+  RETURN_SMI(Socket::LocalPort(fd));
+#endif
+}
+
 #if defined(OS_FUCHSIA)
 static zx_handle_t AsHandle(SmallInteger handle) {
   return static_cast<zx_handle_t>(handle->value());
@@ -23,7 +23,11 @@ class Primitives {
   static void Shutdown();
 
   static bool IsUnwindProtect(intptr_t prim) { return prim == 113; }
+  static bool IsExceptionHandler(intptr_t prim) { return prim == 116; }
   static bool IsSimulationRoot(intptr_t prim) { return prim == 142; }
+  static bool IsClosureValue(intptr_t prim) {
+    return (prim >= 90) && (prim <= 93);
+  }
 
   static bool Invoke(intptr_t prim,
                      intptr_t num_args,
@@ -4,25 +4,240 @@
 
 #include "vm/primordial_soup.h"
 
+#include "vm/bytecode_profile.h"
 #include "vm/flags.h"
 #include "vm/globals.h"
+#include "vm/interpreter.h"
 #include "vm/isolate.h"
+#include "vm/lockers.h"
 #include "vm/message_loop.h"
 #include "vm/os.h"
 #include "vm/port.h"
 #include "vm/primitives.h"
 #include "vm/snapshot.h"
 #include "vm/thread.h"
+#include "vm/thread_pool.h"
+
+namespace psoup {
+
+// A port opened by the embedder. It sits in the PortMap in place of an
+// isolate's loop, but hands its messages to a task on the thread pool rather
+// than running them, so the handler is never called under the PortMap's lock.
+class HostPort : public MessageLoop {
+ public:
+  HostPort(PrimordialSoup_MessageHandler handler, void* context) :
+    MessageLoop(NULL),
+    handler_(handler),
+    context_(context),
+    port_(ILLEGAL_PORT),
+    head_(NULL),
+    tail_(NULL),
+    scheduled_(false),
+    closed_(false),
+    close_deferred_(false),
+    deliverer_(Thread::kInvalidThreadId),
+    next_(NULL) {
+  }
+
+  ~HostPort() {
+    while (head_ != NULL) {
+      IsolateMessage* message = head_;
+      head_ = message->next_;
+      delete message;
+    }
+  }
+
+  static void Startup();
+  static void Shutdown();
+
+  static Port Open(PrimordialSoup_MessageHandler handler, void* context);
+  static bool Close(Port port);
+
+  void PostMessage(IsolateMessage* message);
+  intptr_t AwaitSignal(intptr_t handle, intptr_t signals) {
+    UNREACHABLE();
+    return 0;
+  }
+  void CancelSignalWait(intptr_t wait_id) { UNREACHABLE(); }
+  void MessageEpilogue(int64_t new_wakeup) { UNREACHABLE(); }
+  void Exit(intptr_t exit_code) { UNREACHABLE(); }
+  intptr_t Run() {
+    UNREACHABLE();
+    return 0;
+  }
+  void Interrupt() {}
+
+ private:
+  class DeliverTask : public ThreadPool::Task {
+   public:
+    explicit DeliverTask(HostPort* port) : port_(port) {}
+    virtual void Run() { port_->Deliver(); }
+
+   private:
+    HostPort* port_;
+
+    DISALLOW_COPY_AND_ASSIGN(DeliverTask);
+  };
+
+  void Deliver();
+  void CloseAndDelete();
+
+  PrimordialSoup_MessageHandler handler_;
+  void* context_;
+  Port port_;
+
+  Monitor monitor_;
+  IsolateMessage* head_;
+  IsolateMessage* tail_;
+  bool scheduled_;  // A DeliverTask is queued or running.
+  bool closed_;
+  bool close_deferred_;  // Closed by the handler; Deliver deletes.
+  ThreadId deliverer_;
+
+  HostPort* next_;  // Protected by ports_mutex_.
+
+  static Mutex* ports_mutex_;
+  static HostPort* ports_;
+
+  DISALLOW_COPY_AND_ASSIGN(HostPort);
+};
+
+Mutex* HostPort::ports_mutex_ = NULL;
+HostPort* HostPort::ports_ = NULL;
+
+
+void HostPort::Startup() {
+  ports_mutex_ = new Mutex();
+}
+
+
+void HostPort::Shutdown() {
+  HostPort* host_ports;
+  {
+    MutexLocker ml(ports_mutex_);
+    host_ports = ports_;
+    ports_ = NULL;
+  }
+  while (host_ports != NULL) {
+    HostPort* host_port = host_ports;
+    host_ports = host_port->next_;
+    host_port->CloseAndDelete();
+  }
+  delete ports_mutex_;
+  ports_mutex_ = NULL;
+}
+
+
+Port HostPort::Open(PrimordialSoup_MessageHandler handler, void* context) {
+  HostPort* host_port = new HostPort(handler, context);
+  MutexLocker ml(ports_mutex_);
+  host_port->port_ = PortMap::CreatePort(host_port);
+  host_port->next_ = ports_;
+  ports_ = host_port;
+  return host_port->port_;
+}
+
+
+bool HostPort::Close(Port port) {
+  HostPort* host_port = NULL;
+  {
+    MutexLocker ml(ports_mutex_);
+    HostPort** link = &ports_;
+    while (*link != NULL) {
+      if ((*link)->port_ == port) {
+        host_port = *link;
+        *link = host_port->next_;
+        break;
+      }
+      link = &(*link)->next_;
+    }
+  }
+  if (host_port == NULL) {
+    return false;
+  }
+  host_port->CloseAndDelete();
+  return true;
+}
+
+
+void HostPort::CloseAndDelete() {
+  // Once removed from the PortMap, no PostMessage is in progress or to come.
+  PortMap::ClosePort(port_);
+  {
+    MonitorLocker ml(&monitor_);
+    closed_ = true;
+    if (scheduled_ &&
+        Thread::Compare(deliverer_, Thread::GetCurrentThreadId())) {
+      // Closed from the handler.
+      close_deferred_ = true;
+      return;
+    }
+    while (scheduled_) {
+      ml.Wait();
+    }
+  }
+  delete this;
+}
+
+
+void HostPort::PostMessage(IsolateMessage* message) {
+  MonitorLocker ml(&monitor_);
+  if (head_ == NULL) {
+    head_ = tail_ = message;
+  } else {
+    tail_->next_ = message;
+    tail_ = message;
+  }
+  if (!scheduled_) {
+    scheduled_ = true;
+    Isolate::thread_pool()->Run(new DeliverTask(this));
+  }
+}
+
+
+void HostPort::Deliver() {
+  bool deferred;
+  {
+    MonitorLocker ml(&monitor_);
+    deliverer_ = Thread::GetCurrentThreadId();
+    while (!closed_ && (head_ != NULL)) {
+      IsolateMessage* message = head_;
+      head_ = message->next_;
+      if (head_ == NULL) {
+        tail_ = NULL;
+      }
+      ml.Exit();
+      handler_(port_, message->data(), message->length(), context_);
+      delete message;
+      ml.Enter();
+    }
+    deliverer_ = Thread::kInvalidThreadId;
+    scheduled_ = false;
+    deferred = close_deferred_;
+    ml.NotifyAll();
+  }
+  if (deferred) {
+    delete this;
+  }
+}
+
+}  // namespace psoup
+
 
 PSOUP_EXTERN_C void PrimordialSoup_Startup() {
   psoup::OS::Startup();
+  if (PROFILE_BYTECODES) {
+    psoup::BytecodeProfile::Startup();
+  }
   psoup::Primitives::Startup();
   psoup::PortMap::Startup();
   psoup::Isolate::Startup();
+  psoup::HostPort::Startup();
 }
 
 
 PSOUP_EXTERN_C void PrimordialSoup_Shutdown() {
+  psoup::HostPort::Shutdown();
   psoup::Isolate::Shutdown();
   psoup::PortMap::Shutdown();
   psoup::Primitives::Shutdown();
@@ -36,6 +251,7 @@ PSOUP_EXTERN_C intptr_t PrimordialSoup_RunIsolate(void* snapshot,
                                                   const char** argv) {
   uint64_t seed = psoup::OS::CurrentMonotonicNanos();
   psoup::Isolate* isolate = new psoup::Isolate(snapshot, snapshot_length, seed);
+  psoup::Isolate::FillPool(snapshot, snapshot_length);
   isolate->loop()->PostMessage(new psoup::IsolateMessage(ILLEGAL_PORT,
                                                          argc, argv));
   intptr_t exit_code = isolate->loop()->Run();
@@ -47,3 +263,64 @@ PSOUP_EXTERN_C intptr_t PrimordialSoup_RunIsolate(void* snapshot,
 PSOUP_EXTERN_C void PrimordialSoup_InterruptAll() {
   psoup::Isolate::InterruptAll();
 }
+
+
+PSOUP_EXTERN_C void PrimordialSoup_SetStackSize(size_t stack_size) {
+  psoup::Interpreter::set_stack_size(stack_size);
+}
+
+
+PSOUP_EXTERN_C void PrimordialSoup_SetIsolatePool(size_t size,
+                                                  size_t refill_below) {
+  if (refill_below > size) {
+    refill_below = size;
+  }
+  psoup::Isolate::ConfigurePool(size, refill_below);
+}
+
+
+PSOUP_EXTERN_C PrimordialSoup_Isolate PrimordialSoup_CreateIsolate(
+    void* snapshot, size_t snapshot_length, int argc, const char** argv) {
+  return psoup::Isolate::CreateForHost(snapshot, snapshot_length, argc, argv);
+}
+
+
+PSOUP_EXTERN_C int PrimordialSoup_DestroyIsolate(
+    PrimordialSoup_Isolate isolate) {
+  return psoup::Isolate::TerminateForHost(isolate) ? 1 : 0;
+}
+
+
+PSOUP_EXTERN_C int PrimordialSoup_GetIsolateStats(
+    PrimordialSoup_Isolate isolate, PrimordialSoup_IsolateStats* stats) {
+  psoup::IsolateStats result;
+  if (!psoup::Isolate::StatsForHost(isolate, &result)) {
+    return 0;
+  }
+  stats->heap_size = result.heap_size;
+  stats->messages = result.messages;
+  stats->turns = result.turns;
+  return 1;
+}
+
+
+PSOUP_EXTERN_C PrimordialSoup_Port PrimordialSoup_OpenPort(
+    PrimordialSoup_MessageHandler handler, void* context) {
+  return psoup::HostPort::Open(handler, context);
+}
+
+
+PSOUP_EXTERN_C int PrimordialSoup_ClosePort(PrimordialSoup_Port port) {
+  return psoup::HostPort::Close(port) ? 1 : 0;
+}
+
+
+PSOUP_EXTERN_C int PrimordialSoup_PostMessage(PrimordialSoup_Port port,
+                                              const uint8_t* data,
+                                              size_t length) {
+  uint8_t* copy = reinterpret_cast<uint8_t*>(malloc(length));
+  memcpy(copy, data, length);
+  psoup::IsolateMessage* message =
+      new psoup::IsolateMessage(port, copy, length);
+  return psoup::PortMap::PostMessage(message) ? 1 : 0;
+}
@@ -22,5 +22,70 @@ PSOUP_EXTERN_C intptr_t PrimordialSoup_RunIsolate(void* snapshot,
                                                   size_t snapshot_length,
                                                   int argc, const char** argv);
 PSOUP_EXTERN_C void PrimordialSoup_InterruptAll();
+/* Sets the interpreter stack size of isolates created afterwards. */
+PSOUP_EXTERN_C void PrimordialSoup_SetStackSize(size_t stack_size);
+/*
+ * Keeps up to size isolates per snapshot deserialized and waiting to be
+ * spawned, constructing more in the background once fewer than refill_below
+ * are left. Call after PrimordialSoup_Startup. A size of 0 disables the pool.
+ */
+PSOUP_EXTERN_C void PrimordialSoup_SetIsolatePool(size_t size,
+                                                  size_t refill_below);
+
+/*
+ * Embedding. Between Startup and Shutdown, a host may run isolates alongside
+ * its own threads and exchange messages with them through ports. Message data
+ * is passed through as bytes: an isolate port with deliversBytes set hands
+ * each message to its handler as a ByteArray, and an isolate sends bytes to a
+ * host port with Port sendBytes:. The format is up to the host and the image.
+ */
+typedef int64_t PrimordialSoup_Port;
+typedef int64_t PrimordialSoup_Isolate;
+
+typedef struct {
+  intptr_t heap_size;  /* As of the end of the last turn. */
+  int64_t messages;
+  int64_t turns;
+} PrimordialSoup_IsolateStats;
+
+/*
+ * Called with each message sent to a host port. Messages to one port are
+ * handled in order, one at a time, on a VM thread; the data is only valid for
+ * the duration of the call. The handler may post messages.
+ */
+typedef void (*PrimordialSoup_MessageHandler)(PrimordialSoup_Port port,
+                                              const uint8_t* data,
+                                              size_t length,
+                                              void* context);
+
+/*
+ * Starts an isolate on a VM thread and returns without waiting for it. The
+ * isolate receives copies of argv as the args of main:args:, as from the
+ * command line, which is typically where a host passes the port of its reply
+ * handler. The snapshot must outlive the isolate.
+ */
+PSOUP_EXTERN_C PrimordialSoup_Isolate PrimordialSoup_CreateIsolate(
+    void* snapshot, size_t snapshot_length, int argc, const char** argv);
+/*
+ * Asks the isolate to exit once its current turn ends. Answers 0 if it has
+ * already exited.
+ */
+PSOUP_EXTERN_C int PrimordialSoup_DestroyIsolate(
+    PrimordialSoup_Isolate isolate);
+/* Answers 0 if the isolate has exited. */
+PSOUP_EXTERN_C int PrimordialSoup_GetIsolateStats(
+    PrimordialSoup_Isolate isolate, PrimordialSoup_IsolateStats* stats);
+
+PSOUP_EXTERN_C PrimordialSoup_Port PrimordialSoup_OpenPort(
+    PrimordialSoup_MessageHandler handler, void* context);
+/* Once this returns, the port's handler is not called again. */
+PSOUP_EXTERN_C int PrimordialSoup_ClosePort(PrimordialSoup_Port port);
+/*
+ * Sends a copy of data to a port of an isolate or of the host. May be called
+ * from any thread. Answers 0 if the port is closed.
+ */
+PSOUP_EXTERN_C int PrimordialSoup_PostMessage(PrimordialSoup_Port port,
+                                              const uint8_t* data,
+                                              size_t length);
 
 #endif /* VM_PRIMORDIAL_SOUP_H_ */
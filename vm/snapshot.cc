@@ -4,8 +4,12 @@
 
 #include "vm/snapshot.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "vm/heap.h"
 #include "vm/interpreter.h"
+#include "vm/isolate.h"
 #include "vm/object.h"
 #include "vm/os.h"
 
@@ -19,6 +23,7 @@ class Cluster {
 
   virtual void ReadNodes(Deserializer* d, Heap* h) = 0;
   virtual void ReadEdges(Deserializer* d, Heap* h) = 0;
+  virtual void PostLoad(Deserializer* d, Heap* h) {}
 
  protected:
   intptr_t ref_start_;
@@ -111,6 +116,18 @@ class StringCluster : public Cluster {
   }
 
   void ReadEdges(Deserializer* d, Heap* h) {}
+
+  void PostLoad(Deserializer* d, Heap* h) {
+    // Selectors and symbols are hashed by nearly every map lookup. This waits
+    // until a checkpoint's salt has been restored, and the range is the
+    // canonical strings because they are read last.
+    Isolate* isolate = h->interpreter()->isolate();
+    for (intptr_t i = ref_start_; i < ref_stop_; i++) {
+      String object = static_cast<String>(d->Ref(i));
+      ASSERT(object->is_canonical());
+      object->EnsureHash(isolate);
+    }
+  }
 };
 
 class ArrayCluster : public Cluster {
@@ -244,6 +261,56 @@ class ActivationCluster : public Cluster {
   }
 };
 
+class Float64Cluster : public Cluster {
+ public:
+  Float64Cluster() {}
+  ~Float64Cluster() {}
+
+  void ReadNodes(Deserializer* d, Heap* h) {
+    intptr_t num_objects = d->ReadUnsigned();
+    ref_start_ = d->next_ref();
+    ref_stop_ = ref_start_ + num_objects;
+    for (intptr_t i = 0; i < num_objects; i++) {
+      Float64 object = h->AllocateFloat64(Heap::kSnapshot);
+      object->set_value(bit_cast<double>(d->ReadInt64()));
+      d->RegisterRef(object);
+    }
+    ASSERT(d->next_ref() == ref_stop_);
+  }
+
+  void ReadEdges(Deserializer* d, Heap* h) {}
+};
+
+class EphemeronCluster : public Cluster {
+ public:
+  EphemeronCluster() {}
+  ~EphemeronCluster() {}
+
+  void ReadNodes(Deserializer* d, Heap* h) {
+    intptr_t num_objects = d->ReadUnsigned();
+    ref_start_ = d->next_ref();
+    ref_stop_ = ref_start_ + num_objects;
+    for (intptr_t i = 0; i < num_objects; i++) {
+      Object object = h->AllocateRegularObject(kEphemeronCid, 3,
+                                               Heap::kSnapshot);
+      d->RegisterRef(object);
+    }
+    ASSERT(d->next_ref() == ref_stop_);
+  }
+
+  void ReadEdges(Deserializer* d, Heap* h) {
+    d->ReadRef();  // Class, registered from the object store.
+
+    for (intptr_t i = ref_start_; i < ref_stop_; i++) {
+      Ephemeron object = static_cast<Ephemeron>(d->Ref(i));
+      ASSERT(object->IsEphemeron());
+      object->set_key(d->ReadRef(), kNoBarrier);
+      object->set_value(d->ReadRef(), kNoBarrier);
+      object->set_finalizer(d->ReadRef(), kNoBarrier);
+    }
+  }
+};
+
 class SmallIntegerCluster : public Cluster {
  public:
   SmallIntegerCluster() {}
@@ -365,6 +432,12 @@ void Deserializer::Deserialize() {
   }
 
   ObjectStore os = static_cast<ObjectStore>(ReadRef());
+  if (position() < snapshot_length_) {
+    ReadHashes();
+  }
+  for (intptr_t i = 0; i < num_clusters_; i++) {
+    clusters_[i]->PostLoad(this, heap_);
+  }
 
   heap_->RegisterClass(kSmiCid, os->SmallInteger());
   heap_->RegisterClass(kMintCid, os->MediumInteger());
@@ -493,6 +566,20 @@ intptr_t Deserializer::ReadUnsigned() {
 }
 
 
+// Checkpoints written by the VM end with the hash salt and the identity and
+// string hashes already handed out, which hashed collections in the heap
+// depend on.
+void Deserializer::ReadHashes() {
+  Isolate* isolate = heap_->interpreter()->isolate();
+  isolate->set_salt(static_cast<uintptr_t>(ReadInt64()));
+  intptr_t num_hashes = ReadUnsigned();
+  for (intptr_t i = 0; i < num_hashes; i++) {
+    HeapObject object = static_cast<HeapObject>(ReadRef());
+    object->set_header_hash(ReadInt64());
+  }
+}
+
+
 Cluster* Deserializer::ReadCluster() {
   intptr_t format = ReadInt32();
 
@@ -507,10 +594,879 @@ Cluster* Deserializer::ReadCluster() {
       case kClosureCid: return new ClosureCluster();
       case kActivationCid: return new ActivationCluster();
       case kSmiCid: return new SmallIntegerCluster();
+      case kFloat64Cid: return new Float64Cluster();
+      case kEphemeronCid: return new EphemeronCluster();
     }
     FATAL1("Unknown cluster format %" Pd "\n", format);
     return NULL;
   }
 }
 
+// Slot of a Behavior holding its class id, which is only meaningful to the
+// heap that assigned it.
+static const intptr_t kClassIdSlot = 4;
+
+static const uword kNoKey = ~static_cast<uword>(0);  // Not a valid object.
+
+static inline intptr_t HashObject(uword key, intptr_t mask) {
+  // Fibonacci hashing; the low bits of addresses are alignment.
+  uint64_t hash = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL;
+  return static_cast<intptr_t>(hash ^ (hash >> 32)) & mask;
+}
+
+
+static void* GrowArray(void* array, intptr_t* capacity,
+                       intptr_t element_size) {
+  intptr_t new_capacity = (*capacity == 0) ? 64 : (*capacity * 2);
+  void* result = realloc(array, new_capacity * element_size);
+  if (result == NULL) {
+    FATAL("Out of memory");
+  }
+  *capacity = new_capacity;
+  return result;
+}
+
+class ObjectList {
+ public:
+  ObjectList() : objects_(NULL), length_(0), capacity_(0) {}
+  ~ObjectList() { free(objects_); }
+
+  void Add(Object object) {
+    if (length_ == capacity_) {
+      objects_ = reinterpret_cast<Object*>(
+          GrowArray(objects_, &capacity_, sizeof(Object)));
+    }
+    objects_[length_++] = object;
+  }
+
+  intptr_t length() const { return length_; }
+  Object At(intptr_t index) const { return objects_[index]; }
+  void Set(intptr_t index, Object object) { objects_[index] = object; }
+  void Truncate(intptr_t length) { length_ = length; }
+
+ private:
+  Object* objects_;
+  intptr_t length_;
+  intptr_t capacity_;
+
+  DISALLOW_COPY_AND_ASSIGN(ObjectList);
+};
+
+class SerializationCluster {
+ public:
+  SerializationCluster() {}
+  virtual ~SerializationCluster() {}
+
+  virtual void Trace(Serializer* s, Object object) = 0;
+  virtual void WriteNodes(Serializer* s) = 0;
+  virtual void WriteEdges(Serializer* s) = 0;
+
+  // Answers true if anything newly became reachable.
+  virtual bool TraceDeferred(Serializer* s) { return false; }
+
+ protected:
+  ObjectList objects_;
+};
+
+class RegularObjectSerializationCluster : public SerializationCluster {
+ public:
+  RegularObjectSerializationCluster(Heap* heap, intptr_t cid)
+      : heap_(heap), cls_(heap->ClassAt(cid)),
+        format_(heap->ClassAt(cid)->format()->value()) {}
+
+  void Trace(Serializer* s, Object object) {
+    objects_.Add(object);
+    RegularObject regular = static_cast<RegularObject>(object);
+    bool is_behavior = IsBehavior(regular);
+    for (intptr_t j = 0; j < format_; j++) {
+      if (!is_behavior || (j != kClassIdSlot)) {
+        s->Push(regular->slot(j));
+      }
+    }
+  }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(format_);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      s->RegisterRef(objects_.At(i));
+    }
+  }
+
+  void WriteEdges(Serializer* s) {
+    s->WriteRef(cls_);
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      RegularObject regular = static_cast<RegularObject>(objects_.At(i));
+      bool is_behavior = IsBehavior(regular);
+      for (intptr_t j = 0; j < format_; j++) {
+        if (is_behavior && (j == kClassIdSlot)) {
+          s->WriteRef(s->nil());  // Reassigned when read.
+        } else {
+          s->WriteRef(regular->slot(j));
+        }
+      }
+    }
+  }
+
+ private:
+  // Only registered classes have ids to erase.
+  bool IsBehavior(RegularObject object) {
+    if (format_ <= kClassIdSlot) {
+      return false;
+    }
+    Object id = object->slot(kClassIdSlot);
+    if (!id->IsSmallInteger()) {
+      return false;
+    }
+    intptr_t cid = static_cast<SmallInteger>(id)->value();
+    return (cid >= kFirstLegalCid) && (cid < heap_->class_table_size()) &&
+        (heap_->ClassAt(cid) == object);
+  }
+
+  Heap* const heap_;
+  const Behavior cls_;
+  const intptr_t format_;
+};
+
+class IntegerSerializationCluster : public SerializationCluster {
+ public:
+  IntegerSerializationCluster() {}
+
+  void Trace(Serializer* s, Object object) {
+    if (object->IsLargeInteger()) {
+      LargeInteger large = static_cast<LargeInteger>(object);
+      if ((large->size() * static_cast<intptr_t>(sizeof(digit_t))) > 0xFFFF) {
+        s->Fail();
+      }
+      large_.Add(object);
+    } else {
+      objects_.Add(object);
+    }
+  }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kSmiCid);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      Object object = objects_.At(i);
+      if (object->IsSmallInteger()) {
+        s->WriteInt64(static_cast<SmallInteger>(object)->value());
+      } else {
+        s->WriteInt64(static_cast<MediumInteger>(object)->value());
+      }
+      s->RegisterRef(object);
+    }
+
+    s->WriteUnsigned(large_.length());
+    for (intptr_t i = 0; i < large_.length(); i++) {
+      LargeInteger object = static_cast<LargeInteger>(large_.At(i));
+      intptr_t digits = object->size();
+      s->WriteUint8(object->negative() ? 1 : 0);
+      s->WriteUint16(digits * sizeof(digit_t));
+      for (intptr_t j = 0; j < digits; j++) {
+        digit_t digit = object->digit(j);
+        for (intptr_t shift = 0;
+             shift < static_cast<intptr_t>(kDigitBits);
+             shift += 8) {
+          s->WriteUint8(static_cast<uint8_t>(digit >> shift));
+        }
+      }
+      s->RegisterRef(object);
+    }
+  }
+
+  void WriteEdges(Serializer* s) {}
+
+ private:
+  ObjectList large_;
+};
+
+class Float64SerializationCluster : public SerializationCluster {
+ public:
+  Float64SerializationCluster() {}
+
+  void Trace(Serializer* s, Object object) { objects_.Add(object); }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kFloat64Cid);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      Float64 object = static_cast<Float64>(objects_.At(i));
+      s->WriteInt64(bit_cast<int64_t>(object->value()));
+      s->RegisterRef(object);
+    }
+  }
+
+  void WriteEdges(Serializer* s) {}
+};
+
+class ByteArraySerializationCluster : public SerializationCluster {
+ public:
+  ByteArraySerializationCluster() {}
+
+  void Trace(Serializer* s, Object object) { objects_.Add(object); }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kByteArrayCid);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      ByteArray object = static_cast<ByteArray>(objects_.At(i));
+      s->WriteUnsigned(object->Size());
+      s->WriteBytes(object->element_addr(0), object->Size());
+      s->RegisterRef(object);
+    }
+  }
+
+  void WriteEdges(Serializer* s) {}
+};
+
+class StringSerializationCluster : public SerializationCluster {
+ public:
+  StringSerializationCluster() {}
+
+  void Trace(Serializer* s, Object object) {
+    if (static_cast<String>(object)->is_canonical()) {
+      canonical_.Add(object);
+    } else {
+      objects_.Add(object);
+    }
+  }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kStringCid);
+    WriteNodes(s, &objects_);
+    WriteNodes(s, &canonical_);
+  }
+
+  void WriteNodes(Serializer* s, ObjectList* list) {
+    s->WriteUnsigned(list->length());
+    for (intptr_t i = 0; i < list->length(); i++) {
+      String object = static_cast<String>(list->At(i));
+      s->WriteUnsigned(object->Size());
+      s->WriteBytes(object->element_addr(0), object->Size());
+      s->RegisterRef(object);
+    }
+  }
+
+  void WriteEdges(Serializer* s) {}
+
+ private:
+  ObjectList canonical_;
+};
+
+class ArraySerializationCluster : public SerializationCluster {
+ public:
+  ArraySerializationCluster() {}
+
+  void Trace(Serializer* s, Object object) {
+    objects_.Add(object);
+    Array array = static_cast<Array>(object);
+    intptr_t size = array->Size();
+    for (intptr_t j = 0; j < size; j++) {
+      s->Push(array->element(j));
+    }
+  }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kArrayCid);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      Array object = static_cast<Array>(objects_.At(i));
+      s->WriteUnsigned(object->Size());
+      s->RegisterRef(object);
+    }
+  }
+
+  void WriteEdges(Serializer* s) {
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      Array object = static_cast<Array>(objects_.At(i));
+      intptr_t size = object->Size();
+      for (intptr_t j = 0; j < size; j++) {
+        s->WriteRef(object->element(j));
+      }
+    }
+  }
+};
+
+class WeakArraySerializationCluster : public SerializationCluster {
+ public:
+  WeakArraySerializationCluster() {}
+
+  void Trace(Serializer* s, Object object) {
+    objects_.Add(object);
+    // Elements are not traced, except immediates, which are never collected.
+    WeakArray array = static_cast<WeakArray>(object);
+    intptr_t size = array->Size();
+    for (intptr_t j = 0; j < size; j++) {
+      Object element = array->element(j);
+      if (element->IsSmallInteger()) {
+        s->Push(element);
+      }
+    }
+  }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kWeakArrayCid);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      WeakArray object = static_cast<WeakArray>(objects_.At(i));
+      s->WriteUnsigned(object->Size());
+      s->RegisterRef(object);
+    }
+  }
+
+  void WriteEdges(Serializer* s) {
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      WeakArray object = static_cast<WeakArray>(objects_.At(i));
+      intptr_t size = object->Size();
+      for (intptr_t j = 0; j < size; j++) {
+        s->WriteWeakRef(object->element(j));
+      }
+    }
+  }
+};
+
+// Follows the collector: the value and finalizer are reachable only once the
+// key is, and ephemerons whose keys never become reachable are written as
+// mourned.
+class EphemeronSerializationCluster : public SerializationCluster {
+ public:
+  explicit EphemeronSerializationCluster(Heap* heap)
+      : cls_(heap->ClassAt(kEphemeronCid)) {}
+
+  void Trace(Serializer* s, Object object) {
+    objects_.Add(object);
+    Ephemeron ephemeron = static_cast<Ephemeron>(object);
+    if (IsKeyReachable(s, ephemeron)) {
+      TraceContents(s, ephemeron);
+    } else {
+      deferred_.Add(object);
+    }
+  }
+
+  bool TraceDeferred(Serializer* s) {
+    bool traced = false;
+    intptr_t remaining = 0;
+    for (intptr_t i = 0; i < deferred_.length(); i++) {
+      Ephemeron ephemeron = static_cast<Ephemeron>(deferred_.At(i));
+      if (IsKeyReachable(s, ephemeron)) {
+        TraceContents(s, ephemeron);
+        traced = true;
+      } else {
+        deferred_.Set(remaining++, ephemeron);
+      }
+    }
+    deferred_.Truncate(remaining);
+    return traced;
+  }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kEphemeronCid);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      s->RegisterRef(objects_.At(i));
+    }
+  }
+
+  void WriteEdges(Serializer* s) {
+    s->WriteRef(cls_);
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      Ephemeron object = static_cast<Ephemeron>(objects_.At(i));
+      if (IsKeyReachable(s, object)) {
+        s->WriteRef(object->key());
+        s->WriteRef(object->value());
+        s->WriteRef(object->finalizer());
+      } else {
+        s->WriteRef(s->nil());
+        s->WriteRef(s->nil());
+        s->WriteRef(s->nil());
+      }
+    }
+  }
+
+ private:
+  static bool IsKeyReachable(Serializer* s, Ephemeron ephemeron) {
+    Object key = ephemeron->key();
+    return key->IsSmallInteger() || s->IsReachable(key);
+  }
+
+  static void TraceContents(Serializer* s, Ephemeron ephemeron) {
+    s->Push(ephemeron->key());
+    s->Push(ephemeron->value());
+    s->Push(ephemeron->finalizer());
+  }
+
+  const Behavior cls_;
+  ObjectList deferred_;
+};
+
+class ActivationSerializationCluster : public SerializationCluster {
+ public:
+  ActivationSerializationCluster() {}
+
+  void Trace(Serializer* s, Object object) {
+    objects_.Add(object);
+    Activation activation = static_cast<Activation>(object);
+    if (!HasLivingFrame(activation)) {
+      s->Push(activation->sender());
+      s->Push(activation->bci());
+    }
+    s->Push(activation->method());
+    s->Push(activation->closure());
+    s->Push(activation->receiver());
+    intptr_t depth = activation->stack_depth()->value();
+    for (intptr_t j = 0; j < depth; j++) {
+      s->Push(activation->temp(j));
+    }
+  }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kActivationCid);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      s->RegisterRef(objects_.At(i));
+    }
+  }
+
+  void WriteEdges(Serializer* s) {
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      Activation object = static_cast<Activation>(objects_.At(i));
+      if (HasLivingFrame(object)) {
+        // Written as though its frame had returned.
+        s->WriteRef(s->nil());
+        s->WriteRef(s->nil());
+      } else {
+        s->WriteRef(object->sender());
+        s->WriteRef(object->bci());
+      }
+      s->WriteRef(object->method());
+      s->WriteRef(object->closure());
+      s->WriteRef(object->receiver());
+      intptr_t depth = object->stack_depth()->value();
+      s->WriteUint16(depth);
+      for (intptr_t j = 0; j < depth; j++) {
+        s->WriteRef(object->temp(j));
+      }
+    }
+  }
+
+ private:
+  // The sender of an activation with a frame on the stack is the frame's
+  // address.
+  static bool HasLivingFrame(Activation activation) {
+    return activation->sender()->IsSmallInteger();
+  }
+};
+
+class ClosureSerializationCluster : public SerializationCluster {
+ public:
+  ClosureSerializationCluster() {}
+
+  void Trace(Serializer* s, Object object) {
+    objects_.Add(object);
+    Closure closure = static_cast<Closure>(object);
+    s->Push(closure->defining_activation());
+    s->Push(closure->initial_bci());
+    s->Push(closure->num_args());
+    intptr_t size = closure->NumCopied();
+    for (intptr_t j = 0; j < size; j++) {
+      s->Push(closure->copied(j));
+    }
+  }
+
+  void WriteNodes(Serializer* s) {
+    s->WriteInt32(-kClosureCid);
+    s->WriteUnsigned(objects_.length());
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      Closure object = static_cast<Closure>(objects_.At(i));
+      s->WriteUint16(object->NumCopied());
+      s->RegisterRef(object);
+    }
+  }
+
+  void WriteEdges(Serializer* s) {
+    for (intptr_t i = 0; i < objects_.length(); i++) {
+      Closure object = static_cast<Closure>(objects_.At(i));
+      s->WriteRef(object->defining_activation());
+      s->WriteRef(object->initial_bci());
+      s->WriteRef(object->num_args());
+      intptr_t size = object->NumCopied();
+      for (intptr_t j = 0; j < size; j++) {
+        s->WriteRef(object->copied(j));
+      }
+    }
+  }
+};
+
+Serializer::Serializer(Heap* heap) :
+  heap_(heap),
+  nil_(heap->interpreter()->nil_obj()),
+  failed_(false),
+  bytes_(NULL),
+  length_(0),
+  capacity_(0),
+  reached_(NULL),
+  saved_hashes_(NULL),
+  num_reached_(0),
+  reached_capacity_(0),
+  num_traced_(0),
+  smi_keys_(NULL),
+  smi_refs_(NULL),
+  smi_capacity_(0),
+  num_smis_(0),
+  next_ref_(1),
+  clusters_(NULL),
+  num_clusters_(0),
+  clusters_capacity_(0),
+  regular_clusters_(NULL),
+  regular_clusters_length_(0) {
+  integers_ = new IntegerSerializationCluster();
+  floats_ = new Float64SerializationCluster();
+  byte_arrays_ = new ByteArraySerializationCluster();
+  strings_ = new StringSerializationCluster();
+  arrays_ = new ArraySerializationCluster();
+  weak_arrays_ = new WeakArraySerializationCluster();
+  ephemerons_ = new EphemeronSerializationCluster(heap);
+  activations_ = new ActivationSerializationCluster();
+  closures_ = new ClosureSerializationCluster();
+  AddCluster(integers_);
+  AddCluster(floats_);
+  AddCluster(byte_arrays_);
+  AddCluster(strings_);
+  AddCluster(arrays_);
+  AddCluster(weak_arrays_);
+  AddCluster(ephemerons_);
+  AddCluster(activations_);
+  AddCluster(closures_);
+}
+
+
+Serializer::~Serializer() {
+  for (intptr_t i = 0; i < num_clusters_; i++) {
+    delete clusters_[i];
+  }
+  free(clusters_);
+  free(regular_clusters_);
+  free(reached_);
+  free(saved_hashes_);
+  free(smi_keys_);
+  free(smi_refs_);
+  free(bytes_);
+}
+
+
+bool Serializer::Serialize(Object root) {
+  int64_t start = OS::CurrentMonotonicNanos();
+
+  regular_clusters_length_ = heap_->class_table_size();
+  regular_clusters_ = reinterpret_cast<SerializationCluster**>(
+      calloc(regular_clusters_length_, sizeof(SerializationCluster*)));
+  GrowSmis();
+
+  Push(root);
+  do {
+    Trace();
+  } while (ephemerons_->TraceDeferred(this));
+
+  intptr_t num_nodes = num_reached_ + num_smis_;
+  if (failed_ ||
+      (num_clusters_ > 0xFFFF) ||
+      (num_nodes > static_cast<intptr_t>(kMaxUint32))) {
+    Restore();
+    return false;
+  }
+
+  WriteUint16(0x1984);
+  WriteUint16(0);  // Version.
+  WriteUint16(num_clusters_);
+  WriteUint32(num_nodes);
+  for (intptr_t i = 0; i < num_clusters_; i++) {
+    clusters_[i]->WriteNodes(this);
+  }
+  ASSERT((next_ref_ - 1) == num_nodes);
+  for (intptr_t i = 0; i < num_clusters_; i++) {
+    clusters_[i]->WriteEdges(this);
+  }
+  WriteRef(root);
+  WriteHashes();
+  Restore();
+
+  int64_t stop = OS::CurrentMonotonicNanos();
+  intptr_t time = stop - start;
+  if (TRACE_GROWTH) {
+    OS::PrintErr("Serialized %" Pd "kB heap "
+                 "into %" Pd "kB snapshot "
+                 "with %" Pd " objects "
+                 "in %" Pd " us\n",
+                 heap_->Size() / KB,
+                 length_ / KB,
+                 num_nodes,
+                 time / kNanosecondsPerMicrosecond);
+  }
+  return true;
+}
+
+
+void Serializer::Trace() {
+  while (num_traced_ < num_reached_) {
+    Object object = reached_[num_traced_++];
+    ClusterFor(object)->Trace(this, object);
+  }
+}
+
+
+void Serializer::WriteHashes() {
+  WriteInt64(heap_->interpreter()->isolate()->salt());
+
+  intptr_t num_hashes = 0;
+  for (intptr_t i = 0; i < num_reached_; i++) {
+    if (saved_hashes_[i] != 0) {
+      num_hashes++;
+    }
+  }
+  WriteUnsigned(num_hashes);
+  for (intptr_t i = 0; i < num_reached_; i++) {
+    if (saved_hashes_[i] != 0) {
+      WriteRef(reached_[i]);
+      WriteInt64(saved_hashes_[i]);
+    }
+  }
+}
+
+
+void Serializer::Restore() {
+  for (intptr_t i = 0; i < num_reached_; i++) {
+    HeapObject object = static_cast<HeapObject>(reached_[i]);
+    object->set_header_hash(saved_hashes_[i]);
+    object->set_is_marked(false);
+  }
+}
+
+
+uint8_t* Serializer::TakeBytes() {
+  uint8_t* result = bytes_;
+  bytes_ = NULL;
+  return result;
+}
+
+
+SerializationCluster* Serializer::ClusterFor(Object object) {
+  if (object->IsSmallInteger()) {
+    return integers_;
+  }
+  intptr_t cid = object->ClassId();
+  switch (cid) {
+    case kMintCid:
+    case kBigintCid: return integers_;
+    case kFloat64Cid: return floats_;
+    case kByteArrayCid: return byte_arrays_;
+    case kStringCid: return strings_;
+    case kArrayCid: return arrays_;
+    case kWeakArrayCid: return weak_arrays_;
+    case kEphemeronCid: return ephemerons_;
+    case kActivationCid: return activations_;
+    case kClosureCid: return closures_;
+  }
+  ASSERT(cid >= kFirstRegularObjectCid);
+  ASSERT(cid < regular_clusters_length_);
+  SerializationCluster* cluster = regular_clusters_[cid];
+  if (cluster == NULL) {
+    cluster = new RegularObjectSerializationCluster(heap_, cid);
+    regular_clusters_[cid] = cluster;
+    AddCluster(cluster);
+    Push(heap_->ClassAt(cid));
+  }
+  return cluster;
+}
+
+
+void Serializer::AddCluster(SerializationCluster* cluster) {
+  if (num_clusters_ == clusters_capacity_) {
+    clusters_ = reinterpret_cast<SerializationCluster**>(
+        GrowArray(clusters_, &clusters_capacity_,
+                  sizeof(SerializationCluster*)));
+  }
+  clusters_[num_clusters_++] = cluster;
+}
+
+
+intptr_t Serializer::SmiIndexOf(Object object) const {
+  uword key = static_cast<uword>(object);
+  intptr_t mask = smi_capacity_ - 1;
+  intptr_t index = HashObject(key, mask);
+  while ((smi_keys_[index] != key) && (smi_keys_[index] != kNoKey)) {
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+
+void Serializer::GrowSmis() {
+  uword* old_keys = smi_keys_;
+  intptr_t* old_refs = smi_refs_;
+  intptr_t old_capacity = smi_capacity_;
+
+  smi_capacity_ = (old_capacity == 0) ? 1024 : (old_capacity * 2);
+  smi_keys_ = reinterpret_cast<uword*>(malloc(smi_capacity_ * sizeof(uword)));
+  smi_refs_ = reinterpret_cast<intptr_t*>(
+      malloc(smi_capacity_ * sizeof(intptr_t)));
+  if ((smi_keys_ == NULL) || (smi_refs_ == NULL)) {
+    FATAL("Out of memory");
+  }
+  memset(smi_keys_, 0xFF, smi_capacity_ * sizeof(uword));
+  for (intptr_t i = 0; i < old_capacity; i++) {
+    if (old_keys[i] != kNoKey) {
+      intptr_t index = SmiIndexOf(static_cast<Object>(old_keys[i]));
+      smi_keys_[index] = old_keys[i];
+      smi_refs_[index] = old_refs[i];
+    }
+  }
+  free(old_keys);
+  free(old_refs);
+}
+
+
+void Serializer::Push(Object object) {
+  if (object->IsSmallInteger()) {
+    intptr_t index = SmiIndexOf(object);
+    if (smi_keys_[index] != kNoKey) {
+      return;
+    }
+    smi_keys_[index] = static_cast<uword>(object);
+    smi_refs_[index] = 0;
+    if (++num_smis_ * 2 > smi_capacity_) {
+      GrowSmis();
+    }
+    // Small integers have no edges to trace.
+    integers_->Trace(this, object);
+    return;
+  }
+
+  HeapObject heap_object = static_cast<HeapObject>(object);
+  if (heap_object->is_marked()) {
+    return;
+  }
+  heap_object->set_is_marked(true);
+
+  if (num_reached_ == reached_capacity_) {
+    intptr_t capacity = reached_capacity_;
+    reached_ = reinterpret_cast<Object*>(
+        GrowArray(reached_, &capacity, sizeof(Object)));
+    saved_hashes_ = reinterpret_cast<intptr_t*>(
+        GrowArray(saved_hashes_, &reached_capacity_, sizeof(intptr_t)));
+  }
+  reached_[num_reached_] = object;
+  saved_hashes_[num_reached_] = heap_object->header_hash();
+  num_reached_++;
+  heap_object->set_header_hash(0);
+}
+
+
+bool Serializer::IsReachable(Object object) const {
+  if (object->IsSmallInteger()) {
+    return smi_keys_[SmiIndexOf(object)] != kNoKey;
+  }
+  return static_cast<HeapObject>(object)->is_marked();
+}
+
+
+void Serializer::RegisterRef(Object object) {
+  if (object->IsSmallInteger()) {
+    intptr_t index = SmiIndexOf(object);
+    ASSERT(smi_keys_[index] != kNoKey);
+    ASSERT(smi_refs_[index] == 0);
+    smi_refs_[index] = next_ref_++;
+  } else {
+    HeapObject heap_object = static_cast<HeapObject>(object);
+    ASSERT(heap_object->is_marked());
+    ASSERT(heap_object->header_hash() == 0);
+    heap_object->set_header_hash(next_ref_++);
+  }
+}
+
+
+void Serializer::WriteRef(Object object) {
+  intptr_t ref;
+  if (object->IsSmallInteger()) {
+    intptr_t index = SmiIndexOf(object);
+    ASSERT(smi_keys_[index] != kNoKey);
+    ref = smi_refs_[index];
+  } else {
+    ASSERT(static_cast<HeapObject>(object)->is_marked());
+    ref = static_cast<HeapObject>(object)->header_hash();
+  }
+  ASSERT(ref > 0);
+  WriteUnsigned(ref);
+}
+
+
+void Serializer::WriteWeakRef(Object object) {
+  if (!IsReachable(object)) {
+    object = nil_;
+  }
+  WriteRef(object);
+}
+
+
+void Serializer::Reserve(intptr_t additional) {
+  while (length_ + additional > capacity_) {
+    bytes_ = reinterpret_cast<uint8_t*>(
+        GrowArray(bytes_, &capacity_, sizeof(uint8_t)));
+  }
+}
+
+
+void Serializer::WriteUint8(uint8_t value) {
+  Reserve(1);
+  bytes_[length_++] = value;
+}
+
+
+void Serializer::WriteUint16(uint16_t value) {
+  Reserve(2);
+  bytes_[length_++] = static_cast<uint8_t>(value >> 8);
+  bytes_[length_++] = static_cast<uint8_t>(value);
+}
+
+
+void Serializer::WriteUint32(uint32_t value) {
+  Reserve(4);
+  for (intptr_t shift = 24; shift >= 0; shift -= 8) {
+    bytes_[length_++] = static_cast<uint8_t>(value >> shift);
+  }
+}
+
+
+void Serializer::WriteInt32(int32_t value) {
+  WriteUint32(static_cast<uint32_t>(value));
+}
+
+
+void Serializer::WriteInt64(int64_t value) {
+  Reserve(8);
+  uint64_t bits = static_cast<uint64_t>(value);
+  for (intptr_t shift = 56; shift >= 0; shift -= 8) {
+    bytes_[length_++] = static_cast<uint8_t>(bits >> shift);
+  }
+}
+
+
+void Serializer::WriteUnsigned(intptr_t value) {
+  ASSERT(value >= 0);
+  ASSERT(value <= static_cast<intptr_t>(kMaxUint32));
+  Reserve(5);
+  while (value > kMaxUnsignedDataPerByte) {
+    bytes_[length_++] = static_cast<uint8_t>(value & kByteMask);
+    value >>= kDataBitsPerByte;
+  }
+  bytes_[length_++] = static_cast<uint8_t>(value + kEndUnsignedByteMarker);
+}
+
+
+void Serializer::WriteBytes(const uint8_t* bytes, intptr_t length) {
+  Reserve(length);
+  memcpy(&bytes_[length_], bytes, length);
+  length_ += length;
+}
+
 }  // namespace psoup
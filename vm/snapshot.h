@@ -14,6 +14,7 @@ namespace psoup {
 class Cluster;
 class Heap;
 class Object;
+class SerializationCluster;
 
 // Reads a variant of VictoryFuel.
 class Deserializer : public ValueObject {
@@ -32,6 +33,7 @@ class Deserializer : public ValueObject {
   void Deserialize();
 
   Cluster* ReadCluster();
+  void ReadHashes();
 
   intptr_t next_ref() const { return next_ref_; }
 
@@ -61,6 +63,98 @@ class Deserializer : public ValueObject {
   intptr_t next_ref_;
 };
 
+// Writes the heap reachable from a root in the format read by Deserializer,
+// so a running isolate can be checkpointed and later restarted from the
+// result. Nothing may allocate in the heap while a Serializer is live: it
+// borrows the mark bit and the hash word of the objects it reaches, restoring
+// them before Serialize returns.
+class Serializer : public ValueObject {
+ public:
+  explicit Serializer(Heap* heap);
+  ~Serializer();
+
+  // Answers false if some reachable object cannot be represented.
+  bool Serialize(Object root);
+
+  // The snapshot, allocated with malloc and owned by the caller afterwards.
+  uint8_t* TakeBytes();
+  intptr_t length() const { return length_; }
+
+  void WriteUint8(uint8_t value);
+  void WriteUint16(uint16_t value);
+  void WriteUint32(uint32_t value);
+  void WriteInt32(int32_t value);
+  void WriteInt64(int64_t value);
+  void WriteUnsigned(intptr_t value);
+  void WriteBytes(const uint8_t* bytes, intptr_t length);
+
+  // Marks the object reachable, queueing it to be traced if it is new.
+  void Push(Object object);
+  bool IsReachable(Object object) const;
+
+  void RegisterRef(Object object);
+  void WriteRef(Object object);
+  // As WriteRef, but unreachable objects are written as nil.
+  void WriteWeakRef(Object object);
+
+  Heap* heap() const { return heap_; }
+  Object nil() const { return nil_; }
+  void Fail() { failed_ = true; }
+
+ private:
+  SerializationCluster* ClusterFor(Object object);
+  void AddCluster(SerializationCluster* cluster);
+  void Trace();
+  void WriteHashes();
+  void Restore();
+  void Reserve(intptr_t additional);
+  intptr_t SmiIndexOf(Object object) const;
+  void GrowSmis();
+
+  Heap* const heap_;
+  Object nil_;
+  bool failed_;
+
+  uint8_t* bytes_;
+  intptr_t length_;
+  intptr_t capacity_;
+
+  // Reached heap objects in order, with the hashes their headers held. Until
+  // restored, a reached object's header holds its ref instead, or 0 if it is
+  // not yet numbered.
+  Object* reached_;
+  intptr_t* saved_hashes_;
+  intptr_t num_reached_;
+  intptr_t reached_capacity_;
+  intptr_t num_traced_;
+
+  // Open addressing from small integers to refs.
+  uword* smi_keys_;
+  intptr_t* smi_refs_;
+  intptr_t smi_capacity_;
+  intptr_t num_smis_;
+
+  intptr_t next_ref_;
+
+  SerializationCluster** clusters_;
+  intptr_t num_clusters_;
+  intptr_t clusters_capacity_;
+
+  // Clusters of regular objects, indexed by class id.
+  SerializationCluster** regular_clusters_;
+  intptr_t regular_clusters_length_;
+
+  SerializationCluster* integers_;
+  SerializationCluster* floats_;
+  SerializationCluster* byte_arrays_;
+  SerializationCluster* strings_;
+  SerializationCluster* arrays_;
+  SerializationCluster* weak_arrays_;
+  SerializationCluster* ephemerons_;
+  SerializationCluster* activations_;
+  SerializationCluster* closures_;
+};
+
 }  // namespace psoup
 
 #endif  // VM_SNAPSHOT_H_
@@ -0,0 +1,285 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/socket.h"
+
+#if defined(OS_ANDROID) || defined(OS_LINUX) || defined(OS_MACOS)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "vm/assert.h"
+
+namespace psoup {
+
+#if defined(MSG_NOSIGNAL)
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+static intptr_t NewSocket(int domain) {
+#if defined(SOCK_NONBLOCK)
+  int fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -errno;
+  }
+#else
+  int fd = socket(domain, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -errno;
+  }
+  if ((fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) ||
+      (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)) {
+    intptr_t error = -errno;
+    close(fd);
+    return error;
+  }
+#endif
+#if defined(SO_NOSIGPIPE)
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  return fd;
+}
+
+static intptr_t ResolveNumeric(const char* host, intptr_t port,
+                               struct sockaddr_storage* address,
+                               socklen_t* length) {
+  if ((port < 0) || (port > 65535)) {
+    return -EINVAL;
+  }
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | AI_PASSIVE;
+  char service[8];
+  snprintf(service, sizeof(service), "%d", static_cast<int>(port));
+  struct addrinfo* info;
+  if (getaddrinfo(host, service, &hints, &info) != 0) {
+    return -EINVAL;
+  }
+  memcpy(address, info->ai_addr, info->ai_addrlen);
+  *length = info->ai_addrlen;
+  freeaddrinfo(info);
+  return 0;
+}
+
+static intptr_t UnixAddress(const char* path,
+                            struct sockaddr_storage* address,
+                            socklen_t* length) {
+  struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(address);
+  size_t path_length = strlen(path);
+  if (path_length >= sizeof(un->sun_path)) {
+    return -ENAMETOOLONG;
+  }
+  memset(un, 0, sizeof(*un));
+  un->sun_family = AF_UNIX;
+  memcpy(un->sun_path, path, path_length);
+  *length = sizeof(*un);
+  return 0;
+}
+
+static intptr_t Listen(const struct sockaddr_storage& address,
+                       socklen_t length,
+                       intptr_t backlog) {
+  intptr_t fd = NewSocket(address.ss_family);
+  if (fd < 0) {
+    return fd;
+  }
+  if (address.ss_family != AF_UNIX) {
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  }
+  if ((bind(fd, reinterpret_cast<const struct sockaddr*>(&address),
+            length) == -1) ||
+      (listen(fd, backlog) == -1)) {
+    intptr_t error = -errno;
+    close(fd);
+    return error;
+  }
+  return fd;
+}
+
+static intptr_t Connect(const struct sockaddr_storage& address,
+                        socklen_t length) {
+  intptr_t fd = NewSocket(address.ss_family);
+  if (fd < 0) {
+    return fd;
+  }
+  if (address.ss_family != AF_UNIX) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  int result;
+  do {
+    result = connect(fd, reinterpret_cast<const struct sockaddr*>(&address),
+                     length);
+  } while ((result == -1) && (errno == EINTR));
+  if ((result == -1) && (errno != EINPROGRESS) && (errno != EAGAIN)) {
+    intptr_t error = -errno;
+    close(fd);
+    return error;
+  }
+  return fd;
+}
+
+intptr_t Socket::ListenTCP(const char* host, intptr_t port, intptr_t backlog) {
+  struct sockaddr_storage address;
+  socklen_t length;
+  intptr_t result = ResolveNumeric(host, port, &address, &length);
+  if (result < 0) {
+    return result;
+  }
+  return Listen(address, length, backlog);
+}
+
+intptr_t Socket::ListenUnix(const char* path, intptr_t backlog) {
+  struct sockaddr_storage address;
+  socklen_t length;
+  intptr_t result = UnixAddress(path, &address, &length);
+  if (result < 0) {
+    return result;
+  }
+  // Replace a socket left behind by an earlier listener, but nothing else.
+  struct stat st;
+  if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+  return Listen(address, length, backlog);
+}
+
+intptr_t Socket::ConnectTCP(const char* host, intptr_t port) {
+  struct sockaddr_storage address;
+  socklen_t length;
+  intptr_t result = ResolveNumeric(host, port, &address, &length);
+  if (result < 0) {
+    return result;
+  }
+  return Connect(address, length);
+}
+
+intptr_t Socket::ConnectUnix(const char* path) {
+  struct sockaddr_storage address;
+  socklen_t length;
+  intptr_t result = UnixAddress(path, &address, &length);
+  if (result < 0) {
+    return result;
+  }
+  return Connect(address, length);
+}
+
+intptr_t Socket::Accept(intptr_t fd, intptr_t* fds, intptr_t length) {
+  intptr_t accepted = 0;
+  while (accepted < length) {
+#if defined(OS_ANDROID) || defined(OS_LINUX)
+    int client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int client = accept(fd, NULL, NULL);
+#endif
+    if (client == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return accepted > 0 ? accepted : -errno;
+    }
+#if !defined(OS_ANDROID) && !defined(OS_LINUX)
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+    fcntl(client, F_SETFD, FD_CLOEXEC);
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+#endif
+    fds[accepted++] = client;
+  }
+  return accepted > 0 ? accepted : kWouldBlock;
+}
+
+intptr_t Socket::Read(intptr_t fd, uint8_t* buffer, intptr_t length) {
+  ssize_t result;
+  do {
+    result = read(fd, buffer, length);
+  } while ((result == -1) && (errno == EINTR));
+  if (result == -1) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? kWouldBlock : -errno;
+  }
+  return result;
+}
+
+intptr_t Socket::Write(intptr_t fd, const uint8_t* buffer, intptr_t length) {
+  intptr_t total = 0;
+  while (total < length) {
+    ssize_t result = send(fd, buffer + total, length - total, kSendFlags);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (total > 0) {
+        break;
+      }
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? kWouldBlock : -errno;
+    }
+    total += result;
+  }
+  return total;
+}
+
+intptr_t Socket::Close(intptr_t fd) {
+  // Not retried on EINTR: the descriptor is released regardless.
+  return close(fd) == -1 ? -errno : 0;
+}
+
+intptr_t Socket::PendingError(intptr_t fd) {
+  int error = 0;
+  socklen_t length = sizeof(error);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1) {
+    return -errno;
+  }
+  if (error != 0) {
+    return -error;
+  }
+  // A signal may arrive before the handshake finishes, e.g. one queued for an
+  // earlier socket that had the same descriptor.
+  struct sockaddr_storage peer;
+  socklen_t peer_length = sizeof(peer);
+  if (getpeername(fd, reinterpret_cast<struct sockaddr*>(&peer),
+                  &peer_length) == -1) {
+    return errno == ENOTCONN ? kWouldBlock : -errno;
+  }
+  return 0;
+}
+
+intptr_t Socket::LocalPort(intptr_t fd) {
+  struct sockaddr_storage address;
+  socklen_t length = sizeof(address);
+  if (getsockname(fd, reinterpret_cast<struct sockaddr*>(&address),
+                  &length) == -1) {
+    return -errno;
+  }
+  if (address.ss_family == AF_INET) {
+    return ntohs(reinterpret_cast<struct sockaddr_in*>(&address)->sin_port);
+  }
+  if (address.ss_family == AF_INET6) {
+    return ntohs(reinterpret_cast<struct sockaddr_in6*>(&address)->sin6_port);
+  }
+  return -EAFNOSUPPORT;
+}
+
+}  // namespace psoup
+
+#endif  // defined(OS_ANDROID) || defined(OS_LINUX) || defined(OS_MACOS)
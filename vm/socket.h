@@ -0,0 +1,50 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_SOCKET_H_
+#define VM_SOCKET_H_
+
+#include "vm/allocation.h"
+#include "vm/globals.h"
+
+namespace psoup {
+
+// Non-blocking TCP and Unix domain stream sockets, to be waited on with
+// MessageLoop::AwaitSignal. Operations answer a negative errno on failure.
+class Socket : public AllStatic {
+ public:
+  // Answered by Accept, Read and Write when the operation would block, and by
+  // PendingError while a connect is still in progress.
+  static const intptr_t kWouldBlock = kMinInt32;
+
+  // The host is a numeric IPv4 or IPv6 address. Answer a descriptor.
+  static intptr_t ListenTCP(const char* host, intptr_t port, intptr_t backlog);
+  // Replaces any socket already at path.
+  static intptr_t ListenUnix(const char* path, intptr_t backlog);
+  // The connection may still be in progress: wait to be writable, then check
+  // PendingError.
+  static intptr_t ConnectTCP(const char* host, intptr_t port);
+  static intptr_t ConnectUnix(const char* path);
+
+  // Accepts as many pending connections as fit in fds. Answers the number
+  // accepted.
+  static intptr_t Accept(intptr_t fd, intptr_t* fds, intptr_t length);
+
+  // Answers the number of bytes read by a single read, 0 at the end of the
+  // stream. Waits are edge-triggered on some loops, so read until this
+  // answers kWouldBlock before waiting again.
+  static intptr_t Read(intptr_t fd, uint8_t* buffer, intptr_t length);
+  // Writes until the buffer is exhausted or the write would block. Answers
+  // the number of bytes written.
+  static intptr_t Write(intptr_t fd, const uint8_t* buffer, intptr_t length);
+
+  static intptr_t Close(intptr_t fd);
+  // Answers 0 once a connect has completed.
+  static intptr_t PendingError(intptr_t fd);
+  static intptr_t LocalPort(intptr_t fd);
+};
+
+}  // namespace psoup
+
+#endif  // VM_SOCKET_H_
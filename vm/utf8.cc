@@ -0,0 +1,322 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#include "vm/utf8.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON 1
+#endif
+
+#include "vm/assert.h"
+
+namespace psoup {
+
+// Answers the length of the longest prefix of bytes below 0x80.
+static intptr_t AsciiPrefix(const uint8_t* bytes, intptr_t length) {
+  intptr_t i = 0;
+#if defined(USE_SSE2)
+  while (i + 16 <= length) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&bytes[i]));
+    if (_mm_movemask_epi8(chunk) != 0) break;
+    i += 16;
+  }
+#elif defined(USE_NEON)
+  while (i + 16 <= length) {
+    uint8x16_t chunk = vld1q_u8(&bytes[i]);
+    if (vmaxvq_u8(chunk) >= 0x80) break;
+    i += 16;
+  }
+#endif
+  while (i + 8 <= length) {
+    uint64_t word;
+    memcpy(&word, &bytes[i], sizeof(word));
+    if ((word & 0x8080808080808080ULL) != 0) break;
+    i += 8;
+  }
+  while ((i < length) && (bytes[i] < 0x80)) {
+    i++;
+  }
+  return i;
+}
+
+// Answers the length of the longest prefix of units in 0..0x7F.
+static intptr_t AsciiUnitsPrefix(const int32_t* units, intptr_t length) {
+  intptr_t i = 0;
+#if defined(USE_SSE2)
+  const __m128i high = _mm_set1_epi32(~0x7F);
+  const __m128i zero = _mm_setzero_si128();
+  while (i + 4 <= length) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&units[i]));
+    __m128i ascii = _mm_cmpeq_epi32(_mm_and_si128(chunk, high), zero);
+    if (_mm_movemask_epi8(ascii) != 0xFFFF) break;
+    i += 4;
+  }
+#elif defined(USE_NEON)
+  while (i + 4 <= length) {
+    uint32x4_t chunk = vld1q_u32(reinterpret_cast<const uint32_t*>(&units[i]));
+    if (vmaxvq_u32(chunk) >= 0x80) break;
+    i += 4;
+  }
+#endif
+  while ((i < length) && (static_cast<uint32_t>(units[i]) < 0x80)) {
+    i++;
+  }
+  return i;
+}
+
+// Widens length ASCII bytes to units.
+static void WidenAscii(const uint8_t* bytes, intptr_t length, int32_t* units) {
+  intptr_t i = 0;
+#if defined(USE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  while (i + 16 <= length) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(&bytes[i]));
+    __m128i lo = _mm_unpacklo_epi8(chunk, zero);
+    __m128i hi = _mm_unpackhi_epi8(chunk, zero);
+    __m128i* out = reinterpret_cast<__m128i*>(&units[i]);
+    _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+    i += 16;
+  }
+#elif defined(USE_NEON)
+  while (i + 16 <= length) {
+    uint8x16_t chunk = vld1q_u8(&bytes[i]);
+    uint16x8_t lo = vmovl_u8(vget_low_u8(chunk));
+    uint16x8_t hi = vmovl_high_u8(chunk);
+    uint32_t* out = reinterpret_cast<uint32_t*>(&units[i]);
+    vst1q_u32(out + 0, vmovl_u16(vget_low_u16(lo)));
+    vst1q_u32(out + 4, vmovl_high_u16(lo));
+    vst1q_u32(out + 8, vmovl_u16(vget_low_u16(hi)));
+    vst1q_u32(out + 12, vmovl_high_u16(hi));
+    i += 16;
+  }
+#endif
+  for (; i < length; i++) {
+    units[i] = bytes[i];
+  }
+}
+
+// Narrows length units in 0..0x7F to bytes.
+static void NarrowAscii(const int32_t* units, intptr_t length, uint8_t* bytes) {
+  intptr_t i = 0;
+#if defined(USE_SSE2)
+  while (i + 16 <= length) {
+    const __m128i* in = reinterpret_cast<const __m128i*>(&units[i]);
+    __m128i lo = _mm_packs_epi32(_mm_loadu_si128(in + 0),
+                                 _mm_loadu_si128(in + 1));
+    __m128i hi = _mm_packs_epi32(_mm_loadu_si128(in + 2),
+                                 _mm_loadu_si128(in + 3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&bytes[i]),
+                     _mm_packus_epi16(lo, hi));
+    i += 16;
+  }
+#elif defined(USE_NEON)
+  while (i + 16 <= length) {
+    const uint32_t* in = reinterpret_cast<const uint32_t*>(&units[i]);
+    uint16x8_t lo = vcombine_u16(vmovn_u32(vld1q_u32(in + 0)),
+                                 vmovn_u32(vld1q_u32(in + 4)));
+    uint16x8_t hi = vcombine_u16(vmovn_u32(vld1q_u32(in + 8)),
+                                 vmovn_u32(vld1q_u32(in + 12)));
+    vst1q_u8(&bytes[i], vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+    i += 16;
+  }
+#endif
+  for (; i < length; i++) {
+    bytes[i] = units[i];
+  }
+}
+
+// Answers the length of the well-formed multi-byte sequence at bytes[i], or 0.
+static intptr_t SequenceLength(const uint8_t* bytes, intptr_t i,
+                               intptr_t length) {
+  uint8_t lead = bytes[i];
+  uint8_t lower = 0x80;
+  uint8_t upper = 0xBF;
+  intptr_t n;
+  if (lead < 0xC2) {
+    return 0;  // Continuation byte or overlong 2-byte form.
+  } else if (lead <= 0xDF) {
+    n = 2;
+  } else if (lead <= 0xEF) {
+    n = 3;
+    if (lead == 0xE0) {
+      lower = 0xA0;  // Overlong.
+    } else if (lead == 0xED) {
+      upper = 0x9F;  // Surrogate.
+    }
+  } else if (lead <= 0xF4) {
+    n = 4;
+    if (lead == 0xF0) {
+      lower = 0x90;  // Overlong.
+    } else if (lead == 0xF4) {
+      upper = 0x8F;  // Past U+10FFFF.
+    }
+  } else {
+    return 0;
+  }
+  if (length - i < n) {
+    return 0;
+  }
+  if ((bytes[i + 1] < lower) || (bytes[i + 1] > upper)) {
+    return 0;
+  }
+  for (intptr_t k = 2; k < n; k++) {
+    if ((bytes[i + k] & 0xC0) != 0x80) {
+      return 0;
+    }
+  }
+  return n;
+}
+
+bool UTF8::IsAscii(const uint8_t* bytes, intptr_t length) {
+  return AsciiPrefix(bytes, length) == length;
+}
+
+bool UTF8::Validate(const uint8_t* bytes, intptr_t length,
+                    intptr_t width, intptr_t* units) {
+  ASSERT((width == 2) || (width == 4));
+  intptr_t count = 0;
+  intptr_t i = 0;
+  while (i < length) {
+    if (bytes[i] < 0x80) {
+      intptr_t run = AsciiPrefix(&bytes[i], length - i);
+      count += run;
+      i += run;
+      continue;
+    }
+    intptr_t n = SequenceLength(bytes, i, length);
+    if (n == 0) {
+      return false;
+    }
+    count += ((n == 4) && (width == 2)) ? 2 : 1;
+    i += n;
+  }
+  *units = count;
+  return true;
+}
+
+void UTF8::Decode(const uint8_t* bytes, intptr_t length,
+                  intptr_t width, int32_t* units) {
+  ASSERT((width == 2) || (width == 4));
+  intptr_t i = 0;
+  while (i < length) {
+    uint8_t lead = bytes[i];
+    if (lead < 0x80) {
+      intptr_t run = AsciiPrefix(&bytes[i], length - i);
+      WidenAscii(&bytes[i], run, units);
+      units += run;
+      i += run;
+      continue;
+    }
+    int32_t code_point;
+    if (lead < 0xE0) {
+      code_point = ((lead & 0x1F) << 6) | (bytes[i + 1] & 0x3F);
+      i += 2;
+    } else if (lead < 0xF0) {
+      code_point = ((lead & 0x0F) << 12) |
+                   ((bytes[i + 1] & 0x3F) << 6) |
+                   (bytes[i + 2] & 0x3F);
+      i += 3;
+    } else {
+      code_point = ((lead & 0x07) << 18) |
+                   ((bytes[i + 1] & 0x3F) << 12) |
+                   ((bytes[i + 2] & 0x3F) << 6) |
+                   (bytes[i + 3] & 0x3F);
+      i += 4;
+    }
+    if ((code_point > 0xFFFF) && (width == 2)) {
+      code_point -= 0x10000;
+      *units++ = 0xD800 | (code_point >> 10);
+      *units++ = 0xDC00 | (code_point & 0x3FF);
+    } else {
+      *units++ = code_point;
+    }
+  }
+}
+
+intptr_t UTF8::EncodedLength(const int32_t* units, intptr_t length,
+                             intptr_t width) {
+  ASSERT((width == 2) || (width == 4));
+  intptr_t result = 0;
+  intptr_t i = 0;
+  while (i < length) {
+    intptr_t run = AsciiUnitsPrefix(&units[i], length - i);
+    result += run;
+    i += run;
+    if (i == length) {
+      break;
+    }
+    int32_t unit = units[i++];
+    if (unit < 0) {
+      return -1;
+    } else if (unit < 0x800) {
+      result += 2;
+    } else if (unit < 0xD800) {
+      result += 3;
+    } else if (unit < 0xDC00) {
+      // Leading surrogate: only valid in UTF-16, followed by a trailing one.
+      if ((width == 4) || (i == length) ||
+          (units[i] < 0xDC00) || (units[i] > 0xDFFF)) {
+        return -1;
+      }
+      i++;
+      result += 4;
+    } else if (unit < 0xE000) {
+      return -1;  // Unpaired trailing surrogate.
+    } else if (unit < 0x10000) {
+      result += 3;
+    } else if ((width == 4) && (unit <= 0x10FFFF)) {
+      result += 4;
+    } else {
+      return -1;
+    }
+  }
+  return result;
+}
+
+void UTF8::Encode(const int32_t* units, intptr_t length,
+                  intptr_t width, uint8_t* bytes) {
+  ASSERT((width == 2) || (width == 4));
+  intptr_t i = 0;
+  while (i < length) {
+    intptr_t run = AsciiUnitsPrefix(&units[i], length - i);
+    NarrowAscii(&units[i], run, bytes);
+    bytes += run;
+    i += run;
+    if (i == length) {
+      break;
+    }
+    int32_t code_point = units[i++];
+    if ((code_point >= 0xD800) && (code_point < 0xDC00)) {
+      code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+                   (units[i++] - 0xDC00);
+    }
+    if (code_point < 0x800) {
+      *bytes++ = 0xC0 | (code_point >> 6);
+      *bytes++ = 0x80 | (code_point & 0x3F);
+    } else if (code_point < 0x10000) {
+      *bytes++ = 0xE0 | (code_point >> 12);
+      *bytes++ = 0x80 | ((code_point >> 6) & 0x3F);
+      *bytes++ = 0x80 | (code_point & 0x3F);
+    } else {
+      *bytes++ = 0xF0 | (code_point >> 18);
+      *bytes++ = 0x80 | ((code_point >> 12) & 0x3F);
+      *bytes++ = 0x80 | ((code_point >> 6) & 0x3F);
+      *bytes++ = 0x80 | (code_point & 0x3F);
+    }
+  }
+}
+
+}  // namespace psoup
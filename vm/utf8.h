@@ -0,0 +1,43 @@
+// Copyright (c) 2019, the Newspeak project authors. Please see the AUTHORS file
+// for details. All rights reserved. Use of this source code is governed by a
+// BSD-style license that can be found in the LICENSE file.
+
+#ifndef VM_UTF8_H_
+#define VM_UTF8_H_
+
+#include "vm/allocation.h"
+#include "vm/globals.h"
+
+namespace psoup {
+
+// Conversions between UTF-8 and arrays of 32-bit code units, either code
+// points (width 4) or UTF-16 code units (width 2). Runs of ASCII are handled
+// 16 bytes at a time with SSE2 or NEON where available, and 8 bytes at a time
+// otherwise.
+class UTF8 : public AllStatic {
+ public:
+  static bool IsAscii(const uint8_t* bytes, intptr_t length);
+
+  // Whether bytes are well-formed UTF-8: no overlong forms, surrogates or
+  // code points past U+10FFFF. If so, sets units to the number of code units
+  // of the given width they decode to.
+  static bool Validate(const uint8_t* bytes, intptr_t length,
+                       intptr_t width, intptr_t* units);
+
+  // Decodes well-formed UTF-8 into the number of units Validate answered.
+  static void Decode(const uint8_t* bytes, intptr_t length,
+                     intptr_t width, int32_t* units);
+
+  // Answers the number of bytes units encode to, or -1 if they are not code
+  // points (width 4) or well-paired UTF-16 (width 2).
+  static intptr_t EncodedLength(const int32_t* units, intptr_t length,
+                                intptr_t width);
+
+  // Encodes units that EncodedLength accepted.
+  static void Encode(const int32_t* units, intptr_t length,
+                     intptr_t width, uint8_t* bytes);
+};
+
+}  // namespace psoup
+
+#endif  // VM_UTF8_H_
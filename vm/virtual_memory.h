@@ -15,6 +15,7 @@ class VirtualMemory {
     kNoAccess,
     kReadOnly,
     kReadWrite,
+    kReadExecute,
   };
 
   static VirtualMemory MapReadOnly(const char* filename);
@@ -24,6 +25,15 @@ class VirtualMemory {
   void Free();
   bool Protect(Protection protection);
 
+  // Address space that is inaccessible until parts of it are committed, with
+  // its base aligned to alignment. Only on Android, Linux and macOS.
+  static VirtualMemory Reserve(size_t size,
+                               size_t alignment,
+                               const char* name);
+  static VirtualMemory Commit(uword address, size_t size, const char* name);
+  // Returns the pages to the OS, leaving the range reserved.
+  void Decommit();
+
   uword base() const { return reinterpret_cast<uword>(address_); }
   uword limit() const { return base() + size(); }
   size_t size() const { return size_; }
@@ -59,6 +59,9 @@ VirtualMemory VirtualMemory::Allocate(size_t size,
     case kReadWrite:
       prot = ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE;
       break;
+    case kReadExecute:
+      prot = ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_EXECUTE;
+      break;
     default:
       UNREACHABLE();
       prot = 0;
@@ -110,6 +113,9 @@ bool VirtualMemory::Protect(Protection protection) {
     case kReadWrite:
       prot = ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE;
       break;
+    case kReadExecute:
+      prot = ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_EXECUTE;
+      break;
     default:
       UNREACHABLE();
       prot = 0;
@@ -12,6 +12,7 @@
 
 #include "vm/assert.h"
 #include "vm/os.h"
+#include "vm/utils.h"
 
 namespace psoup {
 
@@ -46,6 +47,7 @@ VirtualMemory VirtualMemory::Allocate(size_t size,
     case kNoAccess: prot = PROT_NONE; break;
     case kReadOnly: prot = PROT_READ; break;
     case kReadWrite: prot = PROT_READ | PROT_WRITE; break;
+    case kReadExecute: prot = PROT_READ | PROT_EXEC; break;
     default:
      UNREACHABLE();
      prot = 0;
@@ -70,6 +72,58 @@ void VirtualMemory::Free() {
 }
 
 
+VirtualMemory VirtualMemory::Reserve(size_t size,
+                                     size_t alignment,
+                                     const char* name) {
+  ASSERT(Utils::IsPowerOfTwo(alignment));
+  size_t padded_size = size + alignment;
+  void* address = mmap(0, padded_size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANON | MAP_NORESERVE,
+                       0, 0);
+  if (address == MAP_FAILED) {
+    FATAL1("Failed to reserve %" Pd " bytes\n", padded_size);
+  }
+
+  uword start = reinterpret_cast<uword>(address);
+  uword base = Utils::RoundUp(start, alignment);
+  uword limit = start + padded_size;
+  if (base > start) {
+    munmap(address, base - start);
+  }
+  if (limit > base + size) {
+    munmap(reinterpret_cast<void*>(base + size), limit - (base + size));
+  }
+
+  return VirtualMemory(reinterpret_cast<void*>(base), size);
+}
+
+
+VirtualMemory VirtualMemory::Commit(uword address,
+                                    size_t size,
+                                    const char* name) {
+  void* result = mmap(reinterpret_cast<void*>(address), size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANON | MAP_FIXED,
+                      0, 0);
+  if (result == MAP_FAILED) {
+    FATAL1("Failed to commit %" Pd " bytes\n", size);
+  }
+  ASSERT(result == reinterpret_cast<void*>(address));
+
+  return VirtualMemory(result, size);
+}
+
+
+void VirtualMemory::Decommit() {
+  void* result = mmap(address_, size_, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANON | MAP_FIXED | MAP_NORESERVE,
+                      0, 0);
+  if (result == MAP_FAILED) {
+    FATAL1("Failed to decommit %" Pd " bytes\n", size_);
+  }
+}
+
+
 bool VirtualMemory::Protect(Protection protection) {
 #if defined(__aarch64__)
   // mprotect crashes my DragonBoard, so skip on ARM64.
@@ -80,6 +134,7 @@ bool VirtualMemory::Protect(Protection protection) {
     case kNoAccess: prot = PROT_NONE; break;
     case kReadOnly: prot = PROT_READ; break;
     case kReadWrite: prot = PROT_READ | PROT_WRITE; break;
+    case kReadExecute: prot = PROT_READ | PROT_EXEC; break;
     default:
      UNREACHABLE();
      prot = 0;
@@ -51,6 +51,7 @@ VirtualMemory VirtualMemory::Allocate(size_t size,
     case kNoAccess: prot = PAGE_NOACCESS; break;
     case kReadOnly: prot = PAGE_READONLY; break;
     case kReadWrite: prot = PAGE_READWRITE; break;
+    case kReadExecute: prot = PAGE_EXECUTE_READ; break;
     default:
      UNREACHABLE();
      prot = 0;
@@ -78,6 +79,7 @@ bool VirtualMemory::Protect(Protection protection) {
     case kNoAccess: prot = PAGE_NOACCESS; break;
     case kReadOnly: prot = PAGE_READONLY; break;
     case kReadWrite: prot = PAGE_READWRITE; break;
+    case kReadExecute: prot = PAGE_EXECUTE_READ; break;
     default:
      UNREACHABLE();
      prot = 0;